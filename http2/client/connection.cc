@@ -0,0 +1,460 @@
+#include "http2/client/connection.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "http2/headers/constants.h"
+#include "http2/protocol/constants.h"
+
+using http2::headers::Header;
+using http2::headers::Headers;
+using http2::protocol::Error;
+using http2::protocol::FrameHeader;
+using http2::protocol::read_u32;
+using http2::protocol::strip_padding;
+
+namespace proto = http2::protocol;
+
+namespace http2 {
+namespace client {
+
+Connection::Connection(const ConnectionOptions& options)
+    : options_(options),
+      local_(options.settings),
+      failed_(false),
+      goaway_received_(false),
+      table_size_update_pending_(false),
+      next_stream_id_(1),
+      conn_recv_window_(proto::kDefaultWindowSize,
+                        options.window_update_fraction),
+      streams_(512),
+      header_stream_id_(0),
+      header_end_stream_(false),
+      output_pos_(0) {
+  encoder_.set_stats(&encoder_stats_);
+  decoder_.set_stats(&decoder_stats_);
+
+  // The client connection preface is the magic string, then SETTINGS.
+  output_.assign(std::begin(proto::kConnectionPreface),
+                 std::end(proto::kConnectionPreface));
+  local_.set_enable_push(false);
+  std::vector<uint8_t> payload;
+  local_.encode(payload);
+  write_frame(proto::SETTINGS_FRAME, proto::NO_FLAGS, 0, payload.data(),
+              payload.size());
+  local_.mark_clean();
+
+  // The connection-level window is not covered by SETTINGS; grow it to match.
+  conn_recv_window_.expand(local_.initial_window_size());
+  grant_window(0, conn_recv_window_, true);
+}
+
+bool Connection::can_request() const {
+  return !failed_ && !goaway_received_ &&
+         next_stream_id_ <= proto::kMaxStreamId &&
+         streams_.size() < peer_.max_concurrent_streams();
+}
+
+uint32_t Connection::request(const Headers& headers,
+                             std::vector<uint8_t> body,
+                             ResponseCallback done) {
+  uint32_t id = next_stream_id_;
+  next_stream_id_ += 2;
+  Stream& s = streams_.insert(id);
+  s.send_window = proto::SendWindow(peer_.initial_window_size());
+  s.recv_window = proto::ReceiveWindow(local_.initial_window_size(),
+                                       options_.window_update_fraction);
+  s.response.stream_id = id;
+  s.done = std::move(done);
+  bool end_stream = body.empty();
+  s.body = std::move(body);
+
+  std::vector<uint8_t> block;
+  for (const Header& h : headers.all()) encoder_.encode(h, block);
+  write_header_block(id, block, end_stream);
+  if (!end_stream) {
+    find_stream(id)->sending = true;
+    sending_.push_back(id);
+    flush_data();
+  }
+  return id;
+}
+
+void Connection::reset(uint32_t stream_id) {
+  if (find_stream(stream_id) == nullptr) return;
+  stream_error(stream_id, proto::CANCEL);
+}
+
+std::size_t Connection::receive(const uint8_t* begin, const uint8_t* end) {
+  const uint8_t* p = begin;
+  FrameHeader hdr;
+  while (!failed_ && proto::decode_frame_header(p, end, hdr)) {
+    if (hdr.length > local_.max_frame_size()) {
+      connection_error(proto::FRAME_SIZE_ERROR);
+      break;
+    }
+    if (std::size_t(end - p) < proto::kFrameHeaderSize + hdr.length) break;
+    const uint8_t* payload = p + proto::kFrameHeaderSize;
+    p = payload + hdr.length;
+    on_frame(hdr, payload, p);
+  }
+  if (failed_) return end - begin;
+  return p - begin;
+}
+
+void Connection::consume_output(std::size_t n) {
+  output_pos_ += n;
+  if (output_pos_ == output_.size()) {
+    output_.clear();
+    output_pos_ = 0;
+  }
+}
+
+void Connection::close() {
+  if (failed_) return;
+  failed_ = true;
+  std::vector<uint32_t> ids;
+  streams_.for_each([&ids](uint32_t id, Stream&) { ids.push_back(id); });
+  for (uint32_t id : ids) complete(id, proto::CANCEL);
+}
+
+// complete forgets a stream and reports its response.
+void Connection::complete(uint32_t id, Error error) {
+  Stream* s = find_stream(id);
+  if (s == nullptr) return;
+  Response response = std::move(s->response);
+  ResponseCallback done = std::move(s->done);
+  response.error = error;
+  if (s->sending) {
+    sending_.erase(std::find(sending_.begin(), sending_.end(), id));
+  }
+  streams_.erase(id);
+  if (done) done(response);
+}
+
+void Connection::on_frame(const FrameHeader& hdr, const uint8_t* p,
+                          const uint8_t* q) {
+  // RFC 7540 section 6.10: nothing may interrupt a header block.
+  if (header_stream_id_ != 0 && hdr.type != proto::CONTINUATION_FRAME) {
+    connection_error(proto::PROTOCOL_ERROR);
+    return;
+  }
+
+  switch (hdr.type) {
+    case proto::DATA_FRAME:
+      on_data(hdr, p, q);
+      break;
+    case proto::HEADERS_FRAME:
+      on_headers(hdr, p, q);
+      break;
+    case proto::RST_STREAM_FRAME:
+      on_rst_stream(hdr, p);
+      break;
+    case proto::SETTINGS_FRAME:
+      on_settings(hdr, p, q);
+      break;
+    case proto::PUSH_PROMISE_FRAME:
+      // We disabled push.
+      connection_error(proto::PROTOCOL_ERROR);
+      break;
+    case proto::PING_FRAME:
+      on_ping(hdr, p);
+      break;
+    case proto::GOAWAY_FRAME:
+      on_goaway(hdr, p);
+      break;
+    case proto::WINDOW_UPDATE_FRAME:
+      on_window_update(hdr, p);
+      break;
+    case proto::CONTINUATION_FRAME:
+      on_continuation(hdr, p, q);
+      break;
+    default:
+      // PRIORITY and unknown frame types are ignored.
+      break;
+  }
+}
+
+void Connection::on_data(const FrameHeader& hdr, const uint8_t* p,
+                         const uint8_t* q) {
+  uint32_t id = hdr.stream_id;
+  if (id == 0) return connection_error(proto::PROTOCOL_ERROR);
+
+  // Responses are consumed as they arrive.
+  if (!conn_recv_window_.receive(hdr.length)) {
+    return connection_error(proto::FLOW_CONTROL_ERROR);
+  }
+  conn_recv_window_.consume(hdr.length);
+  grant_window(0, conn_recv_window_);
+
+  Stream* s = find_stream(id);
+  if (s == nullptr) {
+    if (id >= next_stream_id_) return connection_error(proto::PROTOCOL_ERROR);
+    return;  // a stream we reset or gave up on
+  }
+  if (!s->headers_received) return stream_error(id, proto::PROTOCOL_ERROR);
+  if (!s->recv_window.receive(hdr.length)) {
+    return stream_error(id, proto::FLOW_CONTROL_ERROR);
+  }
+  if (!strip_padding(hdr, p, q)) {
+    return connection_error(proto::PROTOCOL_ERROR);
+  }
+  s->response.body_size += q - p;
+  if (options_.keep_bodies) {
+    s->response.body.insert(s->response.body.end(), p, q);
+  }
+
+  if (hdr.has_flag(proto::END_STREAM)) return complete(id, proto::NO_ERROR);
+  s->recv_window.consume(hdr.length);
+  grant_window(id, s->recv_window);
+}
+
+void Connection::on_headers(const FrameHeader& hdr, const uint8_t* p,
+                            const uint8_t* q) {
+  uint32_t id = hdr.stream_id;
+  if (id == 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (!strip_padding(hdr, p, q)) {
+    return connection_error(proto::PROTOCOL_ERROR);
+  }
+  if (hdr.has_flag(proto::PRIORITY)) {
+    if (q - p < 5) return connection_error(proto::FRAME_SIZE_ERROR);
+    p += 5;
+  }
+  if (id >= next_stream_id_ || (id & 1) == 0) {
+    return connection_error(proto::PROTOCOL_ERROR);
+  }
+
+  header_stream_id_ = id;
+  header_end_stream_ = hdr.has_flag(proto::END_STREAM);
+  header_block_.assign(p, q);
+  if (hdr.has_flag(proto::END_HEADERS)) finish_header_block();
+}
+
+void Connection::on_continuation(const FrameHeader& hdr, const uint8_t* p,
+                                 const uint8_t* q) {
+  if (header_stream_id_ == 0 || hdr.stream_id != header_stream_id_) {
+    return connection_error(proto::PROTOCOL_ERROR);
+  }
+  header_block_.insert(header_block_.end(), p, q);
+  if (hdr.has_flag(proto::END_HEADERS)) finish_header_block();
+}
+
+void Connection::finish_header_block() {
+  uint32_t id = header_stream_id_;
+  header_stream_id_ = 0;
+
+  // The block must be decoded even for a stream we have forgotten, to keep
+  // the HPACK state in step.
+  std::vector<Header> decoded;
+  if (!decoder_.decode(header_block_, decoded)) {
+    return connection_error(proto::COMPRESSION_ERROR);
+  }
+  header_block_.clear();
+  Stream* s = find_stream(id);
+  if (s == nullptr) return;
+
+  Headers* target = &s->response.trailers;
+  if (!s->headers_received) {
+    // Informational (1xx) responses come before the real one.
+    auto status = std::find_if(decoded.begin(), decoded.end(),
+                               [](const Header& h) {
+                                 return h.name == http2::headers::kStatus;
+                               });
+    if (status == decoded.end()) return stream_error(id, proto::PROTOCOL_ERROR);
+    if (status->value.size() == 3 && status->value[0] == '1') {
+      if (header_end_stream_) stream_error(id, proto::PROTOCOL_ERROR);
+      return;
+    }
+    s->headers_received = true;
+    target = &s->response.headers;
+  } else if (!header_end_stream_) {
+    // Trailers must end the stream.
+    return stream_error(id, proto::PROTOCOL_ERROR);
+  }
+  for (Header& h : decoded) target->add(std::move(h));
+  if (header_end_stream_) complete(id, proto::NO_ERROR);
+}
+
+void Connection::on_rst_stream(const FrameHeader& hdr, const uint8_t* p) {
+  if (hdr.length != 4) return connection_error(proto::FRAME_SIZE_ERROR);
+  if (hdr.stream_id == 0) return connection_error(proto::PROTOCOL_ERROR);
+  complete(hdr.stream_id, Error(read_u32(p)));
+}
+
+void Connection::on_settings(const FrameHeader& hdr, const uint8_t* p,
+                             const uint8_t* q) {
+  if (hdr.stream_id != 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (hdr.has_flag(proto::ACK)) {
+    if (hdr.length != 0) return connection_error(proto::FRAME_SIZE_ERROR);
+    return;
+  }
+  if (hdr.length % 6 != 0) return connection_error(proto::FRAME_SIZE_ERROR);
+
+  int64_t old_window = peer_.initial_window_size();
+  Error err = peer_.decode(p, q);
+  if (err != proto::NO_ERROR) return connection_error(err);
+
+  // RFC 7540 section 6.9.2: a change to SETTINGS_INITIAL_WINDOW_SIZE adjusts
+  // the send window of every open stream by the difference.
+  int64_t delta = int64_t(peer_.initial_window_size()) - old_window;
+  if (delta != 0) {
+    bool overflow = false;
+    streams_.for_each([delta, &overflow](uint32_t, Stream& s) {
+      if (!s.send_window.adjust(delta)) overflow = true;
+    });
+    if (overflow) return connection_error(proto::FLOW_CONTROL_ERROR);
+  }
+
+  auto& table = encoder_.mutable_table();
+  if (peer_.header_table_size() < table.max_size()) {
+    table.set_max_size(peer_.header_table_size());
+    table_size_update_pending_ = true;
+  }
+
+  write_frame(proto::SETTINGS_FRAME, proto::ACK, 0, nullptr, 0);
+  if (delta > 0) flush_data();
+}
+
+void Connection::on_ping(const FrameHeader& hdr, const uint8_t* p) {
+  if (hdr.stream_id != 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (hdr.length != 8) return connection_error(proto::FRAME_SIZE_ERROR);
+  if (!hdr.has_flag(proto::ACK)) {
+    write_frame(proto::PING_FRAME, proto::ACK, 0, p, 8);
+  }
+}
+
+void Connection::on_goaway(const FrameHeader& hdr, const uint8_t* p) {
+  if (hdr.stream_id != 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (hdr.length < 8) return connection_error(proto::FRAME_SIZE_ERROR);
+  goaway_received_ = true;
+
+  // Streams past the last one the server will process were never seen, and
+  // may be retried elsewhere.
+  uint32_t last = read_u32(p) & proto::kMaxStreamId;
+  std::vector<uint32_t> refused;
+  streams_.for_each([last, &refused](uint32_t id, Stream&) {
+    if (id > last) refused.push_back(id);
+  });
+  for (uint32_t id : refused) complete(id, proto::REFUSED_STREAM);
+}
+
+void Connection::on_window_update(const FrameHeader& hdr, const uint8_t* p) {
+  if (hdr.length != 4) return connection_error(proto::FRAME_SIZE_ERROR);
+  uint32_t id = hdr.stream_id;
+  int64_t increment = read_u32(p) & proto::kMaxStreamId;
+
+  if (id == 0) {
+    if (increment == 0) return connection_error(proto::PROTOCOL_ERROR);
+    if (!conn_send_window_.grant(increment)) {
+      return connection_error(proto::FLOW_CONTROL_ERROR);
+    }
+    return flush_data();
+  }
+
+  Stream* s = find_stream(id);
+  if (s == nullptr) return;  // window updates may race with stream closure
+  if (increment == 0) return stream_error(id, proto::PROTOCOL_ERROR);
+  if (!s->send_window.grant(increment)) {
+    return stream_error(id, proto::FLOW_CONTROL_ERROR);
+  }
+  flush_data();
+}
+
+// flush_data sends as much of the request bodies as the flow-control windows
+// allow, a frame from each stream in turn.
+void Connection::flush_data() {
+  std::size_t max = peer_.max_frame_size();
+  bool progress = true;
+  while (progress && !sending_.empty() && conn_send_window_.available() > 0) {
+    progress = false;
+    for (std::size_t i = 0; i < sending_.size();) {
+      uint32_t id = sending_[i];
+      Stream* s = find_stream(id);
+      std::size_t n = std::min(s->body.size() - s->body_pos, max);
+      n = std::min<int64_t>(n, conn_send_window_.available());
+      n = std::min<int64_t>(n, s->send_window.available());
+      if (n == 0) {
+        ++i;
+        continue;
+      }
+      bool last = (s->body_pos + n == s->body.size());
+      write_frame(proto::DATA_FRAME, last ? proto::END_STREAM : proto::NO_FLAGS,
+                  id, s->body.data() + s->body_pos, n);
+      s->body_pos += n;
+      s->send_window.consume(n);
+      conn_send_window_.consume(n);
+      progress = true;
+      if (last) {
+        std::vector<uint8_t>().swap(s->body);
+        s->body_pos = 0;
+        s->sending = false;
+        sending_.erase(sending_.begin() + i);
+      } else {
+        ++i;
+      }
+    }
+  }
+}
+
+void Connection::write_frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                             const uint8_t* p, std::size_t n) {
+  proto::encode_frame_header(n, type, flags, stream_id, output_);
+  if (n > 0) output_.insert(output_.end(), p, p + n);
+}
+
+// write_header_block sends an encoded header block in HEADERS and
+// CONTINUATION frames, after any dynamic table size update that is due.
+void Connection::write_header_block(uint32_t id,
+                                    const std::vector<uint8_t>& fragment,
+                                    bool end_stream) {
+  std::vector<uint8_t> prefixed;
+  const std::vector<uint8_t>& block =
+      table_size_update_pending_ ? prefixed : fragment;
+  if (table_size_update_pending_) {
+    encoder_.encode_table_size_update(prefixed);
+    prefixed.insert(prefixed.end(), fragment.begin(), fragment.end());
+    table_size_update_pending_ = false;
+  }
+
+  proto::split_header_block(
+      block.data(), block.size(), peer_.max_frame_size(), end_stream,
+      [this, id](uint8_t type, uint8_t flags, const uint8_t* p,
+                 std::size_t n) { write_frame(type, flags, id, p, n); });
+}
+
+// grant_window sends a WINDOW_UPDATE for the given stream's window (or the
+// connection's, if stream_id is 0) if one is due.
+void Connection::grant_window(uint32_t stream_id, proto::ReceiveWindow& window,
+                              bool force) {
+  uint8_t payload[proto::kWindowUpdateSize];
+  if (proto::take_window_update(window, force, payload)) {
+    write_frame(proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, stream_id,
+                payload, sizeof(payload));
+  }
+}
+
+void Connection::connection_error(Error error) {
+  if (failed_) return;
+  uint32_t last = 0;  // we accept no streams
+  uint8_t payload[8] = {
+      uint8_t(last >> 24), uint8_t(last >> 16), uint8_t(last >> 8),
+      uint8_t(last),       0, 0, 0, uint8_t(error),
+  };
+  write_frame(proto::GOAWAY_FRAME, proto::NO_FLAGS, 0, payload,
+              sizeof(payload));
+  std::vector<uint32_t> ids;
+  streams_.for_each([&ids](uint32_t id, Stream&) { ids.push_back(id); });
+  failed_ = true;
+  for (uint32_t id : ids) complete(id, error);
+}
+
+void Connection::stream_error(uint32_t id, Error error) {
+  uint8_t payload[4] = {0, 0, 0, uint8_t(error)};
+  write_frame(proto::RST_STREAM_FRAME, proto::NO_FLAGS, id, payload,
+              sizeof(payload));
+  complete(id, error);
+}
+
+}  // namespace client
+}  // namespace http2
@@ -0,0 +1,191 @@
+// Tools for speaking HTTP/2 as a client.
+
+#ifndef HTTP2_CLIENT_CONNECTION_H
+#define HTTP2_CLIENT_CONNECTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "http2/headers/headers.h"
+#include "http2/protocol/error.h"
+#include "http2/protocol/flow_control.h"
+#include "http2/protocol/frame.h"
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/protocol/settings.h"
+#include "http2/protocol/stream_table.h"
+
+namespace http2 {
+namespace client {
+
+// ConnectionOptions holds the tunables of a client connection.
+struct ConnectionOptions final {
+  // settings holds the SETTINGS values advertised to the server.  Only the
+  // values that were explicitly set are sent, except that server push is
+  // always disabled.
+  http2::protocol::Settings settings;
+
+  // window_update_fraction controls how often response body credit is
+  // returned to the server, as in the server's ConnectionOptions.
+  double window_update_fraction = 0.5;
+
+  // keep_bodies, if false, counts response body bytes without keeping them,
+  // which is all a load generator needs.
+  bool keep_bodies = true;
+};
+
+// Response is the outcome of one request.
+struct Response final {
+  uint32_t stream_id = 0;
+  http2::headers::Headers headers;
+  http2::headers::Headers trailers;
+  std::vector<uint8_t> body;  // empty unless ConnectionOptions::keep_bodies
+  std::size_t body_size = 0;
+
+  // error is NO_ERROR for a complete response.  Otherwise the stream was
+  // reset (by either side), refused by a GOAWAY, or lost with the
+  // connection, and the rest of the Response is whatever had arrived.
+  http2::protocol::Error error = http2::protocol::NO_ERROR;
+};
+
+// ResponseCallback is called once for each request, when its response is
+// complete or has failed.  It may issue new requests.
+using ResponseCallback = std::function<void(Response&)>;
+
+// Connection implements the HTTP/2 protocol for one client-side connection.
+// Like the server's Connection, it performs no I/O of its own: the caller
+// writes out the bytes it produces and feeds it the bytes it reads.  It must
+// only be used from one thread at a time.
+class Connection final {
+ public:
+  // options must outlive the Connection.  The client connection preface is
+  // queued for output immediately.
+  explicit Connection(const ConnectionOptions& options);
+
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  // can_request returns true iff request may be called: the connection is
+  // alive, and the server's SETTINGS_MAX_CONCURRENT_STREAMS leaves room.
+  bool can_request() const;
+
+  // request sends a request, with body as its body (none if empty), and
+  // returns the ID of its stream.  The headers must start with the
+  // pseudo-headers.  done is called when the response is complete.  Must
+  // only be called when can_request() is true.
+  uint32_t request(const http2::headers::Headers& headers,
+                   std::vector<uint8_t> body, ResponseCallback done);
+
+  // reset cancels a request: the stream is reset with CANCEL, and its
+  // callback gets a Response with that error.
+  void reset(uint32_t stream_id);
+
+  // receive processes bytes read from the server, and returns the number of
+  // bytes consumed, like the server's Connection::receive.  Response
+  // callbacks run from within it.
+  std::size_t receive(const uint8_t* begin, const uint8_t* end);
+
+  // output_data and output_size describe the bytes waiting to be written.
+  const uint8_t* output_data() const { return output_.data() + output_pos_; }
+  std::size_t output_size() const { return output_.size() - output_pos_; }
+  bool has_output() const { return output_pos_ < output_.size(); }
+
+  // consume_output discards the first n bytes of pending output, after they
+  // have been written to the server.
+  void consume_output(std::size_t n);
+
+  // close fails every outstanding request, e.g. because the socket closed.
+  void close();
+
+  // done returns true iff the connection can be closed: it failed, or the
+  // server sent GOAWAY and no requests are left.
+  bool done() const {
+    return failed_ || (goaway_received_ && streams_.empty());
+  }
+  bool failed() const { return failed_; }
+  bool goaway_received() const { return goaway_received_; }
+
+  const http2::protocol::Settings& peer_settings() const { return peer_; }
+  std::size_t num_streams() const { return streams_.size(); }
+
+  // The compression counters of the response headers decoded and the
+  // request headers encoded on this connection.
+  const http2::protocol::hpack::Stats& decoder_stats() const {
+    return decoder_stats_;
+  }
+  const http2::protocol::hpack::Stats& encoder_stats() const {
+    return encoder_stats_;
+  }
+
+ private:
+  struct Stream final {
+    http2::protocol::SendWindow send_window;
+    http2::protocol::ReceiveWindow recv_window;
+    std::vector<uint8_t> body;  // the request body
+    std::size_t body_pos = 0;
+    bool sending = false;  // listed in sending_
+    bool headers_received = false;
+    Response response;
+    ResponseCallback done;
+  };
+
+  Stream* find_stream(uint32_t id) { return streams_.find(id); }
+  void complete(uint32_t id, http2::protocol::Error error);
+
+  void on_frame(const http2::protocol::FrameHeader& hdr, const uint8_t* p,
+                const uint8_t* q);
+  void on_data(const http2::protocol::FrameHeader& hdr, const uint8_t* p,
+               const uint8_t* q);
+  void on_headers(const http2::protocol::FrameHeader& hdr, const uint8_t* p,
+                  const uint8_t* q);
+  void on_continuation(const http2::protocol::FrameHeader& hdr,
+                       const uint8_t* p, const uint8_t* q);
+  void on_rst_stream(const http2::protocol::FrameHeader& hdr, const uint8_t* p);
+  void on_settings(const http2::protocol::FrameHeader& hdr, const uint8_t* p,
+                   const uint8_t* q);
+  void on_ping(const http2::protocol::FrameHeader& hdr, const uint8_t* p);
+  void on_goaway(const http2::protocol::FrameHeader& hdr, const uint8_t* p);
+  void on_window_update(const http2::protocol::FrameHeader& hdr,
+                        const uint8_t* p);
+
+  void finish_header_block();
+  void flush_data();
+  void write_frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                   const uint8_t* p, std::size_t n);
+  void write_header_block(uint32_t id, const std::vector<uint8_t>& block,
+                          bool end_stream);
+  void grant_window(uint32_t stream_id, http2::protocol::ReceiveWindow& window,
+                    bool force = false);
+  void connection_error(http2::protocol::Error error);
+  void stream_error(uint32_t id, http2::protocol::Error error);
+
+  const ConnectionOptions& options_;
+  http2::protocol::Settings local_;
+  http2::protocol::Settings peer_;
+  http2::protocol::hpack::Encoder encoder_;
+  http2::protocol::hpack::Decoder decoder_;
+  http2::protocol::hpack::Stats encoder_stats_;
+  http2::protocol::hpack::Stats decoder_stats_;
+  bool failed_;
+  bool goaway_received_;
+  bool table_size_update_pending_;
+  uint32_t next_stream_id_;
+  http2::protocol::SendWindow conn_send_window_;
+  http2::protocol::ReceiveWindow conn_recv_window_;
+  http2::protocol::StreamTable<Stream> streams_;
+  std::vector<uint32_t> sending_;  // streams with request body left to send
+
+  // The header block being received, if any.
+  uint32_t header_stream_id_;
+  bool header_end_stream_;
+  std::vector<uint8_t> header_block_;
+
+  std::vector<uint8_t> output_;
+  std::size_t output_pos_;
+};
+
+}  // namespace client
+}  // namespace http2
+
+#endif  // HTTP2_CLIENT_CONNECTION_H
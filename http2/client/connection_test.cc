@@ -0,0 +1,168 @@
+#include "http2/client/connection.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http2/protocol/constants.h"
+#include "http2/protocol/frame.h"
+#include "http2/server/connection.h"
+
+using http2::client::Connection;
+using http2::client::ConnectionOptions;
+using http2::client::Response;
+using http2::headers::Headers;
+
+namespace proto = http2::protocol;
+namespace server = http2::server;
+
+// pump moves bytes between the two connections until both fall silent.
+static void pump(Connection& client, server::Connection& srv) {
+  // The server's output comes in slices that need not end on a frame
+  // boundary, so it is collected here first.
+  std::vector<uint8_t> in;
+  while (client.has_output() || srv.has_output()) {
+    while (client.has_output()) {
+      std::size_t n = srv.receive(client.output_data(),
+                                  client.output_data() + client.output_size());
+      client.consume_output(n);
+      if (n == 0) break;
+    }
+    while (srv.output_size() > 0) {
+      in.insert(in.end(), srv.output_data(),
+                srv.output_data() + srv.output_size());
+      srv.consume_output(srv.output_size());
+    }
+    in.erase(in.begin(),
+             in.begin() + client.receive(in.data(), in.data() + in.size()));
+  }
+}
+
+static Headers request_headers(const std::string& method,
+                               const std::string& path) {
+  Headers headers;
+  headers.add(":method", method);
+  headers.add(":scheme", "http");
+  headers.add(":authority", "localhost");
+  headers.add(":path", path);
+  return headers;
+}
+
+static void echo(const server::Request& req, server::Response& resp) {
+  auto path = req.headers.first(":path");
+  resp.headers.add(":status", "200");
+  if (req.body.empty()) {
+    resp.body.assign(path.second.begin(), path.second.end());
+  } else {
+    resp.body = req.body;
+  }
+}
+
+TEST(Client, Get) {
+  server::ConnectionOptions server_options;
+  server::Handler handler = echo;
+  server::Connection srv(server_options, handler);
+  ConnectionOptions options;
+  Connection client(options);
+
+  std::vector<Response> responses;
+  auto done = [&responses](Response& resp) { responses.push_back(resp); };
+  ASSERT_TRUE(client.can_request());
+  EXPECT_EQ(client.request(request_headers("GET", "/a"), {}, done), 1);
+  EXPECT_EQ(client.request(request_headers("GET", "/bb"), {}, done), 3);
+  pump(client, srv);
+
+  ASSERT_EQ(responses.size(), 2);
+  for (const Response& resp : responses) {
+    EXPECT_EQ(resp.error, proto::NO_ERROR);
+    EXPECT_EQ(resp.headers.first(":status").second, "200");
+  }
+  EXPECT_EQ(std::string(responses[0].body.begin(), responses[0].body.end()),
+            "/a");
+  EXPECT_EQ(responses[1].body_size, 3);
+  EXPECT_EQ(client.num_streams(), 0);
+  EXPECT_FALSE(client.done());
+}
+
+TEST(Client, LargePost) {
+  server::ConnectionOptions server_options;
+  server::Handler handler = echo;
+  server::Connection srv(server_options, handler);
+  ConnectionOptions options;
+  options.keep_bodies = false;
+  Connection client(options);
+
+  // Larger than the default windows both ways.
+  std::vector<uint8_t> body(200000);
+  for (std::size_t i = 0; i < body.size(); ++i) body[i] = uint8_t(i * 7);
+  std::vector<Response> responses;
+  client.request(request_headers("POST", "/upload"), body,
+                 [&responses](Response& resp) { responses.push_back(resp); });
+  pump(client, srv);
+
+  ASSERT_EQ(responses.size(), 1);
+  EXPECT_EQ(responses[0].error, proto::NO_ERROR);
+  EXPECT_EQ(responses[0].body_size, body.size());
+  EXPECT_TRUE(responses[0].body.empty());
+}
+
+TEST(Client, Trailers) {
+  server::ConnectionOptions server_options;
+  server::Handler handler = [](server::ServerStream stream)
+      -> server::StreamTask {
+    co_await stream.headers();
+    Headers trailers;
+    trailers.add("grpc-status", "0");
+    stream.set_trailers(trailers);
+    co_await stream.write("ok");
+  };
+  server::Connection srv(server_options, handler);
+  ConnectionOptions options;
+  Connection client(options);
+
+  std::vector<Response> responses;
+  client.request(request_headers("GET", "/"), {},
+                 [&responses](Response& resp) { responses.push_back(resp); });
+  pump(client, srv);
+
+  ASSERT_EQ(responses.size(), 1);
+  EXPECT_EQ(responses[0].error, proto::NO_ERROR);
+  EXPECT_EQ(std::string(responses[0].body.begin(), responses[0].body.end()),
+            "ok");
+  EXPECT_EQ(responses[0].trailers.first("grpc-status").second, "0");
+}
+
+TEST(Client, GoAway) {
+  ConnectionOptions options;
+  Connection client(options);
+  client.consume_output(client.output_size());
+
+  std::vector<Response> responses;
+  auto done = [&responses](Response& resp) { responses.push_back(resp); };
+  client.request(request_headers("GET", "/1"), {}, done);
+  client.request(request_headers("GET", "/3"), {}, done);
+  client.request(request_headers("GET", "/5"), {}, done);
+
+  // The server will process stream 1 only.
+  std::vector<uint8_t> input;
+  proto::encode_frame_header(8, proto::GOAWAY_FRAME, proto::NO_FLAGS, 0,
+                             input);
+  input.insert(input.end(), {0, 0, 0, 1, 0, 0, 0, proto::NO_ERROR});
+  EXPECT_EQ(client.receive(input.data(), input.data() + input.size()),
+            input.size());
+
+  ASSERT_EQ(responses.size(), 2);
+  EXPECT_EQ(responses[0].stream_id, 3);
+  EXPECT_EQ(responses[0].error, proto::REFUSED_STREAM);
+  EXPECT_EQ(responses[1].stream_id, 5);
+  EXPECT_TRUE(client.goaway_received());
+  EXPECT_FALSE(client.can_request());
+  EXPECT_FALSE(client.done());
+
+  client.close();
+  ASSERT_EQ(responses.size(), 3);
+  EXPECT_EQ(responses[2].stream_id, 1);
+  EXPECT_EQ(responses[2].error, proto::CANCEL);
+  EXPECT_TRUE(client.done());
+}
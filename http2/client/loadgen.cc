@@ -0,0 +1,411 @@
+// Load generator in the style of h2load: keeps a number of requests in flight
+// on a number of connections, and reports throughput and latency.  With no
+// --port, it starts an in-process Server on a loopback port to load.
+//
+// Usage: loadgen [--address=HOST] [--port=N] [--connections=N] [--streams=N]
+//                [--threads=N] [--seconds=N | --requests=N]
+//                [--headers=FILE] [--body_size=N] [--response_size=N]
+//                [--shards=N] [--transport=epoll|io_uring]
+//
+// --streams is the number of requests in flight per connection.  --headers
+// names a corpus of requests, used round-robin: blocks of "name: value"
+// lines, separated by blank lines.  Pseudo-headers a block lacks are filled
+// in (":method" is POST if --body_size is set, else GET).  --response_size
+// sets the size of the in-process server's response bodies.
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http2/client/connection.h"
+#include "http2/net/event_loop.h"
+#include "http2/net/socket.h"
+#include "http2/server/server.h"
+
+using http2::headers::Headers;
+
+namespace proto = http2::protocol;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Flags {
+  std::string address = "127.0.0.1";
+  unsigned int port = 0;
+  unsigned int connections = 16;
+  unsigned int streams = 16;
+  unsigned int threads = 1;
+  unsigned int seconds = 5;
+  unsigned int requests = 0;
+  std::string headers_file;
+  unsigned int body_size = 0;
+  unsigned int response_size = 2;
+  unsigned int shards = 1;
+  http2::server::Transport transport = http2::server::TRANSPORT_EPOLL;
+};
+
+bool parse_flag(const char* arg, const char* name, unsigned int& out) {
+  std::size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+  out = std::strtoul(arg + len + 1, nullptr, 10);
+  return true;
+}
+
+bool parse_flag(const char* arg, const char* name, std::string& out) {
+  std::size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+  out = arg + len + 1;
+  return true;
+}
+
+bool parse_transport(const char* arg, http2::server::Transport& out) {
+  std::string s(arg);
+  if (s == "--transport=epoll") {
+    out = http2::server::TRANSPORT_EPOLL;
+  } else if (s == "--transport=io_uring") {
+    out = http2::server::TRANSPORT_IO_URING;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// complete_request puts the pseudo-headers a request lacks in front of it.
+Headers complete_request(const Headers& in, const Flags& flags) {
+  Headers out;
+  auto add_default = [&](const char* name, std::string value) {
+    auto found = in.first(name);
+    out.add(name, found.first ? found.second : value);
+  };
+  add_default(":method", flags.body_size > 0 ? "POST" : "GET");
+  add_default(":scheme", "http");
+  add_default(":authority", flags.address);
+  add_default(":path", "/");
+  for (const auto& h : in.all()) {
+    if (h.name.empty() || h.name[0] != ':') out.add(h.name, h.value);
+  }
+  return out;
+}
+
+// load_corpus reads the --headers file.  Returns false if it cannot be read.
+bool load_corpus(const Flags& flags, std::vector<Headers>& out) {
+  if (flags.headers_file.empty()) {
+    out.push_back(complete_request(Headers(), flags));
+    return true;
+  }
+  std::ifstream in(flags.headers_file);
+  if (!in) return false;
+  Headers block;
+  bool any = false;
+  std::string line;
+  auto finish_block = [&] {
+    if (any) out.push_back(complete_request(block, flags));
+    block = Headers();
+    any = false;
+  };
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) {
+      finish_block();
+      continue;
+    }
+    // Skip the leading ':' of a pseudo-header when looking for the colon.
+    std::size_t colon = line.find(':', 1);
+    if (colon == std::string::npos) continue;
+    std::size_t start = line.find_first_not_of(' ', colon + 1);
+    block.add(line.substr(0, colon),
+              start == std::string::npos ? "" : line.substr(start));
+    any = true;
+  }
+  finish_block();
+  return !out.empty();
+}
+
+// Stats is what each thread measured.
+struct Stats {
+  uint64_t completed = 0;
+  uint64_t failed = 0;
+  uint64_t body_bytes = 0;
+  std::vector<uint32_t> latencies_us;
+};
+
+class Worker;
+
+// ClientSocket drives one client Connection over a nonblocking socket.
+class ClientSocket final : public http2::net::EventLoop::Handler {
+ public:
+  ClientSocket(Worker* worker, int fd,
+               const http2::client::ConnectionOptions& options)
+      : worker_(worker), fd_(fd), conn_(options), closed_(false) {}
+  ~ClientSocket() override {
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  int fd() const { return fd_; }
+  bool closed() const { return closed_; }
+  http2::client::Connection& conn() { return conn_; }
+
+  void on_events(uint32_t events) override;
+  void flush();
+  void shut();
+
+ private:
+  Worker* worker_;
+  int fd_;
+  http2::client::Connection conn_;
+  std::vector<uint8_t> in_;
+  bool closed_;
+};
+
+// Worker runs one thread's share of the connections on its own EventLoop.
+class Worker final {
+ public:
+  Worker(const Flags& flags, const std::vector<Headers>& corpus,
+         std::atomic<int64_t>& budget, unsigned int connections)
+      : flags_(flags),
+        corpus_(corpus),
+        budget_(budget),
+        connections_(connections),
+        next_(0),
+        stopping_(false) {
+    options_.keep_bodies = false;
+    options_.settings.set_initial_window_size(1 << 20);
+    body_.assign(flags.body_size, 'x');
+  }
+
+  void run(Clock::time_point deadline) {
+    for (unsigned int i = 0; i < connections_; ++i) {
+      int fd = http2::net::connect_tcp(flags_.address, flags_.port);
+      http2::net::set_nonblocking(fd);
+      http2::net::set_nodelay(fd);
+      sockets_.push_back(std::make_unique<ClientSocket>(this, fd, options_));
+    }
+    for (auto& s : sockets_) {
+      loop_.add(s->fd(), EPOLLIN | EPOLLOUT | EPOLLRDHUP, s.get());
+      fill(*s);
+      s->flush();
+    }
+    while (!sockets_.empty()) {
+      bool all_idle = true;
+      for (auto& s : sockets_) {
+        if (!s->closed() && s->conn().num_streams() > 0) all_idle = false;
+      }
+      if (all_idle || Clock::now() >= deadline) break;
+      loop_.run_once(10);
+    }
+    // Requests still in flight at the deadline are not counted.
+    stopping_ = true;
+    for (auto& s : sockets_) {
+      if (!s->closed()) loop_.remove(s->fd());
+      s->conn().close();
+    }
+  }
+
+  // fill issues requests until the connection has --streams in flight.
+  void fill(ClientSocket& s) {
+    auto& conn = s.conn();
+    while (conn.num_streams() < flags_.streams && conn.can_request() &&
+           budget_.fetch_sub(1, std::memory_order_relaxed) > 0) {
+      const Headers& headers = corpus_[next_++ % corpus_.size()];
+      Clock::time_point start = Clock::now();
+      conn.request(headers, body_,
+                   [this, &s, start](http2::client::Response& resp) {
+                     finished(s, resp, start);
+                   });
+    }
+  }
+
+  void remove(ClientSocket& s) { loop_.remove(s.fd()); }
+
+  Stats& stats() { return stats_; }
+
+ private:
+  void finished(ClientSocket& s, const http2::client::Response& resp,
+                Clock::time_point start) {
+    if (stopping_) return;
+    if (resp.error != proto::NO_ERROR) {
+      ++stats_.failed;
+      // A reset stream frees its slot like a completed one; fill does
+      // nothing once the connection can take no more requests.
+      if (!s.closed()) fill(s);
+      return;
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start);
+    stats_.latencies_us.push_back(uint32_t(us.count()));
+    stats_.body_bytes += resp.body_size;
+    ++stats_.completed;
+    fill(s);
+  }
+
+  const Flags& flags_;
+  const std::vector<Headers>& corpus_;
+  std::atomic<int64_t>& budget_;
+  unsigned int connections_;
+  std::size_t next_;
+  bool stopping_;
+  http2::client::ConnectionOptions options_;
+  std::vector<uint8_t> body_;
+  http2::net::EventLoop loop_;
+  std::vector<std::unique_ptr<ClientSocket>> sockets_;
+  Stats stats_;
+};
+
+void ClientSocket::on_events(uint32_t events) {
+  if (closed_) return;
+  if (events & EPOLLIN) {
+    uint8_t chunk[65536];
+    for (;;) {
+      ssize_t n = ::read(fd_, chunk, sizeof(chunk));
+      if (n > 0) {
+        in_.insert(in_.end(), chunk, chunk + n);
+        continue;
+      }
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      return shut();
+    }
+    std::size_t used = conn_.receive(in_.data(), in_.data() + in_.size());
+    in_.erase(in_.begin(), in_.begin() + used);
+  }
+  if (events & (EPOLLERR | EPOLLHUP)) return shut();
+  flush();
+}
+
+void ClientSocket::flush() {
+  while (conn_.has_output()) {
+    ssize_t n = ::send(fd_, conn_.output_data(), conn_.output_size(),
+                       MSG_NOSIGNAL);
+    if (n > 0) {
+      conn_.consume_output(n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    return shut();
+  }
+  if (conn_.done()) shut();
+}
+
+void ClientSocket::shut() {
+  if (closed_) return;
+  closed_ = true;
+  worker_->remove(*this);
+  conn_.close();
+}
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  std::size_t i = std::size_t(p / 100 * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  for (int i = 1; i < argc; ++i) {
+    if (!parse_flag(argv[i], "--address", flags.address) &&
+        !parse_flag(argv[i], "--port", flags.port) &&
+        !parse_flag(argv[i], "--connections", flags.connections) &&
+        !parse_flag(argv[i], "--streams", flags.streams) &&
+        !parse_flag(argv[i], "--threads", flags.threads) &&
+        !parse_flag(argv[i], "--seconds", flags.seconds) &&
+        !parse_flag(argv[i], "--requests", flags.requests) &&
+        !parse_flag(argv[i], "--headers", flags.headers_file) &&
+        !parse_flag(argv[i], "--body_size", flags.body_size) &&
+        !parse_flag(argv[i], "--response_size", flags.response_size) &&
+        !parse_flag(argv[i], "--shards", flags.shards) &&
+        !parse_transport(argv[i], flags.transport)) {
+      std::cerr << "unknown flag: " << argv[i] << std::endl;
+      return 2;
+    }
+  }
+  if (flags.threads == 0) flags.threads = 1;
+  if (flags.threads > flags.connections) flags.threads = flags.connections;
+
+  std::vector<Headers> corpus;
+  if (!load_corpus(flags, corpus)) {
+    std::cerr << "cannot read headers from " << flags.headers_file
+              << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<http2::server::Server> server;
+  if (flags.port == 0) {
+    http2::server::ServerOptions options;
+    options.address = flags.address;
+    options.num_shards = flags.shards;
+    options.transport = flags.transport;
+    options.connection.settings.set_max_concurrent_streams(flags.streams);
+    std::vector<uint8_t> body(flags.response_size, 'x');
+    server = std::make_unique<http2::server::Server>(
+        options, [body](const http2::server::Request&,
+                        http2::server::Response& resp) {
+          resp.headers.add(":status", "200");
+          resp.body = body;
+        });
+    server->start();
+    flags.port = server->port();
+  }
+
+  // Without --requests, the run is bounded by time alone.
+  std::atomic<int64_t> budget(flags.requests > 0 ? int64_t(flags.requests)
+                                                 : INT64_MAX);
+  Clock::time_point start = Clock::now();
+  Clock::time_point deadline = (flags.requests > 0)
+                                   ? Clock::time_point::max()
+                                   : start + std::chrono::seconds(flags.seconds);
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (unsigned int i = 0; i < flags.threads; ++i) {
+    unsigned int n = flags.connections / flags.threads +
+                     (i < flags.connections % flags.threads ? 1 : 0);
+    workers.push_back(std::make_unique<Worker>(flags, corpus, budget, n));
+  }
+  std::vector<std::thread> threads;
+  for (auto& w : workers) {
+    Worker* worker = w.get();
+    threads.emplace_back([worker, deadline] { worker->run(deadline); });
+  }
+  for (auto& t : threads) t.join();
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  if (server) server->stop();
+
+  Stats total;
+  for (auto& w : workers) {
+    Stats& s = w->stats();
+    total.completed += s.completed;
+    total.failed += s.failed;
+    total.body_bytes += s.body_bytes;
+    total.latencies_us.insert(total.latencies_us.end(), s.latencies_us.begin(),
+                              s.latencies_us.end());
+  }
+  std::sort(total.latencies_us.begin(), total.latencies_us.end());
+  const auto& lat = total.latencies_us;
+  double secs = elapsed.count();
+  std::cout << "requests=" << total.completed << " failed=" << total.failed
+            << " seconds=" << secs << std::endl;
+  std::cout << "requests_per_sec=" << uint64_t(total.completed / secs)
+            << " body_bytes_per_sec=" << uint64_t(total.body_bytes / secs)
+            << std::endl;
+  std::cout << "latency_us p50=" << percentile(lat, 50)
+            << " p90=" << percentile(lat, 90) << " p99=" << percentile(lat, 99)
+            << " p99.9=" << percentile(lat, 99.9)
+            << " max=" << (lat.empty() ? 0 : lat.back()) << std::endl;
+  return 0;
+}
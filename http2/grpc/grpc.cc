@@ -0,0 +1,194 @@
+#include "http2/grpc/grpc.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "http2/headers/constants.h"
+#include "http2/protocol/hpack/hpack.h"
+
+using http2::headers::Header;
+using http2::headers::Headers;
+using http2::server::ServerStream;
+
+namespace http2 {
+namespace grpc {
+
+static constexpr char kGrpcContentType[] = "application/grpc";
+static constexpr int kNumStatuses = UNAUTHENTICATED + 1;
+
+void Message::copy_to(std::vector<uint8_t>& out) const {
+  out.reserve(out.size() + size);
+  for (const Slice& slice : slices) {
+    out.insert(out.end(), slice.data, slice.data + slice.size);
+  }
+}
+
+void MessageReader::feed(std::vector<uint8_t> chunk) {
+  if (chunk.empty()) return;
+  buffered_ += chunk.size();
+  chunks_.push_back(std::move(chunk));
+}
+
+MessageReader::Result MessageReader::next(Message& msg) {
+  // The previous message is done with, and so are the chunks it used up.
+  msg.slices.clear();
+  while (chunk_ > 0) {
+    chunks_.pop_front();
+    --chunk_;
+  }
+
+  if (buffered_ < kPrefixSize) return INCOMPLETE;
+  uint8_t prefix[kPrefixSize];
+  peek(prefix, kPrefixSize);
+  std::size_t size = (std::size_t(prefix[1]) << 24) |
+                     (std::size_t(prefix[2]) << 16) |
+                     (std::size_t(prefix[3]) << 8) | std::size_t(prefix[4]);
+  if (size > max_message_size_) return TOO_LARGE;
+  if (buffered_ - kPrefixSize < size) return INCOMPLETE;
+
+  skip(kPrefixSize, nullptr);
+  skip(size, &msg.slices);
+  msg.compressed = (prefix[0] & 1) != 0;
+  msg.size = size;
+  return MESSAGE;
+}
+
+// peek copies the next n buffered bytes to out, without consuming them.
+void MessageReader::peek(uint8_t* out, std::size_t n) const {
+  std::size_t offset = offset_;
+  for (auto it = chunks_.begin() + chunk_; n > 0; ++it, offset = 0) {
+    std::size_t take = std::min(n, it->size() - offset);
+    std::copy_n(it->data() + offset, take, out);
+    out += take;
+    n -= take;
+  }
+}
+
+// skip consumes the next n buffered bytes, appending views of them to slices
+// if it is not null.  Chunks are only released by next, so the views stay
+// valid until then.
+void MessageReader::skip(std::size_t n, std::vector<Slice>* slices) {
+  buffered_ -= n;
+  while (n > 0) {
+    const std::vector<uint8_t>& chunk = chunks_[chunk_];
+    std::size_t take = std::min(n, chunk.size() - offset_);
+    if (slices != nullptr) {
+      slices->push_back(Slice{chunk.data() + offset_, take});
+    }
+    offset_ += take;
+    n -= take;
+    if (offset_ == chunk.size()) {
+      ++chunk_;
+      offset_ = 0;
+    }
+  }
+}
+
+void encode_prefix(std::size_t size, bool compressed, uint8_t* out) {
+  out[0] = compressed ? 1 : 0;
+  out[1] = uint8_t(size >> 24);
+  out[2] = uint8_t(size >> 16);
+  out[3] = uint8_t(size >> 8);
+  out[4] = uint8_t(size);
+}
+
+bool is_grpc(const Headers& request) {
+  // "application/grpc", optionally followed by "+proto" and the like.
+  auto type = request.first(http2::headers::kContentType);
+  if (!type.first) return false;
+  std::string_view value = type.second;
+  std::string_view base = kGrpcContentType;
+  return value.substr(0, base.size()) == base &&
+         (value.size() == base.size() || value[base.size()] == '+' ||
+          value[base.size()] == ';');
+}
+
+const std::vector<uint8_t>& response_headers() {
+  static const std::vector<uint8_t> block = [] {
+    std::vector<uint8_t> out;
+    http2::protocol::hpack::Encoder().prepare(
+        {Header(http2::headers::kStatus, "200"),
+         Header(http2::headers::kContentType, kGrpcContentType)},
+        out);
+    return out;
+  }();
+  return block;
+}
+
+// percent_encode encodes a grpc-message value: everything but printable
+// ASCII, and '%' itself, becomes %XX.
+static std::string percent_encode(std::string_view message) {
+  static constexpr char kHex[] = "0123456789ABCDEF";
+  std::string out;
+  out.reserve(message.size());
+  for (char ch : message) {
+    uint8_t byte = uint8_t(ch);
+    if (byte >= 0x20 && byte <= 0x7e && byte != '%') {
+      out.push_back(ch);
+    } else {
+      out.push_back('%');
+      out.push_back(kHex[byte >> 4]);
+      out.push_back(kHex[byte & 0xf]);
+    }
+  }
+  return out;
+}
+
+std::vector<uint8_t> status_trailers(Status status, std::string_view message) {
+  static const std::vector<std::vector<uint8_t>> cache = [] {
+    std::vector<std::vector<uint8_t>> blocks(kNumStatuses);
+    http2::protocol::hpack::Encoder encoder;
+    for (int i = 0; i < kNumStatuses; ++i) {
+      encoder.prepare({Header("grpc-status", std::to_string(i))}, blocks[i]);
+    }
+    return blocks;
+  }();
+  if (message.empty() && status >= 0 && status < kNumStatuses) {
+    return cache[status];
+  }
+  std::vector<uint8_t> out;
+  http2::protocol::hpack::Encoder().prepare(
+      {Header("grpc-status", std::to_string(int(status))),
+       Header("grpc-message", percent_encode(message))},
+      out);
+  return out;
+}
+
+void start(const ServerStream& stream) {
+  stream.send_headers(response_headers());
+}
+
+ServerStream::WriteAwaiter write_message(const ServerStream& stream,
+                                         const uint8_t* data,
+                                         std::size_t size) {
+  start(stream);
+  uint8_t prefix[kPrefixSize];
+  encode_prefix(size, false, prefix);
+  stream.write(prefix, kPrefixSize);
+  return stream.write(data, size);
+}
+
+ServerStream::WriteAwaiter write_message(const ServerStream& stream,
+                                         std::string_view data) {
+  return write_message(stream, reinterpret_cast<const uint8_t*>(data.data()),
+                       data.size());
+}
+
+ServerStream::WriteAwaiter write_message(const ServerStream& stream,
+                                         const Message& msg) {
+  start(stream);
+  uint8_t prefix[kPrefixSize];
+  encode_prefix(msg.size, msg.compressed, prefix);
+  stream.write(prefix, kPrefixSize);
+  for (const Slice& slice : msg.slices) stream.write(slice.data, slice.size);
+  return stream.write(nullptr, 0);
+}
+
+void finish(const ServerStream& stream, Status status,
+            std::string_view message) {
+  start(stream);
+  stream.set_trailers(status_trailers(status, message));
+}
+
+}  // namespace grpc
+}  // namespace http2
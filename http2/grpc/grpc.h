@@ -0,0 +1,157 @@
+// Tools for serving gRPC over HTTP/2.
+
+#ifndef HTTP2_GRPC_GRPC_H
+#define HTTP2_GRPC_GRPC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "http2/headers/headers.h"
+#include "http2/server/stream.h"
+
+namespace http2 {
+namespace grpc {
+
+// Status enumerates the gRPC status codes, as sent in "grpc-status".
+enum Status {
+  OK = 0,
+  CANCELLED = 1,
+  UNKNOWN = 2,
+  INVALID_ARGUMENT = 3,
+  DEADLINE_EXCEEDED = 4,
+  NOT_FOUND = 5,
+  ALREADY_EXISTS = 6,
+  PERMISSION_DENIED = 7,
+  RESOURCE_EXHAUSTED = 8,
+  FAILED_PRECONDITION = 9,
+  ABORTED = 10,
+  OUT_OF_RANGE = 11,
+  UNIMPLEMENTED = 12,
+  INTERNAL = 13,
+  UNAVAILABLE = 14,
+  DATA_LOSS = 15,
+  UNAUTHENTICATED = 16,
+};
+
+// kPrefixSize is the size of the prefix of each message: a compressed flag,
+// then the length of the message as a 32-bit big-endian integer.
+inline constexpr std::size_t kPrefixSize = 5;
+
+// Slice is a view of part of a message, in the buffer it arrived in.
+struct Slice final {
+  const uint8_t* data;
+  std::size_t size;
+};
+
+// Message is a view of one length-prefixed message of a request body, as a
+// chain of slices of the chunks it arrived in.  It is only valid until the
+// MessageReader that produced it moves on to the next message.
+struct Message final {
+  bool compressed = false;
+  std::size_t size = 0;
+  std::vector<Slice> slices;
+
+  // copy_to appends the whole message to out, for code that needs it in one
+  // piece.
+  void copy_to(std::vector<uint8_t>& out) const;
+};
+
+// MessageReader splits a request body into messages, without copying them:
+// it keeps the chunks it is fed, and each message refers to them in place,
+// however the messages fall across chunk (and hence DATA frame) boundaries.
+//
+// For example:
+//
+//   MessageReader reader;
+//   Message msg;
+//   std::vector<uint8_t> chunk;
+//   while (co_await stream.read(chunk)) {
+//     reader.feed(std::move(chunk));
+//     while (reader.next(msg) == MessageReader::MESSAGE) { ... }
+//   }
+class MessageReader final {
+ public:
+  enum Result {
+    MESSAGE,     // a message was returned
+    INCOMPLETE,  // more of the body is needed first
+    TOO_LARGE,   // the next message is longer than max_message_size
+  };
+
+  explicit MessageReader(std::size_t max_message_size = 4 << 20)
+      : max_message_size_(max_message_size),
+        chunk_(0),
+        offset_(0),
+        buffered_(0) {}
+
+  MessageReader(const MessageReader&) = delete;
+  MessageReader& operator=(const MessageReader&) = delete;
+
+  // feed adds the next chunk of the body, taking ownership of it.
+  void feed(std::vector<uint8_t> chunk);
+
+  // next parses the next message into msg, invalidating the previous one.
+  Result next(Message& msg);
+
+  // buffered returns the bytes fed but not yet returned in a message.  If
+  // it is not zero at the end of the body, the last message was truncated.
+  std::size_t buffered() const { return buffered_; }
+
+ private:
+  void peek(uint8_t* out, std::size_t n) const;
+  void skip(std::size_t n, std::vector<Slice>* slices);
+
+  std::size_t max_message_size_;
+  std::deque<std::vector<uint8_t>> chunks_;
+  std::size_t chunk_;     // the chunk being read
+  std::size_t offset_;    // into chunks_[chunk_]
+  std::size_t buffered_;  // from there to the end of chunks_
+};
+
+// encode_prefix writes the kPrefixSize-byte prefix of a message of the given
+// size to out.
+void encode_prefix(std::size_t size, bool compressed, uint8_t* out);
+
+// is_grpc returns true iff the request headers are those of a gRPC call.
+bool is_grpc(const http2::headers::Headers& request);
+
+// response_headers returns the prepared block (see
+// http2::protocol::hpack::Encoder::prepare) of the response headers of
+// every gRPC call: ":status: 200" and "content-type: application/grpc".
+const std::vector<uint8_t>& response_headers();
+
+// status_trailers returns the prepared block of the trailers that end a call
+// with status.  A message, if any, is percent-encoded into "grpc-message";
+// without one, the block comes from a cache.
+std::vector<uint8_t> status_trailers(Status status,
+                                     std::string_view message = {});
+
+// The rest wraps a streaming handler's ServerStream.
+
+// start sends the response headers.  write_message sends them too, if need
+// be.
+void start(const http2::server::ServerStream& stream);
+
+// write_message queues one message of the response.  co_await the result as
+// with ServerStream::write.
+http2::server::ServerStream::WriteAwaiter write_message(
+    const http2::server::ServerStream& stream, const uint8_t* data,
+    std::size_t size);
+http2::server::ServerStream::WriteAwaiter write_message(
+    const http2::server::ServerStream& stream, std::string_view data);
+http2::server::ServerStream::WriteAwaiter write_message(
+    const http2::server::ServerStream& stream, const Message& msg);
+
+// finish sets the trailers that end the call with status, once the handler
+// returns.  If nothing was written, the headers and trailers are sent back
+// to back.
+void finish(const http2::server::ServerStream& stream, Status status,
+            std::string_view message = {});
+
+}  // namespace grpc
+}  // namespace http2
+
+#endif  // HTTP2_GRPC_GRPC_H
@@ -0,0 +1,206 @@
+#include "http2/grpc/grpc.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http2/protocol/constants.h"
+#include "http2/protocol/frame.h"
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/server/connection.h"
+
+using http2::grpc::Message;
+using http2::grpc::MessageReader;
+using http2::headers::Header;
+using http2::protocol::Frame;
+using http2::protocol::FrameHeader;
+using http2::server::Connection;
+using http2::server::ConnectionOptions;
+using http2::server::ServerStream;
+using http2::server::StreamTask;
+
+namespace grpc = http2::grpc;
+namespace proto = http2::protocol;
+
+static std::vector<uint8_t> message(const std::string& payload) {
+  std::vector<uint8_t> out(grpc::kPrefixSize);
+  grpc::encode_prefix(payload.size(), false, out.data());
+  out.insert(out.end(), payload.begin(), payload.end());
+  return out;
+}
+
+static std::string contents(const Message& msg) {
+  std::vector<uint8_t> out;
+  msg.copy_to(out);
+  return std::string(out.begin(), out.end());
+}
+
+TEST(MessageReader, Split) {
+  std::vector<uint8_t> body = message("hello");
+  std::vector<uint8_t> more = message("world, and then some");
+  body.insert(body.end(), more.begin(), more.end());
+  more = message("");
+  body.insert(body.end(), more.begin(), more.end());
+
+  // Feed it in pieces that split both a prefix and a payload.
+  MessageReader reader;
+  Message msg;
+  std::vector<uint8_t> a(body.begin(), body.begin() + 3);
+  std::vector<uint8_t> b(body.begin() + 3, body.begin() + 17);
+  std::vector<uint8_t> c(body.begin() + 17, body.end());
+  const uint8_t* b_data = b.data();
+  const uint8_t* c_data = c.data();
+  reader.feed(std::move(a));
+  EXPECT_EQ(reader.next(msg), MessageReader::INCOMPLETE);
+  reader.feed(std::move(b));
+  ASSERT_EQ(reader.next(msg), MessageReader::MESSAGE);
+  EXPECT_EQ(contents(msg), "hello");
+  ASSERT_EQ(msg.slices.size(), 1);
+  EXPECT_EQ(msg.slices[0].data, b_data + 2);  // in place
+  EXPECT_EQ(reader.next(msg), MessageReader::INCOMPLETE);
+
+  reader.feed(std::move(c));
+  ASSERT_EQ(reader.next(msg), MessageReader::MESSAGE);
+  EXPECT_EQ(contents(msg), "world, and then some");
+  EXPECT_EQ(msg.size, 20);
+  ASSERT_EQ(msg.slices.size(), 2);
+  EXPECT_EQ(msg.slices[1].data, c_data);
+  ASSERT_EQ(reader.next(msg), MessageReader::MESSAGE);
+  EXPECT_EQ(msg.size, 0);
+  EXPECT_EQ(reader.next(msg), MessageReader::INCOMPLETE);
+  EXPECT_EQ(reader.buffered(), 0);
+}
+
+TEST(MessageReader, TooLarge) {
+  MessageReader reader(16);
+  Message msg;
+  reader.feed(message(std::string(17, 'x')));
+  EXPECT_EQ(reader.next(msg), MessageReader::TOO_LARGE);
+  EXPECT_EQ(reader.buffered(), 22);
+}
+
+TEST(Grpc, Headers) {
+  http2::headers::Headers request;
+  request.add("content-type", "application/grpc+proto");
+  EXPECT_TRUE(grpc::is_grpc(request));
+  http2::headers::Headers other;
+  other.add("content-type", "application/grpcx");
+  EXPECT_FALSE(grpc::is_grpc(other));
+
+  proto::hpack::Decoder decoder;
+  std::vector<Header> headers;
+  ASSERT_TRUE(decoder.decode(grpc::response_headers(), headers));
+  EXPECT_EQ(headers,
+            (std::vector<Header>{{":status", "200"},
+                                 {"content-type", "application/grpc"}}));
+  ASSERT_TRUE(decoder.decode(grpc::status_trailers(grpc::OK), headers));
+  EXPECT_EQ(headers, (std::vector<Header>{{"grpc-status", "0"}}));
+  ASSERT_TRUE(decoder.decode(
+      grpc::status_trailers(grpc::INTERNAL, "50% bad\n"), headers));
+  EXPECT_EQ(headers,
+            (std::vector<Header>{{"grpc-status", "13"},
+                                 {"grpc-message", "50%25 bad%0A"}}));
+  EXPECT_TRUE(decoder.table().empty());
+}
+
+static void append_frame(std::vector<uint8_t>& out, uint8_t type,
+                         uint8_t flags, uint32_t sid,
+                         const std::vector<uint8_t>& payload = {}) {
+  proto::encode_frame_header(payload.size(), type, flags, sid, out);
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+static std::vector<Frame> drain(Connection& conn) {
+  std::vector<uint8_t> out;
+  while (conn.has_output()) {
+    out.insert(out.end(), conn.output_data(),
+               conn.output_data() + conn.output_size());
+    conn.consume_output(conn.output_size());
+  }
+  std::vector<Frame> frames;
+  const uint8_t* p = out.data();
+  const uint8_t* q = p + out.size();
+  FrameHeader hdr;
+  while (proto::decode_frame_header(p, q, hdr)) {
+    const uint8_t* next = p + proto::kFrameHeaderSize + hdr.length;
+    Frame f;
+    EXPECT_TRUE(f.decode(p, next));
+    frames.push_back(f);
+    p = next;
+  }
+  return frames;
+}
+
+TEST(Grpc, Echo) {
+  ConnectionOptions options;
+  http2::server::Handler handler = [](ServerStream stream) -> StreamTask {
+    http2::headers::Headers request = co_await stream.headers();
+    if (!grpc::is_grpc(request)) {
+      grpc::finish(stream, grpc::INVALID_ARGUMENT, "not gRPC");
+      co_return;
+    }
+    MessageReader reader;
+    Message msg;
+    std::vector<uint8_t> chunk;
+    while (co_await stream.read(chunk)) {
+      reader.feed(std::move(chunk));
+      while (reader.next(msg) == MessageReader::MESSAGE) {
+        co_await grpc::write_message(stream, msg);
+      }
+    }
+    if (reader.buffered() > 0) {
+      grpc::finish(stream, grpc::INTERNAL, "truncated");
+    } else {
+      grpc::finish(stream, grpc::OK);
+    }
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  std::vector<uint8_t> input(std::begin(proto::kConnectionPreface),
+                             std::end(proto::kConnectionPreface));
+  append_frame(input, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0);
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"},
+                      {":path", "/echo.Echo/Echo"},
+                      {"content-type", "application/grpc"}},
+                     block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  // Two messages, split across three DATA frames.
+  std::vector<uint8_t> body = message("ping");
+  std::vector<uint8_t> more = message("pong!");
+  body.insert(body.end(), more.begin(), more.end());
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(body.begin(), body.begin() + 2));
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(body.begin() + 2, body.begin() + 12));
+  append_frame(input, proto::DATA_FRAME, proto::END_STREAM, 1,
+               std::vector<uint8_t>(body.begin() + 12, body.end()));
+  conn.receive(input.data(), input.data() + input.size());
+
+  std::vector<uint8_t> echoed;
+  std::vector<std::vector<Header>> header_blocks;
+  proto::hpack::Decoder decoder;
+  bool ended = false;
+  for (const Frame& f : drain(conn)) {
+    if (f.stream_id() != 1) continue;
+    EXPECT_FALSE(ended);
+    if (f.type() == proto::DATA_FRAME) {
+      EXPECT_FALSE(f.has_flag(proto::END_STREAM));
+      echoed.insert(echoed.end(), f.payload().begin(), f.payload().end());
+    } else if (f.type() == proto::HEADERS_FRAME) {
+      std::vector<Header> headers;
+      EXPECT_TRUE(decoder.decode(f.payload(), headers));
+      header_blocks.push_back(headers);
+      ended = f.has_flag(proto::END_STREAM);
+    }
+  }
+  EXPECT_TRUE(ended);
+  EXPECT_EQ(echoed, body);
+  ASSERT_EQ(header_blocks.size(), 2);
+  EXPECT_EQ(header_blocks[0][1], Header("content-type", "application/grpc"));
+  EXPECT_EQ(header_blocks[1], (std::vector<Header>{{"grpc-status", "0"}}));
+  EXPECT_EQ(conn.num_streams(), 0);
+}
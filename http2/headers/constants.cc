@@ -42,6 +42,7 @@ const char* const kLastModified = "last-modified";
 const char* const kLink = "link";
 const char* const kLocation = "location";
 const char* const kMaxForwards = "max-forwards";
+const char* const kPriority = "priority";
 const char* const kProxyAuthenticate = "proxy-authenticate";
 const char* const kProxyAuthorization = "proxy-authorization";
 const char* const kRange = "range";
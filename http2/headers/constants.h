@@ -46,6 +46,7 @@ extern const char* const kLastModified;
 extern const char* const kLink;
 extern const char* const kLocation;
 extern const char* const kMaxForwards;
+extern const char* const kPriority;
 extern const char* const kProxyAuthenticate;
 extern const char* const kProxyAuthorization;
 extern const char* const kRange;
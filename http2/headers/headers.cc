@@ -1,78 +1,211 @@
 #include "http2/headers/headers.h"
 
+#include <algorithm>
+#include <stdexcept>
+
 namespace http2 {
 namespace headers {
 
-std::vector<std::string> Headers::every(std::string name) const {
-  std::vector<std::string> results;
-  for (const auto& h : headers_) {
-    if (h.name == name) {
-      results.push_back(h.value);
+Headers::Headers(const Headers& other)
+    : headers_(other.headers_),
+      index_(other.index_ ? std::make_unique<Index>(*other.index_)
+                          : nullptr) {}
+
+Headers& Headers::operator=(const Headers& other) {
+  if (this != &other) *this = Headers(other);
+  return *this;
+}
+
+bool operator==(const Headers::Range& a, const Headers::Range& b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+// build_index indexes the list, once it has grown long enough to need it.
+// There are no tombstones yet.
+void Headers::build_index() {
+  index_ = std::make_unique<Index>();
+  std::vector<Span>& spans = index_->spans;
+  for (std::size_t i = 0; i < headers_.size(); ++i) {
+    uint32_t pos = i;
+    const std::string& name = headers_[i].name;
+    std::size_t at = lower_bound(name);
+    if (at < spans.size() && headers_[spans[at].first].name == name) {
+      spans[at].last = pos;
+      ++spans[at].count;
+    } else {
+      spans.insert(spans.begin() + at, Span{pos, pos, 1});
     }
   }
-  return results;
 }
 
-std::pair<bool, std::string> Headers::first(std::string name) const {
-  for (const auto& h : headers_) {
-    if (h.name == name) {
-      return std::make_pair(true, h.value);
+// lower_bound returns the position in the index of the Span for the given
+// name, or of the first Span after it if there is none.
+std::size_t Headers::lower_bound(std::string_view name) const {
+  const std::vector<Span>& spans = index_->spans;
+  auto it = std::lower_bound(
+      spans.begin(), spans.end(), name,
+      [this](const Span& span, std::string_view name) {
+        return std::string_view(headers_[span.first].name) < name;
+      });
+  return it - spans.begin();
+}
+
+// find locates the live headers with the given name, and returns false if
+// there are none.
+bool Headers::find(std::string_view name, Span& span) const {
+  if (index_) {
+    std::size_t at = lower_bound(name);
+    if (at == index_->spans.size()) return false;
+    span = index_->spans[at];
+    return span.count > 0 && headers_[span.first].name == name;
+  }
+  span.count = 0;
+  for (std::size_t i = 0; i < headers_.size(); ++i) {
+    if (headers_[i].name != name) continue;
+    if (span.count == 0) span.first = i;
+    span.last = i;
+    ++span.count;
+  }
+  return span.count > 0;
+}
+
+Headers::ValueRange Headers::every(std::string_view name) const {
+  Span span;
+  if (!find(name, span)) span = Span{0, 0, 0};
+  return ValueRange(this, span);
+}
+
+std::pair<bool, std::string> Headers::first(std::string_view name) const {
+  if (!index_) {
+    for (const auto& h : headers_) {
+      if (h.name == name) return std::make_pair(true, h.value);
     }
+    return std::make_pair(false, std::string());
   }
-  return std::make_pair(false, std::string());
+  Span span;
+  if (!find(name, span)) return std::make_pair(false, std::string());
+  return std::make_pair(true, headers_[span.first].value);
 }
 
-std::pair<bool, std::string> Headers::last(std::string name) const {
-  auto result = std::make_pair(false, std::string());
-  for (const auto& h : headers_) {
-    if (h.name == name) {
-      result.first = true;
-      result.second = h.value;
+std::pair<bool, std::string> Headers::last(std::string_view name) const {
+  if (!index_) {
+    for (std::size_t i = headers_.size(); i-- > 0;) {
+      if (headers_[i].name == name) {
+        return std::make_pair(true, headers_[i].value);
+      }
     }
+    return std::make_pair(false, std::string());
   }
-  return result;
+  Span span;
+  if (!find(name, span)) return std::make_pair(false, std::string());
+  return std::make_pair(true, headers_[span.last].value);
 }
 
 void Headers::add(Header h) {
+  uint32_t i = headers_.size();
   headers_.push_back(std::move(h));
+  if (!index_) {
+    if (headers_.size() >= kIndexThreshold) build_index();
+    return;
+  }
+  if (!index_->dead.empty()) index_->dead.push_back(false);
+  std::vector<Span>& spans = index_->spans;
+  std::size_t at = lower_bound(headers_[i].name);
+  if (at == spans.size() ||
+      headers_[spans[at].first].name != headers_[i].name) {
+    spans.insert(spans.begin() + at, Span{i, i, 1});
+  } else if (spans[at].count == 0) {
+    spans[at] = Span{i, i, 1};
+  } else {
+    spans[at].last = i;
+    ++spans[at].count;
+  }
 }
 
 void Headers::replace(Header h) {
-  bool found = false;
-  auto it = headers_.begin();
-  while (it != headers_.end()) {
-    if (it->name == h.name) {
-      if (found) {
-        it = headers_.erase(it);
-        continue;
-      }
-      found = true;
-      *it = std::move(h);
+  Span span;
+  if (!find(h.name, span)) return add(std::move(h));
+  headers_[span.first].value = std::move(h.value);
+  erase(h.name, span, true);
+}
+
+void Headers::remove(std::string_view name) {
+  Span span;
+  if (find(name, span)) erase(name, span, false);
+}
+
+std::size_t Headers::size() const {
+  std::size_t sum = 0;
+  for (const auto& h : all()) sum += h.size();
+  return sum;
+}
+
+// erase removes the headers with the given name, which span locates, except
+// for the first if keep_first is set.  A short list closes the gaps at once;
+// an indexed one leaves tombstones, and only visits the headers between the
+// first and the last with the name.
+void Headers::erase(std::string_view name, const Span& span,
+                    bool keep_first) {
+  if (span.count == (keep_first ? 1 : 0)) return;
+  uint32_t from = span.first + (keep_first ? 1 : 0);
+  if (!index_) {
+    uint32_t out = from;
+    for (uint32_t i = from; i < headers_.size(); ++i) {
+      if (i <= span.last && headers_[i].name == name) continue;
+      if (out != i) headers_[out] = std::move(headers_[i]);
+      ++out;
     }
-    ++it;
+    headers_.resize(out);
+    return;
   }
-  if (!found) {
-    headers_.push_back(std::move(h));
+
+  for (uint32_t i = from; i <= span.last; ++i) {
+    if (!dead(i) && headers_[i].name == name) kill(i);
   }
+  // The Span stays, even with no headers left, since its first header
+  // still names it.
+  Span& kept = index_->spans[lower_bound(name)];
+  kept = Span{span.first, span.first, keep_first ? 1u : 0u};
+  if (index_->num_dead > num_live()) sweep();
 }
 
-void Headers::remove(std::string name) {
-  auto it = headers_.begin();
-  while (it != headers_.end()) {
-    if (it->name == name) {
-      it = headers_.erase(it);
-    } else {
-      ++it;
-    }
-  }
+// kill turns the header at position i into a tombstone.
+void Headers::kill(uint32_t i) {
+  if (index_->dead.empty()) index_->dead.resize(headers_.size());
+  index_->dead[i] = true;
+  ++index_->num_dead;
 }
 
-std::size_t Headers::size() const {
-  std::size_t sum = 0;
-  for (const auto& h : headers_) {
-    sum += h.size();
+// sweep closes the gaps left by the tombstones, in one pass, and drops the
+// Spans of the names that have no headers left.  The rest keep their order
+// in the index, since their names do not change; only their positions do.
+// Each header is looked up before it moves: the Spans already visited point
+// below it, at headers that are in place, and the others point at or above
+// it, at headers that have not moved yet.
+void Headers::sweep() {
+  std::vector<Span>& spans = index_->spans;
+  spans.erase(std::remove_if(spans.begin(), spans.end(),
+                             [](const Span& span) { return span.count == 0; }),
+              spans.end());
+  uint32_t out = 0;
+  for (uint32_t i = 0; i < headers_.size(); ++i) {
+    if (index_->dead[i]) continue;
+    Span& span = spans[lower_bound(headers_[i].name)];
+    if (span.first == i) span.first = out;
+    if (span.last == i) span.last = out;
+    if (out != i) headers_[out] = std::move(headers_[i]);
+    ++out;
   }
-  return sum;
+  headers_.resize(out);
+  index_->dead.clear();
+  index_->num_dead = 0;
+}
+
+const std::string& Headers::ValueRange::at(std::size_t i) const {
+  if (i >= size()) throw std::out_of_range("no such value");
+  iterator it = begin();
+  while (i-- > 0) ++it;
+  return *it;
 }
 
 }  // namespace headers
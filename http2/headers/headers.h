@@ -2,8 +2,12 @@
 #define HTTP2_PROTOCOL_HEADER_H
 
 #include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -37,31 +41,249 @@ inline bool operator>(const Header& a, const Header& b) { return (b < a); }
 inline bool operator>=(const Header& a, const Header& b) { return !(a < b); }
 inline bool operator<=(const Header& a, const Header& b) { return !(b < a); }
 
+// Headers holds an ordered list of headers, in which names may repeat.
+//
+// Lookups scan the list while it is short; once it holds kIndexThreshold
+// headers, add() builds an index from each name to where it occurs, which
+// later changes keep up to date.  The index is a sorted vector, allocated
+// only then, so a short list costs no more than its vector.
+//
+// Once the list is indexed, remove() and replace() leave the headers they
+// drop in place as tombstones, which all() and every() skip.  They are
+// swept out in one pass once they outnumber the live headers, so removing
+// k names costs O(k) amortized, plus the distance between the first and
+// last header with each name.  Only the non-const methods change anything,
+// so a const Headers may be read from several threads at once.
 class Headers final {
  public:
-  const std::vector<Header>& all() const { return headers_; }
+  class Range;
+  class ValueRange;
 
-  std::vector<std::string> every(std::string name) const;
-  std::pair<bool, std::string> first(std::string name) const;
-  std::pair<bool, std::string> last(std::string name) const;
+  static constexpr std::size_t kIndexThreshold = 16;
+
+  Headers() = default;
+  Headers(const Headers& other);
+  Headers(Headers&&) noexcept = default;
+  Headers& operator=(const Headers& other);
+  Headers& operator=(Headers&&) noexcept = default;
+
+  // all returns the headers, in order.  The range refers to this Headers,
+  // and is invalidated by any change to it.
+  Range all() const;
+
+  // every returns the values of the headers with the given name, in order.
+  // The range refers to this Headers, and is invalidated by any change to
+  // it.
+  ValueRange every(std::string_view name) const;
+
+  std::pair<bool, std::string> first(std::string_view name) const;
+  std::pair<bool, std::string> last(std::string_view name) const;
 
   void add(Header h);
   void add(std::string name, std::string value) {
-    headers_.emplace_back(std::move(name), std::string(value));
+    add(Header(std::move(name), std::move(value)));
   }
 
+  // replace overwrites the first header with h's name, in place, and removes
+  // any others; or adds h if there are none.
   void replace(Header h);
   void replace(std::string name, std::string value) {
     replace(Header{std::move(name), std::move(value)});
   }
 
-  void remove(std::string name);
+  void remove(std::string_view name);
 
   // size computes the bytes used, as specified by RFC 7541 section 4.1.
   std::size_t size() const;
 
  private:
+  // Span locates the live headers with one name: the positions of the first
+  // and last of them, and how many there are.
+  struct Span {
+    uint32_t first;
+    uint32_t last;
+    uint32_t count;
+  };
+
+  // Index holds a Span for each name, sorted by name.  A Span's name is
+  // that of the header at its first position, so the index holds no copies
+  // of the names.  A name whose headers were all removed keeps its Span,
+  // with a count of 0, until the tombstones are swept: its first header is
+  // still there, dead, to give its name.
+  struct Index {
+    std::vector<Span> spans;
+    std::vector<bool> dead;  // by position; empty while there are none
+    std::size_t num_dead = 0;
+  };
+
+  bool dead(std::size_t i) const {
+    return index_ && !index_->dead.empty() && index_->dead[i];
+  }
+  std::size_t num_live() const {
+    return headers_.size() - (index_ ? index_->num_dead : 0);
+  }
+
+  void build_index();
+  std::size_t lower_bound(std::string_view name) const;
+  bool find(std::string_view name, Span& span) const;
+  void erase(std::string_view name, const Span& span, bool keep_first);
+  void kill(uint32_t i);
+  void sweep();
+
+  // headers_ includes any tombstones.  index_ is null until the list
+  // reaches kIndexThreshold.
   std::vector<Header> headers_;
+  std::unique_ptr<Index> index_;
+};
+
+// Range is a view of the live headers of a Headers, in order.
+class Headers::Range final {
+ public:
+  class iterator final {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Header;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Header*;
+    using reference = const Header&;
+
+    iterator() : headers_(nullptr), pos_(0) {}
+
+    reference operator*() const { return headers_->headers_[pos_]; }
+    pointer operator->() const { return &**this; }
+    iterator& operator++() {
+      ++pos_;
+      skip();
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator copy = *this;
+      ++*this;
+      return copy;
+    }
+    bool operator==(const iterator& other) const { return pos_ == other.pos_; }
+    bool operator!=(const iterator& other) const { return pos_ != other.pos_; }
+
+   private:
+    friend class Range;
+
+    iterator(const Headers* headers, std::size_t pos)
+        : headers_(headers), pos_(pos) {}
+
+    // skip advances past any tombstones.
+    void skip() {
+      while (pos_ < headers_->headers_.size() && headers_->dead(pos_)) ++pos_;
+    }
+
+    const Headers* headers_;
+    std::size_t pos_;
+  };
+  using const_iterator = iterator;
+
+  iterator begin() const {
+    iterator it(headers_, 0);
+    it.skip();
+    return it;
+  }
+  iterator end() const { return iterator(headers_, headers_->headers_.size()); }
+  std::size_t size() const { return headers_->num_live(); }
+  bool empty() const { return size() == 0; }
+
+ private:
+  friend class Headers;
+
+  explicit Range(const Headers* headers) : headers_(headers) {}
+
+  const Headers* headers_;
+};
+
+bool operator==(const Headers::Range& a, const Headers::Range& b);
+inline bool operator!=(const Headers::Range& a, const Headers::Range& b) {
+  return !(a == b);
+}
+
+inline Headers::Range Headers::all() const { return Range(this); }
+
+// ValueRange is a view of the values of the headers with one name.
+class Headers::ValueRange final {
+ public:
+  class iterator final {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string*;
+    using reference = const std::string&;
+
+    iterator() : headers_(nullptr), pos_(0), end_(0) {}
+
+    reference operator*() const { return headers_->headers_[pos_].value; }
+    pointer operator->() const { return &**this; }
+    iterator& operator++() {
+      ++pos_;
+      skip();
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator copy = *this;
+      ++*this;
+      return copy;
+    }
+    bool operator==(const iterator& other) const { return pos_ == other.pos_; }
+    bool operator!=(const iterator& other) const { return pos_ != other.pos_; }
+
+   private:
+    friend class ValueRange;
+
+    iterator(const Headers* headers, std::string_view name, uint32_t pos,
+             uint32_t end)
+        : headers_(headers), name_(name), pos_(pos), end_(end) {}
+
+    // skip advances to the next live header with the name, if any.
+    void skip() {
+      while (pos_ < end_ && (headers_->dead(pos_) ||
+                             headers_->headers_[pos_].name != name_)) {
+        ++pos_;
+      }
+    }
+
+    const Headers* headers_;
+    std::string_view name_;
+    uint32_t pos_;
+    uint32_t end_;
+  };
+
+  iterator begin() const {
+    return iterator(headers_, name_, span_.first, end_pos());
+  }
+  iterator end() const {
+    return iterator(headers_, name_, end_pos(), end_pos());
+  }
+  std::size_t size() const { return span_.count; }
+  bool empty() const { return span_.count == 0; }
+
+  // at returns the i'th value.
+  //
+  // THROWS std::out_of_range if i >= size().
+  const std::string& at(std::size_t i) const;
+
+ private:
+  friend class Headers;
+
+  // The name is taken from the first header, so that the range does not
+  // depend on the caller's copy of it.
+  ValueRange(const Headers* headers, Span span)
+      : headers_(headers),
+        name_(span.count == 0 ? std::string_view()
+                              : std::string_view(
+                                    headers->headers_[span.first].name)),
+        span_(span) {}
+
+  uint32_t end_pos() const { return span_.count == 0 ? 0 : span_.last + 1; }
+
+  const Headers* headers_;
+  std::string_view name_;
+  Span span_;
 };
 
 }  // namespace headers
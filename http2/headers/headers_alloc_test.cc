@@ -0,0 +1,39 @@
+// Allocation counts of changes to an indexed Headers.  Once its vectors have
+// grown to fit, adding, replacing and removing headers with short names and
+// values should not allocate at all, sweeps included.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http2/headers/headers.h"
+#include "http2/testing/alloc_counter.h"
+
+using http2::headers::Headers;
+using http2::testing::AllocationCounter;
+
+TEST(Allocations, IndexedChurn) {
+  std::vector<std::string> names;
+  for (int i = 0; i < 32; ++i) names.push_back("x-" + std::to_string(i));
+  Headers headers;
+  for (const std::string& name : names) headers.add(name, "v");
+
+  // Every other round sweeps the tombstones out.
+  auto churn = [&headers, &names] {
+    for (std::size_t i = 0; i < names.size(); i += 2) {
+      headers.remove(names[i]);
+    }
+    for (std::size_t i = 0; i < names.size(); i += 2) {
+      headers.add(names[i], "w");
+    }
+    headers.replace(names[1], "r");
+  };
+  for (int i = 0; i < 4; ++i) churn();
+
+  AllocationCounter counter;
+  for (int i = 0; i < 10; ++i) churn();
+  EXPECT_EQ(counter.count(), 0);
+  EXPECT_EQ(headers.all().size(), names.size());
+  EXPECT_EQ(headers.first(names[1]).second, "r");
+}
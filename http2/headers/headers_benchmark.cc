@@ -0,0 +1,82 @@
+// Microbenchmarks of Headers lookups and edits, on a typical request.
+//
+// Usage: headers_benchmark [--benchmark_filter=REGEX]
+//                          [--benchmark_format=json] [--benchmark_out=FILE]
+
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "http2/headers/headers.h"
+
+using http2::headers::Headers;
+
+namespace {
+
+Headers request() {
+  Headers h;
+  h.add(":method", "GET");
+  h.add(":scheme", "https");
+  h.add(":authority", "www.example.com");
+  h.add(":path", "/index.html");
+  h.add("user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:109.0)");
+  h.add("accept", "text/html,application/xhtml+xml");
+  h.add("accept-language", "en-US,en;q=0.5");
+  h.add("accept-encoding", "gzip, deflate, br");
+  h.add("cookie", "a=1");
+  h.add("cookie", "b=2");
+  h.add("cookie", "c=3");
+  h.add("upgrade-insecure-requests", "1");
+  h.add("sec-fetch-dest", "document");
+  h.add("sec-fetch-mode", "navigate");
+  h.add("te", "trailers");
+  return h;
+}
+
+// BM_First looks up a pseudo-header near the front, a header near the
+// back, and one that is missing.
+void BM_First(benchmark::State& state, const char* name) {
+  Headers h = request();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(h.first(name));
+  }
+}
+BENCHMARK_CAPTURE(BM_First, front, ":method");
+BENCHMARK_CAPTURE(BM_First, back, "te");
+BENCHMARK_CAPTURE(BM_First, missing, "authorization");
+
+void BM_Last(benchmark::State& state) {
+  Headers h = request();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(h.last("cookie"));
+  }
+}
+BENCHMARK(BM_Last);
+
+void BM_Every(benchmark::State& state) {
+  Headers h = request();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(h.every("cookie"));
+  }
+}
+BENCHMARK(BM_Every);
+
+void BM_Replace(benchmark::State& state) {
+  Headers h = request();
+  for (auto _ : state) {
+    h.replace("accept-encoding", "identity");
+    benchmark::DoNotOptimize(h.all().size());
+  }
+}
+BENCHMARK(BM_Replace);
+
+void BM_Build(benchmark::State& state) {
+  for (auto _ : state) {
+    Headers h = request();
+    benchmark::DoNotOptimize(h.all().size());
+  }
+}
+BENCHMARK(BM_Build);
+
+}  // anonymous namespace
+
+BENCHMARK_MAIN();
@@ -141,3 +141,156 @@ TEST(Headers, Size) {
   headers.replace("abcd", "e");
   EXPECT_EQ(headers.size(), 77);
 }
+
+TEST(Headers, Every) {
+  Headers headers = dummy_request();
+  headers.add("cookie", "a=b");
+  headers.add("cache-control", "private");
+
+  std::vector<std::string> values;
+  for (const std::string& value : headers.every("cache-control")) {
+    values.push_back(value);
+  }
+  EXPECT_EQ(values, (std::vector<std::string>{"max-age=60", "max-stale=3600",
+                                              "private"}));
+  EXPECT_TRUE(headers.every("x-missing").empty());
+  EXPECT_EQ(headers.every("x-missing").begin(),
+            headers.every("x-missing").end());
+
+  // The range does not depend on the caller's copy of the name.
+  auto cookies = headers.every(std::string("coo") + "kie");
+  EXPECT_EQ(*cookies.begin(), "a=b");
+}
+
+// The same operations, on a list long enough to be indexed.
+TEST(Headers, Indexed) {
+  Headers headers = dummy_request();
+  for (int i = 0; i < 20; ++i) {
+    headers.add("x-" + std::to_string(i % 5), std::to_string(i));
+  }
+  std::string_view name = "x-3";
+  EXPECT_EQ(headers.first(name).second, "3");
+  EXPECT_EQ(headers.last(name).second, "18");
+  EXPECT_EQ(headers.every(name).size(), 4);
+  EXPECT_EQ(headers.every(name).at(2), "13");
+
+  // Changes after the index is built keep it up to date.
+  headers.add("x-3", "20");
+  EXPECT_EQ(headers.last("x-3").second, "20");
+  EXPECT_EQ(headers.every("x-3").size(), 5);
+  headers.replace("x-3", "only");
+  EXPECT_EQ(headers.every("x-3").size(), 1);
+  EXPECT_EQ(headers.last("x-3").second, "only");
+  headers.remove("x-1");
+  EXPECT_FALSE(headers.first("x-1").first);
+  // The headers around the removed ones are still found where they moved.
+  std::vector<std::string> values(headers.every("x-2").begin(),
+                                  headers.every("x-2").end());
+  EXPECT_EQ(values, (std::vector<std::string>{"2", "7", "12", "17"}));
+  EXPECT_EQ(headers.last("x-4").second, "19");
+  EXPECT_EQ(headers.first("x-0").second, "0");
+  headers.add("x-1", "back");
+  EXPECT_EQ(headers.every("x-1").size(), 1);
+  EXPECT_EQ(headers.first("x-1").second, "back");
+
+  // Order is kept: the replaced header stays where the first x-3 was, and
+  // the re-added x-1 goes last.
+  auto names = header_names(headers);
+  EXPECT_EQ(names.size(), 6 + 20 + 1 - 4 - 4 + 1);
+  EXPECT_EQ(names.at(6), "x-0");
+  EXPECT_EQ(names.at(7), "x-2");
+  EXPECT_EQ(names.at(8), "x-3");
+  EXPECT_EQ(names.back(), "x-1");
+  EXPECT_EQ(headers.first("x-3").second, "only");
+}
+
+// A copy has an index of its own.
+TEST(Headers, Copy) {
+  // A short list carries no index, only a pointer to one.
+  EXPECT_EQ(sizeof(Headers), sizeof(std::vector<Header>) + sizeof(void*));
+
+  Headers headers;
+  for (int i = 0; i < 20; ++i) {
+    headers.add("x-" + std::to_string(i % 5), std::to_string(i));
+  }
+  Headers copy = headers;
+  copy.remove("x-1");
+  copy.add("x-2", "20");
+  EXPECT_EQ(headers.every("x-1").size(), 4);
+  EXPECT_EQ(headers.last("x-2").second, "17");
+  EXPECT_FALSE(copy.first("x-1").first);
+  EXPECT_EQ(copy.last("x-2").second, "20");
+
+  copy = headers;
+  EXPECT_EQ(copy.all(), headers.all());
+  EXPECT_EQ(copy.every("x-1").at(3), "16");
+}
+
+// Many removals from an indexed list leave the survivors in order, and the
+// index in step with them.
+TEST(Headers, RemoveMany) {
+  Headers headers;
+  for (int i = 0; i < 100; ++i) {
+    headers.add("x-" + std::to_string(i), std::to_string(i));
+  }
+  for (int i = 0; i < 100; i += 3) headers.remove("x-" + std::to_string(i));
+  EXPECT_EQ(headers.first("x-0").first, false);
+  EXPECT_EQ(headers.first("x-1").second, "1");
+  std::size_t live = 0;
+  for (int i = 0; i < 100; ++i) live += (i % 3 != 0);
+  std::size_t bytes = 0;
+  for (const auto& h : headers.all()) bytes += h.size();
+  EXPECT_EQ(headers.size(), bytes);
+
+  auto names = header_names(headers);
+  ASSERT_EQ(names.size(), live);
+  EXPECT_EQ(names.at(0), "x-1");
+  EXPECT_EQ(names.at(1), "x-2");
+  EXPECT_EQ(names.at(2), "x-4");
+  EXPECT_EQ(names.back(), "x-98");
+  for (std::size_t i = 0; i < names.size(); ++i) {
+    EXPECT_EQ(headers.first(names[i]).second, names[i].substr(2));
+  }
+}
+
+// Removals from an indexed list leave tombstones, which all(), every() and
+// size() skip, until they outnumber the live headers and are swept out.
+TEST(Headers, Tombstones) {
+  Headers headers;
+  for (int i = 0; i < 40; ++i) {
+    headers.add("x-" + std::to_string(i % 10), std::to_string(i));
+  }
+  headers.remove("x-0");
+  headers.replace("x-1", "one");
+  EXPECT_EQ(headers.all().size(), 33);
+  std::vector<std::string> values(headers.every("x-2").begin(),
+                                  headers.every("x-2").end());
+  EXPECT_EQ(values, (std::vector<std::string>{"2", "12", "22", "32"}));
+  headers.add("x-0", "back");
+  EXPECT_EQ(headers.every("x-0").size(), 1);
+  EXPECT_EQ(headers.first("x-0").second, "back");
+
+  // The fourth of these sweeps the tombstones out.
+  for (int i = 2; i < 7; ++i) headers.remove("x-" + std::to_string(i));
+  EXPECT_FALSE(headers.first("x-5").first);
+  EXPECT_EQ(headers.first("x-1").second, "one");
+  EXPECT_EQ(headers.every("x-1").size(), 1);
+  values.assign(headers.every("x-8").begin(), headers.every("x-8").end());
+  EXPECT_EQ(values, (std::vector<std::string>{"8", "18", "28", "38"}));
+  EXPECT_EQ(headers.last("x-9").second, "39");
+
+  auto names = header_names(headers);
+  ASSERT_EQ(names.size(), 14);
+  EXPECT_EQ(names.at(0), "x-1");
+  EXPECT_EQ(names.at(1), "x-7");
+  EXPECT_EQ(names.at(12), "x-9");
+  EXPECT_EQ(names.back(), "x-0");
+  std::size_t bytes = 0;
+  for (const auto& h : headers.all()) bytes += h.size();
+  EXPECT_EQ(headers.size(), bytes);
+
+  // A name swept out of the index can come back.
+  headers.add("x-5", "new");
+  EXPECT_EQ(headers.first("x-5").second, "new");
+  EXPECT_EQ(headers.last("x-0").second, "back");
+}
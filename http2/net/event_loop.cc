@@ -0,0 +1,117 @@
+#include "http2/net/event_loop.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+
+static constexpr int kMaxEventsPerBatch = 256;
+
+namespace http2 {
+namespace net {
+
+EventLoop::EventLoop() : epfd_(-1), wakefd_(-1), stopping_(false) {
+  epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  if (epfd_ < 0) {
+    throw std::system_error(errno, std::generic_category(), "epoll_create1");
+  }
+  wakefd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wakefd_ < 0) {
+    int err = errno;
+    ::close(epfd_);
+    throw std::system_error(err, std::generic_category(), "eventfd");
+  }
+  epoll_event ev;
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = wakefd_;
+  if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, wakefd_, &ev) != 0) {
+    int err = errno;
+    ::close(wakefd_);
+    ::close(epfd_);
+    throw std::system_error(err, std::generic_category(), "epoll_ctl");
+  }
+}
+
+EventLoop::~EventLoop() {
+  ::close(wakefd_);
+  ::close(epfd_);
+}
+
+void EventLoop::add(int fd, uint32_t events, Handler* handler) {
+  epoll_event ev;
+  ev.events = events | EPOLLET;
+  ev.data.fd = fd;
+  if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+  }
+  if (std::size_t(fd) >= handlers_.size()) handlers_.resize(fd + 1, nullptr);
+  handlers_[fd] = handler;
+}
+
+void EventLoop::modify(int fd, uint32_t events, Handler* handler) {
+  epoll_event ev;
+  ev.events = events | EPOLLET;
+  ev.data.fd = fd;
+  if (::epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) != 0) {
+    throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+  }
+  handlers_[fd] = handler;
+}
+
+void EventLoop::remove(int fd) {
+  ::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+  if (std::size_t(fd) < handlers_.size()) handlers_[fd] = nullptr;
+}
+
+void EventLoop::run() {
+  while (!stopping()) {
+    run_once(-1);
+  }
+}
+
+void EventLoop::run_once(int timeout_ms) {
+  int timer_ms = timers_.timeout_ms();
+  if (timer_ms >= 0 && (timeout_ms < 0 || timer_ms < timeout_ms)) {
+    timeout_ms = timer_ms;
+  }
+  epoll_event events[kMaxEventsPerBatch];
+  int n = ::epoll_wait(epfd_, events, kMaxEventsPerBatch, timeout_ms);
+  if (n < 0) {
+    if (errno == EINTR) return;
+    throw std::system_error(errno, std::generic_category(), "epoll_wait");
+  }
+  timers_.advance(TimerWheel::clock_ms());
+  for (int i = 0; i < n; ++i) {
+    int fd = events[i].data.fd;
+    if (fd == wakefd_) {
+      drain_wakeup();
+      continue;
+    }
+    // Look the handler up afresh for every event: an earlier handler in this
+    // batch may have removed (and even deleted) it.
+    Handler* handler = handlers_[fd];
+    if (handler != nullptr) handler->on_events(events[i].events);
+  }
+}
+
+void EventLoop::stop() {
+  stopping_.store(true, std::memory_order_release);
+  wake();
+}
+
+void EventLoop::wake() {
+  uint64_t one = 1;
+  ssize_t n = ::write(wakefd_, &one, sizeof(one));
+  (void)n;
+}
+
+void EventLoop::drain_wakeup() {
+  uint64_t value;
+  while (::read(wakefd_, &value, sizeof(value)) > 0) {
+  }
+}
+
+}  // namespace net
+}  // namespace http2
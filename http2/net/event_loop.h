@@ -0,0 +1,94 @@
+// Tools for running a single-threaded, edge-triggered epoll event loop.
+
+#ifndef HTTP2_NET_EVENT_LOOP_H
+#define HTTP2_NET_EVENT_LOOP_H
+
+#include <cstdint>
+
+#include <atomic>
+#include <vector>
+
+#include "http2/net/timer_wheel.h"
+
+namespace http2 {
+namespace net {
+
+// EventLoop multiplexes readiness events for many file descriptors onto the
+// thread that calls run().  All file descriptors are registered in
+// edge-triggered mode, so a Handler must drain its file descriptor (read or
+// write until EAGAIN) every time it is notified.
+//
+// The loop also runs a TimerWheel: waits are cut short for its deadlines,
+// and each batch of events is dispatched right after the wheel has been
+// advanced to the current time, so that timers armed by the handlers are
+// measured from when the events arrived.
+//
+// Except for stop(), an EventLoop must only be used from its own thread.
+class EventLoop final {
+ public:
+  // Handler receives the readiness events for one registered descriptor.
+  class Handler {
+   public:
+    virtual ~Handler() = default;
+
+    // on_events is called with the EPOLL* bits that became ready.
+    virtual void on_events(uint32_t events) = 0;
+  };
+
+  // THROWS std::system_error if the epoll instance cannot be created.
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  // add registers fd for the given events (EPOLLET is implied).
+  //
+  // THROWS std::system_error on failure.
+  void add(int fd, uint32_t events, Handler* handler);
+
+  // modify changes the events of interest for an already-registered fd.
+  //
+  // THROWS std::system_error on failure.
+  void modify(int fd, uint32_t events, Handler* handler);
+
+  // remove unregisters fd.  Pending events for fd that were already returned
+  // by the kernel in the current batch are discarded, so a Handler may delete
+  // itself from inside on_events().
+  void remove(int fd);
+
+  // run dispatches events until stop() is called.
+  void run();
+
+  // run_once waits at most timeout_ms milliseconds (-1 for no limit), or
+  // until the next timer is due, then expires the timers that are due and
+  // dispatches a single batch of events.
+  void run_once(int timeout_ms);
+
+  // timers returns the loop's TimerWheel.
+  TimerWheel& timers() { return timers_; }
+
+  // stop asks run() to return.  Safe to call from any thread.
+  void stop();
+
+  // wake makes the current or next wait of run_once return early.  Safe to
+  // call from any thread.
+  void wake();
+
+  // stopping returns true iff stop() has been called.
+  bool stopping() const { return stopping_.load(std::memory_order_acquire); }
+
+ private:
+  void drain_wakeup();
+
+  int epfd_;
+  int wakefd_;
+  std::atomic<bool> stopping_;
+  std::vector<Handler*> handlers_;  // indexed by fd
+  TimerWheel timers_;
+};
+
+}  // namespace net
+}  // namespace http2
+
+#endif  // HTTP2_NET_EVENT_LOOP_H
@@ -0,0 +1,74 @@
+#include "http2/net/mailbox.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+namespace http2 {
+namespace net {
+
+Mailbox::Mailbox()
+    : fd_(-1), armed_(true), head_(&stub_), tail_(&stub_) {
+  fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(), "eventfd");
+  }
+}
+
+Mailbox::~Mailbox() {
+  while (Message* message = pop()) delete message;
+  ::close(fd_);
+}
+
+void Mailbox::post(Message* message) {
+  push(message);
+  // Whoever clears armed_ owes the owner a wakeup.  The owner re-arms before
+  // it pops, so a message it might miss is always followed by a write.
+  if (armed_.exchange(false, std::memory_order_acq_rel)) {
+    uint64_t one = 1;
+    ssize_t n = ::write(fd_, &one, sizeof(one));
+    (void)n;
+  }
+}
+
+void Mailbox::rearm() {
+  uint64_t value;
+  ssize_t n = ::read(fd_, &value, sizeof(value));
+  (void)n;
+  armed_.exchange(true, std::memory_order_acq_rel);
+}
+
+void Mailbox::push(Message* message) {
+  message->next_.store(nullptr, std::memory_order_relaxed);
+  Message* prev = head_.exchange(message, std::memory_order_acq_rel);
+  prev->next_.store(message, std::memory_order_release);
+}
+
+Mailbox::Message* Mailbox::pop() {
+  Message* tail = tail_;
+  Message* next = tail->next_.load(std::memory_order_acquire);
+  if (tail == &stub_) {
+    if (next == nullptr) return nullptr;
+    tail_ = next;
+    tail = next;
+    next = next->next_.load(std::memory_order_acquire);
+  }
+  if (next != nullptr) {
+    tail_ = next;
+    return tail;
+  }
+  // tail is the last message, unless a post is halfway through linking
+  // another one in; that post will wake us again.
+  if (tail != head_.load(std::memory_order_acquire)) return nullptr;
+  push(&stub_);
+  next = tail->next_.load(std::memory_order_acquire);
+  if (next == nullptr) return nullptr;
+  tail_ = next;
+  return tail;
+}
+
+}  // namespace net
+}  // namespace http2
@@ -0,0 +1,79 @@
+// Tools for handing messages to an event loop from other threads.
+
+#ifndef HTTP2_NET_MAILBOX_H
+#define HTTP2_NET_MAILBOX_H
+
+#include <cstddef>
+
+#include <atomic>
+
+namespace http2 {
+namespace net {
+
+// Mailbox carries messages from any number of threads to the one thread that
+// owns an event loop.  Posting never takes a lock: messages are linked into
+// an intrusive multi-producer, single-consumer queue (Vyukov's), and the
+// eventfd behind fd() is only written when the owner may have gone to sleep,
+// so a burst of posts costs a single wakeup.
+//
+// The owner watches fd() for readability (with epoll, or with an io_uring
+// read) and then calls drain.
+class Mailbox final {
+ public:
+  // Message is the base class of everything posted to a Mailbox.
+  class Message {
+   public:
+    Message() : next_(nullptr) {}
+    virtual ~Message() = default;
+
+   private:
+    friend class Mailbox;
+    std::atomic<Message*> next_;
+  };
+
+  // THROWS std::system_error if the eventfd cannot be created.
+  Mailbox();
+
+  // Deletes the messages that were never drained.
+  ~Mailbox();
+
+  Mailbox(const Mailbox&) = delete;
+  Mailbox& operator=(const Mailbox&) = delete;
+
+  // fd is a non-blocking eventfd that becomes readable after a post.
+  int fd() const { return fd_; }
+
+  // post hands message, and ownership of it, to the owning thread.  Safe to
+  // call from any thread.
+  void post(Message* message);
+
+  // drain passes each message posted so far to fn, which takes ownership of
+  // it, and returns the number of messages.  Only call it from the owning
+  // thread.
+  template <typename F>
+  std::size_t drain(F fn) {
+    rearm();
+    std::size_t n = 0;
+    while (Message* message = pop()) {
+      fn(message);
+      ++n;
+    }
+    return n;
+  }
+
+ private:
+  void push(Message* message);
+  Message* pop();
+  void rearm();
+
+  int fd_;
+  std::atomic<bool> armed_;     // true if the next post must write fd_
+  std::atomic<Message*> head_;  // the last message pushed
+  Message* tail_;               // the next message to pop (owner only)
+  Message stub_;
+};
+
+}  // namespace net
+}  // namespace http2
+
+#endif  // HTTP2_NET_MAILBOX_H
@@ -0,0 +1,88 @@
+#include "http2/net/mailbox.h"
+
+#include <poll.h>
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using http2::net::Mailbox;
+
+namespace {
+
+struct Note final : public Mailbox::Message {
+  Note(int sender, int seq, int* live) : sender(sender), seq(seq), live(live) {
+    if (live != nullptr) ++*live;
+  }
+  ~Note() override {
+    if (live != nullptr) --*live;
+  }
+
+  int sender;
+  int seq;
+  int* live;
+};
+
+bool readable(int fd, int timeout_ms) {
+  pollfd pfd = {fd, POLLIN, 0};
+  return ::poll(&pfd, 1, timeout_ms) == 1;
+}
+
+}  // namespace
+
+TEST(Mailbox, Order) {
+  int live = 0;
+  Mailbox mailbox;
+  EXPECT_FALSE(readable(mailbox.fd(), 0));
+  for (int i = 0; i < 3; ++i) mailbox.post(new Note(0, i, &live));
+  EXPECT_TRUE(readable(mailbox.fd(), 0));
+
+  std::vector<int> seen;
+  std::size_t n = mailbox.drain([&seen](Mailbox::Message* m) {
+    Note* note = static_cast<Note*>(m);
+    seen.push_back(note->seq);
+    delete note;
+  });
+  EXPECT_EQ(n, 3);
+  EXPECT_EQ(seen, std::vector<int>({0, 1, 2}));
+  EXPECT_FALSE(readable(mailbox.fd(), 0));
+
+  // Undelivered messages are deleted with the mailbox.
+  {
+    Mailbox other;
+    other.post(new Note(0, 0, &live));
+    EXPECT_EQ(live, 1);
+  }
+  EXPECT_EQ(live, 0);
+}
+
+TEST(Mailbox, Producers) {
+  constexpr int kThreads = 4;
+  constexpr int kPerThread = 10000;
+  Mailbox mailbox;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&mailbox, t] {
+      for (int i = 0; i < kPerThread; ++i) {
+        mailbox.post(new Note(t, i, nullptr));
+      }
+    });
+  }
+
+  // Each producer's messages arrive in order, and none are lost.
+  std::vector<int> next(kThreads, 0);
+  int total = 0;
+  while (total < kThreads * kPerThread) {
+    ASSERT_TRUE(readable(mailbox.fd(), 10000));
+    mailbox.drain([&](Mailbox::Message* m) {
+      Note* note = static_cast<Note*>(m);
+      EXPECT_EQ(note->seq, next[note->sender]);
+      next[note->sender] = note->seq + 1;
+      ++total;
+      delete note;
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(mailbox.drain([](Mailbox::Message*) {}), 0);
+}
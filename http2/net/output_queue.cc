@@ -0,0 +1,122 @@
+#include "http2/net/output_queue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace http2 {
+namespace net {
+
+OutputQueue::OutputQueue() : head_(0), memory_size_(0), chunk_used_(0) {}
+
+void OutputQueue::append(const uint8_t* p, std::size_t n) {
+  memory_size_ += n;
+  while (n > 0) {
+    if (!chunk_ || chunk_used_ == kChunkSize) {
+      chunk_.reset(new uint8_t[kChunkSize]);
+      chunk_used_ = 0;
+    }
+    std::size_t k = std::min(n, kChunkSize - chunk_used_);
+    uint8_t* dst = chunk_.get() + chunk_used_;
+    std::memcpy(dst, p, k);
+    chunk_used_ += k;
+    p += k;
+    n -= k;
+
+    // Bytes that follow on from the last slice just make it longer.
+    if (!empty()) {
+      Slice& last = slices_.back();
+      if (last.data != nullptr && last.data + last.length == dst &&
+          last.owner.get() == chunk_.get()) {
+        last.length += k;
+        continue;
+      }
+    }
+    slices_.push_back(Slice{std::shared_ptr<const void>(chunk_, chunk_.get()),
+                            dst, k, -1, 0});
+  }
+}
+
+void OutputQueue::append_shared(std::shared_ptr<const void> owner,
+                                const uint8_t* p, std::size_t n) {
+  if (n <= kCopyLimit) return append(p, n);
+  memory_size_ += n;
+  slices_.push_back(Slice{std::move(owner), p, n, -1, 0});
+}
+
+void OutputQueue::append_file(std::shared_ptr<const void> owner, int fd,
+                              uint64_t offset, std::size_t n) {
+  if (n == 0) return;
+  slices_.push_back(Slice{std::move(owner), nullptr, n, fd, offset});
+}
+
+const uint8_t* OutputQueue::front(std::size_t* n) const {
+  if (empty() || slices_[head_].data == nullptr) {
+    *n = 0;
+    return nullptr;
+  }
+  *n = slices_[head_].length;
+  return slices_[head_].data;
+}
+
+std::size_t OutputQueue::gather(iovec* iov, std::size_t max,
+                                std::size_t* bytes) const {
+  std::size_t count = 0;
+  *bytes = 0;
+  for (std::size_t i = head_; i < slices_.size(); ++i) {
+    const Slice& slice = slices_[i];
+    if (count == max || slice.data == nullptr) break;
+    iov[count].iov_base = const_cast<uint8_t*>(slice.data);
+    iov[count].iov_len = slice.length;
+    *bytes += slice.length;
+    ++count;
+  }
+  return count;
+}
+
+bool OutputQueue::front_file(int* fd, uint64_t* offset,
+                             std::size_t* length) const {
+  if (empty() || slices_[head_].data != nullptr) return false;
+  const Slice& slice = slices_[head_];
+  *fd = slice.fd;
+  *offset = slice.offset;
+  *length = slice.length;
+  return true;
+}
+
+void OutputQueue::consume(std::size_t n) {
+  while (n > 0) {
+    Slice& slice = slices_[head_];
+    std::size_t k = std::min(n, slice.length);
+    if (slice.data != nullptr) {
+      slice.data += k;
+      memory_size_ -= k;
+    } else {
+      slice.offset += k;
+    }
+    slice.length -= k;
+    n -= k;
+    if (slice.length == 0) {
+      slice.owner.reset();
+      ++head_;
+    }
+  }
+  if (empty()) {
+    // Idle connections far outnumber busy ones; they hold nothing.
+    std::vector<Slice>().swap(slices_);
+    head_ = 0;
+    chunk_.reset();
+    chunk_used_ = 0;
+  } else if (head_ >= 16 && head_ * 2 >= slices_.size()) {
+    // Reclaim the consumed prefix once it makes up half of the vector.
+    slices_.erase(slices_.begin(), slices_.begin() + head_);
+    head_ = 0;
+  }
+}
+
+std::size_t OutputQueue::footprint() const {
+  return slices_.capacity() * sizeof(Slice) + (chunk_ ? kChunkSize : 0);
+}
+
+}  // namespace net
+}  // namespace http2
@@ -0,0 +1,115 @@
+// A queue of bytes waiting to be written to a socket, kept as a rope.
+
+#ifndef HTTP2_NET_OUTPUT_QUEUE_H
+#define HTTP2_NET_OUTPUT_QUEUE_H
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory>
+#include <vector>
+
+namespace http2 {
+namespace net {
+
+// OutputQueue holds the pending output of one connection as a sequence of
+// slices, each of which is a range of a refcounted buffer or a range of a
+// file.  Large payloads (response bodies, files) are queued by reference,
+// without being copied; small pieces (frame headers, control frames, HPACK
+// blocks) are copied into chunks owned by the queue, so that a run of small
+// frames still goes out as a single iovec.
+//
+// A writer gathers the in-memory slices at the front of the queue into an
+// iovec array for one sendmsg(2), and writes a file slice with sendfile(2)
+// once it reaches the front.  Each slice is released as soon as the last of
+// its bytes has been consumed, so a partial write frees what it completed.
+//
+// The bytes of a slice stay where they are until it is consumed, even as
+// more slices are appended, so the iovecs from gather may be handed to the
+// kernel asynchronously.
+//
+// It is not thread-safe.
+class OutputQueue final {
+ public:
+  // Shared ranges no longer than this are copied instead: below it, another
+  // iovec costs more than the copy saves.
+  static constexpr std::size_t kCopyLimit = 1024;
+
+  // The size of the chunks that small appends are copied into.  A drained
+  // queue frees its chunk, so that idle connections hold none.
+  static constexpr std::size_t kChunkSize = 4096;
+
+  OutputQueue();
+
+  OutputQueue(const OutputQueue&) = delete;
+  OutputQueue& operator=(const OutputQueue&) = delete;
+
+  // append copies n bytes to the end of the queue.
+  void append(const uint8_t* p, std::size_t n);
+
+  // append_shared queues the n bytes at p, which must stay valid for as long
+  // as owner is alive, without copying them.
+  void append_shared(std::shared_ptr<const void> owner, const uint8_t* p,
+                     std::size_t n);
+
+  // append_file queues n bytes of the file fd, starting at offset.  owner
+  // must keep fd open.
+  void append_file(std::shared_ptr<const void> owner, int fd, uint64_t offset,
+                   std::size_t n);
+
+  // empty returns true iff nothing is queued, in memory or not.
+  bool empty() const { return head_ == slices_.size(); }
+
+  // memory_size returns the number of bytes queued in memory, whether
+  // copied or shared.  File ranges are not included.
+  std::size_t memory_size() const { return memory_size_; }
+
+  // front returns the contiguous bytes at the front of the queue, and stores
+  // their length in *n; *n is 0 if the queue is empty or a file range is
+  // next.
+  const uint8_t* front(std::size_t* n) const;
+
+  // gather fills in up to max iovecs with the in-memory bytes at the front
+  // of the queue, stopping short of the first file range.  Returns the
+  // number filled in, and stores their total length in *bytes.
+  std::size_t gather(iovec* iov, std::size_t max, std::size_t* bytes) const;
+
+  // front_file returns true iff a file range is at the front of the queue,
+  // and stores it in *fd, *offset and *length.
+  bool front_file(int* fd, uint64_t* offset, std::size_t* length) const;
+
+  // consume discards the first n bytes of the queue, after they have been
+  // written.  n must not run past the in-memory bytes into a file range,
+  // unless the file range is at the front.
+  void consume(std::size_t n);
+
+  // footprint returns the heap bytes held by the queue itself: its chunk and
+  // its list of slices, but not shared ranges.  It is 0 once drained.
+  std::size_t footprint() const;
+
+ private:
+  struct Slice {
+    std::shared_ptr<const void> owner;
+    const uint8_t* data;  // null for a file range
+    std::size_t length;
+    int fd;
+    uint64_t offset;
+  };
+
+  // The slices from head_ on are queued.  Unlike a std::deque, the vector
+  // allocates nothing while empty.
+  std::vector<Slice> slices_;
+  std::size_t head_;
+  std::size_t memory_size_;
+
+  // The chunk that small appends go to, and how much of it is used.
+  std::shared_ptr<uint8_t[]> chunk_;
+  std::size_t chunk_used_;
+};
+
+}  // namespace net
+}  // namespace http2
+
+#endif  // HTTP2_NET_OUTPUT_QUEUE_H
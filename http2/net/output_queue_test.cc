@@ -0,0 +1,161 @@
+#include "http2/net/output_queue.h"
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using http2::net::OutputQueue;
+
+namespace {
+
+std::string gathered(const OutputQueue& q) {
+  iovec iov[64];
+  std::size_t bytes;
+  std::size_t n = q.gather(iov, 64, &bytes);
+  std::string out;
+  for (std::size_t i = 0; i < n; ++i) {
+    out.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+  }
+  EXPECT_EQ(out.size(), bytes);
+  return out;
+}
+
+void append(OutputQueue& q, const std::string& s) {
+  q.append(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+}
+
+}  // anonymous namespace
+
+TEST(OutputQueue, SmallAppendsCoalesce) {
+  OutputQueue q;
+  append(q, "abc");
+  append(q, "def");
+  append(q, "ghi");
+  iovec iov[4];
+  std::size_t bytes;
+  EXPECT_EQ(q.gather(iov, 4, &bytes), 1u);
+  EXPECT_EQ(bytes, 9u);
+  EXPECT_EQ(q.memory_size(), 9u);
+  EXPECT_EQ(gathered(q), "abcdefghi");
+}
+
+TEST(OutputQueue, SharedRangesAreNotCopied) {
+  OutputQueue q;
+  auto body = std::make_shared<std::vector<uint8_t>>(5000, 'x');
+  append(q, "head");
+  q.append_shared(body, body->data(), body->size());
+  append(q, "tail");
+
+  iovec iov[4];
+  std::size_t bytes;
+  ASSERT_EQ(q.gather(iov, 4, &bytes), 3u);
+  EXPECT_EQ(iov[1].iov_base, body->data());
+  EXPECT_EQ(bytes, 5008u);
+
+  // A shared range is only held until it has been written.
+  std::weak_ptr<std::vector<uint8_t>> weak = body;
+  body.reset();
+  q.consume(4 + 4999);
+  EXPECT_FALSE(weak.expired());
+  q.consume(1);
+  EXPECT_TRUE(weak.expired());
+  EXPECT_EQ(gathered(q), "tail");
+}
+
+TEST(OutputQueue, SmallSharedRangesAreCopied) {
+  OutputQueue q;
+  auto body = std::make_shared<std::vector<uint8_t>>(10, 'x');
+  append(q, "head");
+  q.append_shared(body, body->data(), body->size());
+  std::weak_ptr<std::vector<uint8_t>> weak = body;
+  body.reset();
+  EXPECT_TRUE(weak.expired());
+  EXPECT_EQ(gathered(q), "headxxxxxxxxxx");
+}
+
+TEST(OutputQueue, PartialWrites) {
+  OutputQueue q;
+  std::string big(3 * OutputQueue::kChunkSize + 100, 'a');
+  for (std::size_t i = 0; i < big.size(); ++i) big[i] = char('a' + i % 26);
+  append(q, big);
+  std::string out;
+  while (!q.empty()) {
+    std::size_t n;
+    const uint8_t* p = q.front(&n);
+    ASSERT_GT(n, 0u);
+    n = std::min<std::size_t>(n, 1000);
+    out.append(reinterpret_cast<const char*>(p), n);
+    q.consume(n);
+  }
+  EXPECT_EQ(out, big);
+  EXPECT_EQ(q.memory_size(), 0u);
+}
+
+TEST(OutputQueue, FileRanges) {
+  OutputQueue q;
+  auto owner = std::make_shared<int>(0);
+  append(q, "header");
+  q.append_file(owner, 7, 100, 50);
+  append(q, "next");
+
+  int fd;
+  uint64_t offset;
+  std::size_t length;
+  EXPECT_FALSE(q.front_file(&fd, &offset, &length));
+  EXPECT_EQ(gathered(q), "header");  // gather stops at the file
+  EXPECT_EQ(q.memory_size(), 10u);
+  q.consume(6);
+
+  std::size_t n;
+  EXPECT_EQ(q.front(&n), nullptr);
+  EXPECT_EQ(n, 0u);
+  ASSERT_TRUE(q.front_file(&fd, &offset, &length));
+  EXPECT_EQ(fd, 7);
+  EXPECT_EQ(offset, 100u);
+  EXPECT_EQ(length, 50u);
+  q.consume(20);
+  ASSERT_TRUE(q.front_file(&fd, &offset, &length));
+  EXPECT_EQ(offset, 120u);
+  EXPECT_EQ(length, 30u);
+  q.consume(30);
+  EXPECT_EQ(owner.use_count(), 1);
+  EXPECT_EQ(gathered(q), "next");
+}
+
+TEST(OutputQueue, GatherLimit) {
+  OutputQueue q;
+  auto body = std::make_shared<std::vector<uint8_t>>(2000, 'x');
+  for (int i = 0; i < 10; ++i) {
+    append(q, "h");
+    q.append_shared(body, body->data(), body->size());
+  }
+  iovec iov[4];
+  std::size_t bytes;
+  EXPECT_EQ(q.gather(iov, 4, &bytes), 4u);
+  EXPECT_EQ(bytes, 4002u);
+}
+
+// Idle connections keep an empty queue, which must hold no memory.
+TEST(OutputQueue, DrainedQueueHoldsNothing) {
+  OutputQueue q;
+  EXPECT_EQ(q.footprint(), 0);
+  append(q, "abc");
+  append(q, std::string(5000, 'x'));
+  EXPECT_GT(q.footprint(), OutputQueue::kChunkSize);
+  q.consume(2000);
+  EXPECT_FALSE(q.empty());
+  q.consume(3003);
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(q.footprint(), 0);
+
+  // It is still usable afterwards.
+  append(q, "def");
+  EXPECT_EQ(gathered(q), "def");
+  q.consume(3);
+  EXPECT_EQ(q.footprint(), 0);
+}
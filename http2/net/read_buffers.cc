@@ -0,0 +1,55 @@
+#include "http2/net/read_buffers.h"
+
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <system_error>
+
+static constexpr std::size_t kSlabSize = std::size_t(2) << 20;
+
+namespace http2 {
+namespace net {
+
+ReadBufferPool::ReadBufferPool(std::size_t buffer_size, bool hugepages)
+    : buffer_size_(buffer_size),
+      slab_size_(kSlabSize),
+      hugepages_(hugepages),
+      in_use_(0) {
+  // Keep buffers cache-line aligned, and slabs a whole number of hugepages.
+  buffer_size_ = (buffer_size_ + 63) & ~std::size_t(63);
+  if (buffer_size_ == 0) buffer_size_ = 64;
+  while (slab_size_ < buffer_size_) slab_size_ += kSlabSize;
+}
+
+ReadBufferPool::~ReadBufferPool() {
+  for (void* slab : slabs_) ::munmap(slab, slab_size_);
+}
+
+void ReadBufferPool::grow() {
+  void* slab = MAP_FAILED;
+  if (hugepages_) {
+    slab = ::mmap(nullptr, slab_size_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+  if (slab == MAP_FAILED) {
+    slab = ::mmap(nullptr, slab_size_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED) {
+      throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+    if (hugepages_) ::madvise(slab, slab_size_, MADV_HUGEPAGE);
+  }
+  slabs_.push_back(slab);
+
+  // Push in reverse, so the front of the slab is handed out (and faulted
+  // in) first.
+  uint8_t* base = static_cast<uint8_t*>(slab);
+  std::size_t n = slab_size_ / buffer_size_;
+  free_.reserve(free_.size() + n);
+  for (std::size_t i = n; i > 0; --i) {
+    free_.push_back(base + (i - 1) * buffer_size_);
+  }
+}
+
+}  // namespace net
+}  // namespace http2
@@ -0,0 +1,74 @@
+// A pool of read buffers that are only held while a read is in progress.
+
+#ifndef HTTP2_NET_READ_BUFFERS_H
+#define HTTP2_NET_READ_BUFFERS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+namespace http2 {
+namespace net {
+
+// ReadBufferPool lends out equally-sized buffers for the duration of a read.
+// An idle connection then holds no read buffer at all: it borrows one when
+// its socket becomes readable and gives it back once the complete frames in
+// it have been consumed.
+//
+// Buffers are carved out of 2 MiB slabs, which may be backed by hugepages.
+// Slabs are mapped lazily, so the pool only ever grows to the number of
+// reads in progress at once, and freed buffers are reused most recently
+// freed first, while they are still in cache.
+//
+// It is not thread-safe; each thread should have its own.
+class ReadBufferPool final {
+ public:
+  // If hugepages is true, slabs are taken from the hugetlb pool when it has
+  // room, and otherwise marked for transparent hugepages.
+  ReadBufferPool(std::size_t buffer_size, bool hugepages);
+  ~ReadBufferPool();
+
+  ReadBufferPool(const ReadBufferPool&) = delete;
+  ReadBufferPool& operator=(const ReadBufferPool&) = delete;
+
+  std::size_t buffer_size() const { return buffer_size_; }
+
+  // in_use returns the number of buffers currently lent out.
+  std::size_t in_use() const { return in_use_; }
+
+  // mapped returns the number of bytes of slabs mapped so far.
+  std::size_t mapped() const { return slabs_.size() * slab_size_; }
+
+  // acquire lends out a buffer of buffer_size() bytes.
+  //
+  // THROWS std::system_error if a new slab cannot be mapped.
+  uint8_t* acquire() {
+    if (free_.empty()) grow();
+    uint8_t* buf = free_.back();
+    free_.pop_back();
+    ++in_use_;
+    return buf;
+  }
+
+  // release returns a buffer obtained from acquire.
+  void release(uint8_t* buf) {
+    free_.push_back(buf);
+    --in_use_;
+  }
+
+ private:
+  void grow();
+
+  std::size_t buffer_size_;
+  std::size_t slab_size_;
+  bool hugepages_;
+  std::size_t in_use_;
+  std::vector<void*> slabs_;
+  std::vector<uint8_t*> free_;
+};
+
+}  // namespace net
+}  // namespace http2
+
+#endif  // HTTP2_NET_READ_BUFFERS_H
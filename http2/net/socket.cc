@@ -0,0 +1,195 @@
+#include "http2/net/socket.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+namespace http2 {
+namespace net {
+
+static void throw_errno(const char* what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+static sockaddr_in make_addr(const std::string& address, uint16_t port) {
+  sockaddr_in sin;
+  ::memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(port);
+  if (::inet_pton(AF_INET, address.c_str(), &sin.sin_addr) != 1) {
+    throw std::system_error(EINVAL, std::generic_category(), address);
+  }
+  return sin;
+}
+
+int listen_tcp(const std::string& address, uint16_t port, bool reuseport,
+               int backlog) {
+  sockaddr_in sin = make_addr(address, port);
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) throw_errno("socket");
+  int one = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (reuseport &&
+      ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "SO_REUSEPORT");
+  }
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&sin), sizeof(sin)) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "bind");
+  }
+  if (::listen(fd, backlog) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "listen");
+  }
+  return fd;
+}
+
+int connect_tcp(const std::string& address, uint16_t port) {
+  sockaddr_in sin = make_addr(address, port);
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) throw_errno("socket");
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&sin), sizeof(sin)) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "connect");
+  }
+  set_nodelay(fd);
+  return fd;
+}
+
+uint16_t local_port(int fd) {
+  sockaddr_in sin;
+  socklen_t len = sizeof(sin);
+  if (::getsockname(fd, reinterpret_cast<sockaddr*>(&sin), &len) != 0) {
+    throw_errno("getsockname");
+  }
+  return ntohs(sin.sin_port);
+}
+
+void set_nonblocking(int fd) {
+  int flags = ::fcntl(fd, F_GETFL);
+  if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+    throw_errno("fcntl");
+  }
+}
+
+void set_nodelay(int fd) {
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// The most descriptors one SCM_RIGHTS message may carry.
+static constexpr std::size_t kMaxFds = 253;
+
+static sockaddr_un make_unix_addr(const std::string& path) {
+  sockaddr_un sun;
+  ::memset(&sun, 0, sizeof(sun));
+  sun.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(sun.sun_path)) {
+    throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+  }
+  ::memcpy(sun.sun_path, path.data(), path.size());
+  return sun;
+}
+
+int listen_unix(const std::string& path, int backlog) {
+  sockaddr_un sun = make_unix_addr(path);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) throw_errno("socket");
+  ::unlink(path.c_str());
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&sun), sizeof(sun)) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "bind");
+  }
+  if (::listen(fd, backlog) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "listen");
+  }
+  return fd;
+}
+
+int connect_unix(const std::string& path) {
+  sockaddr_un sun = make_unix_addr(path);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) throw_errno("socket");
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&sun), sizeof(sun)) != 0) {
+    int err = errno;
+    ::close(fd);
+    if (err == ENOENT || err == ECONNREFUSED) return -1;
+    throw std::system_error(err, std::generic_category(), "connect");
+  }
+  return fd;
+}
+
+void send_fds(int sock, const std::vector<int>& fds) {
+  if (fds.empty() || fds.size() > kMaxFds) {
+    throw std::system_error(EINVAL, std::generic_category(), "send_fds");
+  }
+  // The descriptors ride along with a one-byte payload.
+  char byte = 0;
+  iovec iov = {&byte, 1};
+  std::vector<char> control(CMSG_SPACE(fds.size() * sizeof(int)));
+  msghdr msg;
+  ::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+  ::memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+  while (::sendmsg(sock, &msg, MSG_NOSIGNAL) < 0) {
+    if (errno != EINTR) throw_errno("sendmsg");
+  }
+}
+
+std::vector<int> recv_fds(int sock) {
+  char byte;
+  iovec iov = {&byte, 1};
+  std::vector<char> control(CMSG_SPACE(kMaxFds * sizeof(int)));
+  msghdr msg;
+  ::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  ssize_t n;
+  while ((n = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0) {
+    if (errno != EINTR) throw_errno("recvmsg");
+  }
+  std::vector<int> fds;
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    std::size_t have = fds.size();
+    fds.resize(have + count);
+    ::memcpy(fds.data() + have, CMSG_DATA(cmsg), count * sizeof(int));
+  }
+  if (n > 0 && (msg.msg_flags & MSG_CTRUNC) != 0) {
+    for (int fd : fds) ::close(fd);
+    throw std::system_error(EMSGSIZE, std::generic_category(), "recvmsg");
+  }
+  return fds;
+}
+
+}  // namespace net
+}  // namespace http2
@@ -0,0 +1,69 @@
+// Tools for dealing with non-blocking TCP sockets, and with the Unix sockets
+// that hand them from one process to another.
+
+#ifndef HTTP2_NET_SOCKET_H
+#define HTTP2_NET_SOCKET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace http2 {
+namespace net {
+
+// listen_tcp creates a non-blocking TCP socket listening on the given address
+// and port.  If reuseport is true, SO_REUSEPORT is set so that several
+// sockets (one per shard) may share the same port and let the kernel
+// distribute incoming connections among them.
+//
+// THROWS std::system_error on failure.
+int listen_tcp(const std::string& address, uint16_t port, bool reuseport,
+               int backlog);
+
+// connect_tcp opens a blocking TCP connection to the given address and port,
+// with Nagle's algorithm disabled.
+//
+// THROWS std::system_error on failure.
+int connect_tcp(const std::string& address, uint16_t port);
+
+// local_port returns the port to which the given socket is bound.
+//
+// THROWS std::system_error on failure.
+uint16_t local_port(int fd);
+
+// set_nonblocking puts the given file descriptor into non-blocking mode.
+//
+// THROWS std::system_error on failure.
+void set_nonblocking(int fd);
+
+// set_nodelay disables Nagle's algorithm on the given TCP socket.
+void set_nodelay(int fd);
+
+// listen_unix creates a non-blocking Unix stream socket listening at path,
+// replacing any file already there.
+//
+// THROWS std::system_error on failure.
+int listen_unix(const std::string& path, int backlog);
+
+// connect_unix opens a blocking connection to the Unix socket at path, or
+// returns -1 if nothing is listening there.
+//
+// THROWS std::system_error on any other failure.
+int connect_unix(const std::string& path);
+
+// send_fds sends the given file descriptors over a Unix socket as one
+// SCM_RIGHTS message.  At most 253 (SCM_MAX_FD) may be sent at once.
+//
+// THROWS std::system_error on failure.
+void send_fds(int sock, const std::vector<int>& fds);
+
+// recv_fds receives the file descriptors of one send_fds message, close on
+// exec.  Returns an empty vector if the peer closed the socket instead.
+//
+// THROWS std::system_error on failure.
+std::vector<int> recv_fds(int sock);
+
+}  // namespace net
+}  // namespace http2
+
+#endif  // HTTP2_NET_SOCKET_H
@@ -0,0 +1,210 @@
+#include "http2/net/timer_wheel.h"
+
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <limits>
+
+namespace http2 {
+namespace net {
+
+TimerWheel::Timer::Timer()
+    : Node{nullptr, nullptr}, wheel_(nullptr), deadline_(0), slot_(kNoSlot) {}
+
+TimerWheel::Timer::~Timer() { cancel(); }
+
+TimerWheel::Timer::Timer(Timer&& other) noexcept : Timer() { take(other); }
+
+TimerWheel::Timer& TimerWheel::Timer::operator=(Timer&& other) noexcept {
+  if (this != &other) {
+    cancel();
+    take(other);
+  }
+  return *this;
+}
+
+void TimerWheel::Timer::cancel() {
+  if (wheel_ != nullptr) wheel_->remove(this);
+}
+
+// take moves other's place in its list, if any, to this unarmed timer.
+void TimerWheel::Timer::take(Timer& other) {
+  if (!other.armed()) return;
+  wheel_ = other.wheel_;
+  deadline_ = other.deadline_;
+  slot_ = other.slot_;
+  prev = other.prev;
+  next = other.next;
+  prev->next = this;
+  next->prev = this;
+  other.wheel_ = nullptr;
+  other.prev = other.next = nullptr;
+}
+
+uint64_t TimerWheel::clock_ms() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+}
+
+TimerWheel::TimerWheel(uint64_t now_ms) : now_(now_ms), size_(0) {
+  for (uint64_t& bits : occupied_) bits = 0;
+  for (Node& head : slots_) head.prev = head.next = &head;
+}
+
+TimerWheel::~TimerWheel() {
+  // Leave any surviving timers unarmed rather than dangling.
+  for (Node& head : slots_) {
+    while (head.next != &head) {
+      Timer* timer = static_cast<Timer*>(head.next);
+      unlink(timer);
+      timer->wheel_ = nullptr;
+    }
+  }
+}
+
+void TimerWheel::arm(Timer* timer, uint64_t delay_ms) {
+  timer->cancel();
+  timer->wheel_ = this;
+  timer->deadline_ = now_ + (delay_ms == 0 ? 1 : delay_ms);
+  ++size_;
+  place(timer);
+}
+
+void TimerWheel::advance(uint64_t now_ms) {
+  while (now_ < now_ms) {
+    // Skip straight over the ticks where nothing happens.
+    uint64_t next = (size_ == 0) ? now_ms : next_event();
+    if (next > now_ms) {
+      now_ = now_ms;
+      break;
+    }
+    expire(next);
+  }
+}
+
+int TimerWheel::timeout_ms() const {
+  if (size_ == 0) return -1;
+  uint64_t wait = next_event() - now_;
+  return (wait > uint64_t(INT_MAX)) ? INT_MAX : int(wait);
+}
+
+void TimerWheel::link(Node* head, Node* node) {
+  node->prev = head->prev;
+  node->next = head;
+  head->prev->next = node;
+  head->prev = node;
+}
+
+void TimerWheel::unlink(Node* node) {
+  node->prev->next = node->next;
+  node->next->prev = node->prev;
+  node->prev = node->next = nullptr;
+}
+
+// splice moves the whole list at from to the empty head to.
+void TimerWheel::splice(Node* from, Node* to) {
+  if (from->next == from) {
+    to->prev = to->next = to;
+    return;
+  }
+  to->next = from->next;
+  to->prev = from->prev;
+  to->next->prev = to;
+  to->prev->next = to;
+  from->prev = from->next = from;
+}
+
+// place puts an armed timer in the slot for its deadline: on the coarsest
+// level where the deadline and now_ differ, so that every coarser digit of
+// the two is equal.
+void TimerWheel::place(Timer* timer) {
+  static constexpr int kTop = kLevels - 1;
+  static constexpr int kTopShift = kTop * kLevelBits;
+  uint64_t diff = timer->deadline_ ^ now_;
+  int level = (diff == 0) ? 0 : (63 - std::countl_zero(diff)) / kLevelBits;
+  uint64_t index;
+  if (level < kTop) {
+    index = (timer->deadline_ >> (level * kLevelBits)) & (kSlots - 1);
+  } else if ((timer->deadline_ >> kTopShift) - (now_ >> kTopShift) <=
+             kSlots) {
+    // The top level wraps around, so it needs no more than one turn.
+    level = kTop;
+    index = (timer->deadline_ >> kTopShift) & (kSlots - 1);
+  } else {
+    // Out of reach: park it in the top-level slot that comes round last.
+    level = kTop;
+    index = ((now_ >> kTopShift) - 1) & (kSlots - 1);
+  }
+  timer->slot_ = level * kSlots + index;
+  link(&slots_[timer->slot_], timer);
+  occupied_[level] |= uint64_t(1) << index;
+}
+
+void TimerWheel::remove(Timer* timer) {
+  unlink(timer);
+  uint16_t slot = timer->slot_;
+  if (slot != kNoSlot && slots_[slot].next == &slots_[slot]) {
+    occupied_[slot / kSlots] &= ~(uint64_t(1) << (slot % kSlots));
+  }
+  timer->wheel_ = nullptr;
+  --size_;
+}
+
+// next_event returns the first tick after now_ at which a timer expires or
+// moves down a level.
+uint64_t TimerWheel::next_event() const {
+  uint64_t best = std::numeric_limits<uint64_t>::max();
+  for (int level = 0; level < kLevels; ++level) {
+    uint64_t bits = occupied_[level];
+    if (bits == 0) continue;
+    int shift = level * kLevelBits;
+    uint64_t turn = now_ >> shift;
+    // Look for the first occupied slot after the current one.
+    int current = int(turn & (kSlots - 1));
+    uint64_t ahead = std::rotr(bits, (current + 1) % kSlots);
+    uint64_t steps = std::countr_zero(ahead) + 1;
+    uint64_t tick = (turn + steps) << shift;
+    if (tick < best) best = tick;
+  }
+  return best;
+}
+
+void TimerWheel::expire(uint64_t tick) {
+  now_ = tick;
+
+  // Move the timers in the slots this tick begins down a level, starting at
+  // the top, since they may land in a lower slot that also begins now.
+  for (int level = kLevels - 1; level > 0; --level) {
+    int shift = level * kLevelBits;
+    if ((tick & ((uint64_t(1) << shift) - 1)) != 0) continue;
+    uint64_t index = (tick >> shift) & (kSlots - 1);
+    Node moving;
+    splice(&slots_[level * kSlots + index], &moving);
+    occupied_[level] &= ~(uint64_t(1) << index);
+    while (moving.next != &moving) {
+      Timer* timer = static_cast<Timer*>(moving.next);
+      unlink(timer);
+      place(timer);
+    }
+  }
+
+  uint64_t index = tick & (kSlots - 1);
+  Node expiring;
+  splice(&slots_[index], &expiring);
+  occupied_[0] &= ~(uint64_t(1) << index);
+  // The slot may be refilled by the callbacks, so detach the timers from it
+  // before running any of them.
+  for (Node* node = expiring.next; node != &expiring; node = node->next) {
+    static_cast<Timer*>(node)->slot_ = kNoSlot;
+  }
+  while (expiring.next != &expiring) {
+    Timer* timer = static_cast<Timer*>(expiring.next);
+    unlink(timer);
+    timer->wheel_ = nullptr;
+    --size_;
+    timer->on_expire();
+  }
+}
+
+}  // namespace net
+}  // namespace http2
@@ -0,0 +1,123 @@
+// Tools for scheduling timeouts on an event loop.
+
+#ifndef HTTP2_NET_TIMER_WHEEL_H
+#define HTTP2_NET_TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace http2 {
+namespace net {
+
+// TimerWheel schedules the timeouts of one event loop with millisecond
+// resolution.  It is a hierarchical timing wheel: four levels of 64 slots,
+// each slot of a level spanning a whole turn of the level below.  A timer
+// sits in the slot of the coarsest level where its deadline differs from
+// the current time, and moves down a level each time the wheel reaches that
+// slot, so arming, cancelling and re-arming a timer are all O(1).  Deadlines
+// beyond the reach of the top level (about 4.6 hours) wait in it and are
+// placed again when it turns over.
+//
+// Timers are intrusive: a Timer holds its own links, so arming one never
+// allocates, and an object may embed as many as it needs.  A TimerWheel and
+// its Timers must only be used from the thread that runs the event loop.
+class TimerWheel final {
+ private:
+  struct Node {
+    Node* prev;
+    Node* next;
+  };
+
+ public:
+  // Timer is the base class of everything a TimerWheel can schedule.
+  class Timer : private Node {
+   public:
+    Timer();
+
+    // Cancels the timer.
+    virtual ~Timer();
+
+    // Moving a timer moves its schedule with it, leaving other unarmed, so
+    // that timers may live in containers that relocate their elements.
+    Timer(Timer&& other) noexcept;
+    Timer& operator=(Timer&& other) noexcept;
+
+    // armed returns true iff the timer is waiting to expire.
+    bool armed() const { return wheel_ != nullptr; }
+
+    // deadline returns the time at which an armed timer expires.
+    uint64_t deadline() const { return deadline_; }
+
+    // cancel disarms the timer.  Does nothing if it is not armed.
+    void cancel();
+
+   protected:
+    // on_expire is called once the deadline has passed.  The timer is no
+    // longer armed by then, and may be re-armed, or even destroyed, from
+    // within on_expire.
+    virtual void on_expire() = 0;
+
+   private:
+    friend class TimerWheel;
+
+    void take(Timer& other);
+
+    TimerWheel* wheel_;  // null unless armed
+    uint64_t deadline_;
+    uint16_t slot_;  // index into slots_, or kNoSlot while expiring
+  };
+
+  // clock_ms returns the current time on the monotonic clock, in
+  // milliseconds.
+  static uint64_t clock_ms();
+
+  explicit TimerWheel(uint64_t now_ms = clock_ms());
+  ~TimerWheel();
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // now returns the time the wheel has advanced to.
+  uint64_t now() const { return now_; }
+
+  // size returns the number of armed timers.
+  std::size_t size() const { return size_; }
+
+  // arm schedules timer to expire delay_ms milliseconds after now(), or at
+  // the next tick if delay_ms is 0.  An armed timer is re-armed.
+  void arm(Timer* timer, uint64_t delay_ms);
+
+  // advance moves the wheel forward to now_ms, expiring every timer whose
+  // deadline has been reached, in deadline order.
+  void advance(uint64_t now_ms);
+
+  // timeout_ms returns how long the event loop may sleep before it must
+  // call advance again: -1 if no timer is armed, otherwise at most the time
+  // until the earliest deadline.
+  int timeout_ms() const;
+
+ private:
+  static constexpr int kLevelBits = 6;
+  static constexpr int kSlots = 1 << kLevelBits;
+  static constexpr int kLevels = 4;
+  static constexpr uint16_t kNoSlot = 0xffff;
+
+  static void link(Node* head, Node* node);
+  static void unlink(Node* node);
+  static void splice(Node* from, Node* to);
+
+  void place(Timer* timer);
+  void remove(Timer* timer);
+  uint64_t next_event() const;
+  void expire(uint64_t tick);
+
+  uint64_t now_;
+  std::size_t size_;
+  uint64_t occupied_[kLevels];  // per level, a bit for each non-empty slot
+  Node slots_[kLevels * kSlots];
+};
+
+}  // namespace net
+}  // namespace http2
+
+#endif  // HTTP2_NET_TIMER_WHEEL_H
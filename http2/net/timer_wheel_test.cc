@@ -0,0 +1,157 @@
+#include "http2/net/timer_wheel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using http2::net::TimerWheel;
+
+namespace {
+
+// Probe records the time of each expiry.
+struct Probe final : public TimerWheel::Timer {
+  Probe() = default;
+  Probe(TimerWheel* wheel, std::vector<uint64_t>* log)
+      : wheel(wheel), log(log) {}
+
+  void on_expire() override {
+    log->push_back(wheel->now());
+    if (rearm > 0) wheel->arm(this, rearm);
+  }
+
+  TimerWheel* wheel = nullptr;
+  std::vector<uint64_t>* log = nullptr;
+  uint64_t rearm = 0;
+};
+
+}  // namespace
+
+TEST(TimerWheel, Expiry) {
+  TimerWheel wheel(1000);
+  std::vector<uint64_t> log;
+  Probe a(&wheel, &log), b(&wheel, &log), c(&wheel, &log);
+  EXPECT_EQ(wheel.timeout_ms(), -1);
+  wheel.arm(&a, 10);
+  wheel.arm(&b, 5000);
+  wheel.arm(&c, 0);  // the next tick
+  EXPECT_EQ(wheel.size(), 3);
+  EXPECT_EQ(wheel.timeout_ms(), 1);
+
+  wheel.advance(1009);
+  EXPECT_EQ(log, (std::vector<uint64_t>{1001}));
+  EXPECT_FALSE(c.armed());
+  wheel.advance(1010);
+  EXPECT_EQ(log, (std::vector<uint64_t>{1001, 1010}));
+  EXPECT_TRUE(b.armed());
+  EXPECT_LE(wheel.timeout_ms(), 5000 - 10);
+
+  // A late advance still expires timers on their own ticks.
+  wheel.advance(100000);
+  EXPECT_EQ(log, (std::vector<uint64_t>{1001, 1010, 6000}));
+  EXPECT_EQ(wheel.size(), 0);
+  EXPECT_EQ(wheel.now(), 100000);
+}
+
+TEST(TimerWheel, CancelAndRearm) {
+  TimerWheel wheel(0);
+  std::vector<uint64_t> log;
+  Probe a(&wheel, &log), b(&wheel, &log);
+  wheel.arm(&a, 100);
+  wheel.arm(&b, 100);
+  a.cancel();
+  EXPECT_FALSE(a.armed());
+  EXPECT_EQ(wheel.size(), 1);
+
+  // Re-arming moves the deadline, in either direction.
+  wheel.arm(&b, 300);
+  wheel.arm(&b, 200);
+  EXPECT_EQ(b.deadline(), 200);
+  wheel.advance(1000);
+  EXPECT_EQ(log, (std::vector<uint64_t>{200}));
+
+  // A destroyed timer is cancelled.
+  {
+    Probe gone(&wheel, &log);
+    wheel.arm(&gone, 10);
+  }
+  EXPECT_EQ(wheel.size(), 0);
+  wheel.advance(2000);
+  EXPECT_EQ(log.size(), 1);
+}
+
+TEST(TimerWheel, Periodic) {
+  TimerWheel wheel(7);
+  std::vector<uint64_t> log;
+  Probe tick(&wheel, &log);
+  tick.rearm = 64;  // lands in the slot being expired
+  wheel.arm(&tick, 64);
+  wheel.advance(7 + 64 * 4);
+  EXPECT_EQ(log, (std::vector<uint64_t>{71, 135, 199, 263}));
+}
+
+TEST(TimerWheel, Move) {
+  TimerWheel wheel(0);
+  std::vector<uint64_t> log;
+  std::vector<Probe> probes;
+  for (int i = 0; i < 100; ++i) {
+    probes.emplace_back(&wheel, &log);
+    wheel.arm(&probes.back(), 10 + i);
+  }
+  // Reallocation and erasure move armed timers.
+  probes.erase(probes.begin());
+  EXPECT_EQ(wheel.size(), 99);
+  Probe moved;
+  moved = std::move(probes.back());
+  probes.pop_back();
+  EXPECT_TRUE(moved.armed());
+  EXPECT_EQ(moved.deadline(), 109);
+  wheel.advance(1000);
+  EXPECT_EQ(log.size(), 99);
+  EXPECT_EQ(log.front(), 11);
+  EXPECT_EQ(log.back(), 109);
+}
+
+TEST(TimerWheel, Random) {
+  // Against a brute-force schedule, across every level and beyond.
+  TimerWheel wheel(12345);
+  std::mt19937_64 rng(1);
+  std::vector<uint64_t> log;
+  std::vector<Probe> probes(1000);
+  std::vector<uint64_t> expected;
+  for (Probe& p : probes) {
+    p.wheel = &wheel;
+    p.log = &log;
+    int level = rng() % 5;
+    uint64_t delay = 1 + rng() % (uint64_t(1) << (6 * level + 6));
+    wheel.arm(&p, delay);
+    expected.push_back(p.deadline());
+  }
+  // Cancel some, and re-arm others.
+  for (std::size_t i = 0; i < probes.size(); i += 7) {
+    probes[i].cancel();
+    expected[i] = 0;
+  }
+  for (std::size_t i = 3; i < probes.size(); i += 11) {
+    if (expected[i] == 0) continue;
+    wheel.arm(&probes[i], 1 + rng() % 100000);
+    expected[i] = probes[i].deadline();
+  }
+  std::vector<uint64_t> deadlines;
+  for (uint64_t d : expected) {
+    if (d != 0) deadlines.push_back(d);
+  }
+  std::sort(deadlines.begin(), deadlines.end());
+
+  uint64_t now = wheel.now();
+  while (wheel.size() > 0) {
+    int timeout = wheel.timeout_ms();
+    ASSERT_GT(timeout, 0);
+    now += timeout;
+    wheel.advance(now);
+  }
+  EXPECT_EQ(log, deadlines);
+}
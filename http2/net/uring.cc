@@ -0,0 +1,226 @@
+#include "http2/net/uring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+namespace http2 {
+namespace net {
+
+static int sys_io_uring_setup(unsigned int entries, io_uring_params* p) {
+  return ::syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+                              unsigned int min_complete, unsigned int flags,
+                              const void* arg, std::size_t argsz) {
+  return ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   arg, argsz);
+}
+
+static void* map_or_throw(std::size_t len, int fd, off_t offset) {
+  void* ptr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, offset);
+  if (ptr == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(), "mmap");
+  }
+  return ptr;
+}
+
+template <typename T>
+static T* at_offset(void* base, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+}
+
+Uring::Uring(unsigned int entries)
+    : fd_(-1),
+      sq_ptr_(nullptr),
+      sq_len_(0),
+      cq_ptr_(nullptr),
+      cq_len_(0),
+      sqes_(nullptr),
+      sqes_len_(0),
+      sq_local_tail_(0),
+      sq_submitted_tail_(0) {
+  io_uring_params p;
+  ::memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL;
+  fd_ = sys_io_uring_setup(entries, &p);
+  if (fd_ < 0 && errno == EINVAL) {
+    // Older kernels reject the optional flags; they are only optimizations.
+    ::memset(&p, 0, sizeof(p));
+    fd_ = sys_io_uring_setup(entries, &p);
+  }
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+  }
+  features_ = p.features;
+
+  try {
+    sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+      sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+    }
+    sq_ptr_ = map_or_throw(sq_len_, fd_, IORING_OFF_SQ_RING);
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+      cq_ptr_ = sq_ptr_;
+    } else {
+      cq_ptr_ = map_or_throw(cq_len_, fd_, IORING_OFF_CQ_RING);
+    }
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(
+        map_or_throw(sqes_len_, fd_, IORING_OFF_SQES));
+  } catch (...) {
+    release();
+    throw;
+  }
+
+  sq_head_ = at_offset<unsigned int>(sq_ptr_, p.sq_off.head);
+  sq_tail_ = at_offset<std::atomic<unsigned int>>(sq_ptr_, p.sq_off.tail);
+  sq_mask_ = at_offset<unsigned int>(sq_ptr_, p.sq_off.ring_mask);
+  sq_array_ = at_offset<unsigned int>(sq_ptr_, p.sq_off.array);
+  sq_entries_ = p.sq_entries;
+  cq_head_ = at_offset<unsigned int>(cq_ptr_, p.cq_off.head);
+  cq_tail_ = at_offset<std::atomic<unsigned int>>(cq_ptr_, p.cq_off.tail);
+  cq_mask_ = at_offset<unsigned int>(cq_ptr_, p.cq_off.ring_mask);
+  cqes_ = at_offset<io_uring_cqe>(cq_ptr_, p.cq_off.cqes);
+
+  // SQ slot i always holds SQE i, so the indirection array is set up once.
+  for (unsigned int i = 0; i < sq_entries_; ++i) sq_array_[i] = i;
+}
+
+Uring::~Uring() { release(); }
+
+void Uring::release() {
+  if (sqes_ != nullptr) ::munmap(sqes_, sqes_len_);
+  if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) ::munmap(cq_ptr_, cq_len_);
+  if (sq_ptr_ != nullptr) ::munmap(sq_ptr_, sq_len_);
+  if (fd_ >= 0) ::close(fd_);
+  sqes_ = nullptr;
+  cq_ptr_ = sq_ptr_ = nullptr;
+  fd_ = -1;
+}
+
+unsigned int Uring::sq_space() const {
+  auto* head = reinterpret_cast<std::atomic<unsigned int>*>(sq_head_);
+  unsigned int queued =
+      sq_local_tail_ - head->load(std::memory_order_acquire);
+  return sq_entries_ - queued;
+}
+
+io_uring_sqe* Uring::get_sqe() {
+  if (backlog_.empty() && sq_space() == 0) submit();
+  io_uring_sqe* sqe;
+  if (!backlog_.empty() || sq_space() == 0) {
+    // Entries behind the backlog join it, so that they go in in order.
+    sqe = &backlog_.emplace_back();
+  } else {
+    sqe = &sqes_[sq_local_tail_ & *sq_mask_];
+    ++sq_local_tail_;
+  }
+  ::memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+// refill moves as much of the backlog into the submission queue as fits.
+void Uring::refill() {
+  for (unsigned int n = sq_space(); n > 0 && !backlog_.empty(); --n) {
+    sqes_[sq_local_tail_ & *sq_mask_] = backlog_.front();
+    backlog_.pop_front();
+    ++sq_local_tail_;
+  }
+}
+
+unsigned int Uring::submit(unsigned int wait_nr, int timeout_ms) {
+  // A bounded wait passes its timeout through the extended argument.
+  __kernel_timespec ts;
+  io_uring_getevents_arg arg;
+  ::memset(&arg, 0, sizeof(arg));
+  const void* argp = nullptr;
+  std::size_t argsz = 0;
+  unsigned int flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+  if (wait_nr > 0 && timeout_ms >= 0) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = int64_t(timeout_ms % 1000) * 1000000;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    argp = &arg;
+    argsz = sizeof(arg);
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+
+  unsigned int total = 0;
+  while (true) {
+    refill();
+    sq_tail_->store(sq_local_tail_, std::memory_order_release);
+    unsigned int to_submit = sq_local_tail_ - sq_submitted_tail_;
+    if (to_submit == 0 && wait_nr == 0) return total;
+    int n = sys_io_uring_enter(fd_, to_submit, wait_nr, flags, argp, argsz);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      // The wait timed out, or the completion queue is backed up (in which
+      // case the caller must drain it first).
+      if (errno == ETIME || errno == EBUSY || errno == EAGAIN) return total;
+      throw std::system_error(errno, std::generic_category(),
+                              "io_uring_enter");
+    }
+    sq_submitted_tail_ += n;
+    total += n;
+    if (n == 0 || backlog_.empty()) return total;
+
+    // The kernel made room for more of the backlog; submit that without
+    // waiting again.
+    wait_nr = 0;
+    flags = 0;
+    argp = nullptr;
+    argsz = 0;
+  }
+}
+
+BufferPool::BufferPool(Uring& uring, uint16_t group_id, unsigned int count,
+                       std::size_t buffer_size)
+    : uring_(uring),
+      group_id_(group_id),
+      count_(count),
+      buffer_size_(buffer_size),
+      buffers_(nullptr),
+      buffers_len_(count * buffer_size) {
+  if (count == 0 || count > 65536 || buffer_size == 0 ||
+      buffer_size > 0x7fffffff) {
+    throw std::system_error(EINVAL, std::generic_category(),
+                            "bad buffer pool size");
+  }
+  void* buffers = ::mmap(nullptr, buffers_len_, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffers == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(), "mmap");
+  }
+  buffers_ = static_cast<uint8_t*>(buffers);
+  provide(0, count);
+}
+
+BufferPool::~BufferPool() {
+  // Buffers still provided to the kernel are forgotten along with the ring,
+  // which must therefore be torn down first or never used again.
+  ::munmap(buffers_, buffers_len_);
+}
+
+void BufferPool::provide(uint16_t first, unsigned int count) {
+  io_uring_sqe* sqe = uring_.get_sqe();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = count;
+  sqe->addr = reinterpret_cast<uint64_t>(buffer(first));
+  sqe->len = buffer_size_;
+  sqe->off = first;
+  sqe->buf_group = group_id_;
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = 0;
+}
+
+}  // namespace net
+}  // namespace http2
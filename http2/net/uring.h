@@ -0,0 +1,143 @@
+// Tools for driving Linux io_uring directly through its system calls.
+
+#ifndef HTTP2_NET_URING_H
+#define HTTP2_NET_URING_H
+
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <deque>
+
+namespace http2 {
+namespace net {
+
+// Uring owns one io_uring instance: its submission and completion queues,
+// mapped into this process.  A Uring must only be used from one thread.
+class Uring final {
+ public:
+  // THROWS std::system_error if the kernel refuses to set up the ring.
+  explicit Uring(unsigned int entries);
+  ~Uring();
+
+  Uring(const Uring&) = delete;
+  Uring& operator=(const Uring&) = delete;
+
+  int fd() const { return fd_; }
+
+  // get_sqe returns a zeroed submission queue entry to fill in.  If the
+  // submission queue is full, the queued entries are submitted first; if the
+  // kernel will not take them yet (its completion queue is backed up), the
+  // new entry waits in a backlog, in order, until submit() finds it room.
+  io_uring_sqe* get_sqe();
+
+  // submit hands every queued entry to the kernel, then waits until at least
+  // wait_nr completions are available, or for at most timeout_ms
+  // milliseconds if that is not negative.  Returns the number submitted.
+  //
+  // THROWS std::system_error on unexpected failure.
+  unsigned int submit(unsigned int wait_nr = 0, int timeout_ms = -1);
+
+  // close tears the ring down.  The kernel cancels whatever is still in
+  // flight, but may finish doing so in the background, so operations that
+  // point into memory about to be freed must be cancelled and reaped first.
+  void close() { release(); }
+
+  // drain invokes fn(const io_uring_cqe&) for every available completion,
+  // and returns the number handled.
+  template <typename Fn>
+  unsigned int drain(Fn fn) {
+    unsigned int head = *cq_head_;
+    unsigned int tail = cq_tail_->load(std::memory_order_acquire);
+    unsigned int n = 0;
+    while (head != tail) {
+      fn(cqes_[head & *cq_mask_]);
+      ++head;
+      ++n;
+      // Release each slot as soon as it is handled: fn may submit more work,
+      // and the kernel needs the room to post its completions.
+      cq_head_atomic()->store(head, std::memory_order_release);
+    }
+    return n;
+  }
+
+ private:
+  void release();
+  unsigned int sq_space() const;
+  void refill();
+
+  std::atomic<unsigned int>* cq_head_atomic() {
+    return reinterpret_cast<std::atomic<unsigned int>*>(cq_head_);
+  }
+
+  int fd_;
+  unsigned int features_;
+  void* sq_ptr_;
+  std::size_t sq_len_;
+  void* cq_ptr_;
+  std::size_t cq_len_;
+  io_uring_sqe* sqes_;
+  std::size_t sqes_len_;
+
+  unsigned int* sq_head_;
+  std::atomic<unsigned int>* sq_tail_;
+  unsigned int* sq_mask_;
+  unsigned int* sq_array_;
+  unsigned int sq_entries_;
+  unsigned int sq_local_tail_;
+  unsigned int sq_submitted_tail_;
+  std::deque<io_uring_sqe> backlog_;
+
+  unsigned int* cq_head_;
+  std::atomic<unsigned int>* cq_tail_;
+  unsigned int* cq_mask_;
+  io_uring_cqe* cqes_;
+};
+
+// BufferPool is a group of equally-sized receive buffers, provided to the
+// kernel so that receives pick a buffer only once data actually arrives
+// (IOSQE_BUFFER_SELECT).  The buffer's ID is reported in the completion; the
+// buffer then belongs to the application until it is recycled.
+//
+// The buffers are handed over with IORING_OP_PROVIDE_BUFFERS rather than a
+// registered buffer ring: the submissions cost a little more, but they work
+// on every kernel that supports multishot receives.  Their completions are
+// suppressed, and only failures are reported, with user_data 0.
+class BufferPool final {
+ public:
+  // THROWS std::system_error if the buffers cannot be allocated.
+  BufferPool(Uring& uring, uint16_t group_id, unsigned int count,
+             std::size_t buffer_size);
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  uint16_t group_id() const { return group_id_; }
+  std::size_t buffer_size() const { return buffer_size_; }
+
+  // buffer returns the memory of the buffer with the given ID.
+  uint8_t* buffer(uint16_t id) const {
+    return buffers_ + std::size_t(id) * buffer_size_;
+  }
+
+  // recycle queues a submission handing a buffer back to the kernel.
+  void recycle(uint16_t id) { provide(id, 1); }
+
+ private:
+  void provide(uint16_t first, unsigned int count);
+
+  Uring& uring_;
+  uint16_t group_id_;
+  unsigned int count_;
+  std::size_t buffer_size_;
+  uint8_t* buffers_;
+  std::size_t buffers_len_;
+};
+
+}  // namespace net
+}  // namespace http2
+
+#endif  // HTTP2_NET_URING_H
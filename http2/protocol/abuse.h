@@ -0,0 +1,50 @@
+// Tools for noticing when a peer is abusing the protocol.
+
+#ifndef HTTP2_PROTOCOL_ABUSE_H
+#define HTTP2_PROTOCOL_ABUSE_H
+
+#include <cstdint>
+
+namespace http2 {
+namespace protocol {
+
+// AbuseCounter is a credit balance for one class of frames that make an
+// endpoint work without doing anything useful, such as a stream reset right
+// after it was opened, or a PING.  Each such frame is charged against the
+// balance, and useful work (a completed response, a request) earns credit
+// back, up to the limit.  A peer may send any amount of the suspect frames,
+// so long as it sends enough real traffic along with them; only one that
+// runs the balance out is abusive.
+//
+// The counter needs no clock, and costs a compare and an add per frame.
+class AbuseCounter final {
+ public:
+  // A limit of 0 disables the counter.
+  explicit AbuseCounter(uint32_t limit = 0) : credit_(limit), limit_(limit) {}
+
+  // charge spends one unit of credit.  Returns false if there was none left,
+  // in which case the peer should be sent away (ENHANCE_YOUR_CALM).
+  bool charge() {
+    if (credit_ == 0) return limit_ == 0;
+    --credit_;
+    return true;
+  }
+
+  // earn returns n units of credit, up to the limit.
+  void earn(uint32_t n = 1) {
+    uint32_t room = limit_ - credit_;
+    credit_ += (n < room) ? n : room;
+  }
+
+  uint32_t credit() const { return credit_; }
+  uint32_t limit() const { return limit_; }
+
+ private:
+  uint32_t credit_;
+  uint32_t limit_;
+};
+
+}  // namespace protocol
+}  // namespace http2
+
+#endif  // HTTP2_PROTOCOL_ABUSE_H
@@ -0,0 +1,31 @@
+#include "http2/protocol/abuse.h"
+
+#include "gtest/gtest.h"
+
+using http2::protocol::AbuseCounter;
+
+TEST(AbuseCounter, ChargeAndEarn) {
+  AbuseCounter counter(3);
+  EXPECT_TRUE(counter.charge());
+  EXPECT_TRUE(counter.charge());
+  EXPECT_TRUE(counter.charge());
+  EXPECT_FALSE(counter.charge());
+  EXPECT_EQ(counter.credit(), 0);
+
+  counter.earn();
+  EXPECT_TRUE(counter.charge());
+  EXPECT_FALSE(counter.charge());
+
+  // Credit never exceeds the limit.
+  counter.earn(100);
+  EXPECT_EQ(counter.credit(), 3);
+  counter.earn();
+  EXPECT_EQ(counter.credit(), 3);
+}
+
+TEST(AbuseCounter, Disabled) {
+  AbuseCounter counter;
+  for (int i = 0; i < 1000; ++i) EXPECT_TRUE(counter.charge());
+  counter.earn(5);
+  EXPECT_EQ(counter.credit(), 0);
+}
@@ -0,0 +1,55 @@
+#include "http2/protocol/flow_control.h"
+
+#include <algorithm>
+
+namespace http2 {
+namespace protocol {
+
+ReceiveWindow::ReceiveWindow(uint32_t size, double update_fraction)
+    : window_(size),
+      size_(0),
+      pending_(0),
+      threshold_(1),
+      update_fraction_(std::min(std::max(update_fraction, 0.0), 1.0)) {
+  set_size(size);
+}
+
+uint32_t ReceiveWindow::take_update(bool force) {
+  if (pending_ == 0 || (!force && pending_ < threshold_)) return 0;
+  // Never grant past size_, whatever the caller consumed.
+  int64_t room = int64_t(size_) - window_;
+  uint32_t increment = std::min<int64_t>(pending_, std::max<int64_t>(room, 0));
+  pending_ = 0;
+  window_ += increment;
+  return increment;
+}
+
+void ReceiveWindow::resize(uint32_t size) {
+  window_ += int64_t(size) - int64_t(size_);
+  set_size(size);
+}
+
+void ReceiveWindow::expand(uint32_t size) {
+  if (size <= size_) return;
+  // The window grows when the increment is taken.
+  pending_ += size - size_;
+  set_size(size);
+}
+
+void ReceiveWindow::set_size(uint32_t size) {
+  size_ = size;
+  threshold_ = std::max<uint32_t>(1, size * update_fraction_);
+}
+
+bool take_window_update(ReceiveWindow& window, bool force, uint8_t* output) {
+  uint32_t increment = window.take_update(force);
+  if (increment == 0) return false;
+  output[0] = uint8_t(increment >> 24);
+  output[1] = uint8_t(increment >> 16);
+  output[2] = uint8_t(increment >> 8);
+  output[3] = uint8_t(increment);
+  return true;
+}
+
+}  // namespace protocol
+}  // namespace http2
@@ -0,0 +1,122 @@
+// Tools for HTTP/2 flow control (RFC 7540 section 5.2).
+
+#ifndef HTTP2_PROTOCOL_FLOW_CONTROL_H
+#define HTTP2_PROTOCOL_FLOW_CONTROL_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace http2 {
+namespace protocol {
+
+// kMaxWindowSize is the largest legal flow-control window, 2^31-1.
+constexpr int64_t kMaxWindowSize = 0x7fffffff;
+
+// kDefaultWindowSize is the initial size of every window until SETTINGS say
+// otherwise.
+constexpr int64_t kDefaultWindowSize = 65535;
+
+// SendWindow tracks the credit the peer has granted this endpoint for
+// sending DATA, on one stream or on the whole connection.
+class SendWindow final {
+ public:
+  explicit SendWindow(int64_t size = kDefaultWindowSize) : window_(size) {}
+
+  // window returns the current credit.  It may be negative after the peer
+  // shrinks SETTINGS_INITIAL_WINDOW_SIZE.
+  int64_t window() const { return window_; }
+
+  // available returns the number of bytes that may be sent right now.
+  int64_t available() const { return (window_ > 0) ? window_ : 0; }
+
+  // consume charges n bytes of DATA sent.  n must not exceed available().
+  void consume(uint32_t n) { window_ -= n; }
+
+  // grant applies a WINDOW_UPDATE.  Returns false if the window would grow
+  // past kMaxWindowSize, which is a FLOW_CONTROL_ERROR.
+  bool grant(uint32_t increment) {
+    window_ += increment;
+    return window_ <= kMaxWindowSize;
+  }
+
+  // adjust applies a change of SETTINGS_INITIAL_WINDOW_SIZE, by moving the
+  // window by the difference (section 6.9.2).  Returns false on overflow.
+  bool adjust(int64_t delta) {
+    window_ += delta;
+    return window_ <= kMaxWindowSize;
+  }
+
+ private:
+  int64_t window_;
+};
+
+// ReceiveWindow tracks the credit this endpoint has granted the peer, on one
+// stream or on the whole connection, and decides when to grant more.
+//
+// Received bytes go through two steps: receive charges them against the
+// window as they arrive, and consume marks them as processed, which makes
+// their credit eligible to be returned.  Rather than answering every DATA
+// frame with a WINDOW_UPDATE, take_update returns the credit in batches,
+// once at least update_fraction of the window has been consumed.
+class ReceiveWindow final {
+ public:
+  // update_fraction should be in (0, 1]: the peer stalls if the window
+  // empties before a batch is due.  Values outside that range are clamped.
+  explicit ReceiveWindow(uint32_t size = kDefaultWindowSize,
+                         double update_fraction = 0.5);
+
+  // window returns the credit the peer has left.
+  int64_t window() const { return window_; }
+
+  // size returns the size the window is kept at.
+  uint32_t size() const { return size_; }
+
+  // pending returns the credit consumed but not yet returned to the peer.
+  uint32_t pending() const { return pending_; }
+
+  // receive charges n bytes of DATA (including padding) against the window.
+  // Returns false if the peer overran it, which is a FLOW_CONTROL_ERROR.
+  bool receive(uint32_t n) {
+    window_ -= n;
+    return window_ >= 0;
+  }
+
+  // consume marks n received bytes as processed.
+  void consume(uint32_t n) { pending_ += n; }
+
+  // take_update returns the increment of the WINDOW_UPDATE to send now, or
+  // 0 if none is due yet.  If force is true, any pending credit is due.
+  uint32_t take_update(bool force = false);
+
+  // resize applies a change of SETTINGS_INITIAL_WINDOW_SIZE, which moves
+  // the window by the difference without a WINDOW_UPDATE.  The window may
+  // go negative.
+  void resize(uint32_t size);
+
+  // expand grows the window to size with a WINDOW_UPDATE, which is the only
+  // way to grow the connection window.  The increment is queued as pending
+  // credit, to be sent with take_update(true).
+  void expand(uint32_t size);
+
+ private:
+  void set_size(uint32_t size);
+
+  int64_t window_;
+  uint32_t size_;
+  uint32_t pending_;
+  uint32_t threshold_;
+  double update_fraction_;
+};
+
+// kWindowUpdateSize is the size of a WINDOW_UPDATE frame payload.
+constexpr std::size_t kWindowUpdateSize = 4;
+
+// take_window_update takes the update due from window, as take_update does,
+// and writes it to output as the kWindowUpdateSize-byte payload of a
+// WINDOW_UPDATE frame.  Returns false if no update is due.
+bool take_window_update(ReceiveWindow& window, bool force, uint8_t* output);
+
+}  // namespace protocol
+}  // namespace http2
+
+#endif  // HTTP2_PROTOCOL_FLOW_CONTROL_H
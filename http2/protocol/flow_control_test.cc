@@ -0,0 +1,90 @@
+#include "http2/protocol/flow_control.h"
+
+#include "gtest/gtest.h"
+
+using http2::protocol::ReceiveWindow;
+using http2::protocol::SendWindow;
+using http2::protocol::take_window_update;
+
+TEST(SendWindow, GrantAndAdjust) {
+  SendWindow w;
+  EXPECT_EQ(w.available(), 65535);
+  w.consume(65535);
+  EXPECT_EQ(w.available(), 0);
+  EXPECT_TRUE(w.grant(100));
+  EXPECT_EQ(w.available(), 100);
+
+  // A smaller SETTINGS_INITIAL_WINDOW_SIZE can leave the window negative.
+  EXPECT_TRUE(w.adjust(-1000));
+  EXPECT_EQ(w.window(), -900);
+  EXPECT_EQ(w.available(), 0);
+
+  EXPECT_TRUE(w.grant(0x7fffffff - 100));
+  EXPECT_FALSE(w.grant(0x7fffffff));
+  SendWindow big(0x7fffffff);
+  EXPECT_FALSE(big.adjust(1));
+}
+
+TEST(ReceiveWindow, BatchesUpdates) {
+  ReceiveWindow w(1000, 0.25);
+  EXPECT_TRUE(w.receive(100));
+  w.consume(100);
+  EXPECT_EQ(w.take_update(), 0U);
+  EXPECT_TRUE(w.receive(200));
+  w.consume(200);
+  EXPECT_EQ(w.take_update(), 300U);
+  EXPECT_EQ(w.window(), 1000);
+  EXPECT_EQ(w.pending(), 0U);
+
+  // Forcing returns whatever is pending.
+  EXPECT_TRUE(w.receive(10));
+  w.consume(10);
+  EXPECT_EQ(w.take_update(true), 10U);
+  EXPECT_EQ(w.take_update(true), 0U);
+
+  // Overrunning the window is an error.
+  EXPECT_TRUE(w.receive(1000));
+  EXPECT_FALSE(w.receive(1));
+}
+
+TEST(ReceiveWindow, Resize) {
+  ReceiveWindow w(65535, 0.5);
+  EXPECT_TRUE(w.receive(60000));
+
+  // Shrinking moves the window, which may go negative.
+  w.resize(16384);
+  EXPECT_EQ(w.size(), 16384U);
+  EXPECT_EQ(w.window(), 16384 - 60000);
+  w.consume(60000);
+  EXPECT_EQ(w.take_update(), 60000U);
+  EXPECT_EQ(w.window(), 16384);
+
+  w.resize(100000);
+  EXPECT_EQ(w.window(), 100000);
+}
+
+TEST(ReceiveWindow, Expand) {
+  ReceiveWindow w(65535, 0.5);
+  w.expand(1 << 20);
+  EXPECT_EQ(w.window(), 65535);
+  EXPECT_EQ(w.take_update(true), (1u << 20) - 65535);
+  EXPECT_EQ(w.window(), 1 << 20);
+  w.expand(1000);  // never shrinks
+  EXPECT_EQ(w.size(), 1u << 20);
+}
+
+TEST(ReceiveWindow, TakeWindowUpdate) {
+  ReceiveWindow w(1 << 20, 0.5);
+  uint8_t payload[http2::protocol::kWindowUpdateSize] = {};
+  EXPECT_FALSE(take_window_update(w, true, payload));
+
+  EXPECT_TRUE(w.receive(0x10203));
+  w.consume(0x10203);
+  EXPECT_FALSE(take_window_update(w, false, payload));  // not due yet
+  EXPECT_TRUE(take_window_update(w, true, payload));
+  EXPECT_EQ(payload[0], 0x00);
+  EXPECT_EQ(payload[1], 0x01);
+  EXPECT_EQ(payload[2], 0x02);
+  EXPECT_EQ(payload[3], 0x03);
+  EXPECT_EQ(w.window(), 1 << 20);
+}
@@ -1,12 +1,56 @@
 #include "http2/protocol/frame.h"
 
-#include <iostream>
+#include <cstdlib>
+
 #include <iomanip>
 #include <sstream>
 
 namespace http2 {
 namespace protocol {
 
+bool decode_frame_header(const uint8_t* p, const uint8_t* q,
+                         FrameHeader& output) {
+  if (std::size_t(q - p) < kFrameHeaderSize) return false;
+  output.length = (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2];
+  output.type = p[3];
+  output.flags = p[4];
+  output.stream_id = ((uint32_t(p[5]) << 24) | (uint32_t(p[6]) << 16) |
+                      (uint32_t(p[7]) << 8) | p[8]) &
+                     kMaxStreamId;
+  return true;
+}
+
+void encode_frame_header(uint32_t length, uint8_t type, uint8_t flags,
+                         uint32_t stream_id, std::vector<uint8_t>& output) {
+  uint8_t header[kFrameHeaderSize];
+  encode_frame_header(length, type, flags, stream_id, header);
+  output.insert(output.end(), header, header + kFrameHeaderSize);
+}
+
+void encode_frame_header(uint32_t length, uint8_t type, uint8_t flags,
+                         uint32_t stream_id, uint8_t* output) {
+  if (length > 0x00ffffffUL) abort();
+  output[0] = uint8_t(length >> 16);     // Size (hi byte)
+  output[1] = uint8_t(length >> 8);      // Size (mid byte)
+  output[2] = uint8_t(length);           // Size (lo byte)
+  output[3] = type;                      // Type byte
+  output[4] = flags;                     // Flags byte
+  output[5] = uint8_t(stream_id >> 24);  // Stream ID (hi)
+  output[6] = uint8_t(stream_id >> 16);  // Stream ID (mid-hi)
+  output[7] = uint8_t(stream_id >> 8);   // Stream ID (mid-lo)
+  output[8] = uint8_t(stream_id);        // Stream ID (lo)
+}
+
+bool strip_padding(const FrameHeader& hdr, const uint8_t*& p,
+                   const uint8_t*& q) {
+  if (!hdr.has_flag(PADDED)) return true;
+  if (p == q) return false;
+  std::size_t pad = *p++;
+  if (pad > std::size_t(q - p)) return false;
+  q -= pad;
+  return true;
+}
+
 Frame::operator std::string() const {
   std::ostringstream out;
   out << '[' << std::hex << std::setfill('0') << std::setw(2) << uint16_t(type_)
@@ -25,28 +69,27 @@ Frame::operator std::string() const {
 }
 
 std::vector<uint8_t> Frame::encode() const {
-  std::cerr << "DEBUG: " << *this << std::endl;
-  uint32_t s = payload_.size();
-  if (s > 0x00ffffffUL) abort();
   std::vector<uint8_t> frame;
-  frame.reserve(9 + s);
-  frame.insert(frame.end(), {
-                             uint8_t(s >> 16),     // Size (hi byte)
-                             uint8_t(s >> 8),      // Size (mid byte)
-                             uint8_t(s),           // Size (lo byte)
-                             type_,                // Type byte
-                             flags_,               // Flags byte
-                             uint8_t(sid_ >> 24),  // Stream ID (hi byte)
-                             uint8_t(sid_ >> 16),  // Stream ID (mid-hi byte)
-                             uint8_t(sid_ >> 8),   // Stream ID (mid-lo byte)
-                             uint8_t(sid_),        // Stream ID (lo byte)
-                            });
-  frame.insert(frame.end(), payload_.begin(), payload_.end());
+  frame.reserve(kFrameHeaderSize + payload_.size());
+  encode(frame);
   return frame;
 }
 
+void Frame::encode(std::vector<uint8_t>& output) const {
+  encode_frame_header(payload_.size(), type_, flags_, sid_, output);
+  output.insert(output.end(), payload_.begin(), payload_.end());
+}
+
 bool Frame::decode(const uint8_t* p, const uint8_t* q) {
-  return false;
+  FrameHeader hdr;
+  if (!decode_frame_header(p, q, hdr)) return false;
+  p += kFrameHeaderSize;
+  if (std::size_t(q - p) != hdr.length) return false;
+  type_ = hdr.type;
+  flags_ = hdr.flags;
+  sid_ = hdr.stream_id;
+  payload_.assign(p, q);
+  return true;
 }
 
 }  // namespace protocol
@@ -3,6 +3,8 @@
 #ifndef HTTP2_PROTOCOL_FRAME_H
 #define HTTP2_PROTOCOL_FRAME_H
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <initializer_list>
 #include <ostream>
@@ -34,8 +36,75 @@ enum FrameType {
   GOAWAY_FRAME = 0x07,
   WINDOW_UPDATE_FRAME = 0x08,
   CONTINUATION_FRAME = 0x09,
+  // 0x0a through 0x0f not used
+  PRIORITY_UPDATE_FRAME = 0x10,  // RFC 9218 section 7.1
 };
 
+// kFrameHeaderSize is the size of the fixed header that precedes every HTTP/2
+// frame payload, as specified by RFC 7540 section 4.1.
+constexpr std::size_t kFrameHeaderSize = 9;
+
+// kMaxStreamId is the largest legal stream identifier.
+constexpr uint32_t kMaxStreamId = 0x7fffffffUL;
+
+// FrameHeader holds the decoded fixed header of a single HTTP/2 frame.
+struct FrameHeader final {
+  uint32_t length;
+  uint8_t type;
+  uint8_t flags;
+  uint32_t stream_id;
+
+  bool has_flag(uint8_t bit) const { return (flags & bit) == bit; }
+};
+
+// decode_frame_header reads a frame header from the given region of bytes.
+// Returns false if fewer than kFrameHeaderSize bytes are available.  The
+// reserved high bit of the stream ID is ignored.
+bool decode_frame_header(const uint8_t* begin, const uint8_t* end,
+                         FrameHeader& output);
+
+// encode_frame_header appends a frame header to the given output vector.
+void encode_frame_header(uint32_t length, uint8_t type, uint8_t flags,
+                         uint32_t stream_id, std::vector<uint8_t>& output);
+
+// encode_frame_header writes a frame header to the kFrameHeaderSize bytes at
+// output.
+void encode_frame_header(uint32_t length, uint8_t type, uint8_t flags,
+                         uint32_t stream_id, uint8_t* output);
+
+// read_u32 decodes the big-endian 32-bit field at p, which is the form of
+// every 32-bit field in a frame payload.
+inline uint32_t read_u32(const uint8_t* p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+         (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// strip_padding adjusts [p,q) to exclude the Pad Length field and the padding
+// of a PADDED frame.  Returns false if the padding is malformed.
+bool strip_padding(const FrameHeader& hdr, const uint8_t*& p,
+                   const uint8_t*& q);
+
+// split_header_block cuts the n-byte header block at p into a HEADERS frame
+// and as many CONTINUATION frames as it takes to keep each payload within
+// max_frame_size, and calls fn(type, flags, payload, length) for each in
+// order.  END_STREAM goes on the HEADERS frame if end_stream is true, and
+// END_HEADERS on the last frame.
+template <typename Fn>
+void split_header_block(const uint8_t* p, std::size_t n,
+                        std::size_t max_frame_size, bool end_stream, Fn fn) {
+  std::size_t pos = 0;
+  uint8_t type = HEADERS_FRAME;
+  uint8_t flags = end_stream ? END_STREAM : NO_FLAGS;
+  do {
+    std::size_t len = std::min(max_frame_size, n - pos);
+    if (pos + len == n) flags |= END_HEADERS;
+    fn(type, flags, p + pos, len);
+    pos += len;
+    type = CONTINUATION_FRAME;
+    flags = NO_FLAGS;
+  } while (pos < n);
+}
+
 class Frame final {
  public:
   Frame(uint8_t type = PING_FRAME, uint8_t flags = NO_FLAGS,
@@ -60,6 +129,12 @@ class Frame final {
 
   std::vector<uint8_t> encode() const;
 
+  // encode appends the frame to output, which allocates nothing once output
+  // has the capacity.
+  void encode(std::vector<uint8_t>& output) const;
+
+  // decode parses the given region of bytes, which must hold exactly one
+  // complete frame, and returns true on success.
   bool decode(const uint8_t* begin, const uint8_t* end);
   bool decode(const std::vector<uint8_t>& vec) {
     return decode(vec.data(), vec.data() + vec.size());
@@ -0,0 +1,61 @@
+// Allocation counts of Frame round trips: none, once the buffers are big
+// enough.  Parsing priority signals allocates nothing either.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http2/protocol/frame.h"
+#include "http2/protocol/priority.h"
+#include "http2/testing/alloc_counter.h"
+
+namespace proto = http2::protocol;
+using http2::testing::AllocationCounter;
+
+TEST(Allocations, FrameRoundTrip) {
+  proto::Frame frame(proto::DATA_FRAME, proto::END_STREAM, 1);
+  frame.mutable_payload().assign(1000, 'x');
+  std::vector<uint8_t> wire;
+  frame.encode(wire);
+  proto::Frame back;
+  ASSERT_TRUE(back.decode(wire));
+
+  AllocationCounter counter;
+  for (int i = 0; i < 10; ++i) {
+    wire.clear();
+    frame.encode(wire);
+    ASSERT_TRUE(back.decode(wire));
+  }
+  EXPECT_EQ(counter.count(), 0);
+  EXPECT_EQ(back.payload(), frame.payload());
+
+  // The vector-returning encode allocates just the one vector.
+  AllocationCounter once;
+  std::vector<uint8_t> copy = frame.encode();
+  EXPECT_EQ(once.count(), 1);
+}
+
+TEST(Allocations, FrameHeader) {
+  uint8_t buf[proto::kFrameHeaderSize];
+  proto::FrameHeader hdr;
+  AllocationCounter counter;
+  proto::encode_frame_header(16384, proto::HEADERS_FRAME, proto::END_HEADERS,
+                             3, buf);
+  ASSERT_TRUE(proto::decode_frame_header(buf, buf + sizeof(buf), hdr));
+  EXPECT_EQ(counter.count(), 0);
+  EXPECT_EQ(hdr.length, 16384);
+  EXPECT_EQ(hdr.stream_id, 3);
+}
+
+TEST(Allocations, ParsePriority) {
+  // Member names too long for any small-string buffer.
+  std::string value = "an-unknown-member-with-a-long-name=1, u=1, "
+                      "another-unknown-member-name;param=2, i";
+  proto::Priority priority;
+  AllocationCounter counter;
+  proto::parse_priority(value, priority);
+  EXPECT_EQ(counter.count(), 0);
+  EXPECT_EQ(priority.urgency, 1);
+  EXPECT_TRUE(priority.incremental);
+}
@@ -17,6 +17,7 @@ std::size_t decode_integer(const uint8_t* p, const uint8_t* q, unsigned int numb
   unsigned int shift = 0;
   uint8_t mask = (1U << numbits) - 1U;
   uint8_t byte;
+  uint64_t wide;
 
   if (pos == q) goto fail;
   byte = *pos++ & mask;
@@ -26,8 +27,11 @@ std::size_t decode_integer(const uint8_t* p, const uint8_t* q, unsigned int numb
   }
   do {
     if (pos == q) goto fail;
+    if (shift > 28) goto fail;
     byte = *pos++;
-    output += (byte & 0x7f) * (1 << shift);
+    wide = uint64_t(output) + (uint64_t(byte & 0x7f) << shift);
+    if (wide > 0xffffffffULL) goto fail;
+    output = wide;
     shift += 7;
   } while (byte & 0x80);
   return (pos - p);
@@ -44,6 +48,11 @@ bool Decoder::decode_lowmem(const uint8_t* p, const uint8_t* q,
   uint32_t index, namelen, valuelen, new_max_size;
   bool should_add, namehuff, valuehuff;
 
+  // Without a caller's stats, count into a scratch set that is dropped.
+  Stats scratch;
+  Stats& stats = stats_ != nullptr ? *stats_ : scratch;
+
+  stats[BLOCK_BYTES] += q - p;
   while (p != q) {
     // First, get the oddball cases out of the way.
 
@@ -54,6 +63,7 @@ bool Decoder::decode_lowmem(const uint8_t* p, const uint8_t* q,
       p += n;
       if (n == 0) return false;
       mutable_table().set_max_size(new_max_size);
+      ++stats[TABLE_SIZE_UPDATES];
       continue;
     }
 
@@ -69,6 +79,10 @@ bool Decoder::decode_lowmem(const uint8_t* p, const uint8_t* q,
       } catch (const std::out_of_range& e) {
         return false;
       }
+      ++stats[index < static_table().size() ? INDEXED_STATIC
+                                             : INDEXED_DYNAMIC];
+      ++stats[HEADERS];
+      stats[HEADER_BYTES] += h.name.size() + h.value.size();
       callback(std::move(h));
       continue;
     }
@@ -83,6 +97,7 @@ bool Decoder::decode_lowmem(const uint8_t* p, const uint8_t* q,
       p += n;
       if (n == 0) return false;
       should_add = true;
+      ++stats[LITERAL_INCREMENTAL];
     } else {
       // 6.2.2.  Literal Header Field without Indexing
       // 6.2.3.  Literal Header Field Never Indexed
@@ -91,6 +106,8 @@ bool Decoder::decode_lowmem(const uint8_t* p, const uint8_t* q,
       //   (*p & 0xf0) == 0x00
       //   (*p & 0xf0) == 0x10
 
+      ++stats[(*p & 0xf0) == 0x10 ? LITERAL_NEVER_INDEXED
+                                   : LITERAL_WITHOUT_INDEXING];
       n = decode_integer(p, q, 4, index);
       p += n;
       if (n == 0) return false;
@@ -98,7 +115,12 @@ bool Decoder::decode_lowmem(const uint8_t* p, const uint8_t* q,
     }
 
     if (index > 0) {
-      h.name = table().at(index).name;
+      try {
+        h.name = table().at(index).name;
+      } catch (const std::out_of_range& e) {
+        return false;
+      }
+      ++stats[index < static_table().size() ? NAME_STATIC : NAME_DYNAMIC];
       goto have_name;
     }
 
@@ -109,11 +131,14 @@ bool Decoder::decode_lowmem(const uint8_t* p, const uint8_t* q,
     if (n == 0) return false;
     if (namelen > (q - p)) return false;
     if (namehuff) {
-      std::vector<uint8_t> tmp;
+      std::vector<uint8_t>& tmp = huffman_buffer_;
+      tmp.clear();
       if (!decode_huffman(p, p + namelen, tmp)) return false;
-      h.name.assign(tmp.begin(), tmp.end());
+      h.name.assign(reinterpret_cast<const char*>(tmp.data()), tmp.size());
+      stats[HUFFMAN_PLAIN_BYTES] += tmp.size();
+      stats[HUFFMAN_CODED_BYTES] += namelen;
     } else {
-      h.name.assign(p, p + namelen);
+      h.name.assign(reinterpret_cast<const char*>(p), namelen);
     }
     p += namelen;
 
@@ -125,14 +150,19 @@ bool Decoder::decode_lowmem(const uint8_t* p, const uint8_t* q,
     if (n == 0) return false;
     if (valuelen > (q - p)) return false;
     if (valuehuff) {
-      std::vector<uint8_t> tmp;
+      std::vector<uint8_t>& tmp = huffman_buffer_;
+      tmp.clear();
       if (!decode_huffman(p, p + valuelen, tmp)) return false;
-      h.value.assign(tmp.begin(), tmp.end());
+      h.value.assign(reinterpret_cast<const char*>(tmp.data()), tmp.size());
+      stats[HUFFMAN_PLAIN_BYTES] += tmp.size();
+      stats[HUFFMAN_CODED_BYTES] += valuelen;
     } else {
-      h.value.assign(p, p + valuelen);
+      h.value.assign(reinterpret_cast<const char*>(p), valuelen);
     }
     p += valuelen;
     if (should_add) mutable_table().add(h);
+    ++stats[HEADERS];
+    stats[HEADER_BYTES] += h.name.size() + h.value.size();
     callback(std::move(h));
   }
   return true;
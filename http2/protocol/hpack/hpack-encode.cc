@@ -23,7 +23,7 @@ void encode_integer(uint8_t hibits, uint8_t numbits, uint32_t value, std::vector
   output.push_back(value);
 }
 
-Encoder::Encoder() { reset(); }
+Encoder::Encoder() : stats_(nullptr) { reset(); }
 
 void Encoder::reset() {
   table_.reset();
@@ -38,17 +38,57 @@ void Encoder::sensitive_header(std::string name) {
 }
 
 void Encoder::encode(const Header& h, std::vector<uint8_t>& output) {
-  if (h.name.size() >= 127) abort();
-  if (h.value.size() >= 127) abort();
+  std::size_t before = output.size();
+  if (encode(h, true, table().best_match(h), output, stats_)) {
+    table_.add(h);
+  }
+  if (stats_ == nullptr) return;
+  ++(*stats_)[HEADERS];
+  (*stats_)[HEADER_BYTES] += h.name.size() + h.value.size();
+  (*stats_)[BLOCK_BYTES] += output.size() - before;
+}
+
+void Encoder::encode_table_size_update(std::vector<uint8_t>& output) {
+  std::size_t before = output.size();
+  encode_integer(0x20, 5, table().max_size(), output);
+  if (stats_ == nullptr) return;
+  ++(*stats_)[TABLE_SIZE_UPDATES];
+  (*stats_)[BLOCK_BYTES] += output.size() - before;
+}
+
+void Encoder::prepare(const std::vector<Header>& input,
+                      std::vector<uint8_t>& output) const {
+  // A fresh table holds nothing but the static table.
+  Table static_only;
+  for (const auto& h : input) {
+    encode(h, false, static_only.best_match(h), output, nullptr);
+  }
+}
 
+void Encoder::prepare(const http2::headers::Headers& input,
+                      std::vector<uint8_t>& output) const {
+  Table static_only;
+  for (const auto& h : input.all()) {
+    encode(h, false, static_only.best_match(h), output, nullptr);
+  }
+}
+
+// encode appends the representation of h, given the index of its best match
+// (or 0), and counts it in stats, if given.  Returns true iff the peer will
+// add h to its dynamic table.
+bool Encoder::encode(const Header& h, bool may_index, std::size_t index,
+                     std::vector<uint8_t>& output, Stats* stats) const {
   bool is_sensitive = (sensitive_.find(h.name) != sensitive_.end());
-  bool is_big = h.size() > 256;
+  bool no_index = !may_index || h.size() > 256;
+  Counter representation = is_sensitive ? LITERAL_NEVER_INDEXED
+                           : no_index   ? LITERAL_WITHOUT_INDEXING
+                                        : LITERAL_INCREMENTAL;
+  bool is_static = (index < static_table().size());
 
-  auto index = table().best_match(h);
   if (index == 0) {
     if (is_sensitive) {
       output.push_back(0x10);
-    } else if (is_big) {
+    } else if (no_index) {
       output.push_back(0x00);
     } else {
       output.push_back(0x40);
@@ -57,24 +97,33 @@ void Encoder::encode(const Header& h, std::vector<uint8_t>& output) {
     output.insert(output.end(), h.name.begin(), h.name.end());
     encode_integer(0x00, 7, h.value.size(), output);
     output.insert(output.end(), h.value.begin(), h.value.end());
-    return;
+    if (stats != nullptr) ++(*stats)[representation];
+    return representation == LITERAL_INCREMENTAL;
   }
 
-  Header best = table().at(index);
+  const Header& best = table().at(index);
   if (best == h) {
     encode_integer(0x80, 7, index, output);
-    return;
+    if (stats != nullptr) {
+      ++(*stats)[is_static ? INDEXED_STATIC : INDEXED_DYNAMIC];
+    }
+    return false;
   }
 
   if (is_sensitive) {
     encode_integer(0x10, 4, index, output);
-  } else if (is_big) {
+  } else if (no_index) {
     encode_integer(0x00, 4, index, output);
   } else {
     encode_integer(0x40, 6, index, output);
   }
   encode_integer(0x00, 7, h.value.size(), output);
   output.insert(output.end(), h.value.begin(), h.value.end());
+  if (stats != nullptr) {
+    ++(*stats)[is_static ? NAME_STATIC : NAME_DYNAMIC];
+    ++(*stats)[representation];
+  }
+  return representation == LITERAL_INCREMENTAL;
 }
 
 }  // namespace hpack
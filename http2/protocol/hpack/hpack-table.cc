@@ -7,7 +7,7 @@ namespace protocol {
 namespace hpack {
 
 const std::vector<Header>& static_table() {
-  const auto& table = *new std::vector<Header>{
+  static const auto& table = *new std::vector<Header>{
       {},
       {http2::headers::kAuthority, ""},
       {http2::headers::kMethod, http2::headers::kMethodGET},
@@ -74,6 +74,26 @@ const std::vector<Header>& static_table() {
   return table;
 }
 
+const char* counter_name(Counter c) {
+  static const char* const kNames[NUM_COUNTERS] = {
+      "headers",
+      "indexed_static",
+      "indexed_dynamic",
+      "name_static",
+      "name_dynamic",
+      "literal_incremental",
+      "literal_without_indexing",
+      "literal_never_indexed",
+      "huffman_plain_bytes",
+      "huffman_coded_bytes",
+      "header_bytes",
+      "block_bytes",
+      "evictions",
+      "table_size_updates",
+  };
+  return kNames[c];
+}
+
 void Table::set_max_size(std::size_t sz) {
   max_size_ = sz;
   evict();
@@ -89,6 +109,7 @@ void Table::evict() {
   while (size_ > max_size_) {
     size_ -= dynamic_.back().size();
     dynamic_.pop_back();
+    if (stats_ != nullptr) ++(*stats_)[EVICTIONS];
   }
 }
 
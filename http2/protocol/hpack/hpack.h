@@ -22,6 +22,62 @@ namespace hpack {
 
 using Header = http2::headers::Header;
 
+// Counter enumerates what an Encoder or Decoder counts in a Stats.
+enum Counter {
+  // Header fields coded.
+  HEADERS,
+
+  // Header fields coded as a bare index, by table.
+  INDEXED_STATIC,
+  INDEXED_DYNAMIC,
+
+  // Literal header fields whose name was coded as an index, by table.
+  NAME_STATIC,
+  NAME_DYNAMIC,
+
+  // Literal header fields, by representation (RFC 7541 section 6.2).
+  LITERAL_INCREMENTAL,
+  LITERAL_WITHOUT_INDEXING,
+  LITERAL_NEVER_INDEXED,
+
+  // The length of the Huffman-coded strings, before and after coding.
+  HUFFMAN_PLAIN_BYTES,
+  HUFFMAN_CODED_BYTES,
+
+  // Bytes in and out: the lengths of the names and values of the header
+  // fields, and of the header blocks that carried them.
+  HEADER_BYTES,
+  BLOCK_BYTES,
+
+  // Dynamic table entries evicted, and dynamic table size updates coded.
+  EVICTIONS,
+  TABLE_SIZE_UPDATES,
+
+  NUM_COUNTERS,
+};
+
+// counter_name returns a lowercase name for c, e.g. "indexed_static".
+const char* counter_name(Counter c);
+
+// Stats holds the counters of an Encoder or Decoder.  They cost an increment
+// or two per header field, and add up, so those of many connections can be
+// summed to compare table sizes and indexing policies on real traffic.
+struct Stats final {
+  uint64_t counts[NUM_COUNTERS] = {};
+
+  uint64_t operator[](Counter c) const { return counts[c]; }
+  uint64_t& operator[](Counter c) { return counts[c]; }
+
+  Stats& operator+=(const Stats& other) {
+    for (int i = 0; i < NUM_COUNTERS; ++i) counts[i] += other.counts[i];
+    return *this;
+  }
+  Stats& operator-=(const Stats& other) {
+    for (int i = 0; i < NUM_COUNTERS; ++i) counts[i] -= other.counts[i];
+    return *this;
+  }
+};
+
 // static_table returns the HTTP/2 static table, as specified by RFC 7541
 // Appendix A.
 const std::vector<Header>& static_table();
@@ -30,7 +86,7 @@ const std::vector<Header>& static_table();
 // the static and dynamic tables.
 class Table final {
  public:
-  Table() : size_(0), max_size_(4096) {}
+  Table() : size_(0), max_size_(4096), stats_(nullptr) {}
 
   // empty returns true iff the dynamic table contains no entries.
   bool empty() const { return dynamic_.empty(); }
@@ -41,10 +97,17 @@ class Table final {
   // max_size returns the current maximum size of the dynamic table.
   std::size_t max_size() const { return max_size_; }
 
+  // set_stats counts the entries evicted from now on, except those cleared
+  // by reset(), in stats; or stops counting them, if stats is null.
+  void set_stats(Stats* stats) { stats_ = stats; }
+
   void reset() {
+    Stats* stats = stats_;
+    stats_ = nullptr;
     max_size_ = 0;
     evict();
     max_size_ = 4096;
+    stats_ = stats;
   }
 
   // set_max_size changes the maximum size of the dynamic table, evicting old
@@ -56,7 +119,7 @@ class Table final {
   // k=61+[num dynamic table entries].
   //
   // THROWS std::out_of_range if index is 0 or past the dynamic table.
-  Header at(std::size_t index) const {
+  const Header& at(std::size_t index) const {
     if (index < 1) throw std::out_of_range("illegal index 0");
     if (index < 62) return static_table().at(index);
     return dynamic_.at(index - 62);
@@ -77,6 +140,7 @@ class Table final {
 
   std::size_t size_;
   std::size_t max_size_;
+  Stats* stats_;
   std::deque<Header> dynamic_;
 };
 
@@ -104,12 +168,24 @@ inline bool decode_huffman(const std::vector<uint8_t>& input,
 // Decoder manages the state for receiving HPACK-encoded HTTP/2 headers.
 class Decoder final {
  public:
+  Decoder() : stats_(nullptr) {}
+
   const Table& table() const { return table_; }
   Table& mutable_table() { return table_; }
 
-  // reset returns this Decoder to its initial state.
+  // reset returns this Decoder to its initial state.  Its stats are kept.
   void reset() { table_.reset(); }
 
+  // set_stats adds the counters of everything decoded from now on to stats,
+  // which must outlive the Decoder or the next call; or stops counting, if
+  // stats is null, as it is at first.  The counters are kept by the caller
+  // rather than by every Decoder, so that a caller with many of them may
+  // keep one set for all.
+  void set_stats(Stats* stats) {
+    stats_ = stats;
+    table_.set_stats(stats);
+  }
+
   // decode_lowmem scans the given byte region as a headers block, streaming
   // the headers via the provided callback as they are decoded, and returns
   // true on success or false on decode failure.
@@ -136,6 +212,11 @@ class Decoder final {
 
  private:
   Table table_;
+  Stats* stats_;
+
+  // Holds each Huffman-coded string as it is decoded, so that decoding
+  // allocates no more than the decoded headers themselves need.
+  std::vector<uint8_t> huffman_buffer_;
 };
 
 // encode_integer encodes an integer into the HPACK variable-length encoding,
@@ -166,17 +247,29 @@ class Encoder final {
   const Table& table() const { return table_; }
   Table& mutable_table() { return table_; }
 
-  // reset returns this Encoder to its initial state.
+  // reset returns this Encoder to its initial state.  Its stats are kept.
   void reset();
 
+  // set_stats is as for Decoder.  Blocks made by prepare are not counted.
+  void set_stats(Stats* stats) {
+    stats_ = stats;
+    table_.set_stats(stats);
+  }
+
   // sensitive_header marks the named header as "sensitive".  A sensitive
   // header is never indexed in the dynamic table.
   void sensitive_header(std::string name);
 
   // encode marshals the given header to form an HPACK-formatted payload, and
-  // appends that payload to the given output vector.
+  // appends that payload to the given output vector.  A header sent with
+  // incremental indexing is added to the table, as the peer will add it.
   void encode(const Header& h, std::vector<uint8_t>& output);
 
+  // encode_table_size_update appends a dynamic table size update, which
+  // tells the peer the table's current max_size().  It must start a header
+  // block.
+  void encode_table_size_update(std::vector<uint8_t>& output);
+
   // encode_all marshals each of the given headers, in the order provided, to
   // form an HPACK-formatted payload, and appends that payload to the given
   // output vector.
@@ -187,9 +280,23 @@ class Encoder final {
     }
   }
 
+  // prepare is like encode_all, except that the payload leaves the peer's
+  // dynamic table alone: it only refers to the static table, and sends
+  // everything else as literals without indexing.  Such a prepared block
+  // does not depend on the state of any Encoder, so it may be computed once
+  // and then sent on any connection, as part of any header block.
+  void prepare(const std::vector<Header>& input,
+               std::vector<uint8_t>& output) const;
+  void prepare(const http2::headers::Headers& input,
+               std::vector<uint8_t>& output) const;
+
  private:
+  bool encode(const Header& h, bool may_index, std::size_t index,
+              std::vector<uint8_t>& output, Stats* stats) const;
+
   Table table_;
   std::set<std::string> sensitive_;
+  Stats* stats_;
 };
 
 }  // namespace hpack
@@ -0,0 +1,101 @@
+// Allocation counts of steady-state HPACK encoding and decoding.  Once the
+// dynamic table and the output buffers have warmed up, the only allocations
+// left should be those of the decoded strings that are too long for the
+// small-string buffer of std::string.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/testing/alloc_counter.h"
+
+namespace hpack = http2::protocol::hpack;
+using http2::headers::Header;
+using http2::testing::AllocationCounter;
+
+namespace {
+
+const std::vector<Header>& request() {
+  static const std::vector<Header> headers = {
+      {":method", "GET"},
+      {":scheme", "https"},
+      {":authority", "www.example.com"},
+      {":path", "/index.html"},
+      {"user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:109.0)"},
+      {"accept-encoding", "gzip, deflate, br"},
+      {"cookie", "session=8f14e45fceea167a"}};
+  return headers;
+}
+
+// heap_strings returns the number of names and values in headers that
+// std::string must allocate for.
+uint64_t heap_strings(const std::vector<Header>& headers) {
+  std::size_t inline_capacity = std::string().capacity();
+  uint64_t n = 0;
+  for (const Header& h : headers) {
+    n += (h.name.size() > inline_capacity) + (h.value.size() > inline_capacity);
+  }
+  return n;
+}
+
+}  // anonymous namespace
+
+TEST(Allocations, EncodeIndexed) {
+  hpack::Encoder encoder;
+  encoder.sensitive_header("cookie");
+  std::vector<uint8_t> block;
+  encoder.encode_all(request(), block);
+
+  // Every header is now indexed, except the cookie, which is sent as a
+  // literal each time.
+  AllocationCounter counter;
+  for (int i = 0; i < 10; ++i) {
+    block.clear();
+    encoder.encode_all(request(), block);
+  }
+  EXPECT_EQ(counter.count(), 0);
+}
+
+TEST(Allocations, DecodeIndexed) {
+  hpack::Encoder encoder;
+  hpack::Decoder decoder;
+  std::vector<uint8_t> first, block;
+  encoder.encode_all(request(), first);
+  encoder.encode_all(request(), block);
+  std::vector<Header> out;
+  ASSERT_TRUE(decoder.decode(first, out));
+  ASSERT_TRUE(decoder.decode(block, out));
+
+  // The second block is all indices, which leave the table as it is, so it
+  // can be decoded again and again.  Only the long strings are copied out
+  // of the table onto the heap.
+  AllocationCounter counter;
+  for (int i = 0; i < 10; ++i) ASSERT_TRUE(decoder.decode(block, out));
+  EXPECT_EQ(counter.count(), 10 * heap_strings(request()));
+  EXPECT_EQ(out, request());
+}
+
+TEST(Allocations, DecodeHuffman) {
+  // Huffman-coded literals that are never indexed, so the same block can be
+  // decoded again and again.
+  std::vector<uint8_t> block;
+  for (const Header& h : request()) {
+    block.push_back(0x10);
+    for (const std::string* s : {&h.name, &h.value}) {
+      std::vector<uint8_t> coded;
+      hpack::encode_huffman(std::vector<uint8_t>(s->begin(), s->end()), coded);
+      hpack::encode_integer(0x80, 7, coded.size(), block);
+      block.insert(block.end(), coded.begin(), coded.end());
+    }
+  }
+  hpack::Decoder decoder;
+  std::vector<Header> out;
+  ASSERT_TRUE(decoder.decode(block, out));
+  ASSERT_EQ(out, request());
+
+  AllocationCounter counter;
+  for (int i = 0; i < 10; ++i) ASSERT_TRUE(decoder.decode(block, out));
+  EXPECT_EQ(counter.count(), 10 * heap_strings(request()));
+}
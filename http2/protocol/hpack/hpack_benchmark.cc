@@ -0,0 +1,207 @@
+// HPACK microbenchmarks: the integer and Huffman codings, whole header
+// blocks, and dynamic table lookups.
+//
+// Usage: hpack_benchmark [--benchmark_filter=REGEX]
+//                        [--benchmark_format=json] [--benchmark_out=FILE]
+//
+// Pass --benchmark_format=json (or --benchmark_out=FILE with
+// --benchmark_out_format=json) for results to track over time.
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "http2/protocol/hpack/hpack.h"
+
+namespace hpack = http2::protocol::hpack;
+using http2::headers::Header;
+
+namespace {
+
+// Header sets like those a browser sends and a server answers with.
+std::vector<Header> request_headers(int i) {
+  return {{":method", "GET"},
+          {":scheme", "https"},
+          {":authority", "www.example.com"},
+          {":path", "/static/img/" + std::to_string(i % 50) + ".png"},
+          {"user-agent",
+           "Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 "
+           "Firefox/115.0"},
+          {"accept", "image/avif,image/webp,*/*"},
+          {"accept-language", "en-US,en;q=0.5"},
+          {"accept-encoding", "gzip, deflate, br"},
+          {"referer", "https://www.example.com/"},
+          {"cookie", "session=" + std::to_string(1000003 * (i % 7))}};
+}
+
+std::vector<Header> response_headers(int i) {
+  return {{":status", i % 10 == 0 ? "304" : "200"},
+          {"content-type", "image/png"},
+          {"content-length", std::to_string(1000 + 37 * i)},
+          {"cache-control", "public, max-age=31536000"},
+          {"date", "Sat, 18 Oct 2026 12:00:00 GMT"},
+          {"server", "libhttp2"},
+          {"etag", "\"" + std::to_string(7919 * i) + "\""}};
+}
+
+using HeaderSet = std::vector<Header> (*)(int);
+constexpr int kBlocks = 256;
+
+// Strings of 256 bytes with different character distributions.
+enum Distribution { LOWERCASE, DIGITS, HEADER_VALUES, BINARY };
+
+std::vector<uint8_t> sample(Distribution d) {
+  static const char kHeaderValue[] =
+      "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8 "
+      "Mozilla/5.0 (X11; Linux x86_64) gzip, deflate, br en-US,en;q=0.5 ";
+  std::mt19937 rng(42);
+  std::vector<uint8_t> out(256);
+  for (std::size_t i = 0; i < out.size(); ++i) {
+    switch (d) {
+      case LOWERCASE:
+        out[i] = 'a' + rng() % 26;
+        break;
+      case DIGITS:
+        out[i] = '0' + rng() % 10;
+        break;
+      case HEADER_VALUES:
+        out[i] = kHeaderValue[i % (sizeof(kHeaderValue) - 1)];
+        break;
+      case BINARY:
+        out[i] = rng();
+        break;
+    }
+  }
+  return out;
+}
+
+void BM_EncodeInteger(benchmark::State& state) {
+  uint32_t value = state.range(0);
+  std::vector<uint8_t> out;
+  for (auto _ : state) {
+    out.clear();
+    hpack::encode_integer(0x00, 5, value, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+}
+BENCHMARK(BM_EncodeInteger)->Arg(10)->Arg(1000)->Arg(1000000);
+
+void BM_DecodeInteger(benchmark::State& state) {
+  std::vector<uint8_t> in;
+  hpack::encode_integer(0x00, 5, state.range(0), in);
+  uint32_t value;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hpack::decode_integer(in, 5, value));
+    benchmark::DoNotOptimize(value);
+  }
+}
+BENCHMARK(BM_DecodeInteger)->Arg(10)->Arg(1000)->Arg(1000000);
+
+void BM_EncodeHuffman(benchmark::State& state, Distribution d) {
+  std::vector<uint8_t> in = sample(d);
+  std::vector<uint8_t> out;
+  for (auto _ : state) {
+    out.clear();
+    hpack::encode_huffman(in, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * in.size());
+}
+BENCHMARK_CAPTURE(BM_EncodeHuffman, lowercase, LOWERCASE);
+BENCHMARK_CAPTURE(BM_EncodeHuffman, digits, DIGITS);
+BENCHMARK_CAPTURE(BM_EncodeHuffman, header_values, HEADER_VALUES);
+BENCHMARK_CAPTURE(BM_EncodeHuffman, binary, BINARY);
+
+void BM_DecodeHuffman(benchmark::State& state, Distribution d) {
+  std::vector<uint8_t> in;
+  hpack::encode_huffman(sample(d), in);
+  std::vector<uint8_t> out;
+  for (auto _ : state) {
+    out.clear();
+    if (!hpack::decode_huffman(in, out)) state.SkipWithError("decode failed");
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * in.size());
+}
+BENCHMARK_CAPTURE(BM_DecodeHuffman, lowercase, LOWERCASE);
+BENCHMARK_CAPTURE(BM_DecodeHuffman, digits, DIGITS);
+BENCHMARK_CAPTURE(BM_DecodeHuffman, header_values, HEADER_VALUES);
+BENCHMARK_CAPTURE(BM_DecodeHuffman, binary, BINARY);
+
+// BM_EncodeAll encodes a stream of header blocks on one Encoder, as a
+// connection would, so that the dynamic table is in a steady state.
+void BM_EncodeAll(benchmark::State& state, HeaderSet set) {
+  std::vector<std::vector<Header>> blocks;
+  for (int i = 0; i < kBlocks; ++i) blocks.push_back(set(i));
+  hpack::Encoder encoder;
+  std::vector<uint8_t> out;
+  int i = 0;
+  for (auto _ : state) {
+    out.clear();
+    encoder.encode_all(blocks[i], out);
+    benchmark::DoNotOptimize(out.data());
+    i = (i + 1) % kBlocks;
+  }
+  state.SetItemsProcessed(state.iterations() * blocks[0].size());
+}
+BENCHMARK_CAPTURE(BM_EncodeAll, requests, request_headers);
+BENCHMARK_CAPTURE(BM_EncodeAll, responses, response_headers);
+
+// BM_Decode decodes the blocks of BM_EncodeAll in order, starting over
+// (with a fresh table) once they run out.
+void BM_Decode(benchmark::State& state, HeaderSet set) {
+  std::vector<std::vector<uint8_t>> blocks(kBlocks);
+  hpack::Encoder encoder;
+  for (int i = 0; i < kBlocks; ++i) encoder.encode_all(set(i), blocks[i]);
+  hpack::Decoder decoder;
+  std::vector<Header> out;
+  std::size_t headers = set(0).size();
+  int i = 0;
+  for (auto _ : state) {
+    out.clear();
+    if (!decoder.decode(blocks[i], out)) state.SkipWithError("decode failed");
+    benchmark::DoNotOptimize(out.data());
+    if (++i == kBlocks) {
+      i = 0;
+      decoder.reset();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * headers);
+}
+BENCHMARK_CAPTURE(BM_Decode, requests, request_headers);
+BENCHMARK_CAPTURE(BM_Decode, responses, response_headers);
+
+// BM_BestMatch looks up headers in a table holding the given number of
+// dynamic entries: half exact hits, half name-only hits.
+void BM_BestMatch(benchmark::State& state) {
+  int entries = state.range(0);
+  hpack::Table table;
+  table.set_max_size(64 * 1024 * 1024);
+  for (int i = 0; i < entries; ++i) {
+    table.add(Header("x-custom-" + std::to_string(i % 16),
+                     "value-" + std::to_string(i)));
+  }
+  std::vector<Header> probes;
+  for (int i = 0; i < 64; ++i) {
+    int n = entries > 0 ? i * 7919 % entries : i;
+    probes.emplace_back("x-custom-" + std::to_string(n % 16),
+                        i % 2 == 0 ? "value-" + std::to_string(n) : "miss");
+  }
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.best_match(probes[i]));
+    i = (i + 1) % probes.size();
+  }
+}
+BENCHMARK(BM_BestMatch)
+    ->ArgName("entries")
+    ->Arg(0)
+    ->Arg(8)
+    ->Arg(64)
+    ->Arg(512);
+
+}  // anonymous namespace
+
+BENCHMARK_MAIN();
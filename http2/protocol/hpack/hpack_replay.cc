@@ -0,0 +1,403 @@
+// HPACK trace replay: encodes and decodes the header sets of recorded
+// connections, in the "story" JSON format of the hpack-test-case corpus
+// (https://github.com/http2jp/hpack-test-case), and reports how well they
+// compress and how fast.  Each story is replayed through one Encoder and one
+// Decoder, as one direction of one connection, and every decoded header set
+// is checked against the original.
+//
+// A story is {"cases": [{"headers": [{"name": "value"}, ...]}, ...]}; any
+// other fields, such as each case's "wire" encoding, are ignored.
+//
+// Usage: hpack_replay [--table_size=BYTES] [--index=all|none]
+//                     [--sensitive=NAME,...] [--rounds=N] STORY.json...
+//
+//   --table_size  the dynamic table size, in both directions (default 4096)
+//   --index       all: add every header the Encoder may to the dynamic table
+//                 none: never index (as Encoder::prepare does)
+//   --sensitive   headers never to index, e.g. cookie,authorization
+//   --rounds      timing rounds; the fastest is reported (default 5)
+//
+// Prints one line of key=value pairs per story, then a total line.  Rates
+// are fractions of the header fields; compression is block bytes over the
+// bytes of the names and values.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "http2/protocol/hpack/hpack.h"
+
+namespace hpack = http2::protocol::hpack;
+using http2::headers::Header;
+
+namespace {
+
+struct Flags {
+  unsigned int table_size = 4096;
+  unsigned int rounds = 5;
+  bool index = true;
+  std::vector<std::string> sensitive;
+  std::vector<std::string> files;
+};
+
+bool parse_flag(const char* arg, const char* name, unsigned int& out) {
+  std::size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+  out = std::strtoul(arg + len + 1, nullptr, 10);
+  return true;
+}
+
+bool parse_flag(const char* arg, const char* name, std::string& out) {
+  std::size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+  out = arg + len + 1;
+  return true;
+}
+
+// JsonReader extracts the header sets from a story.  It accepts any JSON,
+// but keeps nothing but the strings in "cases[].headers[]".
+class JsonReader final {
+ public:
+  explicit JsonReader(const std::string& text)
+      : p_(text.data()), q_(text.data() + text.size()) {}
+
+  // read returns false if the text is not JSON, or is not a story.
+  bool read(std::vector<std::vector<Header>>& cases) {
+    cases_ = &cases;
+    if (!value(TOP)) return false;
+    skip_space();
+    return p_ == q_;
+  }
+
+ private:
+  // Where a value sits in the story.
+  enum Context { TOP, CASES, CASE, HEADERS, HEADER, OTHER };
+
+  void skip_space() {
+    while (p_ != q_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' ||
+                        *p_ == '\r')) {
+      ++p_;
+    }
+  }
+
+  bool literal(const char* word) {
+    std::size_t n = std::strlen(word);
+    if (std::size_t(q_ - p_) < n || std::strncmp(p_, word, n) != 0) {
+      return false;
+    }
+    p_ += n;
+    return true;
+  }
+
+  static void append_utf8(uint32_t c, std::string& out) {
+    if (c < 0x80) {
+      out += char(c);
+    } else if (c < 0x800) {
+      out += char(0xc0 | (c >> 6));
+      out += char(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      out += char(0xe0 | (c >> 12));
+      out += char(0x80 | ((c >> 6) & 0x3f));
+      out += char(0x80 | (c & 0x3f));
+    } else {
+      out += char(0xf0 | (c >> 18));
+      out += char(0x80 | ((c >> 12) & 0x3f));
+      out += char(0x80 | ((c >> 6) & 0x3f));
+      out += char(0x80 | (c & 0x3f));
+    }
+  }
+
+  bool hex4(uint32_t& out) {
+    if (q_ - p_ < 4) return false;
+    out = 0;
+    for (int i = 0; i < 4; ++i) {
+      char ch = *p_++;
+      out <<= 4;
+      if (ch >= '0' && ch <= '9') {
+        out |= ch - '0';
+      } else if (ch >= 'a' && ch <= 'f') {
+        out |= ch - 'a' + 10;
+      } else if (ch >= 'A' && ch <= 'F') {
+        out |= ch - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool string(std::string& out) {
+    if (p_ == q_ || *p_ != '"') return false;
+    ++p_;
+    out.clear();
+    while (p_ != q_ && *p_ != '"') {
+      char ch = *p_++;
+      if (ch != '\\') {
+        out += ch;
+        continue;
+      }
+      if (p_ == q_) return false;
+      ch = *p_++;
+      switch (ch) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+          uint32_t c;
+          if (!hex4(c)) return false;
+          if (c >= 0xd800 && c < 0xdc00) {
+            uint32_t lo;
+            if (!literal("\\u") || !hex4(lo)) return false;
+            c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+          }
+          append_utf8(c, out);
+          break;
+        }
+        default: out += ch; break;
+      }
+    }
+    if (p_ == q_) return false;
+    ++p_;
+    return true;
+  }
+
+  bool object(Context ctx) {
+    ++p_;
+    skip_space();
+    if (p_ != q_ && *p_ == '}') {
+      ++p_;
+      return true;
+    }
+    std::string key;
+    while (true) {
+      skip_space();
+      if (!string(key)) return false;
+      skip_space();
+      if (p_ == q_ || *p_++ != ':') return false;
+      skip_space();
+      if (ctx == HEADER) {
+        std::string value;
+        if (!string(value)) return false;
+        cases_->back().emplace_back(key, value);
+      } else {
+        Context inner = OTHER;
+        if (ctx == TOP && key == "cases") inner = CASES;
+        if (ctx == CASE && key == "headers") inner = HEADERS;
+        if (!value(inner)) return false;
+      }
+      skip_space();
+      if (p_ == q_) return false;
+      char ch = *p_++;
+      if (ch == '}') return true;
+      if (ch != ',') return false;
+    }
+  }
+
+  bool array(Context ctx) {
+    ++p_;
+    skip_space();
+    if (p_ != q_ && *p_ == ']') {
+      ++p_;
+      return true;
+    }
+    while (true) {
+      skip_space();
+      Context inner = OTHER;
+      if (ctx == CASES) {
+        cases_->emplace_back();
+        inner = CASE;
+      }
+      if (ctx == HEADERS) inner = HEADER;
+      if (!value(inner)) return false;
+      skip_space();
+      if (p_ == q_) return false;
+      char ch = *p_++;
+      if (ch == ']') return true;
+      if (ch != ',') return false;
+    }
+  }
+
+  bool value(Context ctx) {
+    skip_space();
+    if (p_ == q_) return false;
+    bool container = (*p_ == '{' || *p_ == '[');
+    if ((ctx == CASES || ctx == HEADERS) && *p_ != '[') return false;
+    if ((ctx == CASE || ctx == HEADER) && *p_ != '{') return false;
+    if (container && *p_ == '{') return object(ctx);
+    if (container) return array(ctx);
+    if (*p_ == '"') {
+      std::string ignored;
+      return string(ignored);
+    }
+    if (literal("true") || literal("false") || literal("null")) return true;
+    const char* start = p_;
+    while (p_ != q_ && std::strchr("+-0123456789.eE", *p_) != nullptr) ++p_;
+    return p_ != start;
+  }
+
+  const char* p_;
+  const char* q_;
+  std::vector<std::vector<Header>>* cases_;
+};
+
+// Result is what one replay of one story measured.
+struct Result {
+  uint64_t header_bytes = 0;
+  uint64_t block_bytes = 0;
+  double encode_ns = 0;
+  double decode_ns = 0;
+  hpack::Stats decoded;
+};
+
+// replay encodes and decodes every case of a story, each on the same
+// connection, and returns false if a round trip fails.
+bool replay(const Flags& flags, const std::vector<std::vector<Header>>& cases,
+            Result& result) {
+  hpack::Encoder encoder;
+  hpack::Decoder decoder;
+  result.decoded = hpack::Stats();
+  decoder.set_stats(&result.decoded);
+  for (const std::string& name : flags.sensitive) {
+    encoder.sensitive_header(name);
+  }
+  encoder.mutable_table().set_max_size(flags.table_size);
+
+  std::vector<std::vector<uint8_t>> blocks(cases.size());
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < cases.size(); ++i) {
+    if (i == 0 && flags.table_size != 4096) {
+      encoder.encode_table_size_update(blocks[i]);
+    }
+    if (flags.index) {
+      encoder.encode_all(cases[i], blocks[i]);
+    } else {
+      encoder.prepare(cases[i], blocks[i]);
+    }
+  }
+  auto middle = std::chrono::steady_clock::now();
+  std::vector<std::vector<Header>> decoded(cases.size());
+  for (std::size_t i = 0; i < cases.size(); ++i) {
+    if (!decoder.decode(blocks[i], decoded[i])) return false;
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  for (std::size_t i = 0; i < cases.size(); ++i) {
+    if (decoded[i] != cases[i]) return false;
+    for (const Header& h : cases[i]) {
+      result.header_bytes += h.name.size() + h.value.size();
+    }
+    result.block_bytes += blocks[i].size();
+  }
+  result.encode_ns =
+      std::chrono::duration<double, std::nano>(middle - start).count();
+  result.decode_ns =
+      std::chrono::duration<double, std::nano>(end - middle).count();
+  return true;
+}
+
+void print(const std::string& name, const Result& r) {
+  double headers = std::max<double>(1, r.decoded[hpack::HEADERS]);
+  std::cout << "story=" << name << " headers=" << r.decoded[hpack::HEADERS]
+            << " header_bytes=" << r.header_bytes
+            << " block_bytes=" << r.block_bytes
+            << " bytes_per_header=" << r.block_bytes / headers
+            << " compression="
+            << double(r.block_bytes) / std::max<double>(1, r.header_bytes)
+            << " encode_ns_per_header=" << r.encode_ns / headers
+            << " decode_ns_per_header=" << r.decode_ns / headers
+            << " static_hit_rate="
+            << r.decoded[hpack::INDEXED_STATIC] / headers
+            << " dynamic_hit_rate="
+            << r.decoded[hpack::INDEXED_DYNAMIC] / headers
+            << " dynamic_name_rate="
+            << r.decoded[hpack::NAME_DYNAMIC] / headers
+            << " evictions=" << r.decoded[hpack::EVICTIONS] << std::endl;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  for (int i = 1; i < argc; ++i) {
+    std::string index, sensitive;
+    if (parse_flag(argv[i], "--table_size", flags.table_size) ||
+        parse_flag(argv[i], "--rounds", flags.rounds)) {
+      continue;
+    }
+    if (parse_flag(argv[i], "--index", index)) {
+      if (index != "all" && index != "none") {
+        std::cerr << "--index must be all or none" << std::endl;
+        return 2;
+      }
+      flags.index = (index == "all");
+      continue;
+    }
+    if (parse_flag(argv[i], "--sensitive", sensitive)) {
+      std::istringstream in(sensitive);
+      std::string name;
+      while (std::getline(in, name, ',')) {
+        if (!name.empty()) flags.sensitive.push_back(name);
+      }
+      continue;
+    }
+    if (argv[i][0] == '-') {
+      std::cerr << "unknown flag: " << argv[i] << std::endl;
+      return 2;
+    }
+    flags.files.push_back(argv[i]);
+  }
+  if (flags.files.empty() || flags.rounds == 0) {
+    std::cerr << "usage: hpack_replay [--table_size=BYTES] [--index=all|none] "
+                 "[--sensitive=NAME,...] [--rounds=N] STORY.json..."
+              << std::endl;
+    return 2;
+  }
+
+  Result total;
+  for (const std::string& file : flags.files) {
+    std::ifstream in(file);
+    std::stringstream text;
+    text << in.rdbuf();
+    std::vector<std::vector<Header>> cases;
+    if (!in || !JsonReader(text.str()).read(cases)) {
+      std::cerr << file << ": not a story" << std::endl;
+      return 1;
+    }
+
+    // Keep the fastest round of each direction, to shed noise.
+    Result best;
+    for (unsigned int round = 0; round < flags.rounds; ++round) {
+      Result r;
+      if (!replay(flags, cases, r)) {
+        std::cerr << file << ": round trip failed" << std::endl;
+        return 1;
+      }
+      if (round == 0 || r.encode_ns < best.encode_ns) {
+        best.encode_ns = r.encode_ns;
+      }
+      if (round == 0 || r.decode_ns < best.decode_ns) {
+        best.decode_ns = r.decode_ns;
+      }
+      best.header_bytes = r.header_bytes;
+      best.block_bytes = r.block_bytes;
+      best.decoded = r.decoded;
+    }
+    print(file, best);
+    total.header_bytes += best.header_bytes;
+    total.block_bytes += best.block_bytes;
+    total.encode_ns += best.encode_ns;
+    total.decode_ns += best.decode_ns;
+    total.decoded += best.decoded;
+  }
+  print("total", total);
+  return 0;
+}
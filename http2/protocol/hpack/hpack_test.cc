@@ -381,3 +381,101 @@ TEST(Header, RoundTrip) {
   d.reset();
   e.reset();
 }
+
+TEST(Header, Prepare) {
+  http2::protocol::hpack::Encoder e;
+  http2::protocol::hpack::Decoder d;
+  std::vector<http2::headers::Header> input = {
+      {":status", "200"},
+      {"content-type", "application/grpc"},
+      {"grpc-status", "0"}};
+  std::vector<uint8_t> block;
+  e.prepare(input, block);
+  // An indexed :status, then two literals that are never added to the table.
+  EXPECT_EQ(block[0], 0x88);
+  EXPECT_EQ(block[1], 0x0f);
+  std::vector<http2::headers::Header> back;
+  EXPECT_TRUE(d.decode(block, back));
+  EXPECT_PRED_FORMAT2(items_equal, input, back);
+  EXPECT_TRUE(d.table().empty());
+
+  // The same block is valid anywhere, any number of times.
+  std::vector<uint8_t> twice = block;
+  twice.insert(twice.end(), block.begin(), block.end());
+  EXPECT_TRUE(d.decode(twice, back));
+  EXPECT_EQ(back.size(), 6);
+  EXPECT_TRUE(d.table().empty());
+}
+
+TEST(Stats, Encoder) {
+  using namespace http2::protocol::hpack;
+  Encoder e;
+  Decoder d;
+  Stats es, ds;
+  e.set_stats(&es);
+  d.set_stats(&ds);
+  std::vector<http2::headers::Header> input = {
+      {":method", "GET"}, {":path", "/x"}, {"custom-key", "custom-value"}};
+  std::vector<uint8_t> block;
+  e.encode_all(input, block);
+  Stats s = es;
+  EXPECT_EQ(s[HEADERS], 3);
+  EXPECT_EQ(s[INDEXED_STATIC], 1);
+  EXPECT_EQ(s[NAME_STATIC], 1);
+  EXPECT_EQ(s[LITERAL_INCREMENTAL], 2);
+  EXPECT_EQ(s[HEADER_BYTES], 7 + 3 + 5 + 2 + 10 + 12);
+  EXPECT_EQ(s[BLOCK_BYTES], block.size());
+
+  // Headers sent with incremental indexing are in both tables, so the
+  // second time they are sent as bare indices.
+  std::vector<http2::headers::Header> back;
+  EXPECT_TRUE(d.decode(block, back));
+  block.clear();
+  e.encode_all(input, block);
+  EXPECT_EQ(block.size(), 3);
+  back.clear();
+  EXPECT_TRUE(d.decode(block, back));
+  EXPECT_PRED_FORMAT2(items_equal, input, back);
+  s = es;
+  EXPECT_EQ(s[INDEXED_STATIC], 2);
+  EXPECT_EQ(s[INDEXED_DYNAMIC], 2);
+  EXPECT_EQ(ds[INDEXED_DYNAMIC], 2);
+
+  // Shrinking the table evicts both entries.
+  e.mutable_table().set_max_size(0);
+  block.clear();
+  e.encode_table_size_update(block);
+  EXPECT_TRUE(d.decode(block, back));
+  EXPECT_EQ(es[EVICTIONS], 2);
+  EXPECT_EQ(es[TABLE_SIZE_UPDATES], 1);
+  EXPECT_EQ(ds[EVICTIONS], 2);
+  EXPECT_EQ(ds[TABLE_SIZE_UPDATES], 1);
+}
+
+TEST(Stats, Decoder) {
+  using namespace http2::protocol::hpack;
+  Decoder d;
+  Stats s;
+  d.set_stats(&s);
+  std::vector<http2::headers::Header> back;
+
+  // RFC 7541 Appendix C.4.1: three static entries, then :authority with a
+  // Huffman-coded value.
+  std::vector<uint8_t> block = {0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1,
+                                0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b,
+                                0xa0, 0xab, 0x90, 0xf4, 0xff};
+  EXPECT_TRUE(d.decode(block, back));
+  EXPECT_EQ(s[HEADERS], 4);
+  EXPECT_EQ(s[INDEXED_STATIC], 3);
+  EXPECT_EQ(s[NAME_STATIC], 1);
+  EXPECT_EQ(s[LITERAL_INCREMENTAL], 1);
+  EXPECT_EQ(s[HUFFMAN_PLAIN_BYTES], 15);
+  EXPECT_EQ(s[HUFFMAN_CODED_BYTES], 12);
+  EXPECT_EQ(s[BLOCK_BYTES], block.size());
+
+  // Stats add up across decoders.
+  Stats total = s;
+  total += s;
+  EXPECT_EQ(total[HEADERS], 8);
+  EXPECT_STREQ(counter_name(INDEXED_STATIC), "indexed_static");
+}
@@ -0,0 +1,126 @@
+#include "http2/protocol/priority.h"
+
+#include <algorithm>
+#include <string_view>
+
+namespace http2 {
+namespace protocol {
+
+static bool is_space(char ch) { return ch == ' ' || ch == '\t'; }
+
+static bool is_key_char(char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '_' ||
+         ch == '-' || ch == '.' || ch == '*';
+}
+
+void parse_priority(const char* begin, const char* end, Priority& out) {
+  const char* p = begin;
+  while (p != end) {
+    while (p != end && is_space(*p)) ++p;
+    const char* key = p;
+    while (p != end && is_key_char(*p)) ++p;
+    std::string_view name(key, p - key);
+
+    // Item value: a bare key means boolean true.
+    const char* value = nullptr;
+    const char* value_end = nullptr;
+    if (p != end && *p == '=') {
+      value = ++p;
+      while (p != end && *p != ';' && *p != ',' && !is_space(*p)) ++p;
+      value_end = p;
+    }
+    // Skip any parameters, and anything else up to the next member.
+    while (p != end && *p != ',') ++p;
+    if (p != end) ++p;
+
+    if (name == "u") {
+      if (value != nullptr && value_end - value == 1 && *value >= '0' &&
+          *value < char('0' + kNumUrgencies)) {
+        out.urgency = *value - '0';
+      }
+    } else if (name == "i") {
+      if (value == nullptr) {
+        out.incremental = true;
+      } else if (value_end - value == 2 && value[0] == '?') {
+        if (value[1] == '0') out.incremental = false;
+        if (value[1] == '1') out.incremental = true;
+      }
+    }
+  }
+}
+
+void PriorityScheduler::Queue::push_front(const Entry& entry) {
+  if (head_ > 0) {
+    items_[--head_] = entry;
+  } else {
+    items_.insert(items_.begin(), entry);
+  }
+}
+
+void PriorityScheduler::Queue::pop_front() {
+  ++head_;
+  if (head_ == items_.size()) {
+    clear();
+  } else if (head_ >= 16 && head_ * 2 >= items_.size()) {
+    // Reclaim the popped prefix once it makes up half of the vector.
+    items_.erase(items_.begin(), items_.begin() + head_);
+    head_ = 0;
+  }
+}
+
+void PriorityScheduler::push(uint32_t stream_id, uint32_t tag,
+                             const Priority& priority) {
+  Bucket& bucket = buckets_[std::min<unsigned int>(priority.urgency,
+                                                   kNumUrgencies - 1)];
+  Entry entry{stream_id, tag};
+  if (priority.incremental) {
+    bucket.incremental.push_back(entry);
+  } else {
+    // Nearly always the newest stream (push_back) or the one just served
+    // (push_front); anything else was reprioritized mid-response.
+    auto& q = bucket.sequential;
+    if (q.empty() || q.back().stream_id < stream_id) {
+      q.push_back(entry);
+    } else if (stream_id <= q.front().stream_id) {
+      q.push_front(entry);
+    } else {
+      auto it = std::lower_bound(q.begin(), q.end(), stream_id,
+                                 [](const Entry& e, uint32_t id) {
+                                   return e.stream_id < id;
+                                 });
+      q.insert(it, entry);
+    }
+  }
+  nonempty_ |= uint8_t(1u << (&bucket - buckets_));
+  ++size_;
+}
+
+PriorityScheduler::Entry PriorityScheduler::pop() {
+  unsigned int urgency = __builtin_ctz(nonempty_);
+  Bucket& bucket = buckets_[urgency];
+  Entry entry;
+  if (!bucket.sequential.empty()) {
+    entry = bucket.sequential.front();
+    bucket.sequential.pop_front();
+  } else {
+    entry = bucket.incremental.front();
+    bucket.incremental.pop_front();
+  }
+  if (bucket.sequential.empty() && bucket.incremental.empty()) {
+    nonempty_ &= uint8_t(~(1u << urgency));
+  }
+  --size_;
+  return entry;
+}
+
+void PriorityScheduler::clear() {
+  for (Bucket& bucket : buckets_) {
+    bucket.sequential.clear();
+    bucket.incremental.clear();
+  }
+  nonempty_ = 0;
+  size_ = 0;
+}
+
+}  // namespace protocol
+}  // namespace http2
@@ -0,0 +1,145 @@
+// Tools for the extensible prioritization scheme of RFC 9218.
+
+#ifndef HTTP2_PROTOCOL_PRIORITY_H
+#define HTTP2_PROTOCOL_PRIORITY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace http2 {
+namespace protocol {
+
+// kNumUrgencies is the number of urgency levels; 0 is the most urgent.
+constexpr unsigned int kNumUrgencies = 8;
+
+// Priority holds the parameters of an RFC 9218 priority field value.
+struct Priority final {
+  uint8_t urgency = 3;
+  bool incremental = false;
+};
+
+inline bool operator==(const Priority& a, const Priority& b) {
+  return a.urgency == b.urgency && a.incremental == b.incremental;
+}
+inline bool operator!=(const Priority& a, const Priority& b) {
+  return !(a == b);
+}
+
+// parse_priority applies the "u" and "i" members of a priority field value
+// (a Structured Fields dictionary, e.g. "u=1, i") to out.  Members that are
+// missing, unknown, or out of range leave out unchanged, as the RFC requires.
+void parse_priority(const char* begin, const char* end, Priority& out);
+inline void parse_priority(std::string_view value, Priority& out) {
+  parse_priority(value.data(), value.data() + value.size(), out);
+}
+
+// PriorityScheduler decides which stream sends the next DATA frame.  Streams
+// with data to send are kept in one bucket per urgency, and the most urgent
+// non-empty bucket is found with a bit scan.  Within a bucket, non-incremental
+// streams go first, one at a time in stream ID order, followed by
+// incremental streams taking turns round-robin.
+//
+// The scheduler knows nothing about the streams themselves.  Each entry
+// carries a caller-chosen tag, so that the caller can recognize (and skip)
+// entries made stale by a reprioritization or by the stream going away.
+// Stale entries are dropped as they are popped, or all at once by
+// remove_if.
+class PriorityScheduler final {
+ public:
+  struct Entry {
+    uint32_t stream_id;
+    uint32_t tag;
+  };
+
+  PriorityScheduler() : nonempty_(0), size_(0) {}
+
+  bool empty() const { return nonempty_ == 0; }
+
+  // size returns the number of entries, stale ones included.
+  std::size_t size() const { return size_; }
+
+  // push schedules a stream.  After a non-incremental stream sends a frame,
+  // pushing it again puts it back at the front of its bucket, whereas an
+  // incremental stream goes to the back.
+  void push(uint32_t stream_id, uint32_t tag, const Priority& priority);
+
+  // pop removes and returns the entry that should be served next.  The
+  // scheduler must not be empty.
+  Entry pop();
+
+  // remove_if removes every entry for which stale(entry) returns true,
+  // leaving the others in order.
+  template <typename Fn>
+  void remove_if(Fn stale);
+
+  // clear removes every entry.
+  void clear();
+
+ private:
+  // Queue is a FIFO of entries.  Unlike std::deque, it allocates nothing
+  // until it is first used, which keeps the many idle connections small.
+  class Queue {
+   public:
+    Queue() : head_(0) {}
+
+    bool empty() const { return head_ == items_.size(); }
+    std::size_t size() const { return items_.size() - head_; }
+    const Entry& front() const { return items_[head_]; }
+    const Entry& back() const { return items_.back(); }
+    std::vector<Entry>::iterator begin() { return items_.begin() + head_; }
+    std::vector<Entry>::iterator end() { return items_.end(); }
+
+    void push_back(const Entry& entry) { items_.push_back(entry); }
+    void push_front(const Entry& entry);
+    void insert(std::vector<Entry>::iterator it, const Entry& entry) {
+      items_.insert(it, entry);
+    }
+    void pop_front();
+    template <typename Fn>
+    void remove_if(Fn stale) {
+      items_.erase(std::remove_if(begin(), end(), stale), end());
+      if (empty()) clear();
+    }
+    void clear() {
+      items_.clear();
+      head_ = 0;
+    }
+
+   private:
+    std::vector<Entry> items_;
+    std::size_t head_;  // index of the front entry
+  };
+
+  struct Bucket {
+    Queue sequential;   // sorted by stream ID
+    Queue incremental;  // in round-robin order
+  };
+
+  Bucket buckets_[kNumUrgencies];
+  uint8_t nonempty_;  // bit u is set iff buckets_[u] has entries
+  std::size_t size_;
+};
+
+template <typename Fn>
+void PriorityScheduler::remove_if(Fn stale) {
+  size_ = 0;
+  for (unsigned int u = 0; u < kNumUrgencies; ++u) {
+    Bucket& bucket = buckets_[u];
+    bucket.sequential.remove_if(stale);
+    bucket.incremental.remove_if(stale);
+    size_ += bucket.sequential.size() + bucket.incremental.size();
+    if (bucket.sequential.empty() && bucket.incremental.empty()) {
+      nonempty_ &= uint8_t(~(1u << u));
+    }
+  }
+}
+
+}  // namespace protocol
+}  // namespace http2
+
+#endif  // HTTP2_PROTOCOL_PRIORITY_H
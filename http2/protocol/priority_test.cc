@@ -0,0 +1,124 @@
+#include "http2/protocol/priority.h"
+
+#include <cstdint>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using http2::protocol::Priority;
+using http2::protocol::PriorityScheduler;
+using http2::protocol::parse_priority;
+
+static Priority parsed(const char* value) {
+  Priority p;
+  parse_priority(value, p);
+  return p;
+}
+
+TEST(Priority, Parse) {
+  EXPECT_EQ(parsed("").urgency, 3);
+  EXPECT_FALSE(parsed("").incremental);
+  EXPECT_EQ(parsed("u=0").urgency, 0);
+  EXPECT_EQ(parsed("u=7").urgency, 7);
+  EXPECT_TRUE(parsed("i").incremental);
+  EXPECT_TRUE(parsed("i=?1").incremental);
+  EXPECT_FALSE(parsed("i=?0").incremental);
+
+  Priority p = parsed("u=5, i");
+  EXPECT_EQ(p.urgency, 5);
+  EXPECT_TRUE(p.incremental);
+  p = parsed("i;foo=bar,  u=1;x, unknown=\"abc\"");
+  EXPECT_EQ(p.urgency, 1);
+  EXPECT_TRUE(p.incremental);
+
+  // Out-of-range or mistyped values are ignored.
+  EXPECT_EQ(parsed("u=8").urgency, 3);
+  EXPECT_EQ(parsed("u=-1").urgency, 3);
+  EXPECT_EQ(parsed("u=12").urgency, 3);
+  EXPECT_EQ(parsed("u=?1").urgency, 3);
+  EXPECT_FALSE(parsed("i=1").incremental);
+
+  // Later members override earlier ones.
+  EXPECT_EQ(parsed("u=1, u=6").urgency, 6);
+}
+
+static std::vector<uint32_t> drain(PriorityScheduler& s, bool requeue,
+                                   std::size_t limit) {
+  std::vector<uint32_t> order;
+  while (!s.empty() && order.size() < limit) {
+    auto e = s.pop();
+    order.push_back(e.stream_id);
+    if (requeue) {
+      Priority p;
+      p.urgency = e.tag >> 1;
+      p.incremental = e.tag & 1;
+      s.push(e.stream_id, e.tag, p);
+    }
+  }
+  return order;
+}
+
+static void push(PriorityScheduler& s, uint32_t id, uint8_t u, bool i) {
+  Priority p;
+  p.urgency = u;
+  p.incremental = i;
+  s.push(id, (u << 1) | (i ? 1 : 0), p);
+}
+
+TEST(PriorityScheduler, UrgencyFirst) {
+  PriorityScheduler s;
+  EXPECT_TRUE(s.empty());
+  push(s, 1, 3, false);
+  push(s, 3, 7, false);
+  push(s, 5, 0, false);
+  push(s, 7, 3, false);
+  EXPECT_EQ(drain(s, false, 10), (std::vector<uint32_t>{5, 1, 7, 3}));
+  EXPECT_TRUE(s.empty());
+}
+
+TEST(PriorityScheduler, SequentialInOrder) {
+  PriorityScheduler s;
+  push(s, 5, 3, false);
+  push(s, 1, 3, false);
+  push(s, 9, 3, false);
+  push(s, 3, 3, false);
+  // A non-incremental stream keeps the front until it is done.
+  EXPECT_EQ(drain(s, true, 3), (std::vector<uint32_t>{1, 1, 1}));
+  s.clear();
+  EXPECT_TRUE(s.empty());
+}
+
+TEST(PriorityScheduler, IncrementalRoundRobin) {
+  PriorityScheduler s;
+  push(s, 1, 4, true);
+  push(s, 3, 4, true);
+  push(s, 5, 4, true);
+  EXPECT_EQ(drain(s, true, 7), (std::vector<uint32_t>{1, 3, 5, 1, 3, 5, 1}));
+
+  // Urgent work preempts the rotation, and sequential beats incremental.
+  s.clear();
+  push(s, 1, 4, true);
+  push(s, 3, 4, true);
+  push(s, 9, 4, false);
+  push(s, 11, 1, true);
+  EXPECT_EQ(drain(s, false, 10), (std::vector<uint32_t>{11, 9, 1, 3}));
+}
+
+TEST(PriorityScheduler, RemoveIf) {
+  PriorityScheduler s;
+  push(s, 1, 3, false);
+  push(s, 3, 3, true);
+  push(s, 5, 0, false);
+  push(s, 7, 3, false);
+  push(s, 9, 3, true);
+  EXPECT_EQ(s.size(), 5);
+
+  // Removing entries keeps the others in order, and empties buckets.
+  s.remove_if([](const PriorityScheduler::Entry& e) {
+    return e.stream_id == 5 || e.stream_id == 7 || e.stream_id == 3;
+  });
+  EXPECT_EQ(s.size(), 2);
+  EXPECT_EQ(drain(s, false, 10), (std::vector<uint32_t>{1, 9}));
+  EXPECT_EQ(s.size(), 0);
+}
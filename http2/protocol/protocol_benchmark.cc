@@ -0,0 +1,103 @@
+// Microbenchmarks of SETTINGS payloads and frame marshaling.
+//
+// Usage: protocol_benchmark [--benchmark_filter=REGEX]
+//                           [--benchmark_format=json] [--benchmark_out=FILE]
+
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "http2/protocol/frame.h"
+#include "http2/protocol/settings.h"
+
+namespace proto = http2::protocol;
+
+namespace {
+
+proto::Settings server_settings() {
+  proto::Settings settings;
+  settings.set_header_table_size(8192);
+  settings.set_enable_push(false);
+  settings.set_max_concurrent_streams(250);
+  settings.set_initial_window_size(1 << 20);
+  settings.set_max_frame_size(1 << 16);
+  settings.set_max_header_list_size(1 << 16);
+  return settings;
+}
+
+void BM_SettingsEncode(benchmark::State& state) {
+  proto::Settings settings = server_settings();
+  std::vector<uint8_t> out;
+  for (auto _ : state) {
+    out.clear();
+    settings.encode(out);
+    benchmark::DoNotOptimize(out.data());
+  }
+}
+BENCHMARK(BM_SettingsEncode);
+
+void BM_SettingsDecode(benchmark::State& state) {
+  std::vector<uint8_t> in;
+  server_settings().encode(in);
+  proto::Settings settings;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(settings.decode(in));
+  }
+}
+BENCHMARK(BM_SettingsDecode);
+
+void BM_FrameHeaderEncode(benchmark::State& state) {
+  uint8_t out[proto::kFrameHeaderSize];
+  uint32_t sid = 1;
+  for (auto _ : state) {
+    proto::encode_frame_header(16384, proto::DATA_FRAME, proto::NO_FLAGS, sid,
+                               out);
+    benchmark::DoNotOptimize(out);
+    sid += 2;
+  }
+}
+BENCHMARK(BM_FrameHeaderEncode);
+
+void BM_FrameHeaderDecode(benchmark::State& state) {
+  uint8_t in[proto::kFrameHeaderSize];
+  proto::encode_frame_header(16384, proto::DATA_FRAME, proto::NO_FLAGS, 1, in);
+  proto::FrameHeader hdr;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        proto::decode_frame_header(in, in + sizeof(in), hdr));
+    benchmark::DoNotOptimize(hdr);
+  }
+}
+BENCHMARK(BM_FrameHeaderDecode);
+
+// BM_FrameEncode and BM_FrameDecode marshal whole Frames, with a payload of
+// the given size.
+void BM_FrameEncode(benchmark::State& state) {
+  proto::Frame frame;
+  frame.set_type(proto::DATA_FRAME);
+  frame.set_stream_id(1);
+  frame.mutable_payload().assign(state.range(0), 'x');
+  for (auto _ : state) {
+    std::vector<uint8_t> out = frame.encode();
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FrameEncode)->Arg(0)->Arg(64)->Arg(16384);
+
+void BM_FrameDecode(benchmark::State& state) {
+  proto::Frame frame;
+  frame.set_type(proto::DATA_FRAME);
+  frame.set_stream_id(1);
+  frame.mutable_payload().assign(state.range(0), 'x');
+  std::vector<uint8_t> in = frame.encode();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(frame.decode(in));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FrameDecode)->Arg(0)->Arg(64)->Arg(16384);
+
+}  // anonymous namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,240 @@
+// Tools for keeping track of the streams on an HTTP/2 connection.
+
+#ifndef HTTP2_PROTOCOL_STREAM_TABLE_H
+#define HTTP2_PROTOCOL_STREAM_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace http2 {
+namespace protocol {
+
+// StreamStatus classifies a stream ID as seen by a StreamTable.
+enum StreamStatus {
+  // IDLE_STREAM: the ID is above every ID opened so far.
+  IDLE_STREAM,
+
+  // ACTIVE_STREAM: the stream is in the table.
+  ACTIVE_STREAM,
+
+  // RESET_STREAM: the stream was recently closed with RST_STREAM by this
+  // endpoint, so frames the peer sent before seeing it must be ignored
+  // (RFC 7540 section 5.1, "closed").
+  RESET_STREAM,
+
+  // CLOSED_STREAM: the stream was closed normally, or reset too long ago to
+  // be remembered.
+  CLOSED_STREAM,
+};
+
+// StreamTable maps the IDs of the streams opened by one peer to values of
+// type T.  Such IDs all have the same parity and only ever increase, and at
+// most SETTINGS_MAX_CONCURRENT_STREAMS of them are live at once, so they
+// cluster in a narrow window just below the newest ID.
+//
+// Each stream lives in a slot of a dense ring indexed by (id >> 1), which
+// covers the window [base, base + capacity).  Opening an ID past the end of
+// the ring slides the window forward; the rare long-lived stream that falls
+// off the back is moved to a small sorted overflow vector.  Slots are reused
+// in place, so opening a stream never allocates a node.  The ring starts
+// small and doubles whenever it is half full, up to its capacity, so the
+// many connections that only ever have a few streams open stay small.
+//
+// A bitmap covering the last kResetWindow IDs remembers which streams this
+// endpoint reset, so late frames on them can be told apart from frames on
+// streams that closed normally.
+//
+// T must be default-constructible and movable.  Resetting a slot assigns
+// T() to it, which releases whatever the old value held.
+template <typename T>
+class StreamTable final {
+ public:
+  // kResetWindow is the number of most recent IDs covered by the bitmap of
+  // reset streams.
+  static constexpr uint32_t kResetWindow = 1024;
+
+  // capacity is rounded up to a power of 2.  It should be at least twice
+  // the expected number of concurrent streams.
+  explicit StreamTable(uint32_t capacity = 64)
+      : mask_(0),
+        max_slots_(kMinSlots),
+        base_(0),
+        size_(0),
+        last_id_(0),
+        reset_top_(0),
+        reset_{} {
+    while (max_slots_ < capacity && max_slots_ < (1u << 20)) max_slots_ <<= 1;
+    ring_.resize(kMinSlots);
+    mask_ = kMinSlots - 1;
+  }
+
+  StreamTable(const StreamTable&) = delete;
+  StreamTable& operator=(const StreamTable&) = delete;
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::size_t capacity() const { return max_slots_; }
+
+  // ring_size returns the number of slots allocated so far.
+  std::size_t ring_size() const { return ring_.size(); }
+
+  // last_id returns the highest ID ever opened or reset, or 0.
+  uint32_t last_id() const { return last_id_; }
+
+  // find returns the value for a live stream, or nullptr.
+  T* find(uint32_t id) {
+    Slot* slot = find_slot(id);
+    return (slot == nullptr) ? nullptr : &slot->value;
+  }
+  const T* find(uint32_t id) const {
+    return const_cast<StreamTable*>(this)->find(id);
+  }
+
+  // status classifies any ID of the table's parity.
+  StreamStatus status(uint32_t id) const {
+    if (id > last_id_) return IDLE_STREAM;
+    if (find(id) != nullptr) return ACTIVE_STREAM;
+    return is_reset(id >> 1) ? RESET_STREAM : CLOSED_STREAM;
+  }
+
+  // insert opens a stream and returns its default-constructed value.  The ID
+  // must be greater than last_id().
+  T& insert(uint32_t id) {
+    if (size_ >= ring_.size() / 2 && ring_.size() < max_slots_) grow();
+    uint32_t index = id >> 1;
+    if (index - base_ > mask_) slide(index - mask_);
+    advance(id);
+    Slot& slot = ring_[index & mask_];
+    slot.id = id;
+    ++size_;
+    return slot.value;
+  }
+
+  // erase closes a live stream normally.  Does nothing if it is not live.
+  void erase(uint32_t id) { remove(id); }
+
+  // reset closes a stream because this endpoint sent RST_STREAM for it.  The
+  // stream need not be live: refused streams are never opened at all.
+  void reset(uint32_t id) {
+    remove(id);
+    advance(id);
+    uint32_t index = id >> 1;
+    if (in_reset_window(index)) {
+      reset_[(index / 64) % kResetWords] |= uint64_t(1) << (index % 64);
+    }
+  }
+
+  // for_each calls fn(id, value) for every live stream.
+  template <typename Fn>
+  void for_each(Fn fn) {
+    for (Slot& slot : overflow_) fn(slot.id, slot.value);
+    for (uint32_t i = 0; i <= mask_; ++i) {
+      Slot& slot = ring_[(base_ + i) & mask_];
+      if (slot.id != 0) fn(slot.id, slot.value);
+    }
+  }
+
+ private:
+  static constexpr uint32_t kResetWords = kResetWindow / 64;
+  static constexpr uint32_t kMinSlots = 8;
+
+  struct Slot {
+    uint32_t id = 0;  // 0 when the slot is empty
+    T value;
+  };
+
+  Slot* find_slot(uint32_t id) {
+    if (id == 0) return nullptr;
+    uint32_t index = id >> 1;
+    if (index >= base_) {
+      if (index - base_ > mask_) return nullptr;
+      Slot& slot = ring_[index & mask_];
+      return (slot.id == id) ? &slot : nullptr;
+    }
+    auto it = std::lower_bound(
+        overflow_.begin(), overflow_.end(), id,
+        [](const Slot& slot, uint32_t id) { return slot.id < id; });
+    if (it == overflow_.end() || it->id != id) return nullptr;
+    return &*it;
+  }
+
+  void remove(uint32_t id) {
+    Slot* slot = find_slot(id);
+    if (slot == nullptr) return;
+    --size_;
+    if (id >> 1 < base_) {
+      overflow_.erase(overflow_.begin() + (slot - overflow_.data()));
+      return;
+    }
+    slot->id = 0;
+    slot->value = T();
+  }
+
+  // grow doubles the ring.  The window keeps its base, so every live slot
+  // still falls inside it.
+  void grow() {
+    std::vector<Slot> ring(ring_.size() * 2);
+    uint32_t mask = ring.size() - 1;
+    for (Slot& slot : ring_) {
+      if (slot.id != 0) ring[(slot.id >> 1) & mask] = std::move(slot);
+    }
+    ring_.swap(ring);
+    mask_ = mask;
+  }
+
+  // slide moves the front of the ring up to new_base.  Live streams in the
+  // slots it passes over are evicted to the overflow vector, which stays
+  // sorted because they are evicted in increasing order.
+  void slide(uint32_t new_base) {
+    uint32_t steps = std::min(new_base - base_, mask_ + 1);
+    for (uint32_t i = 0; i < steps; ++i) {
+      Slot& slot = ring_[(base_ + i) & mask_];
+      if (slot.id == 0) continue;
+      overflow_.push_back(std::move(slot));
+      slot.id = 0;
+      slot.value = T();
+    }
+    base_ = new_base;
+  }
+
+  // advance records id as the newest ID seen, clearing the bitmap words
+  // that drop out of the reset window as a result.
+  void advance(uint32_t id) {
+    if (id <= last_id_) return;
+    last_id_ = id;
+    uint32_t top = (id >> 1) / 64;
+    uint32_t steps = std::min(top - reset_top_, kResetWords);
+    for (uint32_t i = 1; i <= steps; ++i) {
+      reset_[(reset_top_ + i) % kResetWords] = 0;
+    }
+    reset_top_ = top;
+  }
+
+  bool in_reset_window(uint32_t index) const {
+    return index / 64 + kResetWords > reset_top_;
+  }
+
+  bool is_reset(uint32_t index) const {
+    if (!in_reset_window(index)) return false;
+    return (reset_[(index / 64) % kResetWords] >> (index % 64)) & 1;
+  }
+
+  std::vector<Slot> ring_;
+  std::vector<Slot> overflow_;
+  uint32_t mask_;
+  uint32_t max_slots_;
+  uint32_t base_;
+  std::size_t size_;
+  uint32_t last_id_;
+  uint32_t reset_top_;
+  uint64_t reset_[kResetWords];
+};
+
+}  // namespace protocol
+}  // namespace http2
+
+#endif  // HTTP2_PROTOCOL_STREAM_TABLE_H
@@ -0,0 +1,124 @@
+#include "http2/protocol/stream_table.h"
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using http2::protocol::StreamTable;
+
+TEST(StreamTable, InsertFindErase) {
+  StreamTable<std::string> table(8);
+  EXPECT_TRUE(table.empty());
+  EXPECT_EQ(table.find(1), nullptr);
+  EXPECT_EQ(table.status(1), http2::protocol::IDLE_STREAM);
+
+  table.insert(1) = "one";
+  table.insert(3) = "three";
+  table.insert(7) = "seven";
+  EXPECT_EQ(table.size(), 3U);
+  EXPECT_EQ(table.last_id(), 7U);
+  ASSERT_NE(table.find(3), nullptr);
+  EXPECT_EQ(*table.find(3), "three");
+  EXPECT_EQ(table.find(5), nullptr);
+  EXPECT_EQ(table.status(5), http2::protocol::CLOSED_STREAM);
+  EXPECT_EQ(table.status(7), http2::protocol::ACTIVE_STREAM);
+  EXPECT_EQ(table.status(9), http2::protocol::IDLE_STREAM);
+
+  table.erase(3);
+  EXPECT_EQ(table.find(3), nullptr);
+  EXPECT_EQ(table.size(), 2U);
+  EXPECT_EQ(table.status(3), http2::protocol::CLOSED_STREAM);
+  table.erase(3);
+  EXPECT_EQ(table.size(), 2U);
+}
+
+TEST(StreamTable, SlotsAreReused) {
+  StreamTable<std::string> table(8);
+  for (uint32_t id = 1; id < 10000; id += 2) {
+    table.insert(id) = std::to_string(id);
+    ASSERT_EQ(*table.find(id), std::to_string(id));
+    table.erase(id);
+  }
+  EXPECT_TRUE(table.empty());
+  EXPECT_EQ(table.ring_size(), 8U);
+}
+
+TEST(StreamTable, Grows) {
+  StreamTable<int> table(64);
+  EXPECT_EQ(table.capacity(), 64U);
+  EXPECT_EQ(table.ring_size(), 8U);
+  for (uint32_t id = 1; id < 40; id += 2) table.insert(id) = id;
+  EXPECT_EQ(table.ring_size(), 64U);
+  for (uint32_t id = 1; id < 40; id += 2) {
+    ASSERT_NE(table.find(id), nullptr);
+    EXPECT_EQ(*table.find(id), int(id));
+  }
+  for (uint32_t id = 41; id < 400; id += 2) {
+    table.insert(id) = id;
+    table.erase(id - 40);
+  }
+  EXPECT_EQ(table.ring_size(), 64U);
+  EXPECT_EQ(table.size(), 20U);
+}
+
+TEST(StreamTable, LongLivedStreamOverflows) {
+  StreamTable<std::string> table(8);
+  table.insert(1) = "old";
+  table.insert(3) = "older";
+  for (uint32_t id = 5; id < 1001; id += 2) {
+    table.insert(id) = std::to_string(id);
+    if (id > 7) table.erase(id - 4);
+  }
+  ASSERT_NE(table.find(1), nullptr);
+  EXPECT_EQ(*table.find(1), "old");
+  ASSERT_NE(table.find(3), nullptr);
+  EXPECT_EQ(*table.find(3), "older");
+  EXPECT_EQ(*table.find(999), "999");
+  EXPECT_EQ(*table.find(997), "997");
+  EXPECT_EQ(table.find(995), nullptr);
+
+  std::vector<uint32_t> ids;
+  table.for_each([&ids](uint32_t id, std::string&) { ids.push_back(id); });
+  EXPECT_EQ(ids, (std::vector<uint32_t>{1, 3, 997, 999}));
+
+  table.erase(1);
+  table.erase(3);
+  EXPECT_EQ(table.find(1), nullptr);
+  EXPECT_EQ(table.find(3), nullptr);
+  EXPECT_EQ(table.size(), 2U);
+}
+
+TEST(StreamTable, LargeJump) {
+  StreamTable<int> table(8);
+  table.insert(1) = 1;
+  table.insert(0x7ffffff1) = 2;
+  EXPECT_EQ(*table.find(1), 1);
+  EXPECT_EQ(*table.find(0x7ffffff1), 2);
+  EXPECT_EQ(table.size(), 2U);
+}
+
+TEST(StreamTable, Reset) {
+  StreamTable<int> table(8);
+  table.insert(1);
+  table.insert(3);
+  table.reset(1);
+  table.reset(5);  // refused, never opened
+  table.erase(3);
+  EXPECT_EQ(table.status(1), http2::protocol::RESET_STREAM);
+  EXPECT_EQ(table.status(3), http2::protocol::CLOSED_STREAM);
+  EXPECT_EQ(table.status(5), http2::protocol::RESET_STREAM);
+  EXPECT_EQ(table.last_id(), 5U);
+  EXPECT_TRUE(table.empty());
+
+  // Resets are forgotten once they fall out of the window.
+  uint32_t far = 5 + 2 * (StreamTable<int>::kResetWindow + 64);
+  table.insert(far);
+  EXPECT_EQ(table.status(1), http2::protocol::CLOSED_STREAM);
+  EXPECT_EQ(table.status(5), http2::protocol::CLOSED_STREAM);
+  table.reset(far);
+  EXPECT_EQ(table.status(far), http2::protocol::RESET_STREAM);
+  EXPECT_EQ(table.status(far - 2), http2::protocol::CLOSED_STREAM);
+}
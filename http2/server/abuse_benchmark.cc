@@ -0,0 +1,125 @@
+// Abuse accounting benchmark: feeds a Connection a mix of legitimate traffic
+// (requests, uploads, PINGs, PRIORITY and WINDOW_UPDATE frames) in process,
+// with the abuse limits at their defaults and with them all off, and reports
+// the cost per frame of each.  The difference is the overhead of the
+// counters on traffic that never comes near a limit.
+//
+// Usage: abuse_benchmark [--requests=N] [--rounds=N]
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "http2/protocol/constants.h"
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/server/benchmark_util.h"
+#include "http2/server/connection.h"
+
+namespace proto = http2::protocol;
+using http2::server::bench::append_frame;
+using http2::server::bench::parse_flag;
+
+namespace {
+
+struct Flags {
+  unsigned int requests = 20000;
+  unsigned int rounds = 7;
+};
+
+// make_input builds the client side of a busy, well-behaved connection, and
+// counts its frames.
+std::vector<uint8_t> make_input(unsigned int requests, std::size_t* frames) {
+  std::vector<uint8_t> out(std::begin(proto::kConnectionPreface),
+                           std::end(proto::kConnectionPreface));
+  append_frame(out, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0, {});
+  append_frame(out, proto::SETTINGS_FRAME, proto::ACK, 0, {});
+  *frames = 2;
+
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  std::vector<uint8_t> chunk(512, 'x');
+  for (unsigned int i = 0; i < requests; ++i) {
+    uint32_t id = 2 * i + 1;
+    block.clear();
+    if (i % 4 == 0) {
+      // An upload, in a few DATA frames.
+      encoder.encode_all({{":method", "POST"},
+                          {":scheme", "http"},
+                          {":path", "/upload"},
+                          {":authority", "localhost"}},
+                         block);
+      append_frame(out, proto::HEADERS_FRAME, proto::END_HEADERS, id, block);
+      append_frame(out, proto::DATA_FRAME, proto::NO_FLAGS, id, chunk);
+      append_frame(out, proto::DATA_FRAME, proto::NO_FLAGS, id, chunk);
+      append_frame(out, proto::DATA_FRAME, proto::END_STREAM, id, chunk);
+      *frames += 4;
+    } else {
+      encoder.encode_all({{":method", "GET"},
+                          {":scheme", "http"},
+                          {":path", "/"},
+                          {":authority", "localhost"}},
+                         block);
+      append_frame(out, proto::HEADERS_FRAME,
+                   proto::END_HEADERS | proto::END_STREAM, id, block);
+      *frames += 1;
+    }
+    if (i % 8 == 0) {
+      append_frame(out, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 0,
+                   {0, 0, 0x10, 0});
+      append_frame(out, proto::PRIORITY_FRAME, proto::NO_FLAGS, id + 2,
+                   {0, 0, 0, 0, 16});
+      *frames += 2;
+    }
+    if (i % 32 == 0) {
+      append_frame(out, proto::PING_FRAME, proto::NO_FLAGS, 0,
+                   std::vector<uint8_t>(8, uint8_t(i)));
+      *frames += 1;
+    }
+  }
+  return out;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  for (int i = 1; i < argc; ++i) {
+    if (!parse_flag(argv[i], "--requests", flags.requests) &&
+        !parse_flag(argv[i], "--rounds", flags.rounds)) {
+      std::cerr << "unknown flag: " << argv[i] << std::endl;
+      return 2;
+    }
+  }
+
+  std::size_t frames;
+  std::vector<uint8_t> input = make_input(flags.requests, &frames);
+
+  http2::server::ConnectionOptions guarded;
+  guarded.settings.set_max_concurrent_streams(1000000);
+  guarded.settings.set_initial_window_size(1 << 30);
+  http2::server::ConnectionOptions unguarded = guarded;
+  unguarded.max_rapid_resets = 0;
+  unguarded.max_control_frames = 0;
+  unguarded.max_empty_frames = 0;
+  unguarded.max_continuation_frames = 0;
+  unguarded.max_header_block_size = 0;
+
+  http2::server::Handler handler = [](const http2::server::Request&,
+                                      http2::server::Response& resp) {
+    resp.headers.add(":status", "200");
+    resp.body.assign({'o', 'k'});
+  };
+  double best_unguarded, best_guarded;
+  if (!http2::server::bench::compare(unguarded, guarded, handler, input,
+                                     flags.rounds, &best_unguarded,
+                                     &best_guarded)) {
+    std::cerr << "connection failed: the traffic tripped a limit" << std::endl;
+    return 1;
+  }
+  double off = best_unguarded / frames;
+  double on = best_guarded / frames;
+  std::cout << "frames=" << frames << " ns_per_frame_unguarded=" << off
+            << " ns_per_frame_guarded=" << on
+            << " overhead_pct=" << (on - off) / off * 100 << std::endl;
+  return 0;
+}
@@ -0,0 +1,62 @@
+#include "http2/server/benchmark_util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "http2/protocol/frame.h"
+
+namespace http2 {
+namespace server {
+namespace bench {
+
+bool parse_flag(const char* arg, const char* name, unsigned int& out) {
+  std::size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+  out = std::strtoul(arg + len + 1, nullptr, 10);
+  return true;
+}
+
+void append_frame(std::vector<uint8_t>& out, uint8_t type, uint8_t flags,
+                  uint32_t sid, const std::vector<uint8_t>& payload) {
+  http2::protocol::encode_frame_header(payload.size(), type, flags, sid, out);
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+double run_once(const ConnectionOptions& options, const Handler& handler,
+                const std::vector<uint8_t>& input) {
+  Connection conn(options, handler);
+  std::vector<uint8_t> carry;
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t pos = 0; pos < input.size();) {
+    std::size_t n = std::min<std::size_t>(16384, input.size() - pos);
+    carry.insert(carry.end(), input.begin() + pos, input.begin() + pos + n);
+    pos += n;
+    std::size_t used = conn.receive(carry.data(), carry.data() + carry.size());
+    carry.erase(carry.begin(), carry.begin() + used);
+    while (conn.output_size() > 0) conn.consume_output(conn.output_size());
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return conn.done() ? -1 : elapsed.count();
+}
+
+bool compare(const ConnectionOptions& baseline,
+             const ConnectionOptions& variant, const Handler& handler,
+             const std::vector<uint8_t>& input, unsigned int rounds,
+             double* best_baseline, double* best_variant) {
+  *best_baseline = *best_variant = 1e300;
+  for (unsigned int round = 0; round < rounds; ++round) {
+    double a = run_once(baseline, handler, input);
+    double b = run_once(variant, handler, input);
+    if (a < 0 || b < 0) return false;
+    *best_baseline = std::min(*best_baseline, a);
+    *best_variant = std::min(*best_variant, b);
+  }
+  return true;
+}
+
+}  // namespace bench
+}  // namespace server
+}  // namespace http2
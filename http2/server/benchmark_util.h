@@ -0,0 +1,42 @@
+// Helpers shared by the in-process Connection benchmarks.
+
+#ifndef HTTP2_SERVER_BENCHMARK_UTIL_H
+#define HTTP2_SERVER_BENCHMARK_UTIL_H
+
+#include <cstdint>
+#include <vector>
+
+#include "http2/server/connection.h"
+#include "http2/server/handler.h"
+
+namespace http2 {
+namespace server {
+namespace bench {
+
+// parse_flag stores the value of an argument of the form "--name=N" in out,
+// and returns true, if arg is one.
+bool parse_flag(const char* arg, const char* name, unsigned int& out);
+
+// append_frame appends a frame with the given header fields and payload.
+void append_frame(std::vector<uint8_t>& out, uint8_t type, uint8_t flags,
+                  uint32_t sid, const std::vector<uint8_t>& payload);
+
+// run_once returns the nanoseconds it takes one Connection to process input
+// in 16 KiB reads, as a socket would deliver it, discarding its output; or
+// a negative number if the connection fails along the way.
+double run_once(const ConnectionOptions& options, const Handler& handler,
+                const std::vector<uint8_t>& input);
+
+// compare runs input through a Connection with each of baseline and variant
+// in turn, rounds times, and keeps the best round of each in *best_baseline
+// and *best_variant, to shed noise.  Returns false if a connection failed.
+bool compare(const ConnectionOptions& baseline,
+             const ConnectionOptions& variant, const Handler& handler,
+             const std::vector<uint8_t>& input, unsigned int rounds,
+             double* best_baseline, double* best_variant);
+
+}  // namespace bench
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_BENCHMARK_UTIL_H
@@ -0,0 +1,1092 @@
+#include "http2/server/connection.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "http2/headers/constants.h"
+#include "http2/protocol/constants.h"
+#include "http2/stats/stats.h"
+#include "http2/trace/probes.h"
+
+using http2::headers::Header;
+using http2::headers::Headers;
+using http2::protocol::Error;
+using http2::protocol::FrameHeader;
+using http2::protocol::read_u32;
+using http2::protocol::strip_padding;
+
+namespace proto = http2::protocol;
+namespace stats = http2::stats;
+
+// The opaque data of the PINGs sent by the keepalive timer.
+static constexpr uint8_t kKeepalivePing[8] = {'k', 'e', 'e', 'p',
+                                              'a', 'l', 'i', 'v'};
+
+namespace http2 {
+namespace server {
+
+// HpackCounter adds what an HPACK Encoder or Decoder counts into a
+// connection's Stats while it is in scope to http2::stats.
+class HpackCounter final {
+ public:
+  HpackCounter(const proto::hpack::Stats& counts, stats::Direction dir,
+               bool enabled)
+      : counts_(counts), dir_(dir), enabled_(enabled) {
+    if (enabled_) before_ = counts_;
+  }
+  ~HpackCounter() {
+    if (!enabled_) return;
+    proto::hpack::Stats delta = counts_;
+    delta -= before_;
+    stats::count_hpack(dir_, delta);
+  }
+
+  HpackCounter(const HpackCounter&) = delete;
+  HpackCounter& operator=(const HpackCounter&) = delete;
+
+ private:
+  const proto::hpack::Stats& counts_;
+  stats::Direction dir_;
+  bool enabled_;
+  proto::hpack::Stats before_;
+};
+
+Connection::Connection(const ConnectionOptions& options, const Handler& handler,
+                       MemoryBudget* budget)
+    : options_(options),
+      handler_(handler),
+      local_(options.settings),
+      preface_received_(false),
+      failed_(false),
+      goaway_received_(false),
+      goaway_sent_(false),
+      table_size_update_pending_(false),
+      last_stream_id_(0),
+      conn_recv_window_(proto::kDefaultWindowSize,
+                        options.window_update_fraction),
+      stream_recv_window_size_(proto::kDefaultWindowSize),
+      header_stream_id_(0),
+      header_end_stream_(false),
+      header_refused_(false),
+      header_discarded_(false),
+      header_frames_(0),
+      rapid_resets_(options.max_rapid_resets),
+      control_frames_(options.max_control_frames),
+      empty_frames_(options.max_empty_frames),
+      streams_(2 * std::min<uint32_t>(local_.max_concurrent_streams(), 512)),
+      host_(nullptr),
+      mailbox_(nullptr),
+      timers_(nullptr),
+      settings_timeout_(this, DEADLINE_SETTINGS),
+      idle_timeout_(this, DEADLINE_IDLE),
+      keepalive_timeout_(this, DEADLINE_KEEPALIVE),
+      drain_timeout_(this, DEADLINE_DRAIN),
+      settings_ack_pending_(true),
+      ping_outstanding_(false),
+      budget_(budget),
+      body_bytes_(0),
+      pending_bodies_(0),
+      transport_bytes_(0),
+      accounted_(0),
+      paused_(false) {
+  encoder_.set_stats(&encoder_stats_);
+  decoder_.set_stats(&decoder_stats_);
+
+  // The server connection preface is a (possibly empty) SETTINGS frame.
+  std::vector<uint8_t> payload;
+  local_.encode(payload);
+  write_frame(proto::SETTINGS_FRAME, proto::NO_FLAGS, 0, payload.data(),
+              payload.size());
+  local_.mark_clean();
+
+  // The connection-level window is not covered by SETTINGS; grow it to match.
+  conn_recv_window_.expand(local_.initial_window_size());
+  grant_window(0, conn_recv_window_, true);
+  update_memory();
+}
+
+Connection::~Connection() {
+  // Offloads still in flight are deleted when the mailbox delivers them.
+  for (Offload* job : offloads_) job->conn_ = nullptr;
+  if (!failed_) close_all_streams(proto::NO_ERROR);
+  if (budget_ != nullptr) budget_->adjust(accounted_, 0);
+}
+
+void Connection::attach(ConnectionHost* host, http2::net::Mailbox* mailbox,
+                        http2::net::TimerWheel* timers) {
+  host_ = host;
+  mailbox_ = mailbox;
+  timers_ = timers;
+  if (settings_ack_pending_) {
+    arm(settings_timeout_, options_.settings_timeout_ms);
+  }
+  touch();
+}
+
+std::size_t Connection::receive(const uint8_t* begin, const uint8_t* end) {
+  const uint8_t* p = begin;
+  if (failed_) return end - begin;
+  if (p != end) touch();
+
+  if (!preface_received_) {
+    std::size_t n = std::min(std::size_t(end - p),
+                             sizeof(proto::kConnectionPreface));
+    if (::memcmp(p, proto::kConnectionPreface, n) != 0) {
+      connection_error(proto::PROTOCOL_ERROR);
+      return end - begin;
+    }
+    if (n < sizeof(proto::kConnectionPreface)) return 0;
+    p += n;
+    preface_received_ = true;
+  }
+
+  FrameHeader hdr;
+  while (!failed_ && proto::decode_frame_header(p, end, hdr)) {
+    if (hdr.length > local_.max_frame_size()) {
+      connection_error(proto::FRAME_SIZE_ERROR);
+      break;
+    }
+    if (std::size_t(end - p) < proto::kFrameHeaderSize + hdr.length) break;
+    const uint8_t* payload = p + proto::kFrameHeaderSize;
+    p = payload + hdr.length;
+    if (options_.stats) {
+      stats::count_frame(stats::RECEIVED, hdr.type,
+                         proto::kFrameHeaderSize + hdr.length);
+    }
+    HTTP2_PROBE5(frame_received, this, hdr.stream_id, hdr.type, hdr.flags,
+                 hdr.length);
+    on_frame(hdr, payload, p);
+  }
+  run_ready();
+  update_memory();
+  if (failed_) return end - begin;
+  return p - begin;
+}
+
+std::size_t Connection::memory_usage() const {
+  return output_.memory_size() + header_block_.size() +
+         encoder_.table().size() + decoder_.table().size() + body_bytes_ +
+         frame_pool_.cached_bytes() + transport_bytes_;
+}
+
+void Connection::set_transport_memory(std::size_t n) {
+  transport_bytes_ = n;
+  update_memory();
+}
+
+void Connection::shutdown() {
+  if (failed_ || goaway_sent_) return;
+  goaway_sent_ = true;
+  write_goaway(proto::NO_ERROR);
+  arm(drain_timeout_, options_.drain_timeout_ms);
+  update_memory();
+}
+
+void Connection::enhance_your_calm() {
+  connection_error(proto::ENHANCE_YOUR_CALM);
+  update_memory();
+}
+
+void Connection::update_memory() {
+  // Once no streaming handler is running, the frames left over from a burst
+  // of them go back to the heap.
+  if (frame_pool_.live_frames() == 0) frame_pool_.trim();
+  std::size_t usage = memory_usage();
+  if (budget_ != nullptr) budget_->adjust(accounted_, usage);
+  accounted_ = usage;
+
+  // Pausing reads would never shrink the pending bodies (see on_data).
+  std::size_t held = usage - pending_bodies_;
+  if (!paused_ && held > options_.memory_limit) {
+    paused_ = true;
+  } else if (paused_ && held <= options_.memory_low_water) {
+    // Grant the credit that was withheld while paused.
+    paused_ = false;
+    grant_window(0, conn_recv_window_, true);
+    streams_.for_each([this](uint32_t id, Stream& s) {
+      if (s.state == STREAM_OPEN) grant_window(id, s.recv_window, true);
+    });
+    usage = memory_usage();
+    if (budget_ != nullptr) budget_->adjust(accounted_, usage);
+    accounted_ = usage;
+  }
+}
+
+void Connection::complete_offload(Offload* job) {
+  auto it = std::find(offloads_.begin(), offloads_.end(), job);
+  if (it == offloads_.end()) return;  // not ours
+  *it = offloads_.back();
+  offloads_.pop_back();
+  job->conn_ = nullptr;
+
+  // If the stream was reset, its handler is gone, and nobody owns job.
+  Stream* s = find_stream(job->stream_id_);
+  if (s == nullptr || s->wait != WAIT_OFFLOAD) {
+    delete job;
+    return;
+  }
+  // The handler owns job from here on, even if it is never resumed because
+  // the connection has failed.
+  job->delivered_ = true;
+  if (failed_) return;
+  wake(job->stream_id_, s, WAIT_OFFLOAD);
+  run_ready();
+  update_memory();
+  if (host_ != nullptr) host_->wake();
+}
+
+void Connection::arm(Timeout& timeout, uint32_t ms) {
+  if (timers_ != nullptr && ms != 0) timers_->arm(&timeout, ms);
+}
+
+// touch restarts the timeouts that any input from the peer resets.  Called
+// for every read, so it must stay cheap: re-arming a timer is O(1).
+void Connection::touch() {
+  ping_outstanding_ = false;
+  arm(idle_timeout_, options_.idle_timeout_ms);
+  arm(keepalive_timeout_, options_.keepalive_interval_ms);
+}
+
+void Connection::on_timeout(Deadline deadline, uint32_t stream_id) {
+  if (done()) return;
+  switch (deadline) {
+    case DEADLINE_SETTINGS:
+      connection_error(proto::SETTINGS_TIMEOUT);
+      break;
+    case DEADLINE_IDLE:
+      // A connection waiting on its own handlers is not idle.
+      if (!streams_.empty()) {
+        arm(idle_timeout_, options_.idle_timeout_ms);
+        return;
+      }
+      connection_error(proto::NO_ERROR);
+      break;
+    case DEADLINE_KEEPALIVE:
+      if (ping_outstanding_) {
+        connection_error(proto::NO_ERROR);
+        break;
+      }
+      write_frame(proto::PING_FRAME, proto::NO_FLAGS, 0, kKeepalivePing,
+                  sizeof(kKeepalivePing));
+      ping_outstanding_ = true;
+      arm(keepalive_timeout_, options_.keepalive_interval_ms);
+      break;
+    case DEADLINE_REQUEST:
+      stream_error(stream_id, proto::CANCEL);
+      break;
+    case DEADLINE_DRAIN:
+      connection_error(proto::NO_ERROR);
+      break;
+  }
+  update_memory();
+  if (host_ != nullptr) host_->wake();
+}
+
+void Connection::consume_output(std::size_t n) {
+  output_.consume(n);
+  update_memory();
+}
+
+Connection::Stream* Connection::find_stream(uint32_t id) {
+  return streams_.find(id);
+}
+
+void Connection::close_stream(uint32_t id, Close how, uint32_t error) {
+  Stream* s = find_stream(id);
+  if (s == nullptr) return;
+  HTTP2_PROBE4(stream_close, this, id, uint8_t(how), error);
+  release_stream(s);
+  streams_.erase(id);
+}
+
+// close_all_streams reports the streams still open when the connection fails
+// or is destroyed as closed.  They are left in place: a failed connection
+// only waits to be torn down.
+void Connection::close_all_streams(Error error) {
+  streams_.for_each([this, error](uint32_t id, Stream&) {
+    HTTP2_PROBE4(stream_close, this, id, uint8_t(CLOSE_CONNECTION),
+                 uint32_t(error));
+  });
+}
+
+// end_stream forgets a stream whose response is complete.  If the request is
+// not, the peer is told to stop sending it (RFC 7540 section 8.1).
+void Connection::end_stream(uint32_t id, Stream* s) {
+  rapid_resets_.earn();
+  if (s->state == STREAM_OPEN) return stream_error(id, proto::NO_ERROR);
+  close_stream(id);
+}
+
+// release_stream removes a stream's buffered bodies from the accounting.
+void Connection::release_stream(Stream* s) {
+  body_bytes_ -= s->request.body.size();
+  if (!s->streaming && s->state == STREAM_OPEN) {
+    pending_bodies_ -= s->request.body.size();
+  }
+  if (!s->response.file) body_bytes_ -= body_size(*s) - s->body_pos;
+}
+
+void Connection::on_frame(const FrameHeader& hdr, const uint8_t* p,
+                          const uint8_t* q) {
+  // RFC 7540 section 6.10: nothing may interrupt a header block.
+  if (header_stream_id_ != 0 && hdr.type != proto::CONTINUATION_FRAME) {
+    connection_error(proto::PROTOCOL_ERROR);
+    return;
+  }
+
+  switch (hdr.type) {
+    case proto::DATA_FRAME:
+      on_data(hdr, p, q);
+      break;
+    case proto::HEADERS_FRAME:
+      on_headers(hdr, p, q);
+      break;
+    case proto::PRIORITY_FRAME:
+      on_priority(hdr);
+      break;
+    case proto::RST_STREAM_FRAME:
+      on_rst_stream(hdr, p);
+      break;
+    case proto::SETTINGS_FRAME:
+      on_settings(hdr, p, q);
+      break;
+    case proto::PUSH_PROMISE_FRAME:
+      // Clients cannot push.
+      connection_error(proto::PROTOCOL_ERROR);
+      break;
+    case proto::PING_FRAME:
+      on_ping(hdr, p);
+      break;
+    case proto::GOAWAY_FRAME:
+      on_goaway(hdr, p);
+      break;
+    case proto::WINDOW_UPDATE_FRAME:
+      on_window_update(hdr, p);
+      break;
+    case proto::CONTINUATION_FRAME:
+      on_continuation(hdr, p, q);
+      break;
+    case proto::PRIORITY_UPDATE_FRAME:
+      on_priority_update(hdr, p, q);
+      break;
+    default:
+      // Unknown frame types MUST be ignored, but not in unlimited numbers.
+      charge(control_frames_);
+      break;
+  }
+}
+
+void Connection::on_data(const FrameHeader& hdr, const uint8_t* p,
+                         const uint8_t* q) {
+  uint32_t id = hdr.stream_id;
+  if (id == 0) return connection_error(proto::PROTOCOL_ERROR);
+
+  // Connection credit is returned on arrival, so that one slow stream cannot
+  // stall the others; each stream's own window bounds what it buffers.
+  if (!conn_recv_window_.receive(hdr.length)) {
+    return connection_error(proto::FLOW_CONTROL_ERROR);
+  }
+  conn_recv_window_.consume(hdr.length);
+  grant_window(0, conn_recv_window_);
+
+  Stream* s = find_stream(id);
+  if (s == nullptr || s->state != STREAM_OPEN) {
+    if (id > last_stream_id_) return ignore_or_fail();
+    // Frames already in flight when we reset the stream are ignored.
+    if (streams_.status(id) == proto::RESET_STREAM) return;
+    return stream_error(id, proto::STREAM_CLOSED);
+  }
+  if (!s->recv_window.receive(hdr.length)) {
+    return stream_error(id, proto::FLOW_CONTROL_ERROR);
+  }
+  if (!strip_padding(hdr, p, q)) {
+    return connection_error(proto::PROTOCOL_ERROR);
+  }
+  if (p != q) {
+    control_frames_.earn();
+    empty_frames_.earn();
+  } else if (!hdr.has_flag(proto::END_STREAM) && !charge(empty_frames_)) {
+    return;
+  }
+  if (!s->streaming) {
+    // The body is buffered until the request is complete, and reading less
+    // would not free any of it; so it must fit in the memory limit.
+    std::size_t n = q - p;
+    if (s->request.body.size() + n > options_.memory_limit) {
+      return reject_body(id, s);
+    }
+    if (memory_usage() + n > options_.memory_limit) {
+      return stream_error(id, proto::REFUSED_STREAM);
+    }
+    pending_bodies_ += n;
+  }
+  // Once a streaming handler has returned, nobody will read the rest.
+  if (!s->streaming || s->task) {
+    s->request.body.insert(s->request.body.end(), p, q);
+    body_bytes_ += q - p;
+  }
+
+  if (hdr.has_flag(proto::END_STREAM)) {
+    if (!s->streaming) return dispatch(id, s);
+    s->state = STREAM_HALF_CLOSED_REMOTE;
+    wake(id, s, WAIT_READ);
+  } else {
+    // A streaming handler's body is credited back as the handler reads it
+    // (see consume_body), so a slow reader throttles the peer.  Buffered
+    // bodies, padding and input nobody will read count as consumed now.
+    uint32_t unread = (s->streaming && s->task) ? q - p : 0;
+    s->recv_window.consume(hdr.length - unread);
+    grant_window(id, s->recv_window);
+    if (p != q) wake(id, s, WAIT_READ);
+  }
+}
+
+// reject_body answers a request whose buffered body could never fit in the
+// memory limit with 413 (Content Too Large), and stops the peer sending the
+// rest of it.
+void Connection::reject_body(uint32_t id, Stream* s) {
+  Headers headers;
+  headers.add(http2::headers::kStatus, "413");
+  send_headers(id, headers, true);
+  end_stream(id, s);
+}
+
+// consume_body accounts for n bytes of request body that a streaming handler
+// has read or abandoned, returning their credit to the peer.
+void Connection::consume_body(uint32_t id, Stream* s, std::size_t n) {
+  body_bytes_ -= n;
+  if (s->state != STREAM_OPEN) return;  // the peer is done sending
+  s->recv_window.consume(n);
+  grant_window(id, s->recv_window);
+}
+
+void Connection::on_headers(const FrameHeader& hdr, const uint8_t* p,
+                            const uint8_t* q) {
+  uint32_t id = hdr.stream_id;
+  if (id == 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (!strip_padding(hdr, p, q)) {
+    return connection_error(proto::PROTOCOL_ERROR);
+  }
+  if (hdr.has_flag(proto::PRIORITY)) {
+    if (q - p < 5) return connection_error(proto::FRAME_SIZE_ERROR);
+    p += 5;
+  }
+
+  Stream* s = find_stream(id);
+  header_refused_ = false;
+  header_discarded_ = false;
+  if (s == nullptr) {
+    if ((id & 1) == 0) return connection_error(proto::PROTOCOL_ERROR);
+    if (id <= last_stream_id_) {
+      if (streams_.status(id) != proto::RESET_STREAM) {
+        return connection_error(proto::STREAM_CLOSED);
+      }
+      header_discarded_ = true;
+    } else if (goaway_sent_) {
+      // Opened after our GOAWAY: never processed (RFC 7540 section 6.8).
+      header_discarded_ = true;
+    } else {
+      last_stream_id_ = id;
+      header_refused_ = streams_.size() >= local_.max_concurrent_streams();
+    }
+  } else if (s->state != STREAM_OPEN) {
+    // A stream error (RFC 9113 section 5.1), but the block must still be
+    // decoded to keep the HPACK state in sync.
+    stream_error(id, proto::STREAM_CLOSED);
+    header_discarded_ = true;
+  } else if (!hdr.has_flag(proto::END_STREAM)) {
+    // A second HEADERS frame carries trailers, and must end the stream.
+    return connection_error(proto::PROTOCOL_ERROR);
+  }
+
+  uint32_t max_size = options_.max_header_block_size;
+  if (std::size_t(q - p) > max_size && max_size != 0) {
+    return connection_error(proto::ENHANCE_YOUR_CALM);
+  }
+  header_stream_id_ = id;
+  header_end_stream_ = hdr.has_flag(proto::END_STREAM);
+  header_frames_ = 0;
+  header_block_.assign(p, q);
+  if (hdr.has_flag(proto::END_HEADERS)) finish_header_block();
+}
+
+void Connection::on_continuation(const FrameHeader& hdr, const uint8_t* p,
+                                 const uint8_t* q) {
+  if (header_stream_id_ == 0 || hdr.stream_id != header_stream_id_) {
+    return connection_error(proto::PROTOCOL_ERROR);
+  }
+  if (p == q && !hdr.has_flag(proto::END_HEADERS) && !charge(empty_frames_)) {
+    return;
+  }
+  uint32_t max_frames = options_.max_continuation_frames;
+  uint32_t max_size = options_.max_header_block_size;
+  if ((++header_frames_ > max_frames && max_frames != 0) ||
+      (header_block_.size() + (q - p) > max_size && max_size != 0)) {
+    return connection_error(proto::ENHANCE_YOUR_CALM);
+  }
+  header_block_.insert(header_block_.end(), p, q);
+  if (hdr.has_flag(proto::END_HEADERS)) finish_header_block();
+}
+
+void Connection::finish_header_block() {
+  uint32_t id = header_stream_id_;
+  header_stream_id_ = 0;
+
+  // The block must be decoded even if the stream is refused, so that our
+  // HPACK dynamic table stays in sync with the peer's.
+  Headers decoded;
+  HTTP2_PROBE3(hpack_decode_start, this, id, header_block_.size());
+  bool ok;
+  {
+    HpackCounter counter(decoder_stats_, stats::RECEIVED, options_.stats);
+    ok = decoder_.decode_lowmem(
+        header_block_.data(), header_block_.data() + header_block_.size(),
+        [&decoded](Header h) { decoded.add(std::move(h)); });
+  }
+  HTTP2_PROBE4(hpack_decode_end, this, id, decoded.all().size(), int(ok));
+  header_block_.clear();
+  if (!ok) return connection_error(proto::COMPRESSION_ERROR);
+
+  if (header_discarded_) return;
+  Stream* s = find_stream(id);
+  if (s != nullptr) {
+    s->request.trailers = std::move(decoded);
+    if (!s->streaming) return dispatch(id, s);
+    s->state = STREAM_HALF_CLOSED_REMOTE;
+    wake(id, s, WAIT_READ);
+    return;
+  }
+
+  if (header_refused_) return stream_error(id, proto::REFUSED_STREAM);
+  if (!decoded.first(http2::headers::kMethod).first) {
+    return stream_error(id, proto::PROTOCOL_ERROR);
+  }
+  control_frames_.earn();
+  s = &streams_.insert(id);
+  HTTP2_PROBE2(stream_open, this, id);
+  if (options_.stats) {
+    stats::count_stream_opened();
+    s->started_ns = stats::now_ns();
+  }
+  s->send_window = proto::SendWindow(peer_.initial_window_size());
+  s->recv_window = proto::ReceiveWindow(stream_recv_window_size_,
+                                        options_.window_update_fraction);
+  for (const auto& h : decoded.all()) {
+    if (h.name == http2::headers::kPriority) {
+      proto::parse_priority(h.value, s->priority);
+    }
+  }
+  // A PRIORITY_UPDATE sent ahead of the request overrides its header.
+  for (auto it = idle_priorities_.begin(); it != idle_priorities_.end();) {
+    if (it->first == id) s->priority = it->second;
+    it = (it->first <= id) ? idle_priorities_.erase(it) : it + 1;
+  }
+  s->request.stream_id = id;
+  s->request.headers = std::move(decoded);
+  s->timeout = Timeout(this, DEADLINE_REQUEST, id);
+  arm(s->timeout, options_.request_timeout_ms);
+  if (handler_.is_stream()) {
+    if (header_end_stream_) s->state = STREAM_HALF_CLOSED_REMOTE;
+    start_stream(id, s);
+  } else if (header_end_stream_) {
+    dispatch(id, s);
+  }
+}
+
+void Connection::on_priority(const FrameHeader& hdr) {
+  if (hdr.stream_id == 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (hdr.length != 5) {
+    return stream_error(hdr.stream_id, proto::FRAME_SIZE_ERROR);
+  }
+  // Prioritization hints are advisory, and ignored.
+  charge(control_frames_);
+}
+
+void Connection::on_rst_stream(const FrameHeader& hdr, const uint8_t* p) {
+  if (hdr.stream_id == 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (hdr.length != 4) return connection_error(proto::FRAME_SIZE_ERROR);
+  if (hdr.stream_id > last_stream_id_) return ignore_or_fail();
+  // A stream reset while its response is still being produced is work
+  // thrown away (the "rapid reset" attack).
+  if (find_stream(hdr.stream_id) != nullptr && !charge(rapid_resets_)) return;
+  if (options_.stats) stats::count_stream_reset(stats::RECEIVED, read_u32(p));
+  close_stream(hdr.stream_id, CLOSE_RESET_RECEIVED, read_u32(p));
+}
+
+void Connection::on_settings(const FrameHeader& hdr, const uint8_t* p,
+                             const uint8_t* q) {
+  if (hdr.stream_id != 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (hdr.has_flag(proto::ACK)) {
+    if (hdr.length != 0) return connection_error(proto::FRAME_SIZE_ERROR);
+    settings_ack_pending_ = false;
+    settings_timeout_.cancel();
+    // Our SETTINGS_INITIAL_WINDOW_SIZE now applies to the streams the peer
+    // opened in the meantime, too (section 6.9.2).
+    stream_recv_window_size_ = local_.initial_window_size();
+    streams_.for_each([this](uint32_t id, Stream& s) {
+      s.recv_window.resize(stream_recv_window_size_);
+      if (s.state == STREAM_OPEN) grant_window(id, s.recv_window);
+    });
+    return;
+  }
+  if (hdr.length % 6 != 0) return connection_error(proto::FRAME_SIZE_ERROR);
+  if (!charge(control_frames_)) return;
+
+  int64_t old_window = peer_.initial_window_size();
+  Error err = peer_.decode(p, q);
+  if (err != proto::NO_ERROR) return connection_error(err);
+
+  // RFC 7540 section 6.9.2: a change to SETTINGS_INITIAL_WINDOW_SIZE adjusts
+  // the send window of every open stream by the difference.
+  int64_t delta = int64_t(peer_.initial_window_size()) - old_window;
+  if (delta != 0) {
+    bool overflow = false;
+    streams_.for_each([delta, &overflow](uint32_t, Stream& s) {
+      if (!s.send_window.adjust(delta)) overflow = true;
+    });
+    if (overflow) return connection_error(proto::FLOW_CONTROL_ERROR);
+    if (delta > 0) wake_credit_waiters();
+  }
+
+  auto& table = encoder_.mutable_table();
+  if (peer_.header_table_size() < table.max_size()) {
+    HpackCounter counter(encoder_stats_, stats::SENT, options_.stats);
+    table.set_max_size(peer_.header_table_size());
+    table_size_update_pending_ = true;
+  }
+
+  write_frame(proto::SETTINGS_FRAME, proto::ACK, 0, nullptr, 0);
+  if (delta > 0) {
+    requeue_blocked_streams();
+    flush_data();
+  }
+}
+
+void Connection::on_ping(const FrameHeader& hdr, const uint8_t* p) {
+  if (hdr.stream_id != 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (hdr.length != 8) return connection_error(proto::FRAME_SIZE_ERROR);
+  if (!hdr.has_flag(proto::ACK) && charge(control_frames_)) {
+    write_frame(proto::PING_FRAME, proto::ACK, 0, p, 8);
+  }
+}
+
+void Connection::on_goaway(const FrameHeader& hdr, const uint8_t* p) {
+  if (hdr.stream_id != 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (hdr.length < 8) return connection_error(proto::FRAME_SIZE_ERROR);
+  if (options_.stats) stats::count_goaway(stats::RECEIVED, read_u32(p + 4));
+  goaway_received_ = true;
+}
+
+void Connection::on_window_update(const FrameHeader& hdr, const uint8_t* p) {
+  if (hdr.length != 4) return connection_error(proto::FRAME_SIZE_ERROR);
+  uint32_t id = hdr.stream_id;
+  int64_t increment = read_u32(p) & proto::kMaxStreamId;
+
+  if (id == 0) {
+    if (increment == 0) return connection_error(proto::PROTOCOL_ERROR);
+    if (!conn_send_window_.grant(increment)) {
+      return connection_error(proto::FLOW_CONTROL_ERROR);
+    }
+    flush_data();
+    wake_credit_waiters();
+    return;
+  }
+
+  Stream* s = find_stream(id);
+  if (s == nullptr) {
+    if (id > last_stream_id_) return ignore_or_fail();
+    return;  // window updates may race with stream closure
+  }
+  if (increment == 0) return stream_error(id, proto::PROTOCOL_ERROR);
+  if (!s->send_window.grant(increment)) {
+    return stream_error(id, proto::FLOW_CONTROL_ERROR);
+  }
+  if (!s->queued && s->body_pos < body_size(*s)) schedule(id, s);
+  flush_data();
+  s = find_stream(id);
+  if (s != nullptr && send_credit(*s) > 0) wake(id, s, WAIT_CREDIT);
+}
+
+void Connection::on_priority_update(const FrameHeader& hdr, const uint8_t* p,
+                                    const uint8_t* q) {
+  if (hdr.stream_id != 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (hdr.length < 4) return connection_error(proto::FRAME_SIZE_ERROR);
+  uint32_t id = read_u32(p) & proto::kMaxStreamId;
+  if (id == 0) return connection_error(proto::PROTOCOL_ERROR);
+  if (!charge(control_frames_)) return;
+  const char* value = reinterpret_cast<const char*>(p + 4);
+  const char* value_end = reinterpret_cast<const char*>(q);
+
+  if (id > last_stream_id_) {
+    // RFC 9218 section 7.1: idle streams with a buffered signal count
+    // against the concurrency limit.
+    for (auto& item : idle_priorities_) {
+      if (item.first == id) {
+        proto::parse_priority(value, value_end, item.second);
+        return;
+      }
+    }
+    if (streams_.size() + idle_priorities_.size() >=
+        local_.max_concurrent_streams()) {
+      return connection_error(proto::PROTOCOL_ERROR);
+    }
+    proto::Priority priority;
+    proto::parse_priority(value, value_end, priority);
+    idle_priorities_.emplace_back(id, priority);
+    return;
+  }
+
+  Stream* s = find_stream(id);
+  if (s == nullptr) return;  // already closed
+  proto::Priority old = s->priority;
+  proto::parse_priority(value, value_end, s->priority);
+  if (s->queued && s->priority != old) {
+    schedule(id, s);
+    flush_data();
+  }
+}
+
+void Connection::dispatch(uint32_t id, Stream* s) {
+  pending_bodies_ -= s->request.body.size();
+  s->state = STREAM_HALF_CLOSED_REMOTE;
+  HTTP2_PROBE2(dispatch_start, this, id);
+  try {
+    handler_(s->request, s->response);
+  } catch (...) {
+    // As for a streaming handler, the stream is reset and the connection
+    // carries on.
+    HTTP2_PROBE2(dispatch_end, this, id);
+    return stream_error(id, proto::INTERNAL_ERROR);
+  }
+  HTTP2_PROBE2(dispatch_end, this, id);
+  if (!s->response.file && !s->response.body.empty()) {
+    body_bytes_ += s->response.body.size();
+    s->fixed_body = std::make_shared<const std::vector<uint8_t>>(
+        std::move(s->response.body));
+  }
+
+  bool end_stream = (body_size(*s) == 0);
+  send_headers(id, s->response.headers, end_stream);
+  if (end_stream) {
+    rapid_resets_.earn();
+    close_stream(id);
+    return;
+  }
+  schedule(id, s);
+  flush_data();
+}
+
+// start_stream calls a streaming handler, which first runs from run_ready.
+void Connection::start_stream(uint32_t id, Stream* s) {
+  FramePool*& current = FramePool::current();
+  FramePool* saved = current;
+  current = &frame_pool_;
+  StreamTask task;
+  HTTP2_PROBE2(dispatch_start, this, id);
+  try {
+    task = handler_.start(ServerStream(this, id));
+  } catch (...) {
+    current = saved;
+    HTTP2_PROBE2(dispatch_end, this, id);
+    return stream_error(id, proto::INTERNAL_ERROR);
+  }
+  current = saved;
+  HTTP2_PROBE2(dispatch_end, this, id);
+
+  task.promise().stream_ = ServerStream(this, id);
+  s->streaming = true;
+  s->body_open = true;
+  s->task = std::move(task);
+  ready_.push_back(id);
+}
+
+// wake makes a streaming handler runnable, if it is waiting for reason.
+void Connection::wake(uint32_t id, Stream* s, Wait reason) {
+  if (s->wait != reason) return;
+  s->wait = WAIT_NONE;
+  ready_.push_back(id);
+}
+
+void Connection::wake_credit_waiters() {
+  streams_.for_each([this](uint32_t id, Stream& s) {
+    if (s.wait == WAIT_CREDIT && send_credit(s) > 0) wake(id, &s, WAIT_CREDIT);
+  });
+}
+
+// run_ready resumes the runnable streaming handlers, and sends what they
+// write, until none is left runnable.
+void Connection::run_ready() {
+  while (!ready_.empty() && !failed_) {
+    for (std::size_t i = 0; i < ready_.size(); ++i) resume_stream(ready_[i]);
+    ready_.clear();
+    flush_data();
+  }
+  ready_.clear();
+}
+
+void Connection::resume_stream(uint32_t id) {
+  Stream* s = find_stream(id);
+  if (s == nullptr || !s->task || s->task.done()) return;
+  s->task.resume();
+  // The handler cannot open or close streams, so s is still valid.
+  if (s->task.done()) finish_stream(id, s);
+}
+
+// finish_stream completes the response of a streaming handler that returned.
+void Connection::finish_stream(uint32_t id, Stream* s) {
+  if (s->task.promise().failed()) {
+    return stream_error(id, proto::INTERNAL_ERROR);
+  }
+  s->task = StreamTask();
+  s->body_open = false;
+  consume_body(id, s, s->request.body.size());
+  std::vector<uint8_t>().swap(s->request.body);
+
+  bool empty = (buffered_body(*s) == 0);
+  bool trailers = !s->trailer_block.empty();
+  if (!s->headers_sent) {
+    s->headers_sent = true;
+    send_headers(id, s->response.headers, empty && !trailers);
+  } else if (empty && !trailers) {
+    write_frame(proto::DATA_FRAME, proto::END_STREAM, id, nullptr, 0);
+  }
+  if (empty) {
+    if (trailers) write_header_block(id, s->trailer_block, true);
+    return end_stream(id, s);
+  }
+  if (!s->queued) schedule(id, s);
+}
+
+// send_credit returns the bytes of a stream's response that could be sent
+// now, beyond those already buffered.
+int64_t Connection::send_credit(const Stream& s) const {
+  int64_t window = std::min<int64_t>(conn_send_window_.available(),
+                                     s.send_window.available());
+  return window - int64_t(buffered_body(s));
+}
+
+void Connection::send_headers(uint32_t id, const Headers& headers,
+                              bool end_stream) {
+  std::vector<uint8_t> block;
+  {
+    HpackCounter counter(encoder_stats_, stats::SENT, options_.stats);
+    // Pseudo-headers must precede regular headers.
+    auto status = headers.first(http2::headers::kStatus);
+    encoder_.encode(Header(http2::headers::kStatus,
+                           status.first ? status.second : "200"),
+                    block);
+    for (const auto& h : headers.all()) {
+      if (h.name == http2::headers::kStatus) continue;
+      encoder_.encode(h, block);
+    }
+  }
+  write_header_block(id, block, end_stream);
+  Stream* s = find_stream(id);
+  if (s != nullptr && s->started_ns != 0) {
+    stats::record_time_to_headers(stats::now_ns() - s->started_ns);
+  }
+}
+
+// write_header_block sends an encoded header block in HEADERS and
+// CONTINUATION frames, after any dynamic table size update that is due.
+void Connection::write_header_block(uint32_t id,
+                                    const std::vector<uint8_t>& fragment,
+                                    bool end_stream) {
+  std::vector<uint8_t> prefixed;
+  const std::vector<uint8_t>& block =
+      table_size_update_pending_ ? prefixed : fragment;
+  if (table_size_update_pending_) {
+    HpackCounter counter(encoder_stats_, stats::SENT, options_.stats);
+    encoder_.encode_table_size_update(prefixed);
+    prefixed.insert(prefixed.end(), fragment.begin(), fragment.end());
+    table_size_update_pending_ = false;
+  }
+
+  proto::split_header_block(
+      block.data(), block.size(), peer_.max_frame_size(), end_stream,
+      [this, id](uint8_t type, uint8_t flags, const uint8_t* p,
+                 std::size_t n) { write_frame(type, flags, id, p, n); });
+}
+
+// body_size returns the length of a response's body, wherever it is.
+uint64_t Connection::body_size(const Stream& s) {
+  if (s.response.file) return s.response.file->length();
+  if (s.fixed_body) return s.fixed_body->size();
+  return s.response.body.size();
+}
+
+void Connection::schedule(uint32_t id, Stream* s) {
+  s->queued = true;
+  scheduler_.push(id, ++s->schedule_tag, s->priority);
+
+  // The entries left behind by reprioritized or closed streams are dropped
+  // as flush_data pops them, which it never does while the peer keeps the
+  // connection window shut.  Each stream has at most one live entry, so
+  // compact once the stale ones are sure to outnumber those.
+  if (scheduler_.size() > 2 * streams_.size() + 16) {
+    scheduler_.remove_if([this](const proto::PriorityScheduler::Entry& e) {
+      Stream* queued = find_stream(e.stream_id);
+      return queued == nullptr || !queued->queued ||
+             e.tag != queued->schedule_tag;
+    });
+  }
+}
+
+void Connection::flush_data() {
+  std::size_t max = peer_.max_frame_size();
+  while (!scheduler_.empty() && conn_send_window_.available() > 0) {
+    auto entry = scheduler_.pop();
+    uint32_t id = entry.stream_id;
+    Stream* s = find_stream(id);
+    if (s == nullptr || !s->queued || entry.tag != s->schedule_tag) continue;
+    s->queued = false;
+
+    const Response& resp = s->response;
+    uint64_t size = body_size(*s);
+    std::size_t n = std::min<uint64_t>(size - s->body_pos, max);
+    n = std::min<int64_t>(n, conn_send_window_.available());
+    n = std::min<int64_t>(n, s->send_window.available());
+    if (n == 0) {
+      // Blocked until a WINDOW_UPDATE arrives.
+      if (options_.stats) stats::count_flow_control_stall();
+      HTTP2_PROBE3(flow_control_stall, this, id, size - s->body_pos);
+      continue;
+    }
+
+    bool last = (s->body_pos + n == size) && !s->body_open;
+    bool trailers = last && !s->trailer_block.empty();
+    uint8_t flags = (last && !trailers) ? proto::END_STREAM : proto::NO_FLAGS;
+    // Only the frame header is copied, unless the body is a streaming
+    // handler's buffer, which it goes on writing to.
+    if (resp.file) {
+      write_frame(proto::DATA_FRAME, flags, id, nullptr, 0, n);
+      output_.append_file(resp.file, resp.file->fd(),
+                          resp.file->offset() + s->body_pos, n);
+    } else if (s->fixed_body) {
+      write_frame(proto::DATA_FRAME, flags, id, nullptr, 0, n);
+      output_.append_shared(s->fixed_body, s->fixed_body->data() + s->body_pos,
+                            n);
+    } else {
+      write_frame(proto::DATA_FRAME, flags, id,
+                  resp.body.data() + s->body_pos, n);
+    }
+    if (!resp.file) body_bytes_ -= n;
+    if (s->started_ns != 0) {
+      stats::record_time_to_first_byte(stats::now_ns() - s->started_ns);
+      s->started_ns = 0;
+    }
+    s->body_pos += n;
+    s->send_window.consume(n);
+    conn_send_window_.consume(n);
+    if (options_.stats && conn_send_window_.available() <= 0 &&
+        (s->body_pos < size || s->body_open)) {
+      stats::count_flow_control_stall();
+    }
+    if (conn_send_window_.available() <= 0 && s->body_pos < size) {
+      HTTP2_PROBE3(flow_control_stall, this, id, size - s->body_pos);
+    }
+    if (last) {
+      if (trailers) write_header_block(id, s->trailer_block, true);
+      end_stream(id, s);
+      continue;
+    }
+    if (s->streaming) {
+      if (s->body_pos == s->response.body.size()) {
+        s->response.body.clear();
+        s->body_pos = 0;
+      }
+      if (buffered_body(*s) <= options_.stream_buffer_size) {
+        wake(id, s, WAIT_DRAIN);
+      }
+    }
+    if (s->body_pos < body_size(*s)) schedule(id, s);
+  }
+}
+
+void Connection::requeue_blocked_streams() {
+  streams_.for_each([this](uint32_t id, Stream& s) {
+    if (!s.queued && s.body_pos < body_size(s)) schedule(id, &s);
+  });
+}
+
+// write_frame queues a frame whose payload is the n bytes at p, followed by
+// extra bytes that the caller queues itself.
+void Connection::write_frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                             const uint8_t* p, std::size_t n,
+                             std::size_t extra) {
+  uint8_t header[proto::kFrameHeaderSize];
+  proto::encode_frame_header(n + extra, type, flags, stream_id, header);
+  if (options_.stats) {
+    stats::count_frame(stats::SENT, type, sizeof(header) + n + extra);
+  }
+  HTTP2_PROBE5(frame_sent, this, stream_id, type, flags, n + extra);
+  output_.append(header, sizeof(header));
+  if (n > 0) output_.append(p, n);
+}
+
+// grant_window sends a WINDOW_UPDATE for the given stream's window (or the
+// connection's, if stream_id is 0) if one is due.  While the connection is
+// paused, credit is withheld until it resumes.
+void Connection::grant_window(uint32_t stream_id, proto::ReceiveWindow& window,
+                              bool force) {
+  if (paused_) return;
+  uint8_t payload[proto::kWindowUpdateSize];
+  if (proto::take_window_update(window, force, payload)) {
+    write_frame(proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, stream_id,
+                payload, sizeof(payload));
+  }
+}
+
+// ignore_or_fail handles a frame for a stream the peer has not opened: an
+// error, unless the stream was opened after our GOAWAY, in which case the
+// frame is ignored.
+void Connection::ignore_or_fail() {
+  if (!goaway_sent_) connection_error(proto::PROTOCOL_ERROR);
+}
+
+void Connection::write_goaway(Error error) {
+  uint8_t payload[8] = {
+      uint8_t(last_stream_id_ >> 24), uint8_t(last_stream_id_ >> 16),
+      uint8_t(last_stream_id_ >> 8),  uint8_t(last_stream_id_),
+      uint8_t(error >> 24),           uint8_t(error >> 16),
+      uint8_t(error >> 8),            uint8_t(error),
+  };
+  if (options_.stats) stats::count_goaway(stats::SENT, error);
+  write_frame(proto::GOAWAY_FRAME, proto::NO_FLAGS, 0, payload,
+              sizeof(payload));
+}
+
+// charge counts a frame against an abuse limit, and fails the connection if
+// the limit is exceeded.  Returns false if it was.
+bool Connection::charge(proto::AbuseCounter& counter) {
+  if (counter.charge()) return true;
+  connection_error(proto::ENHANCE_YOUR_CALM);
+  return false;
+}
+
+void Connection::connection_error(Error error) {
+  if (failed_) return;
+  write_goaway(error);
+  failed_ = true;
+  close_all_streams(error);
+}
+
+void Connection::stream_error(uint32_t id, Error error) {
+  uint8_t payload[4] = {
+      uint8_t(error >> 24), uint8_t(error >> 16),
+      uint8_t(error >> 8),  uint8_t(error),
+  };
+  write_frame(proto::RST_STREAM_FRAME, proto::NO_FLAGS, id, payload,
+              sizeof(payload));
+  if (options_.stats) stats::count_stream_reset(stats::SENT, error);
+  // Also fired for streams that were refused or already closed.
+  HTTP2_PROBE4(stream_close, this, id, uint8_t(CLOSE_RESET_SENT),
+               uint32_t(error));
+  Stream* s = find_stream(id);
+  if (s != nullptr) release_stream(s);
+  streams_.reset(id);
+}
+
+}  // namespace server
+}  // namespace http2
@@ -0,0 +1,495 @@
+// Tools for running the server side of a single HTTP/2 connection.
+
+#ifndef HTTP2_SERVER_CONNECTION_H
+#define HTTP2_SERVER_CONNECTION_H
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "http2/protocol/abuse.h"
+#include "http2/protocol/error.h"
+#include "http2/protocol/flow_control.h"
+#include "http2/protocol/frame.h"
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/protocol/priority.h"
+#include "http2/protocol/settings.h"
+#include "http2/protocol/stream_table.h"
+#include "http2/net/mailbox.h"
+#include "http2/net/output_queue.h"
+#include "http2/net/timer_wheel.h"
+#include "http2/server/executor.h"
+#include "http2/server/frame_pool.h"
+#include "http2/server/handler.h"
+#include "http2/server/memory.h"
+#include "http2/server/stream.h"
+
+namespace http2 {
+namespace server {
+
+// ConnectionOptions holds the tunables shared by every connection of a server.
+struct ConnectionOptions final {
+  // settings holds the SETTINGS values advertised to the peer.  Only the
+  // values that were explicitly set are sent.
+  http2::protocol::Settings settings;
+
+  // window_update_fraction controls how often request body credit is
+  // returned to the peer: a stream or connection window is only topped up
+  // once at least this fraction of it has been consumed.  Smaller values
+  // mean more WINDOW_UPDATE frames; 1.0 waits for the window to empty.
+  double window_update_fraction = 0.5;
+
+  // Once a connection holds more than memory_limit bytes (see
+  // Connection::memory_usage), it stops reading from its socket and stops
+  // granting the peer flow-control credit, until its usage falls back to
+  // memory_low_water.  Request bodies buffered for non-streaming handlers
+  // only shrink once the rest of the request is read, so they do not count
+  // towards the pause; instead, a DATA frame that would take the connection
+  // over memory_limit resets its stream (REFUSED_STREAM), or is answered
+  // with 413 if the body alone would exceed it.
+  std::size_t memory_limit = 4 << 20;
+  std::size_t memory_low_water = 1 << 20;
+
+  // stream_buffer_size bounds the response body a streaming handler may
+  // queue on one stream: a write that leaves more than this buffered
+  // suspends the handler until the stream drains.
+  std::size_t stream_buffer_size = 64 << 10;
+
+  // executor, if set, runs the work that streaming handlers pass to
+  // ServerStream::offload.  Otherwise that work runs on the event loop.
+  Executor* executor = nullptr;
+
+  // Timeouts, in milliseconds, or 0 for none.  They need a TimerWheel (see
+  // Connection::attach), which every shard provides.
+  //
+  // settings_timeout_ms bounds the wait for the peer to acknowledge our
+  // SETTINGS; the connection then fails with SETTINGS_TIMEOUT.
+  uint32_t settings_timeout_ms = 10000;
+
+  // idle_timeout_ms ends a connection with no open streams once nothing has
+  // been received for this long.
+  uint32_t idle_timeout_ms = 300000;
+
+  // keepalive_interval_ms sends a PING once nothing has been received for
+  // this long; a peer that stays silent for another interval is dropped.
+  uint32_t keepalive_interval_ms = 0;
+
+  // request_timeout_ms resets (CANCEL) a stream that is still open this
+  // long after its request headers arrived.
+  uint32_t request_timeout_ms = 0;
+
+  // drain_timeout_ms bounds how long a connection that was shut down (see
+  // Connection::shutdown) waits for its streams to finish.
+  uint32_t drain_timeout_ms = 30000;
+
+  // Abuse limits, or 0 for none.  Each class of frame that costs us work
+  // without getting the peer anything is kept on a credit balance (see
+  // http2::protocol::AbuseCounter) that useful traffic tops up; a peer that
+  // runs one out is sent away with ENHANCE_YOUR_CALM.
+  //
+  // max_rapid_resets bounds the streams the peer resets while their
+  // responses are in progress, net of the responses it lets complete.
+  uint32_t max_rapid_resets = 100;
+
+  // max_control_frames bounds the SETTINGS, PING, PRIORITY, PRIORITY_UPDATE
+  // and unknown frames, net of the requests and DATA frames.
+  uint32_t max_control_frames = 1000;
+
+  // max_empty_frames bounds the empty DATA frames that do not end their
+  // stream and the empty CONTINUATION frames, net of non-empty DATA frames.
+  uint32_t max_empty_frames = 100;
+
+  // max_continuation_frames and max_header_block_size bound each header
+  // block, which would otherwise grow for as long as the peer withholds
+  // END_HEADERS.
+  uint32_t max_continuation_frames = 32;
+  uint32_t max_header_block_size = 256 << 10;
+
+  // stats records the connection's frames, streams and response latencies
+  // in the process-wide counters of http2::stats.
+  bool stats = true;
+};
+
+// ConnectionHost is implemented by the transport that drives a Connection,
+// so that the connection can ask for attention outside of receive().
+class ConnectionHost {
+ public:
+  virtual ~ConnectionHost() = default;
+
+  // wake is called when the connection has produced output, or has become
+  // done, because offloaded work came back or a timer fired.  The transport
+  // should flush the connection soon, but not from within wake.
+  virtual void wake() = 0;
+};
+
+// StreamState enumerates the server-side stream states of RFC 7540 section
+// 5.1 that a live stream can be in.
+enum StreamState {
+  STREAM_OPEN,
+  STREAM_HALF_CLOSED_REMOTE,
+};
+
+// Connection implements the HTTP/2 protocol for one server-side connection.
+// It performs no I/O of its own: the owning transport feeds it the bytes read
+// from the socket and writes out the bytes it produces.  A Connection (and
+// the HPACK state inside it) must only be used from the thread that owns it.
+class Connection final {
+ public:
+  // Both options and handler must outlive the Connection, as must budget if
+  // one is given.  The server connection preface is queued for output
+  // immediately.
+  Connection(const ConnectionOptions& options, const Handler& handler,
+             MemoryBudget* budget = nullptr);
+  ~Connection();
+
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  // receive processes bytes read from the peer, and returns the number of
+  // bytes consumed.  Only complete frames are consumed: the caller must keep
+  // any unconsumed tail and present it again, with more data appended, on the
+  // next call.  Any streaming handlers that the input unblocks are run before
+  // receive returns.
+  std::size_t receive(const uint8_t* begin, const uint8_t* end);
+
+  // FileChunk is a range of a file that belongs in the output stream, to be
+  // written straight from the file (e.g. with sendfile).
+  struct FileChunk {
+    int fd;
+    uint64_t offset;
+    std::size_t length;
+  };
+
+  // Pending output is a sequence of in-memory bytes, interleaved with
+  // FileChunks holding the payloads of DATA frames from Response::file.  The
+  // in-memory bytes are themselves a sequence of slices: frame headers and
+  // other small pieces are copied, but response bodies are queued by
+  // reference.
+  //
+  // output_data and output_size describe the contiguous bytes at the front
+  // of the pending output; output_size() is 0 if a FileChunk is next.
+  const uint8_t* output_data() const {
+    std::size_t n;
+    return output_.front(&n);
+  }
+  std::size_t output_size() const {
+    std::size_t n;
+    output_.front(&n);
+    return n;
+  }
+
+  // gather_output fills in up to max iovecs with the in-memory bytes waiting
+  // to be written ahead of the next FileChunk, if any, for a single
+  // sendmsg(2).  Returns the number filled in, and stores their total length
+  // in *bytes.  The iovecs stay valid until the bytes are consumed.
+  std::size_t gather_output(iovec* iov, std::size_t max,
+                            std::size_t* bytes) const {
+    return output_.gather(iov, max, bytes);
+  }
+
+  // has_output returns true iff any output is pending, in memory or not.
+  bool has_output() const { return !output_.empty(); }
+
+  // consume_output discards the first n bytes of pending output, after they
+  // have been written to the peer.  n must not exceed the total length
+  // reported by gather_output().
+  void consume_output(std::size_t n);
+
+  // output_file stores the FileChunk to write next and returns true, if
+  // output_size() is 0 and a FileChunk is pending.
+  bool output_file(FileChunk& chunk) const {
+    return output_.front_file(&chunk.fd, &chunk.offset, &chunk.length);
+  }
+
+  // consume_file discards the first n bytes of the next FileChunk, after
+  // they have been written to the peer.
+  void consume_file(std::size_t n) { consume_output(n); }
+
+  // done returns true iff the connection has nothing left to do and should be
+  // closed once the pending output has been written.
+  bool done() const {
+    return failed_ || ((goaway_received_ || goaway_sent_) && streams_.empty());
+  }
+
+  // memory_usage returns the bytes this connection is holding on behalf of
+  // its peer: pending output, buffered request and response bodies, partial
+  // header blocks, both HPACK dynamic tables, cached coroutine frames, and
+  // whatever the transport has reported with set_transport_memory.
+  std::size_t memory_usage() const;
+
+  // set_transport_memory records the bytes held by the transport for this
+  // connection, e.g. in read buffers.
+  void set_transport_memory(std::size_t n);
+
+  // paused returns true iff the connection is over its memory limit, in
+  // which case the transport should stop reading from the socket.
+  bool paused() const { return paused_; }
+
+  // shutdown begins a graceful shutdown: a GOAWAY (NO_ERROR) tells the peer
+  // the last stream that will be processed.  Streams it opens after that are
+  // ignored, and the connection is done once the others finish, or fails
+  // once drain_timeout_ms has passed.
+  void shutdown();
+
+  // enhance_your_calm ends the connection with a GOAWAY (ENHANCE_YOUR_CALM).
+  // Shards use it to shed their most expensive connections when over budget.
+  void enhance_your_calm();
+
+  // attach connects the connection to its transport's event loop: host is
+  // woken for output produced outside of receive(), mailbox delivers
+  // finished Offloads (see ServerStream::offload) back to this connection,
+  // and timers runs its timeouts.  Any of them may be null.  Without a
+  // mailbox, offloaded work runs in place; without timers, nothing times
+  // out.  All three must outlive the Connection.
+  void attach(ConnectionHost* host, http2::net::Mailbox* mailbox,
+              http2::net::TimerWheel* timers);
+  ConnectionHost* host() const { return host_; }
+
+  // complete_offload takes back an Offload that was delivered through the
+  // mailbox, given that its connection() is this one, runs the handler that
+  // was waiting for it, and wakes the host.  Once the connection has failed,
+  // the handler is not run again; it frees the Offload when destroyed.
+  void complete_offload(Offload* job);
+
+  const http2::protocol::Settings& local_settings() const { return local_; }
+  const http2::protocol::Settings& peer_settings() const { return peer_; }
+  uint32_t last_stream_id() const { return last_stream_id_; }
+  std::size_t num_streams() const { return streams_.size(); }
+
+  // The compression counters of the request headers decoded and the
+  // response headers encoded on this connection.  With options.stats, they
+  // are also added to http2::stats as they grow.
+  const http2::protocol::hpack::Stats& decoder_stats() const {
+    return decoder_stats_;
+  }
+  const http2::protocol::hpack::Stats& encoder_stats() const {
+    return encoder_stats_;
+  }
+
+ private:
+  friend class ServerStream;
+
+  // What a streaming handler is suspended on, if anything.
+  enum Wait : uint8_t {
+    WAIT_NONE,
+    WAIT_READ,    // request body
+    WAIT_DRAIN,   // buffered response body
+    WAIT_CREDIT,  // send window
+    WAIT_OFFLOAD, // an Offload
+  };
+
+  // The timeouts a connection keeps.
+  enum Deadline : uint8_t {
+    DEADLINE_SETTINGS,   // our SETTINGS are acknowledged
+    DEADLINE_IDLE,       // input arrives on an idle connection
+    DEADLINE_KEEPALIVE,  // any input arrives
+    DEADLINE_REQUEST,    // a stream closes
+    DEADLINE_DRAIN,      // a shut down connection runs out of streams
+  };
+
+  // How a stream was closed, for the stream_close probe.
+  enum Close : uint8_t {
+    CLOSE_DONE,            // its response is complete
+    CLOSE_RESET_SENT,      // we sent RST_STREAM
+    CLOSE_RESET_RECEIVED,  // the peer sent RST_STREAM
+    CLOSE_CONNECTION,      // the connection failed or went away
+  };
+
+  // Timeout is a timer for one Deadline of the connection, or of a stream.
+  class Timeout final : public http2::net::TimerWheel::Timer {
+   public:
+    Timeout() = default;
+    Timeout(Connection* conn, Deadline deadline, uint32_t stream_id = 0)
+        : conn_(conn), deadline_(deadline), stream_id_(stream_id) {}
+
+   private:
+    void on_expire() override { conn_->on_timeout(deadline_, stream_id_); }
+
+    Connection* conn_ = nullptr;
+    Deadline deadline_ = DEADLINE_SETTINGS;
+    uint32_t stream_id_ = 0;
+  };
+
+  struct Stream final {
+    StreamState state = STREAM_OPEN;
+    http2::protocol::SendWindow send_window;
+    http2::protocol::ReceiveWindow recv_window;
+    bool queued = false;
+    uint32_t schedule_tag = 0;
+    http2::protocol::Priority priority;
+    uint64_t body_pos = 0;
+    Request request;
+    Response response;
+
+    // The body of a non-streaming response, moved out of response.body so
+    // that the output queue can share it rather than copy it.
+    std::shared_ptr<const std::vector<uint8_t>> fixed_body;
+
+    // When the request headers arrived (see http2::stats::now_ns), for the
+    // latency histograms; 0 once the first byte of the body is queued.
+    uint64_t started_ns = 0;
+
+    // Streaming handlers only.  task is released once the handler returns;
+    // body_open stays true until then.
+    bool streaming = false;
+    bool body_open = false;
+    bool headers_sent = false;
+    std::vector<uint8_t> trailer_block;  // prepared; none if empty
+    Wait wait = WAIT_NONE;
+    StreamTask task;
+
+    // Armed while the request timeout applies.
+    Timeout timeout;
+  };
+
+  Stream* find_stream(uint32_t id);
+  void close_stream(uint32_t id, Close how = CLOSE_DONE, uint32_t error = 0);
+  void close_all_streams(http2::protocol::Error error);
+  void end_stream(uint32_t id, Stream* s);
+  void release_stream(Stream* s);
+  void reject_body(uint32_t id, Stream* s);
+
+  void on_frame(const http2::protocol::FrameHeader& hdr, const uint8_t* p,
+                const uint8_t* q);
+  void on_data(const http2::protocol::FrameHeader& hdr, const uint8_t* p,
+               const uint8_t* q);
+  void on_headers(const http2::protocol::FrameHeader& hdr, const uint8_t* p,
+                  const uint8_t* q);
+  void on_continuation(const http2::protocol::FrameHeader& hdr,
+                       const uint8_t* p, const uint8_t* q);
+  void on_priority(const http2::protocol::FrameHeader& hdr);
+  void on_rst_stream(const http2::protocol::FrameHeader& hdr, const uint8_t* p);
+  void on_settings(const http2::protocol::FrameHeader& hdr, const uint8_t* p,
+                   const uint8_t* q);
+  void on_ping(const http2::protocol::FrameHeader& hdr, const uint8_t* p);
+  void on_goaway(const http2::protocol::FrameHeader& hdr, const uint8_t* p);
+  void on_window_update(const http2::protocol::FrameHeader& hdr,
+                        const uint8_t* p);
+  void on_priority_update(const http2::protocol::FrameHeader& hdr,
+                          const uint8_t* p, const uint8_t* q);
+
+  void arm(Timeout& timeout, uint32_t ms);
+  void touch();
+  void on_timeout(Deadline deadline, uint32_t stream_id);
+
+  void finish_header_block();
+  void dispatch(uint32_t id, Stream* s);
+  void start_stream(uint32_t id, Stream* s);
+  void wake(uint32_t id, Stream* s, Wait reason);
+  void wake_credit_waiters();
+  void run_ready();
+  void resume_stream(uint32_t id);
+  void finish_stream(uint32_t id, Stream* s);
+  void consume_body(uint32_t id, Stream* s, std::size_t n);
+  int64_t send_credit(const Stream& s) const;
+  static uint64_t body_size(const Stream& s);
+  std::size_t buffered_body(const Stream& s) const {
+    return s.response.body.size() - s.body_pos;
+  }
+  void send_headers(uint32_t id, const http2::headers::Headers& headers,
+                    bool end_stream);
+  void write_header_block(uint32_t id, const std::vector<uint8_t>& fragment,
+                          bool end_stream);
+
+  void schedule(uint32_t id, Stream* s);
+  void flush_data();
+  void requeue_blocked_streams();
+
+  void write_frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                   const uint8_t* p, std::size_t n, std::size_t extra = 0);
+  void grant_window(uint32_t stream_id, http2::protocol::ReceiveWindow& window,
+                    bool force = false);
+  void update_memory();
+  void ignore_or_fail();
+  bool charge(http2::protocol::AbuseCounter& counter);
+  void write_goaway(http2::protocol::Error error);
+  void connection_error(http2::protocol::Error error);
+  void stream_error(uint32_t id, http2::protocol::Error error);
+
+  const ConnectionOptions& options_;
+  const Handler& handler_;
+  http2::protocol::Settings local_;
+  http2::protocol::Settings peer_;
+  http2::protocol::hpack::Encoder encoder_;
+  http2::protocol::hpack::Decoder decoder_;
+  http2::protocol::hpack::Stats encoder_stats_;
+  http2::protocol::hpack::Stats decoder_stats_;
+
+  bool preface_received_;
+  bool failed_;
+  bool goaway_received_;
+  bool goaway_sent_;  // by shutdown()
+  bool table_size_update_pending_;
+  uint32_t last_stream_id_;
+  http2::protocol::SendWindow conn_send_window_;
+  http2::protocol::ReceiveWindow conn_recv_window_;
+
+  // The SETTINGS_INITIAL_WINDOW_SIZE the peer is known to use for new
+  // streams: the default until it acknowledges ours.
+  uint32_t stream_recv_window_size_;
+
+  // The header block currently being assembled from HEADERS + CONTINUATION.
+  // A refused block is answered with REFUSED_STREAM; a discarded one (for a
+  // stream we already reset) is dropped silently.  Both are still decoded.
+  uint32_t header_stream_id_;
+  bool header_end_stream_;
+  bool header_refused_;
+  bool header_discarded_;
+  uint32_t header_frames_;  // CONTINUATION frames so far
+  std::vector<uint8_t> header_block_;
+
+  // Abuse accounting; see ConnectionOptions.
+  http2::protocol::AbuseCounter rapid_resets_;
+  http2::protocol::AbuseCounter control_frames_;
+  http2::protocol::AbuseCounter empty_frames_;
+
+  // Declared ahead of streams_, so that it outlives their coroutines.
+  FramePool frame_pool_;
+
+  http2::protocol::StreamTable<Stream> streams_;
+  // Streams with response data to send.  An entry is stale unless its tag
+  // matches the stream's schedule_tag.
+  http2::protocol::PriorityScheduler scheduler_;
+
+  // Streaming handlers to resume once the current input has been processed.
+  std::vector<uint32_t> ready_;
+
+  // Offloads in flight, which must be told if the connection goes away.
+  ConnectionHost* host_;
+  http2::net::Mailbox* mailbox_;
+  std::vector<Offload*> offloads_;
+
+  // Connection-wide timeouts.  A PING is outstanding from the keepalive
+  // timer until input arrives.
+  http2::net::TimerWheel* timers_;
+  Timeout settings_timeout_;
+  Timeout idle_timeout_;
+  Timeout keepalive_timeout_;
+  Timeout drain_timeout_;
+  bool settings_ack_pending_;
+  bool ping_outstanding_;
+
+  // PRIORITY_UPDATE signals received for streams not yet opened.
+  std::vector<std::pair<uint32_t, http2::protocol::Priority>>
+      idle_priorities_;
+
+  http2::net::OutputQueue output_;
+
+  // Memory accounting.  accounted_ is the usage last reported to budget_.
+  MemoryBudget* budget_;
+  std::size_t body_bytes_;
+  std::size_t pending_bodies_;  // request bodies waiting for END_STREAM
+  std::size_t transport_bytes_;
+  std::size_t accounted_;
+  bool paused_;
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_CONNECTION_H
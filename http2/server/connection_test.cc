@@ -0,0 +1,1534 @@
+#include "http2/server/connection.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http2/protocol/constants.h"
+#include "http2/stats/stats.h"
+
+using http2::protocol::Frame;
+using http2::protocol::FrameHeader;
+using http2::server::Connection;
+using http2::server::ConnectionOptions;
+using http2::server::Request;
+using http2::server::Response;
+using http2::server::ServerStream;
+using http2::server::StreamTask;
+
+namespace proto = http2::protocol;
+
+static void append_frame(std::vector<uint8_t>& out, uint8_t type,
+                         uint8_t flags, uint32_t sid,
+                         std::vector<uint8_t> payload = {}) {
+  proto::encode_frame_header(payload.size(), type, flags, sid, out);
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+static std::vector<uint8_t> client_preface() {
+  std::vector<uint8_t> out(std::begin(proto::kConnectionPreface),
+                           std::end(proto::kConnectionPreface));
+  append_frame(out, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0);
+  return out;
+}
+
+// drain parses and consumes every frame the connection has queued.
+static std::vector<Frame> drain(Connection& conn) {
+  std::vector<uint8_t> out;
+  Connection::FileChunk chunk;
+  while (conn.has_output()) {
+    out.insert(out.end(), conn.output_data(),
+               conn.output_data() + conn.output_size());
+    conn.consume_output(conn.output_size());
+    if (conn.output_file(chunk)) {
+      std::size_t have = out.size();
+      out.resize(have + chunk.length);
+      EXPECT_EQ(::pread(chunk.fd, out.data() + have, chunk.length,
+                        chunk.offset),
+                ssize_t(chunk.length));
+      conn.consume_file(chunk.length);
+    }
+  }
+
+  std::vector<Frame> frames;
+  const uint8_t* p = out.data();
+  const uint8_t* q = p + out.size();
+  FrameHeader hdr;
+  while (proto::decode_frame_header(p, q, hdr)) {
+    const uint8_t* next = p + proto::kFrameHeaderSize + hdr.length;
+    Frame f;
+    EXPECT_TRUE(f.decode(p, next));
+    frames.push_back(f);
+    p = next;
+  }
+  EXPECT_EQ(p, q);
+  return frames;
+}
+
+// CountingHost counts the times a connection asks to be flushed.
+struct CountingHost final : public http2::server::ConnectionHost {
+  void wake() override { ++wakes; }
+  int wakes = 0;
+};
+
+static void echo_path(const Request& req, Response& resp) {
+  auto path = req.headers.first(":path");
+  resp.headers.add(":status", "200");
+  resp.body.assign(path.second.begin(), path.second.end());
+}
+
+TEST(Connection, Handshake) {
+  ConnectionOptions options;
+  options.settings.set_max_concurrent_streams(100);
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::SETTINGS_FRAME);
+  EXPECT_EQ(frames[0].payload().size(), 6);
+
+  auto input = client_preface();
+  EXPECT_EQ(conn.receive(input.data(), input.data() + input.size()),
+            input.size());
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::SETTINGS_FRAME);
+  EXPECT_TRUE(frames[0].has_flag(proto::ACK));
+  EXPECT_FALSE(conn.done());
+}
+
+TEST(Connection, BadPreface) {
+  ConnectionOptions options;
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+  drain(conn);
+
+  std::string bogus = "GET / HTTP/1.1\r\n\r\n";
+  conn.receive(reinterpret_cast<const uint8_t*>(bogus.data()),
+               reinterpret_cast<const uint8_t*>(bogus.data() + bogus.size()));
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::GOAWAY_FRAME);
+  EXPECT_EQ(frames[0].payload().at(7), proto::PROTOCOL_ERROR);
+  EXPECT_TRUE(conn.done());
+}
+
+TEST(Connection, PartialFrames) {
+  ConnectionOptions options;
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+  drain(conn);
+
+  auto input = client_preface();
+  append_frame(input, proto::PING_FRAME, proto::NO_FLAGS, 0,
+               {1, 2, 3, 4, 5, 6, 7, 8});
+
+  // Feed one byte at a time; only whole frames may be consumed.
+  std::vector<uint8_t> pending;
+  for (uint8_t byte : input) {
+    pending.push_back(byte);
+    auto n = conn.receive(pending.data(), pending.data() + pending.size());
+    pending.erase(pending.begin(), pending.begin() + n);
+  }
+  EXPECT_TRUE(pending.empty());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[1].type(), proto::PING_FRAME);
+  EXPECT_TRUE(frames[1].has_flag(proto::ACK));
+  EXPECT_EQ(frames[1].payload(), std::vector<uint8_t>({1, 2, 3, 4, 5, 6, 7, 8}));
+}
+
+TEST(Connection, Request) {
+  ConnectionOptions options;
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+  drain(conn);
+
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"},
+                      {":scheme", "http"},
+                      {":path", "/hello"},
+                      {":authority", "example.com"}},
+                     block);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 3);
+  EXPECT_EQ(frames[1].type(), proto::HEADERS_FRAME);
+  EXPECT_EQ(frames[1].stream_id(), 1);
+  EXPECT_TRUE(frames[1].has_flag(proto::END_HEADERS));
+  EXPECT_FALSE(frames[1].has_flag(proto::END_STREAM));
+
+  proto::hpack::Decoder decoder;
+  std::vector<http2::headers::Header> headers;
+  EXPECT_TRUE(decoder.decode(frames[1].payload(), headers));
+  ASSERT_EQ(headers.size(), 1);
+  EXPECT_EQ(headers[0], http2::headers::Header(":status", "200"));
+
+  EXPECT_EQ(frames[2].type(), proto::DATA_FRAME);
+  EXPECT_TRUE(frames[2].has_flag(proto::END_STREAM));
+  EXPECT_EQ(std::string(frames[2].payload().begin(), frames[2].payload().end()),
+            "/hello");
+  EXPECT_EQ(conn.num_streams(), 0);
+}
+
+TEST(Connection, FlowControl) {
+  ConnectionOptions options;
+  http2::server::Handler handler = [](const Request&, Response& resp) {
+    resp.body.assign(100, 'x');
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  // Advertise a 40-byte stream window.
+  auto input = client_preface();
+  input.resize(input.size() - proto::kFrameHeaderSize);
+  append_frame(input, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0,
+               {0x00, 0x04, 0x00, 0x00, 0x00, 40});
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 3);
+  EXPECT_EQ(frames[2].type(), proto::DATA_FRAME);
+  EXPECT_EQ(frames[2].payload().size(), 40);
+  EXPECT_FALSE(frames[2].has_flag(proto::END_STREAM));
+
+  input.clear();
+  append_frame(input, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 1,
+               {0x00, 0x00, 0x00, 100});
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].payload().size(), 60);
+  EXPECT_TRUE(frames[0].has_flag(proto::END_STREAM));
+}
+
+TEST(Connection, Stats) {
+  ConnectionOptions options;
+  http2::server::Handler handler = [](const Request&, Response& resp) {
+    resp.body.assign(100, 'x');
+  };
+  Connection conn(options, handler);
+  drain(conn);
+  http2::stats::Snapshot before = http2::stats::snapshot();
+
+  // As in FlowControl: the response stalls on a 40-byte stream window.
+  auto input = client_preface();
+  input.resize(input.size() - proto::kFrameHeaderSize);
+  append_frame(input, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0,
+               {0x00, 0x04, 0x00, 0x00, 0x00, 40});
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  append_frame(input, proto::RST_STREAM_FRAME, proto::NO_FLAGS, 1,
+               {0, 0, 0, proto::CANCEL});
+  conn.receive(input.data(), input.data() + input.size());
+  drain(conn);
+
+  http2::stats::Snapshot after = http2::stats::snapshot();
+  auto delta = [](uint64_t a, uint64_t b) { return a - b; };
+  EXPECT_EQ(delta(after.frames[http2::stats::RECEIVED][proto::HEADERS_FRAME],
+                  before.frames[http2::stats::RECEIVED][proto::HEADERS_FRAME]),
+            1);
+  EXPECT_EQ(delta(after.frames[http2::stats::SENT][proto::DATA_FRAME],
+                  before.frames[http2::stats::SENT][proto::DATA_FRAME]),
+            1);
+  EXPECT_EQ(delta(after.bytes[http2::stats::RECEIVED],
+                  before.bytes[http2::stats::RECEIVED]),
+            input.size() - sizeof(proto::kConnectionPreface));
+  EXPECT_EQ(delta(after.streams_opened, before.streams_opened), 1);
+  EXPECT_EQ(
+      delta(after.streams_reset[http2::stats::RECEIVED][proto::CANCEL],
+            before.streams_reset[http2::stats::RECEIVED][proto::CANCEL]),
+      1);
+  EXPECT_EQ(delta(after.flow_control_stalls, before.flow_control_stalls), 1);
+  EXPECT_EQ(delta(after.time_to_headers.count(),
+                  before.time_to_headers.count()),
+            1);
+  EXPECT_EQ(delta(after.time_to_first_byte.count(),
+                  before.time_to_first_byte.count()),
+            1);
+  using proto::hpack::HEADERS;
+  EXPECT_EQ(conn.decoder_stats()[HEADERS], 2);
+  EXPECT_EQ(conn.encoder_stats()[HEADERS], 1);
+  EXPECT_EQ(delta(after.hpack[http2::stats::RECEIVED][HEADERS],
+                  before.hpack[http2::stats::RECEIVED][HEADERS]),
+            2);
+  EXPECT_EQ(delta(after.hpack[http2::stats::SENT][HEADERS],
+                  before.hpack[http2::stats::SENT][HEADERS]),
+            1);
+}
+
+TEST(Connection, LateFrames) {
+  ConnectionOptions options;
+  options.settings.set_max_concurrent_streams(1);
+  options.window_update_fraction = 0;  // return credit for every frame
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+  drain(conn);
+
+  // Stream 1 stays open; stream 3 is refused.
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  block.clear();
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 3, block);
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[1].type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames[1].stream_id(), 3);
+  EXPECT_EQ(conn.num_streams(), 1);
+
+  // DATA that was already in flight on the refused stream is ignored, apart
+  // from connection-level flow control.
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::END_STREAM, 3, {'h', 'i'});
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::WINDOW_UPDATE_FRAME);
+  EXPECT_EQ(frames[0].stream_id(), 0);
+
+  // Finish stream 1; more DATA on it is a stream error.
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::END_STREAM, 1, {'o', 'k'});
+  conn.receive(input.data(), input.data() + input.size());
+  drain(conn);
+  EXPECT_EQ(conn.num_streams(), 0);
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::END_STREAM, 1, {'n', 'o'});
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[1].type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames[1].stream_id(), 1);
+  EXPECT_FALSE(conn.done());
+}
+
+// HEADERS on a half-closed (remote) stream resets only that stream.
+TEST(Connection, HeadersAfterEndStream) {
+  ConnectionOptions options;
+  http2::server::Handler handler = [](const Request&, Response& resp) {
+    resp.body.assign(100000, 'x');  // more than the send window
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+  drain(conn);
+  ASSERT_EQ(conn.num_streams(), 1);
+
+  // The stray block adds to the dynamic table, which stream 3 then uses.
+  input.clear();
+  block.clear();
+  encoder.encode_all({{"x-stray", "1"}}, block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  block.clear();
+  encoder.encode_all({{":method", "GET"}, {":path", "/"}, {"x-stray", "1"}},
+                     block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 3, block);
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  ASSERT_GE(frames.size(), 2);
+  EXPECT_EQ(frames[0].type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames[0].stream_id(), 1);
+  EXPECT_EQ(frames[0].payload().at(3), proto::STREAM_CLOSED);
+  EXPECT_EQ(frames[1].type(), proto::HEADERS_FRAME);
+  EXPECT_EQ(frames[1].stream_id(), 3);
+  EXPECT_FALSE(conn.done());
+}
+
+TEST(Connection, Priority) {
+  ConnectionOptions options;
+  http2::server::Handler handler = [](const Request& req, Response& resp) {
+    auto path = req.headers.first(":path");
+    resp.body.assign(path.second == "/bulk" ? 100000 : 10, 'x');
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  // The bulk download uses up the connection and stream windows.
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/bulk"},
+                      {"priority", "u=5"}},
+                     block);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+  std::size_t sent = 0;
+  for (const auto& f : drain(conn)) {
+    if (f.type() == proto::DATA_FRAME) sent += f.payload().size();
+  }
+  EXPECT_EQ(sent, 65535);
+
+  // An urgent request arrives, and a PRIORITY_UPDATE makes the bulk download
+  // even less urgent.  When the windows open, the urgent response goes first.
+  input.clear();
+  block.clear();
+  encoder.encode_all({{":method", "GET"}, {":path", "/css"},
+                      {"priority", "u=0"}},
+                     block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 3, block);
+  append_frame(input, proto::PRIORITY_UPDATE_FRAME, proto::NO_FLAGS, 0,
+               {0x00, 0x00, 0x00, 0x01, 'u', '=', '7'});
+  append_frame(input, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 1,
+               {0x00, 0x01, 0x00, 0x00});
+  append_frame(input, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 0,
+               {0x00, 0x01, 0x00, 0x00});
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  std::vector<uint32_t> data_order;
+  for (const auto& f : frames) {
+    if (f.type() == proto::DATA_FRAME) data_order.push_back(f.stream_id());
+  }
+  ASSERT_GE(data_order.size(), 2);
+  EXPECT_EQ(data_order[0], 3);
+  EXPECT_EQ(data_order[1], 1);
+}
+
+TEST(Connection, PriorityUpdateChurn) {
+  ConnectionOptions options;
+  options.max_control_frames = 0;
+  http2::server::Handler handler = [](const Request& req, Response& resp) {
+    auto path = req.headers.first(":path");
+    resp.body.assign(path.second == "/bulk" ? 100000 : 10, 'x');
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  // The bulk download shuts the connection window.
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/bulk"},
+                      {"priority", "u=5"}},
+                     block);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  block.clear();
+  encoder.encode_all({{":method", "GET"}, {":path", "/css"}}, block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 3, block);
+  conn.receive(input.data(), input.data() + input.size());
+  drain(conn);
+
+  // Reprioritizing the waiting response over and over leaves stale entries
+  // behind; they must not get in the way once the window opens.
+  input.clear();
+  for (int i = 0; i < 1000; ++i) {
+    uint8_t u = (i % 2 == 0) ? '1' : '2';
+    append_frame(input, proto::PRIORITY_UPDATE_FRAME, proto::NO_FLAGS, 0,
+                 {0x00, 0x00, 0x00, 0x03, 'u', '=', u});
+  }
+  append_frame(input, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 1,
+               {0x00, 0x01, 0x00, 0x00});
+  append_frame(input, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 0,
+               {0x00, 0x01, 0x00, 0x00});
+  conn.receive(input.data(), input.data() + input.size());
+  std::vector<uint32_t> data_order;
+  for (const auto& f : drain(conn)) {
+    if (f.type() == proto::DATA_FRAME) data_order.push_back(f.stream_id());
+  }
+  ASSERT_GE(data_order.size(), 2);
+  EXPECT_EQ(data_order[0], 3);
+  EXPECT_EQ(data_order[1], 1);
+  EXPECT_FALSE(conn.done());
+}
+
+TEST(Connection, FileBody) {
+  std::string contents;
+  for (int i = 0; i < 5000; ++i) contents.append(std::to_string(i));
+  std::FILE* tmp = std::tmpfile();
+  ASSERT_NE(tmp, nullptr);
+  ASSERT_EQ(std::fwrite(contents.data(), 1, contents.size(), tmp),
+            contents.size());
+  std::fflush(tmp);
+  int fd = ::dup(fileno(tmp));
+  std::fclose(tmp);
+
+  ConnectionOptions options;
+  auto file = std::make_shared<http2::server::FileBody>(fd, 100, 17000);
+  http2::server::Handler handler = [&file](const Request&, Response& resp) {
+    resp.file = file;
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/file"}}, block);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  append_frame(input, proto::PING_FRAME, proto::NO_FLAGS, 0,
+               {1, 2, 3, 4, 5, 6, 7, 8});
+  conn.receive(input.data(), input.data() + input.size());
+
+  // Two DATA frames, split at the peer's max_frame_size, with the PING ACK
+  // queued after them in memory.
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 5);
+  EXPECT_EQ(frames[1].type(), proto::HEADERS_FRAME);
+  EXPECT_FALSE(frames[1].has_flag(proto::END_STREAM));
+  EXPECT_EQ(frames[2].type(), proto::DATA_FRAME);
+  EXPECT_EQ(frames[2].payload().size(), 16384);
+  EXPECT_EQ(frames[3].type(), proto::DATA_FRAME);
+  EXPECT_TRUE(frames[3].has_flag(proto::END_STREAM));
+  EXPECT_EQ(frames[4].type(), proto::PING_FRAME);
+  std::string body(frames[2].payload().begin(), frames[2].payload().end());
+  body.append(frames[3].payload().begin(), frames[3].payload().end());
+  EXPECT_EQ(body, contents.substr(100, 17000));
+  EXPECT_EQ(conn.num_streams(), 0);
+}
+
+TEST(Connection, HandlerThrows) {
+  ConnectionOptions options;
+  http2::server::Handler handler = [](const Request& req, Response& resp) {
+    if (req.headers.first(":path").second == "/missing") {
+      resp.file = http2::server::FileBody::open("/nonexistent/missing");
+    }
+    resp.headers.add(":status", "200");
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  // The stream that threw is reset; the connection and its other streams
+  // carry on.
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/missing"}}, block);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  block.clear();
+  encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 3, block);
+  conn.receive(input.data(), input.data() + input.size());
+
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 3);
+  EXPECT_EQ(frames[1].type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames[1].stream_id(), 1);
+  EXPECT_EQ(frames[1].payload()[3], proto::INTERNAL_ERROR);
+  EXPECT_EQ(frames[2].type(), proto::HEADERS_FRAME);
+  EXPECT_EQ(frames[2].stream_id(), 3);
+  EXPECT_FALSE(conn.done());
+  EXPECT_EQ(conn.num_streams(), 0);
+}
+
+TEST(Connection, SharedBody) {
+  ConnectionOptions options;
+  std::vector<uint8_t> contents(20000);
+  for (std::size_t i = 0; i < contents.size(); ++i) contents[i] = uint8_t(i);
+  const uint8_t* body_data = nullptr;
+  http2::server::Handler handler = [&](const Request&, Response& resp) {
+    resp.body = contents;
+    body_data = resp.body.data();
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+
+  // The DATA payloads are gathered from the handler's own buffer, between
+  // frame headers copied into the queue.
+  iovec iov[16];
+  std::size_t bytes;
+  std::size_t n = conn.gather_output(iov, 16, &bytes);
+  ASSERT_EQ(n, 4);
+  EXPECT_EQ(iov[1].iov_base, body_data);
+  EXPECT_EQ(iov[1].iov_len, 16384);
+  EXPECT_EQ(iov[3].iov_base, body_data + 16384);
+  EXPECT_EQ(iov[3].iov_len, 20000 - 16384);
+  EXPECT_EQ(conn.num_streams(), 0);
+  EXPECT_GE(conn.memory_usage(), 20000);
+
+  // A partial write leaves the rest in place.
+  conn.consume_output(iov[0].iov_len + 100);
+  n = conn.gather_output(iov, 16, &bytes);
+  ASSERT_EQ(n, 3);
+  EXPECT_EQ(iov[0].iov_base, body_data + 100);
+  conn.consume_output(iov[0].iov_len);
+
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::DATA_FRAME);
+  EXPECT_TRUE(frames[0].has_flag(proto::END_STREAM));
+  EXPECT_EQ(std::vector<uint8_t>(frames[0].payload().begin(),
+                                 frames[0].payload().end()),
+            std::vector<uint8_t>(contents.begin() + 16384, contents.end()));
+  EXPECT_FALSE(conn.has_output());
+}
+
+// Like the shards, this stops feeding input while the connection is paused.
+TEST(Connection, MemoryLimit) {
+  ConnectionOptions options;
+  options.memory_limit = 1000;
+  options.memory_low_water = 500;
+  options.window_update_fraction = 0;  // return credit for every frame
+  http2::server::Handler handler = [](const Request& req, Response& resp) {
+    resp.headers.add(":status", "200");
+    if (req.headers.first(":path").second == "/big") {
+      resp.body.assign(2000, 'y');
+      return;
+    }
+    std::string n = std::to_string(req.body.size());
+    resp.body.assign(n.begin(), n.end());
+  };
+  http2::server::MemoryBudget budget(0);
+  Connection conn(options, handler, &budget);
+  drain(conn);
+  EXPECT_EQ(budget.used(), conn.memory_usage());
+
+  proto::hpack::Encoder encoder;
+  auto request = [&encoder](std::vector<uint8_t>& out, uint32_t id,
+                            const char* method, const char* path,
+                            uint8_t flags) {
+    std::vector<uint8_t> block;
+    encoder.encode_all({{":method", method}, {":path", path}}, block);
+    append_frame(out, proto::HEADERS_FRAME, proto::END_HEADERS | flags, id,
+                 block);
+  };
+
+  // A buffered body that could never fit is refused with 413, rather than
+  // pausing a connection that would then never read the rest of it.
+  auto input = client_preface();
+  request(input, 1, "POST", "/", proto::NO_FLAGS);
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(2000, 'x'));
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_FALSE(conn.paused());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 4);
+  EXPECT_EQ(frames[1].type(), proto::WINDOW_UPDATE_FRAME);
+  EXPECT_EQ(frames[1].stream_id(), 0);
+  EXPECT_EQ(frames[2].type(), proto::HEADERS_FRAME);
+  EXPECT_TRUE(frames[2].has_flag(proto::END_STREAM));
+  EXPECT_EQ(frames[3].type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames[3].payload().at(3), proto::NO_ERROR);
+  EXPECT_EQ(conn.num_streams(), 0);
+  EXPECT_EQ(budget.used(), conn.memory_usage());
+
+  // Bodies that fit alone but not together: the one that would go over is
+  // refused, and the other is served.
+  input.clear();
+  request(input, 3, "POST", "/", proto::NO_FLAGS);
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 3,
+               std::vector<uint8_t>(600, 'x'));
+  request(input, 5, "POST", "/", proto::NO_FLAGS);
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 5,
+               std::vector<uint8_t>(600, 'x'));
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_FALSE(conn.paused());
+  EXPECT_EQ(conn.num_streams(), 1);
+  frames = drain(conn);
+  ASSERT_FALSE(frames.empty());
+  EXPECT_EQ(frames.back().type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames.back().stream_id(), 5);
+  EXPECT_EQ(frames.back().payload().at(3), proto::REFUSED_STREAM);
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::END_STREAM, 3);
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(std::string(frames[1].payload().begin(), frames[1].payload().end()),
+            "600");
+  EXPECT_EQ(conn.num_streams(), 0);
+
+  // A large response pauses the connection; writing it out resumes the
+  // connection, with no further input.
+  input.clear();
+  request(input, 7, "GET", "/big", proto::END_STREAM);
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_TRUE(conn.paused());
+  EXPECT_EQ(budget.used(), conn.memory_usage());
+  frames = drain(conn);
+  EXPECT_FALSE(conn.paused());
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[1].payload().size(), 2000);
+  EXPECT_EQ(budget.used(), conn.memory_usage());
+}
+
+TEST(Connection, WindowUpdateBatching) {
+  ConnectionOptions options;
+  options.window_update_fraction = 0.5;
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+  drain(conn);
+
+  auto input = client_preface();
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16000, 'x'));
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_EQ(drain(conn).size(), 1);  // just the SETTINGS ack
+
+  // Crossing half of the 65535-byte windows returns all of the credit.
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16000, 'x'));
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(1000, 'x'));
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 2);
+  for (const auto& f : frames) {
+    EXPECT_EQ(f.type(), proto::WINDOW_UPDATE_FRAME);
+    const auto& p = f.payload();
+    EXPECT_EQ((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3], 33000);
+  }
+  EXPECT_EQ(frames[0].stream_id(), 0);
+  EXPECT_EQ(frames[1].stream_id(), 1);
+}
+
+TEST(Connection, InitialWindowSizeAck) {
+  ConnectionOptions options;
+  options.settings.set_initial_window_size(1000);
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+  drain(conn);
+
+  // Until our SETTINGS are acknowledged, the peer may use the default
+  // window, so 2000 bytes are fine.
+  auto input = client_preface();
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(2000, 'x'));
+  conn.receive(input.data(), input.data() + input.size());
+  for (const auto& f : drain(conn)) {
+    EXPECT_NE(f.type(), proto::RST_STREAM_FRAME);
+  }
+
+  // The ACK shrinks the open stream's window to 1000 - 2000; the consumed
+  // 2000 bytes are then due back, which refills it to 1000.
+  input.clear();
+  append_frame(input, proto::SETTINGS_FRAME, proto::ACK, 0);
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::WINDOW_UPDATE_FRAME);
+  EXPECT_EQ(frames[0].stream_id(), 1);
+  EXPECT_EQ(frames[0].payload()[2], 2000 / 256);
+  EXPECT_EQ(frames[0].payload()[3], 2000 % 256);
+
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(1001, 'x'));
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  ASSERT_FALSE(frames.empty());
+  EXPECT_EQ(frames.back().type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames.back().stream_id(), 1);
+}
+
+TEST(Connection, StreamingHandler) {
+  ConnectionOptions options;
+  http2::server::Handler handler = [](ServerStream stream) -> StreamTask {
+    http2::headers::Headers request = co_await stream.headers();
+    http2::headers::Headers response;
+    response.add(":status", "200");
+    response.add("x-path", request.first(":path").second);
+    stream.send_headers(response);
+    std::vector<uint8_t> chunk;
+    while (co_await stream.read(chunk)) co_yield chunk;
+    co_yield "done";
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  // The handler starts as soon as the request headers arrive.
+  auto input = client_preface();
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/up"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[1].type(), proto::HEADERS_FRAME);
+  EXPECT_FALSE(frames[1].has_flag(proto::END_STREAM));
+  proto::hpack::Decoder decoder;
+  std::vector<http2::headers::Header> headers;
+  EXPECT_TRUE(decoder.decode(frames[1].payload(), headers));
+  ASSERT_EQ(headers.size(), 2);
+  EXPECT_EQ(headers[1], http2::headers::Header("x-path", "/up"));
+
+  // Each chunk of the request is echoed as it arrives.
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1, {'a', 'b', 'c'});
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::DATA_FRAME);
+  EXPECT_EQ(frames[0].payload(), std::vector<uint8_t>({'a', 'b', 'c'}));
+  EXPECT_FALSE(frames[0].has_flag(proto::END_STREAM));
+
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::END_STREAM, 1, {'d', 'e'});
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(std::string(frames[0].payload().begin(), frames[0].payload().end()),
+            "dedone");
+  EXPECT_TRUE(frames[0].has_flag(proto::END_STREAM));
+  EXPECT_EQ(conn.num_streams(), 0);
+}
+
+TEST(Connection, StreamingBackpressure) {
+  ConnectionOptions options;
+  options.stream_buffer_size = 100;
+  int written = 0;
+  http2::server::Handler handler = [&written](ServerStream stream)
+      -> StreamTask {
+    for (int i = 0; i < 3; ++i) {
+      co_yield std::string(100, 'a' + i);
+      ++written;
+    }
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  // Advertise a 50-byte stream window.
+  auto input = client_preface();
+  input.resize(input.size() - proto::kFrameHeaderSize);
+  append_frame(input, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0,
+               {0x00, 0x04, 0x00, 0x00, 0x00, 50});
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 3);
+  EXPECT_EQ(frames[2].payload().size(), 50);
+  EXPECT_EQ(written, 1);  // suspended with 150 bytes buffered
+
+  input.clear();
+  append_frame(input, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 1,
+               {0x00, 0x00, 0x00, 100});
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].payload().size(), 100);
+  EXPECT_EQ(written, 2);
+
+  input.clear();
+  append_frame(input, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 1,
+               {0x00, 0x00, 0x00, 200});
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  EXPECT_EQ(written, 3);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[0].payload().size(), 150);
+  EXPECT_EQ(frames[1].payload().size(), 0);
+  EXPECT_TRUE(frames[1].has_flag(proto::END_STREAM));
+  EXPECT_EQ(conn.num_streams(), 0);
+}
+
+TEST(Connection, StreamingCredit) {
+  ConnectionOptions options;
+  http2::server::Handler handler = [](ServerStream stream) -> StreamTask {
+    int64_t n = co_await stream.credit();
+    co_yield std::string(n, 'x');
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  // With no stream window, the handler waits for credit.
+  auto input = client_preface();
+  input.resize(input.size() - proto::kFrameHeaderSize);
+  append_frame(input, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0,
+               {0x00, 0x04, 0x00, 0x00, 0x00, 0x00});
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_EQ(drain(conn).size(), 1);  // SETTINGS ack
+
+  input.clear();
+  append_frame(input, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 1,
+               {0x00, 0x00, 0x00, 30});
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[0].type(), proto::HEADERS_FRAME);
+  EXPECT_EQ(frames[1].payload().size(), 30);
+  EXPECT_TRUE(frames[1].has_flag(proto::END_STREAM));
+}
+
+TEST(Connection, StreamingUpload) {
+  ConnectionOptions options;
+  std::size_t received = 0;
+  http2::server::Handler handler = [&received](ServerStream stream)
+      -> StreamTask {
+    std::vector<uint8_t> chunk;
+    while (co_await stream.read(chunk)) {
+      received += chunk.size();
+      co_await stream.credit();  // a slow consumer
+    }
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  // With no response window, each read waits for a WINDOW_UPDATE.
+  auto input = client_preface();
+  input.resize(input.size() - proto::kFrameHeaderSize);
+  append_frame(input, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0,
+               {0x00, 0x04, 0x00, 0x00, 0x00, 0x00});
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16384, 'a'));
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_EQ(received, 16384);
+  drain(conn);
+
+  // Until the handler reads again, only the connection gets credit back, and
+  // the peer can send no more than the rest of the stream window.
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16384, 'b'));
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16384, 'c'));
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16383, 'd'));
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  EXPECT_FALSE(frames.empty());
+  for (const Frame& f : frames) {
+    EXPECT_EQ(f.type(), proto::WINDOW_UPDATE_FRAME);
+    EXPECT_EQ(f.stream_id(), 0);
+  }
+  EXPECT_EQ(received, 16384);
+
+  // Reading returns the stream's credit.
+  input.clear();
+  append_frame(input, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 1,
+               {0x00, 0x00, 0x00, 1});
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_EQ(received, 65535);
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::WINDOW_UPDATE_FRAME);
+  EXPECT_EQ(frames[0].stream_id(), 1);
+  EXPECT_EQ(frames[0].payload(),
+            std::vector<uint8_t>({0x00, 0x00, 0xff, 0xff}));
+
+  // Past the window, the stream fails rather than buffering more.
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16384, 'e'));
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16384, 'f'));
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16384, 'g'));
+  append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(16384, 'h'));
+  conn.receive(input.data(), input.data() + input.size());
+  frames = drain(conn);
+  ASSERT_FALSE(frames.empty());
+  EXPECT_EQ(frames.back().type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames.back().payload()[3], proto::FLOW_CONTROL_ERROR);
+  EXPECT_EQ(conn.num_streams(), 0);
+}
+
+TEST(Connection, StreamingErrors) {
+  struct Guard {
+    bool* destroyed;
+    ~Guard() { *destroyed = true; }
+  };
+  ConnectionOptions options;
+  bool destroyed = false;
+  http2::server::Handler handler = [&destroyed](ServerStream stream)
+      -> StreamTask {
+    http2::headers::Headers request = co_await stream.headers();
+    if (request.first(":path").second == "/throw") {
+      throw std::runtime_error("oops");
+    }
+    Guard guard{&destroyed};
+    std::vector<uint8_t> chunk;
+    while (co_await stream.read(chunk)) {
+    }
+  };
+  Connection conn(options, handler);
+  drain(conn);
+
+  // An exception resets the stream.
+  auto input = client_preface();
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/throw"}}, block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[1].type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames[1].payload()[3], proto::INTERNAL_ERROR);
+  EXPECT_EQ(conn.num_streams(), 0);
+
+  // A stream reset by the peer destroys its suspended handler.
+  input.clear();
+  block.clear();
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 3, block);
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_EQ(conn.num_streams(), 1);
+  EXPECT_FALSE(destroyed);
+  input.clear();
+  append_frame(input, proto::RST_STREAM_FRAME, proto::NO_FLAGS, 3,
+               {0, 0, 0, proto::CANCEL});
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_TRUE(destroyed);
+  EXPECT_EQ(conn.num_streams(), 0);
+  EXPECT_FALSE(conn.done());
+}
+
+TEST(Connection, Offload) {
+  http2::server::Executor executor(2);
+  http2::net::Mailbox mailbox;
+  ConnectionOptions options;
+  options.executor = &executor;
+  std::thread::id loop_thread = std::this_thread::get_id();
+  std::thread::id work_thread;
+  http2::server::Handler handler = [&](ServerStream stream) -> StreamTask {
+    int sum = co_await stream.offload([&work_thread] {
+      work_thread = std::this_thread::get_id();
+      int sum = 0;
+      for (int i = 1; i <= 100; ++i) sum += i;
+      return sum;
+    });
+    EXPECT_EQ(std::this_thread::get_id(), loop_thread);
+    co_yield std::to_string(sum);
+  };
+  Connection conn(options, handler);
+  CountingHost host;
+  conn.attach(&host, &mailbox, nullptr);
+  drain(conn);
+
+  auto input = client_preface();
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME,
+               proto::END_HEADERS | proto::END_STREAM, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_EQ(drain(conn).size(), 1);  // SETTINGS ack
+
+  pollfd pfd = {mailbox.fd(), POLLIN, 0};
+  ASSERT_EQ(::poll(&pfd, 1, 10000), 1);
+  mailbox.drain([&](http2::net::Mailbox::Message* m) {
+    auto* job = static_cast<http2::server::Offload*>(m);
+    ASSERT_EQ(job->connection(), &conn);
+    EXPECT_EQ(job->connection()->host(), &host);
+    job->connection()->complete_offload(job);
+  });
+  EXPECT_EQ(host.wakes, 1);
+  EXPECT_NE(work_thread, loop_thread);
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(std::string(frames[1].payload().begin(), frames[1].payload().end()),
+            "5050");
+  EXPECT_TRUE(frames[1].has_flag(proto::END_STREAM));
+}
+
+TEST(Connection, OffloadAfterClose) {
+  http2::server::Executor executor(1);
+  http2::net::Mailbox mailbox;
+  ConnectionOptions options;
+  options.executor = &executor;
+  http2::server::Handler handler = [](ServerStream stream) -> StreamTask {
+    co_await stream.offload([] {});
+  };
+
+  // The connection closes while its offload is in flight.
+  {
+    Connection conn(options, handler);
+    conn.attach(nullptr, &mailbox, nullptr);
+    auto input = client_preface();
+    proto::hpack::Encoder encoder;
+    std::vector<uint8_t> block;
+    encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+    append_frame(input, proto::HEADERS_FRAME,
+                 proto::END_HEADERS | proto::END_STREAM, 1, block);
+    conn.receive(input.data(), input.data() + input.size());
+  }
+  pollfd pfd = {mailbox.fd(), POLLIN, 0};
+  ASSERT_EQ(::poll(&pfd, 1, 10000), 1);
+  std::size_t n = mailbox.drain([](http2::net::Mailbox::Message* m) {
+    auto* job = static_cast<http2::server::Offload*>(m);
+    EXPECT_EQ(job->connection(), nullptr);
+    delete job;
+  });
+  EXPECT_EQ(n, 1);
+}
+
+TEST(Connection, OffloadAfterConnectionError) {
+  http2::server::Executor executor(1);
+  http2::net::Mailbox mailbox;
+  ConnectionOptions options;
+  options.executor = &executor;
+  // The offloaded function holds a reference to token until it is freed.
+  // (It is named because GCC 12 destroys a lambda temporary in a co_await
+  // expression twice.)
+  auto token = std::make_shared<int>(0);
+  http2::server::Handler handler = [token](ServerStream stream) -> StreamTask {
+    auto fn = [token] {};
+    co_await stream.offload(std::move(fn));
+  };
+  long baseline = token.use_count();
+
+  // The offload is delivered after the connection has failed, so the
+  // handler is never resumed; it must still free the offload.
+  {
+    Connection conn(options, handler);
+    conn.attach(nullptr, &mailbox, nullptr);
+    auto input = client_preface();
+    proto::hpack::Encoder encoder;
+    std::vector<uint8_t> block;
+    encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+    append_frame(input, proto::HEADERS_FRAME,
+                 proto::END_HEADERS | proto::END_STREAM, 1, block);
+    conn.receive(input.data(), input.data() + input.size());
+
+    std::vector<uint8_t> garbage;
+    append_frame(garbage, proto::PING_FRAME, proto::NO_FLAGS, 1,
+                 {0, 0, 0, 0, 0, 0, 0, 0});
+    conn.receive(garbage.data(), garbage.data() + garbage.size());
+    EXPECT_TRUE(conn.done());
+
+    pollfd pfd = {mailbox.fd(), POLLIN, 0};
+    ASSERT_EQ(::poll(&pfd, 1, 10000), 1);
+    std::size_t n = mailbox.drain([&conn](http2::net::Mailbox::Message* m) {
+      auto* job = static_cast<http2::server::Offload*>(m);
+      ASSERT_EQ(job->connection(), &conn);
+      conn.complete_offload(job);
+    });
+    EXPECT_EQ(n, 1);
+    EXPECT_GT(token.use_count(), baseline);
+  }
+  EXPECT_EQ(token.use_count(), baseline);
+}
+
+TEST(Connection, SettingsTimeout) {
+  ConnectionOptions options;
+  options.settings_timeout_ms = 1000;
+  http2::net::TimerWheel wheel(0);
+  CountingHost host;
+
+  // A peer that never acknowledges our SETTINGS is sent away.
+  Connection slow(options, echo_path);
+  slow.attach(&host, nullptr, &wheel);
+  drain(slow);
+  auto input = client_preface();
+  slow.receive(input.data(), input.data() + input.size());
+  drain(slow);
+  wheel.advance(999);
+  EXPECT_FALSE(slow.done());
+  wheel.advance(1000);
+  EXPECT_TRUE(slow.done());
+  EXPECT_EQ(host.wakes, 1);
+  auto frames = drain(slow);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::GOAWAY_FRAME);
+  EXPECT_EQ(frames[0].payload()[7], proto::SETTINGS_TIMEOUT);
+
+  // The acknowledgement cancels the timer.
+  Connection prompt(options, echo_path);
+  prompt.attach(&host, nullptr, &wheel);
+  drain(prompt);
+  append_frame(input, proto::SETTINGS_FRAME, proto::ACK, 0);
+  prompt.receive(input.data(), input.data() + input.size());
+  wheel.advance(20000);
+  EXPECT_FALSE(prompt.done());
+}
+
+TEST(Connection, IdleTimeout) {
+  ConnectionOptions options;
+  options.idle_timeout_ms = 1000;
+  http2::net::TimerWheel wheel(0);
+  http2::server::Handler handler = [](ServerStream stream) -> StreamTask {
+    std::vector<uint8_t> chunk;
+    while (co_await stream.read(chunk)) {
+    }
+  };
+  Connection conn(options, handler);
+  conn.attach(nullptr, nullptr, &wheel);
+  drain(conn);
+
+  // Input restarts the timer.
+  auto input = client_preface();
+  append_frame(input, proto::SETTINGS_FRAME, proto::ACK, 0);
+  wheel.advance(900);
+  conn.receive(input.data(), input.data() + input.size());
+  wheel.advance(1800);
+  EXPECT_FALSE(conn.done());
+
+  // An open stream keeps the connection alive.
+  input.clear();
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+  wheel.advance(5000);
+  EXPECT_FALSE(conn.done());
+
+  input.clear();
+  append_frame(input, proto::DATA_FRAME, proto::END_STREAM, 1);
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_EQ(conn.num_streams(), 0);
+  drain(conn);
+  wheel.advance(6000);
+  EXPECT_TRUE(conn.done());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::GOAWAY_FRAME);
+  EXPECT_EQ(frames[0].payload()[7], proto::NO_ERROR);
+}
+
+TEST(Connection, Keepalive) {
+  ConnectionOptions options;
+  options.keepalive_interval_ms = 1000;
+  http2::net::TimerWheel wheel(0);
+  Connection conn(options, echo_path);
+  conn.attach(nullptr, nullptr, &wheel);
+  drain(conn);
+  auto input = client_preface();
+  append_frame(input, proto::SETTINGS_FRAME, proto::ACK, 0);
+  conn.receive(input.data(), input.data() + input.size());
+  drain(conn);
+
+  // Silence is met with a PING; its answer keeps the connection open.
+  wheel.advance(1000);
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::PING_FRAME);
+  EXPECT_FALSE(frames[0].has_flag(proto::ACK));
+  input.clear();
+  append_frame(input, proto::PING_FRAME, proto::ACK, 0,
+               frames[0].payload());
+  conn.receive(input.data(), input.data() + input.size());
+
+  // Another interval of silence after an unanswered PING ends it.
+  wheel.advance(2500);
+  EXPECT_EQ(drain(conn).size(), 1);
+  EXPECT_FALSE(conn.done());
+  wheel.advance(3500);
+  EXPECT_TRUE(conn.done());
+  frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::GOAWAY_FRAME);
+}
+
+TEST(Connection, RequestTimeout) {
+  ConnectionOptions options;
+  options.request_timeout_ms = 500;
+  http2::net::TimerWheel wheel(0);
+  bool destroyed = false;
+  struct Guard {
+    bool* destroyed;
+    ~Guard() { *destroyed = true; }
+  };
+  http2::server::Handler handler = [&destroyed](ServerStream stream)
+      -> StreamTask {
+    Guard guard{&destroyed};
+    std::vector<uint8_t> chunk;
+    while (co_await stream.read(chunk)) {
+    }
+  };
+  Connection conn(options, handler);
+  CountingHost host;
+  conn.attach(&host, nullptr, &wheel);
+  drain(conn);
+
+  auto input = client_preface();
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 3, block);
+  conn.receive(input.data(), input.data() + input.size());
+  drain(conn);
+
+  // Stream 1 ends in time; stream 3 does not.
+  wheel.advance(200);
+  input.clear();
+  append_frame(input, proto::RST_STREAM_FRAME, proto::NO_FLAGS, 1,
+               {0, 0, 0, proto::CANCEL});
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_EQ(conn.num_streams(), 1);
+  destroyed = false;
+  wheel.advance(500);
+  EXPECT_TRUE(destroyed);
+  EXPECT_EQ(conn.num_streams(), 0);
+  EXPECT_EQ(host.wakes, 1);
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::RST_STREAM_FRAME);
+  EXPECT_EQ(frames[0].stream_id(), 3);
+  EXPECT_EQ(frames[0].payload()[3], proto::CANCEL);
+  EXPECT_FALSE(conn.done());
+}
+
+TEST(Connection, Shutdown) {
+  ConnectionOptions options;
+  options.drain_timeout_ms = 1000;
+  http2::net::TimerWheel wheel(0);
+  http2::server::Handler handler = [](ServerStream stream) -> StreamTask {
+    std::vector<uint8_t> chunk;
+    while (co_await stream.read(chunk)) {
+    }
+    co_yield std::string("done");
+  };
+  Connection conn(options, handler);
+  conn.attach(nullptr, nullptr, &wheel);
+  drain(conn);
+  auto input = client_preface();
+  append_frame(input, proto::SETTINGS_FRAME, proto::ACK, 0);
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  conn.receive(input.data(), input.data() + input.size());
+  drain(conn);
+
+  // GOAWAY names the last stream that will be served.
+  conn.shutdown();
+  EXPECT_FALSE(conn.done());
+  auto frames = drain(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::GOAWAY_FRAME);
+  EXPECT_EQ(frames[0].payload()[3], 1);
+  EXPECT_EQ(frames[0].payload()[7], proto::NO_ERROR);
+
+  // Later streams are ignored, and the earlier one runs to completion.
+  input.clear();
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 3, block);
+  append_frame(input, proto::DATA_FRAME, proto::END_STREAM, 3, {'x'});
+  append_frame(input, proto::DATA_FRAME, proto::END_STREAM, 1);
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_EQ(conn.num_streams(), 0);
+  EXPECT_TRUE(conn.done());
+  frames = drain(conn);
+  ASSERT_GE(frames.size(), 2);
+  for (const Frame& f : frames) {
+    EXPECT_EQ(f.stream_id(), 1);
+    EXPECT_NE(f.type(), proto::RST_STREAM_FRAME);
+  }
+
+  // A stream that never finishes is cut off by the drain deadline.
+  Connection slow(options, handler);
+  slow.attach(nullptr, nullptr, &wheel);
+  drain(slow);
+  input = client_preface();
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  slow.receive(input.data(), input.data() + input.size());
+  slow.shutdown();
+  drain(slow);
+  wheel.advance(wheel.now() + 999);
+  EXPECT_FALSE(slow.done());
+  wheel.advance(wheel.now() + 1);
+  EXPECT_TRUE(slow.done());
+  frames = drain(slow);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].type(), proto::GOAWAY_FRAME);
+}
+
+// goaway_error returns the error code of the last frame if it is a GOAWAY.
+static int goaway_error(const std::vector<Frame>& frames) {
+  if (frames.empty() || frames.back().type() != proto::GOAWAY_FRAME) {
+    return -1;
+  }
+  return frames.back().payload()[7];
+}
+
+TEST(Connection, RapidReset) {
+  ConnectionOptions options;
+  options.max_rapid_resets = 4;
+  http2::server::Handler handler = [](ServerStream stream) -> StreamTask {
+    std::vector<uint8_t> chunk;
+    while (co_await stream.read(chunk)) {
+    }
+  };
+  Connection conn(options, handler);
+  drain(conn);
+  auto input = client_preface();
+  conn.receive(input.data(), input.data() + input.size());
+  drain(conn);
+
+  // Open a stream and cancel it at once, over and over.
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  for (uint32_t id = 1; id <= 9; id += 2) {
+    input.clear();
+    append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, id, block);
+    append_frame(input, proto::RST_STREAM_FRAME, proto::NO_FLAGS, id,
+                 {0, 0, 0, proto::CANCEL});
+    conn.receive(input.data(), input.data() + input.size());
+    EXPECT_EQ(conn.done(), id == 9);
+  }
+  EXPECT_EQ(goaway_error(drain(conn)), proto::ENHANCE_YOUR_CALM);
+
+  // Completed requests earn the allowance back.
+  http2::server::Handler echo = echo_path;
+  Connection fair(options, echo);
+  drain(fair);
+  input = client_preface();
+  for (uint32_t id = 1; id <= 39; id += 2) {
+    append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, id, block);
+    append_frame(input, proto::RST_STREAM_FRAME, proto::NO_FLAGS, id,
+                 {0, 0, 0, proto::CANCEL});
+    encoder.encode_all({{":method", "GET"}, {":path", "/"}}, block);
+    append_frame(input, proto::HEADERS_FRAME,
+                 proto::END_HEADERS | proto::END_STREAM, id + 2, block);
+    id += 2;
+  }
+  fair.receive(input.data(), input.data() + input.size());
+  EXPECT_FALSE(fair.done());
+}
+
+TEST(Connection, ContinuationFlood) {
+  ConnectionOptions options;
+  options.max_continuation_frames = 8;
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+  drain(conn);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME, proto::NO_FLAGS, 1, {0x82});
+  for (int i = 0; i < 8; ++i) {
+    append_frame(input, proto::CONTINUATION_FRAME, proto::NO_FLAGS, 1,
+                 {0x84});
+  }
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_FALSE(conn.done());
+  input.clear();
+  append_frame(input, proto::CONTINUATION_FRAME, proto::NO_FLAGS, 1, {0x84});
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_TRUE(conn.done());
+  EXPECT_EQ(goaway_error(drain(conn)), proto::ENHANCE_YOUR_CALM);
+
+  // A block that grows too large fails however few frames carry it.
+  options.max_header_block_size = 1000;
+  Connection big(options, handler);
+  drain(big);
+  input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(600, 0x82));
+  append_frame(input, proto::CONTINUATION_FRAME, proto::NO_FLAGS, 1,
+               std::vector<uint8_t>(600, 0x82));
+  big.receive(input.data(), input.data() + input.size());
+  EXPECT_TRUE(big.done());
+  EXPECT_EQ(goaway_error(drain(big)), proto::ENHANCE_YOUR_CALM);
+}
+
+TEST(Connection, ControlFlood) {
+  ConnectionOptions options;
+  options.max_control_frames = 10;
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+  drain(conn);
+  auto input = client_preface();  // its SETTINGS counts too
+  for (int i = 0; i < 9; ++i) {
+    append_frame(input, proto::PING_FRAME, proto::NO_FLAGS, 0,
+                 std::vector<uint8_t>(8, i));
+  }
+  // Acknowledgements are not charged.
+  append_frame(input, proto::SETTINGS_FRAME, proto::ACK, 0);
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_FALSE(conn.done());
+  EXPECT_EQ(drain(conn).size(), 10);
+
+  input.clear();
+  append_frame(input, proto::PRIORITY_FRAME, proto::NO_FLAGS, 1,
+               {0, 0, 0, 0, 16});
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_TRUE(conn.done());
+  EXPECT_EQ(goaway_error(drain(conn)), proto::ENHANCE_YOUR_CALM);
+}
+
+TEST(Connection, EmptyDataFlood) {
+  ConnectionOptions options;
+  options.max_empty_frames = 3;
+  http2::server::Handler handler = echo_path;
+  Connection conn(options, handler);
+  drain(conn);
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  auto input = client_preface();
+  append_frame(input, proto::HEADERS_FRAME, proto::END_HEADERS, 1, block);
+  // Payload earns credit back, so interleaved empty frames are fine.
+  for (int i = 0; i < 10; ++i) {
+    append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1);
+    append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1, {'x'});
+  }
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_FALSE(conn.done());
+
+  input.clear();
+  for (int i = 0; i < 4; ++i) {
+    append_frame(input, proto::DATA_FRAME, proto::NO_FLAGS, 1);
+  }
+  conn.receive(input.data(), input.data() + input.size());
+  EXPECT_TRUE(conn.done());
+  EXPECT_EQ(goaway_error(drain(conn)), proto::ENHANCE_YOUR_CALM);
+}
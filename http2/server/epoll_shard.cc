@@ -0,0 +1,368 @@
+#include "http2/server/epoll_shard.h"
+
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include "http2/net/socket.h"
+
+// The most iovecs gathered for one sendmsg(2); well under IOV_MAX.
+static constexpr std::size_t kMaxIovecs = 64;
+
+namespace http2 {
+namespace server {
+
+// Session binds one accepted socket to its Connection.
+class EpollShard::Session final : public http2::net::EventLoop::Handler,
+                                  public ConnectionHost {
+ public:
+  Session(EpollShard* shard, int fd)
+      : shard_(shard),
+        fd_(fd),
+        conn_(shard->options_, shard->handler_, &shard->budget_),
+        read_paused_(false),
+        dirty_(false),
+        lingering_(false) {
+    if (shard->tls_ != nullptr) {
+      handshake_.reset(new http2::tls::TlsHandshake(*shard->tls_, fd));
+    }
+    conn_.attach(this, &shard->mailbox_, &shard->loop_.timers());
+  }
+  ~Session() override { ::close(fd_); }
+
+  void on_events(uint32_t events) override;
+
+  // wake queues the session to be flushed once the current batch of events
+  // has been handled.
+  void wake() override;
+
+  // flush_if_woken flushes the session if it was woken, as after a socket
+  // event.  May delete this.
+  void flush_if_woken();
+
+  // flush writes as much pending output as the socket accepts.  Returns false
+  // if the connection should be closed.  Nothing is written until any TLS
+  // handshake is done.
+  bool flush();
+
+  // drain shuts the connection down gracefully.
+  void drain() {
+    conn_.shutdown();
+    wake();
+  }
+
+  // shed sends the peer away with ENHANCE_YOUR_CALM.  The connection closes
+  // on its next event, which the shutdown guarantees.
+  void shed();
+
+  const Connection& conn() const { return conn_; }
+
+ private:
+  // handshake advances the TLS handshake.  Returns false if the connection
+  // should be closed.
+  bool handshake();
+
+  // read_all reads and processes input until the socket would block.
+  // Returns false if the connection should be closed.
+  bool read_all();
+
+  // linger half-closes a finished connection, and discards its input until
+  // the peer closes its side.  Returns false once it has.
+  bool linger();
+
+  // receive feeds one borrowed buffer to the connection.  Complete frames
+  // are parsed in place; only a trailing partial frame is copied out, so the
+  // buffer can be returned as soon as this returns.
+  void receive(const uint8_t* p, std::size_t n);
+
+  EpollShard* shard_;
+  int fd_;
+  Connection conn_;
+  std::unique_ptr<http2::tls::TlsHandshake> handshake_;  // until offloaded
+  std::vector<uint8_t> carry_;  // a partial frame, empty when idle
+  bool read_paused_;  // input was left unread because conn_ is paused
+  bool dirty_;        // waiting in shard_->dirty_
+  bool lingering_;    // half-closed while draining
+};
+
+// Inbox passes the readiness of the mailbox's eventfd to the shard.
+class EpollShard::Inbox final : public http2::net::EventLoop::Handler {
+ public:
+  explicit Inbox(EpollShard* shard) : shard_(shard) {}
+  void on_events(uint32_t) override { shard_->drain_mailbox(); }
+
+ private:
+  EpollShard* shard_;
+};
+
+// DrainTimer closes whatever is left once a drain has run out of time.
+class EpollShard::DrainTimer final : public http2::net::TimerWheel::Timer {
+ public:
+  explicit DrainTimer(EpollShard* shard) : shard_(shard) {}
+
+ private:
+  void on_expire() override { shard_->close_all(); }
+
+  EpollShard* shard_;
+};
+
+void EpollShard::Session::on_events(uint32_t events) {
+  if (handshake_ != nullptr) {
+    if (!handshake()) {
+      shard_->close_session(fd_);  // deletes this
+      return;
+    }
+    if (handshake_ != nullptr) return;
+    // The client may have sent its preface along with its last flight.
+    events |= EPOLLIN;
+  }
+  bool ok = (events & EPOLLERR) == 0;
+  if (ok && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) ok = read_all();
+  if (ok) ok = flush();
+  // Epoll will not report input that arrived while paused a second time.
+  if (ok && read_paused_ && !conn_.paused()) ok = read_all() && flush();
+  if (!ok || (conn_.done() && !conn_.has_output())) {
+    if (ok && shard_->draining_ && linger()) return;
+    shard_->close_session(fd_);  // deletes this
+    return;
+  }
+  if (shard_->budget_.exceeded()) shard_->shed_load();
+}
+
+void EpollShard::Session::wake() {
+  if (dirty_) return;
+  dirty_ = true;
+  shard_->dirty_.push_back(fd_);
+}
+
+void EpollShard::Session::flush_if_woken() {
+  if (!dirty_) return;
+  dirty_ = false;
+  on_events(0);
+}
+
+void EpollShard::Session::shed() {
+  conn_.enhance_your_calm();
+  flush();
+  ::shutdown(fd_, SHUT_RD);
+}
+
+bool EpollShard::Session::handshake() {
+  // The connection's timeouts cover a stalled handshake too.
+  if (conn_.done()) return false;
+  switch (handshake_->step()) {
+    case http2::tls::TlsHandshake::DONE:
+      handshake_.reset();
+      return true;
+    case http2::tls::TlsHandshake::FAILED:
+      return false;
+    default:
+      return true;
+  }
+}
+
+bool EpollShard::Session::linger() {
+  // Closing with unread input would reset the connection, and the peer might
+  // lose the GOAWAY.
+  if (!lingering_) {
+    lingering_ = true;
+    ::shutdown(fd_, SHUT_WR);
+  }
+  return read_all();
+}
+
+bool EpollShard::Session::read_all() {
+  read_paused_ = false;
+  while (true) {
+    if (conn_.paused()) {
+      read_paused_ = true;
+      return true;
+    }
+    http2::net::ReadBufferPool& pool = shard_->read_buffers_;
+    uint8_t* buf = pool.acquire();
+    ssize_t n = ::read(fd_, buf, pool.buffer_size());
+    if (n > 0 && !lingering_) receive(buf, n);
+    pool.release(buf);
+    if (n == 0) return false;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (conn_.done() && !lingering_) return true;
+  }
+}
+
+void EpollShard::Session::receive(const uint8_t* p, std::size_t n) {
+  if (carry_.empty()) {
+    std::size_t used = conn_.receive(p, p + n);
+    if (used < n) carry_.assign(p + used, p + n);
+  } else {
+    carry_.insert(carry_.end(), p, p + n);
+    std::size_t used =
+        conn_.receive(carry_.data(), carry_.data() + carry_.size());
+    carry_.erase(carry_.begin(), carry_.begin() + used);
+    if (carry_.empty()) std::vector<uint8_t>().swap(carry_);
+  }
+  conn_.set_transport_memory(carry_.capacity());
+}
+
+bool EpollShard::Session::flush() {
+  if (handshake_ != nullptr) return true;
+  Connection::FileChunk chunk;
+  iovec iov[kMaxIovecs];
+  while (conn_.has_output()) {
+    msghdr msg = {};
+    std::size_t bytes;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = conn_.gather_output(iov, kMaxIovecs, &bytes);
+    if (msg.msg_iovlen > 0) {
+      ssize_t n = ::sendmsg(fd_, &msg, MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      conn_.consume_output(n);
+      if (std::size_t(n) < bytes) return true;  // the socket buffer is full
+    } else if (conn_.output_file(chunk)) {
+      off_t offset = chunk.offset;
+      ssize_t n = ::sendfile(fd_, chunk.fd, &offset, chunk.length);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      if (n == 0) return false;  // the file shrank under us
+      conn_.consume_file(n);
+    }
+  }
+  return true;
+}
+
+EpollShard::EpollShard(int listen_fd, const ConnectionOptions& options,
+                       const http2::server::Handler& handler,
+                       const EpollOptions& epoll, std::size_t memory_limit,
+                       const http2::tls::TlsContext* tls)
+    : listen_fd_(listen_fd),
+      options_(options),
+      handler_(handler),
+      tls_(tls),
+      budget_(memory_limit),
+      read_buffers_(epoll.read_buffer_size, epoll.hugepages),
+      inbox_(new Inbox(this)),
+      drain_requested_(false),
+      draining_(false),
+      drain_timer_(new DrainTimer(this)) {
+  loop_.add(listen_fd_, EPOLLIN, this);
+  loop_.add(mailbox_.fd(), EPOLLIN, inbox_.get());
+}
+
+EpollShard::~EpollShard() {
+  sessions_.clear();
+  loop_.remove(mailbox_.fd());
+  if (listen_fd_ >= 0) {
+    loop_.remove(listen_fd_);
+    ::close(listen_fd_);
+  }
+}
+
+void EpollShard::run() {
+  while (!loop_.stopping()) {
+    loop_.run_once(-1);
+    if (drain_requested_.exchange(false, std::memory_order_acquire)) {
+      begin_drain();
+    }
+    flush_dirty();
+    if (draining_ && sessions_.empty()) break;
+  }
+}
+
+void EpollShard::drain() {
+  drain_requested_.store(true, std::memory_order_release);
+  loop_.wake();
+}
+
+void EpollShard::on_events(uint32_t) {
+  // Edge-triggered: accept until the backlog is empty.
+  while (true) {
+    int fd = ::accept4(listen_fd_, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      return;  // EAGAIN, or out of descriptors until something closes
+    }
+    http2::net::set_nodelay(fd);
+    auto session = std::make_unique<Session>(this, fd);
+    Session* ptr = session.get();
+    sessions_[fd] = std::move(session);
+    loop_.add(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP, ptr);
+    ptr->on_events(0);  // may delete ptr
+  }
+}
+
+void EpollShard::drain_mailbox() {
+  mailbox_.drain([](http2::net::Mailbox::Message* message) {
+    Offload* job = static_cast<Offload*>(message);
+    Connection* conn = job->connection();
+    if (conn == nullptr) {
+      delete job;  // its connection has closed
+      return;
+    }
+    conn->complete_offload(job);
+  });
+}
+
+void EpollShard::flush_dirty() {
+  // Sessions are looked up by descriptor, since one may have closed after it
+  // was woken.  A new session on a reused descriptor is not dirty.
+  for (int fd : dirty_) {
+    auto it = sessions_.find(fd);
+    if (it != sessions_.end()) it->second->flush_if_woken();
+  }
+  dirty_.clear();
+}
+
+void EpollShard::begin_drain() {
+  if (draining_) return;
+  draining_ = true;
+  loop_.remove(listen_fd_);
+  ::close(listen_fd_);
+  listen_fd_ = -1;
+  loop_.timers().arm(drain_timer_.get(),
+                     uint64_t(options_.drain_timeout_ms) + kDrainLingerMs);
+  for (auto& item : sessions_) item.second->drain();
+}
+
+void EpollShard::close_all() {
+  for (auto& item : sessions_) loop_.remove(item.first);
+  sessions_.clear();
+}
+
+void EpollShard::close_session(int fd) {
+  loop_.remove(fd);
+  sessions_.erase(fd);
+}
+
+void EpollShard::shed_load() {
+  // Send away the most expensive connections until the rest fit.
+  std::vector<Session*> victims;
+  for (auto& item : sessions_) {
+    if (!item.second->conn().done()) victims.push_back(item.second.get());
+  }
+  std::sort(victims.begin(), victims.end(), [](Session* a, Session* b) {
+    return a->conn().memory_usage() > b->conn().memory_usage();
+  });
+  std::size_t used = budget_.used();
+  for (Session* s : victims) {
+    if (used <= budget_.limit()) break;
+    used -= std::min(used, s->conn().memory_usage());
+    s->shed();
+  }
+}
+
+}  // namespace server
+}  // namespace http2
@@ -0,0 +1,104 @@
+// A server shard built on an edge-triggered epoll event loop.
+
+#ifndef HTTP2_SERVER_EPOLL_SHARD_H
+#define HTTP2_SERVER_EPOLL_SHARD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "http2/net/event_loop.h"
+#include "http2/net/mailbox.h"
+#include "http2/net/read_buffers.h"
+#include "http2/server/connection.h"
+#include "http2/server/handler.h"
+#include "http2/server/memory.h"
+#include "http2/server/shard.h"
+#include "http2/tls/tls.h"
+
+namespace http2 {
+namespace server {
+
+// EpollOptions configures the reads of each EpollShard.
+struct EpollOptions final {
+  // read_buffer_size is the size of the buffers that sockets are read into.
+  std::size_t read_buffer_size = 16384;
+
+  // hugepages backs the read buffers with hugepages where possible.
+  bool hugepages = false;
+};
+
+// EpollShard serves its connections from one EventLoop.  Sockets are read
+// with plain read(2) whenever epoll reports them ready, and written with
+// sendmsg(2), gathering each connection's pending output without copying it.
+// Reads borrow a buffer from the shard's pool, which goes back as soon as
+// the complete frames in it are processed, so an idle connection holds at
+// most the tail of one partial frame.  A connection over its memory limit is
+// not read from until it drains.  The results of offloaded handler work come
+// back through the shard's Mailbox, which the loop watches like a socket, and
+// the connections' timeouts run on the loop's TimerWheel.  A drained shard
+// closes its listener but leaves the socket itself open, since a new process
+// may have taken it over.
+//
+// With a TlsContext, each connection first completes a TLS handshake, and
+// is then served exactly like a cleartext one, because kTLS does the
+// encryption below the socket.
+class EpollShard final : public Shard,
+                         public http2::net::EventLoop::Handler {
+ public:
+  // Takes ownership of listen_fd, which must be non-blocking.  Both options
+  // and handler must outlive the EpollShard, as must tls, which is null for
+  // cleartext.  memory_limit bounds the memory held by all connections
+  // together (0 for no limit).
+  EpollShard(int listen_fd, const ConnectionOptions& options,
+             const http2::server::Handler& handler, const EpollOptions& epoll,
+             std::size_t memory_limit,
+             const http2::tls::TlsContext* tls = nullptr);
+  ~EpollShard() override;
+
+  void run() override;
+  void stop() override { loop_.stop(); }
+  void drain() override;
+
+  // num_connections returns the number of open connections.  Only
+  // meaningful on the shard's own thread.
+  std::size_t num_connections() const { return sessions_.size(); }
+
+  void on_events(uint32_t events) override;
+
+ private:
+  class Session;
+  class Inbox;
+  class DrainTimer;
+
+  void close_session(int fd);
+  void shed_load();
+  void drain_mailbox();
+  void flush_dirty();
+  void begin_drain();
+  void close_all();
+
+  http2::net::EventLoop loop_;
+  int listen_fd_;
+  const ConnectionOptions& options_;
+  const http2::server::Handler& handler_;
+  const http2::tls::TlsContext* tls_;
+  MemoryBudget budget_;
+  http2::net::ReadBufferPool read_buffers_;
+  http2::net::Mailbox mailbox_;
+  std::unique_ptr<Inbox> inbox_;
+  std::atomic<bool> drain_requested_;
+  bool draining_;
+  std::unique_ptr<DrainTimer> drain_timer_;
+  std::unordered_map<int, std::unique_ptr<Session>> sessions_;
+  std::vector<int> dirty_;  // sessions woken outside of their own events
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_EPOLL_SHARD_H
@@ -0,0 +1,103 @@
+#include "http2/server/executor.h"
+
+namespace http2 {
+namespace server {
+
+// The executor and worker index of the current thread, if it is a worker.
+static thread_local const Executor* current_executor = nullptr;
+static thread_local std::size_t current_index = 0;
+
+Executor::Executor(unsigned int num_threads)
+    : next_(0), pending_(0), stopping_(false) {
+  if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+  if (num_threads == 0) num_threads = 1;
+  for (unsigned int i = 0; i < num_threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (unsigned int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back([this, i] { work(i); });
+  }
+}
+
+Executor::~Executor() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+void Executor::submit(Task* task) {
+  bool local = (current_executor == this);
+  std::size_t index;
+  if (local) {
+    index = current_index;
+  } else {
+    index = next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+  }
+  Worker& worker = *workers_[index];
+  {
+    std::lock_guard<std::mutex> lock(worker.mu);
+    (local ? worker.local : worker.shared).push_back(task);
+    pending_.fetch_add(1, std::memory_order_release);
+  }
+  // Taking mu_ orders the notification after a sleeping worker's last look
+  // at pending_, so the wakeup cannot be lost.
+  std::lock_guard<std::mutex> lock(mu_);
+  wake_.notify_one();
+}
+
+void Executor::work(std::size_t index) {
+  current_executor = this;
+  current_index = index;
+  while (true) {
+    if (Task* task = find_task(index)) {
+      task->run();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mu_);
+    wake_.wait(lock, [this] {
+      return stopping_ || pending_.load(std::memory_order_acquire) > 0;
+    });
+    if (stopping_ && pending_.load(std::memory_order_acquire) == 0) return;
+  }
+}
+
+Executor::Task* Executor::find_task(std::size_t index) {
+  // Our own newest task first, while it is still warm in the cache, then the
+  // oldest task dealt to us from outside...
+  {
+    Worker& self = *workers_[index];
+    std::lock_guard<std::mutex> lock(self.mu);
+    if (!self.local.empty()) {
+      Task* task = self.local.back();
+      self.local.pop_back();
+      pending_.fetch_sub(1, std::memory_order_relaxed);
+      return task;
+    }
+    if (!self.shared.empty()) {
+      Task* task = self.shared.front();
+      self.shared.pop_front();
+      pending_.fetch_sub(1, std::memory_order_relaxed);
+      return task;
+    }
+  }
+  // ...then the oldest task of anyone else.
+  for (std::size_t i = 1; i < workers_.size(); ++i) {
+    Worker& victim = *workers_[(index + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mu);
+    std::deque<Task*>& tasks =
+        victim.shared.empty() ? victim.local : victim.shared;
+    if (!tasks.empty()) {
+      Task* task = tasks.front();
+      tasks.pop_front();
+      pending_.fetch_sub(1, std::memory_order_relaxed);
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace server
+}  // namespace http2
@@ -0,0 +1,81 @@
+// A thread pool for handler work too heavy to run on an event loop.
+
+#ifndef HTTP2_SERVER_EXECUTOR_H
+#define HTTP2_SERVER_EXECUTOR_H
+
+#include <cstddef>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace http2 {
+namespace server {
+
+// Executor runs CPU-heavy tasks on a pool of worker threads, so that they do
+// not stall the other connections of the event loop they came from.  Each
+// worker has its own queues: tasks submitted by a worker go on its local
+// queue and are run newest first, while tasks from other threads are dealt
+// out round-robin to the workers' shared queues and run oldest first, so
+// that none starves under load.  A worker whose queues are empty steals the
+// oldest task of another before it goes to sleep.
+//
+// Executor knows nothing of connections.  Streaming handlers reach it with
+// ServerStream::offload, which sends the result back to the connection's
+// event loop through its Mailbox.
+class Executor final {
+ public:
+  // Task is one unit of work.
+  class Task {
+   public:
+    virtual ~Task() = default;
+
+    // run is called once, on a worker thread.  The task is responsible for
+    // its own deletion, during or after run.
+    virtual void run() = 0;
+  };
+
+  // Starts num_threads workers, or one per CPU if num_threads is 0.
+  explicit Executor(unsigned int num_threads = 0);
+
+  // Runs the tasks already submitted, then stops the workers.
+  ~Executor();
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  // submit queues task to be run.  Safe to call from any thread, including
+  // from within a Task, but not once the Executor is being destroyed.
+  void submit(Task* task);
+
+  // num_threads returns the number of workers.
+  std::size_t num_threads() const { return workers_.size(); }
+
+ private:
+  struct Worker final {
+    std::mutex mu;
+    std::deque<Task*> local;   // submitted by this worker, run newest first
+    std::deque<Task*> shared;  // submitted from outside, run oldest first
+  };
+
+  void work(std::size_t index);
+  Task* find_task(std::size_t index);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<std::size_t> next_;     // where the next outside task goes
+  std::atomic<std::size_t> pending_;  // tasks queued, across all workers
+
+  std::mutex mu_;
+  std::condition_variable wake_;
+  bool stopping_;  // guarded by mu_
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_EXECUTOR_H
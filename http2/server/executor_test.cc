@@ -0,0 +1,94 @@
+#include "http2/server/executor.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using http2::server::Executor;
+
+namespace {
+
+// CountTask counts down a shared counter, and may spawn children.
+class CountTask final : public Executor::Task {
+ public:
+  CountTask(Executor* executor, std::atomic<int>* count, int depth)
+      : executor_(executor), count_(count), depth_(depth) {}
+
+  void run() override {
+    if (depth_ > 0) {
+      executor_->submit(new CountTask(executor_, count_, depth_ - 1));
+      executor_->submit(new CountTask(executor_, count_, depth_ - 1));
+    }
+    count_->fetch_add(1);
+    delete this;
+  }
+
+ private:
+  Executor* executor_;
+  std::atomic<int>* count_;
+  int depth_;
+};
+
+// FnTask runs a function.
+class FnTask final : public Executor::Task {
+ public:
+  explicit FnTask(std::function<void()> fn) : fn_(std::move(fn)) {}
+
+  void run() override {
+    fn_();
+    delete this;
+  }
+
+ private:
+  std::function<void()> fn_;
+};
+
+}  // namespace
+
+TEST(Executor, RunsEverything) {
+  std::atomic<int> count(0);
+  {
+    Executor executor(4);
+    EXPECT_EQ(executor.num_threads(), 4);
+    for (int i = 0; i < 100; ++i) {
+      executor.submit(new CountTask(&executor, &count, 0));
+    }
+  }
+  EXPECT_EQ(count.load(), 100);
+}
+
+TEST(Executor, NestedTasks) {
+  // Each tree of tasks starts on one worker; the others must steal to help.
+  std::atomic<int> count(0);
+  {
+    Executor executor(3);
+    for (int i = 0; i < 4; ++i) {
+      executor.submit(new CountTask(&executor, &count, 8));
+    }
+    while (count.load() < 4 * 511) std::this_thread::yield();
+  }
+  EXPECT_EQ(count.load(), 4 * 511);
+}
+
+TEST(Executor, OutsideTasksInOrder) {
+  // Tasks from outside the pool run oldest first, even when they queue up
+  // behind a busy worker.
+  std::atomic<bool> release(false);
+  std::vector<int> order;
+  {
+    Executor executor(1);
+    executor.submit(new FnTask([&release] {
+      while (!release.load()) std::this_thread::yield();
+    }));
+    for (int i = 0; i < 10; ++i) {
+      executor.submit(new FnTask([&order, i] { order.push_back(i); }));
+    }
+    release.store(true);
+  }
+  ASSERT_EQ(order.size(), 10);
+  for (int i = 0; i < 10; ++i) EXPECT_EQ(order[i], i);
+}
@@ -0,0 +1,88 @@
+#include "http2/server/frame_pool.h"
+
+#include <cstddef>
+#include <new>
+
+namespace http2 {
+namespace server {
+
+// Block prefixes every allocation.  While the block is in use it records
+// its owner; while it is free it links to the next free block.
+struct alignas(std::max_align_t) FramePool::Block {
+  union {
+    FramePool* pool;
+    Block* next;
+  };
+  std::size_t size_class;  // unused if not pooled
+};
+
+FramePool::FramePool() : free_{}, cached_bytes_(0), surplus_(0), live_(0) {}
+
+FramePool::~FramePool() {
+  for (std::size_t i = 0; i <= kNumClasses; ++i) {
+    while (free_[i] != nullptr) {
+      Block* b = free_[i];
+      free_[i] = b->next;
+      ::operator delete(b);
+    }
+  }
+}
+
+FramePool*& FramePool::current() {
+  static thread_local FramePool* pool = nullptr;
+  return pool;
+}
+
+void* FramePool::allocate(FramePool* pool, std::size_t n) {
+  std::size_t size_class = (n + kGranule - 1) / kGranule;
+  Block* b = nullptr;
+  if (pool != nullptr && size_class <= kNumClasses) {
+    b = pool->free_[size_class];
+    if (b != nullptr) {
+      pool->free_[size_class] = b->next;
+      pool->cached_bytes_ -= size_class * kGranule;
+      if (b->next != nullptr) --pool->surplus_;
+    }
+  } else {
+    pool = nullptr;
+  }
+  if (b == nullptr) {
+    std::size_t bytes = (pool != nullptr) ? size_class * kGranule : n;
+    b = static_cast<Block*>(::operator new(sizeof(Block) + bytes));
+  }
+  b->pool = pool;
+  b->size_class = size_class;
+  if (pool != nullptr) ++pool->live_;
+  return b + 1;
+}
+
+void FramePool::deallocate(void* p) {
+  Block* b = static_cast<Block*>(p) - 1;
+  FramePool* pool = b->pool;
+  if (pool == nullptr) {
+    ::operator delete(b);
+    return;
+  }
+  --pool->live_;
+  b->next = pool->free_[b->size_class];
+  pool->free_[b->size_class] = b;
+  pool->cached_bytes_ += b->size_class * kGranule;
+  if (b->next != nullptr) ++pool->surplus_;
+}
+
+void FramePool::trim() {
+  if (surplus_ == 0) return;
+  for (std::size_t i = 0; i <= kNumClasses; ++i) {
+    if (free_[i] == nullptr) continue;
+    while (free_[i]->next != nullptr) {
+      Block* b = free_[i]->next;
+      free_[i]->next = b->next;
+      cached_bytes_ -= i * kGranule;
+      ::operator delete(b);
+    }
+  }
+  surplus_ = 0;
+}
+
+}  // namespace server
+}  // namespace http2
@@ -0,0 +1,70 @@
+// A pooled allocator for coroutine frames.
+
+#ifndef HTTP2_SERVER_FRAME_POOL_H
+#define HTTP2_SERVER_FRAME_POOL_H
+
+#include <cstddef>
+
+namespace http2 {
+namespace server {
+
+// FramePool recycles the coroutine frames of one connection's streaming
+// handlers.  Every request runs the same handler, so frames come in a few
+// sizes; once a connection has served a burst of requests, later requests
+// reuse the freed frames instead of going to the global heap.
+//
+// Frames up to kMaxPooledSize bytes are kept on one free list per 64-byte
+// size class; larger ones are not pooled.  trim returns the frames of a past
+// burst to the heap, keeping one of each size.  Each block records the pool
+// it came from, so a frame may be freed without naming its pool, but every
+// frame must be freed before its pool is destroyed.  Like its connection, a
+// FramePool belongs to one thread.
+class FramePool final {
+ public:
+  static constexpr std::size_t kMaxPooledSize = 4096;
+
+  FramePool();
+  ~FramePool();
+
+  FramePool(const FramePool&) = delete;
+  FramePool& operator=(const FramePool&) = delete;
+
+  // allocate returns n bytes drawn from pool, or from the global heap if
+  // pool is null.
+  //
+  // THROWS std::bad_alloc if memory is exhausted.
+  static void* allocate(FramePool* pool, std::size_t n);
+
+  // deallocate frees memory returned by allocate.
+  static void deallocate(void* p);
+
+  // current is the pool that frames allocated on this thread come from.
+  // The connection sets it around each call into a handler.
+  static FramePool*& current();
+
+  // trim frees every cached frame but one of each size class, which is
+  // enough for a connection serving one request at a time.
+  void trim();
+
+  // cached_bytes returns the bytes held on the free lists.
+  std::size_t cached_bytes() const { return cached_bytes_; }
+
+  // live_frames returns the number of frames allocated and not yet freed.
+  std::size_t live_frames() const { return live_; }
+
+ private:
+  struct Block;
+  static constexpr std::size_t kGranule = 64;
+  static constexpr std::size_t kNumClasses = kMaxPooledSize / kGranule;
+
+  // free_[c] holds the free blocks of c granules, for c up to kNumClasses.
+  Block* free_[kNumClasses + 1];
+  std::size_t cached_bytes_;
+  std::size_t surplus_;  // cached blocks behind the first of their class
+  std::size_t live_;
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_FRAME_POOL_H
@@ -0,0 +1,76 @@
+#include "http2/server/frame_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+using http2::server::FramePool;
+
+TEST(FramePool, Reuse) {
+  FramePool pool;
+  void* a = FramePool::allocate(&pool, 200);
+  void* b = FramePool::allocate(&pool, 300);
+  EXPECT_EQ(pool.live_frames(), 2);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(a) % alignof(std::max_align_t), 0);
+
+  FramePool::deallocate(a);
+  EXPECT_EQ(pool.live_frames(), 1);
+  EXPECT_EQ(pool.cached_bytes(), 256);
+
+  // Frames of the same size class come back off the free list.
+  void* c = FramePool::allocate(&pool, 250);
+  EXPECT_EQ(c, a);
+  EXPECT_EQ(pool.cached_bytes(), 0);
+
+  // Frames of other size classes do not.
+  FramePool::deallocate(b);
+  void* d = FramePool::allocate(&pool, 100);
+  EXPECT_NE(d, b);
+  EXPECT_EQ(pool.cached_bytes(), 320);
+
+  FramePool::deallocate(c);
+  FramePool::deallocate(d);
+  EXPECT_EQ(pool.live_frames(), 0);
+}
+
+TEST(FramePool, Unpooled) {
+  FramePool pool;
+  void* big = FramePool::allocate(&pool, FramePool::kMaxPooledSize + 1);
+  EXPECT_EQ(pool.live_frames(), 0);
+  FramePool::deallocate(big);
+  EXPECT_EQ(pool.cached_bytes(), 0);
+
+  void* p = FramePool::allocate(nullptr, 64);
+  FramePool::deallocate(p);
+  EXPECT_EQ(FramePool::current(), nullptr);
+}
+
+TEST(FramePool, LargestClass) {
+  FramePool pool;
+  void* p = FramePool::allocate(&pool, FramePool::kMaxPooledSize);
+  EXPECT_EQ(pool.live_frames(), 1);
+  FramePool::deallocate(p);
+  EXPECT_EQ(pool.cached_bytes(), FramePool::kMaxPooledSize);
+  EXPECT_EQ(FramePool::allocate(&pool, FramePool::kMaxPooledSize), p);
+  FramePool::deallocate(p);
+}
+
+TEST(FramePool, Trim) {
+  FramePool pool;
+  void* frames[8];
+  for (void*& p : frames) p = FramePool::allocate(&pool, 200);
+  void* other = FramePool::allocate(&pool, 1000);
+  for (void* p : frames) FramePool::deallocate(p);
+  FramePool::deallocate(other);
+  EXPECT_EQ(pool.cached_bytes(), 8 * 256 + 1024);
+
+  // One frame of each size is kept.
+  pool.trim();
+  EXPECT_EQ(pool.cached_bytes(), 256 + 1024);
+  void* p = FramePool::allocate(&pool, 200);
+  EXPECT_EQ(pool.cached_bytes(), 1024);
+  FramePool::deallocate(p);
+  pool.trim();
+  EXPECT_EQ(pool.cached_bytes(), 256 + 1024);
+}
@@ -0,0 +1,30 @@
+#include "http2/server/handler.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+
+namespace http2 {
+namespace server {
+
+FileBody::~FileBody() { ::close(fd_); }
+
+std::shared_ptr<FileBody> FileBody::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "open");
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "fstat");
+  }
+  return std::make_shared<FileBody>(fd, 0, st.st_size);
+}
+
+}  // namespace server
+}  // namespace http2
@@ -0,0 +1,123 @@
+// Types for plugging application logic into the HTTP/2 server.
+
+#ifndef HTTP2_SERVER_HANDLER_H
+#define HTTP2_SERVER_HANDLER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "http2/headers/headers.h"
+#include "http2/server/stream.h"
+
+namespace http2 {
+namespace server {
+
+// Request holds a single HTTP/2 request, as received by the server.
+struct Request final {
+  uint32_t stream_id = 0;
+  http2::headers::Headers headers;
+  http2::headers::Headers trailers;
+  std::vector<uint8_t> body;
+};
+
+// FileBody is a region of an open file, to be sent as a response body.  Over
+// cleartext connections the server writes such bodies with sendfile(2), so
+// the file's bytes go from the page cache to the socket without ever being
+// copied through userspace.  A FileBody closes its file when destroyed.
+class FileBody final {
+ public:
+  // Takes ownership of fd.
+  FileBody(int fd, uint64_t offset, uint64_t length)
+      : fd_(fd), offset_(offset), length_(length) {}
+  ~FileBody();
+
+  FileBody(const FileBody&) = delete;
+  FileBody& operator=(const FileBody&) = delete;
+
+  // open returns a FileBody covering the whole of the named file.
+  //
+  // THROWS std::system_error if the file cannot be opened.
+  static std::shared_ptr<FileBody> open(const std::string& path);
+
+  int fd() const { return fd_; }
+  uint64_t offset() const { return offset_; }
+  uint64_t length() const { return length_; }
+
+ private:
+  int fd_;
+  uint64_t offset_;
+  uint64_t length_;
+};
+
+// Response holds a single HTTP/2 response, as produced by a Handler.  If the
+// handler does not set ":status", the server sends "200".
+struct Response final {
+  http2::headers::Headers headers;
+  std::vector<uint8_t> body;
+
+  // file, if set, is sent as the body instead of the body field.  The file
+  // must not shrink until the response has been sent.
+  std::shared_ptr<FileBody> file;
+};
+
+// Handler is the application logic of a server.  It is invoked once per
+// request, on the event loop thread that owns the request's connection.  A
+// single Handler is shared by every shard, so it must be safe to call
+// concurrently from several threads.
+//
+// A Handler wraps one of two kinds of function:
+//
+// - void(const Request&, Response&) is called once the whole request has
+//   arrived, and produces the whole response.
+//
+// - StreamTask(ServerStream) is a coroutine, started as soon as the request
+//   headers arrive, that reads the request body and writes the response body
+//   a chunk at a time.  See stream.h.  Large uploads need one: its memory
+//   is bounded by the stream's flow-control window, not by the body size.
+//
+// Either kind that lets an exception escape has its stream reset with
+// INTERNAL_ERROR; the connection and its other streams carry on.
+class Handler final {
+ public:
+  using Function = std::function<void(const Request&, Response&)>;
+  using StreamFunction = std::function<StreamTask(ServerStream)>;
+
+  Handler() = default;
+
+  template <typename F>
+    requires(!std::is_same_v<std::decay_t<F>, Handler> &&
+             std::is_invocable_r_v<void, F&, const Request&, Response&>)
+  Handler(F f) : function_(std::move(f)) {}
+
+  template <typename F>
+    requires(!std::is_same_v<std::decay_t<F>, Handler> &&
+             std::is_invocable_r_v<StreamTask, F&, ServerStream>)
+  Handler(F f) : stream_function_(std::move(f)) {}
+
+  // is_stream returns true iff this is a streaming handler.
+  bool is_stream() const { return bool(stream_function_); }
+
+  // Calls a non-streaming handler.
+  void operator()(const Request& req, Response& resp) const {
+    function_(req, resp);
+  }
+
+  // start calls a streaming handler, returning its (suspended) coroutine.
+  StreamTask start(ServerStream stream) const {
+    return stream_function_(stream);
+  }
+
+ private:
+  Function function_;
+  StreamFunction stream_function_;
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_HANDLER_H
@@ -0,0 +1,189 @@
+// Idle-connection memory benchmark: opens many loopback connections to an
+// in-process Server, leaves them idle after one request, and reports the
+// growth in resident memory, scaled to 100k connections.  Only the server's
+// user-space memory is counted; socket buffers live in the kernel.
+//
+// Usage: idle_memory_benchmark [--connections=N] [--settle_ms=N]
+//                              [--partial] [--hugepages]
+//                              [--transport=epoll|io_uring]
+//                              [--max_bytes_per_connection=N]
+//
+// --partial leaves half a frame unread on every connection, to measure the
+// cost of carrying partial frames.  With --max_bytes_per_connection, it
+// exits with status 1 if the cost per connection exceeds N bytes, so that a
+// regression fails loudly.
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http2/net/socket.h"
+#include "http2/protocol/constants.h"
+#include "http2/protocol/frame.h"
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/server/server.h"
+
+namespace proto = http2::protocol;
+
+namespace {
+
+struct Flags {
+  unsigned int connections = 10000;
+  unsigned int settle_ms = 1000;
+  unsigned int max_bytes_per_connection = 0;  // 0 for no limit
+  bool partial = false;
+  bool hugepages = false;
+  http2::server::Transport transport = http2::server::TRANSPORT_EPOLL;
+};
+
+bool parse_flag(const char* arg, const char* name, unsigned int& out) {
+  std::size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+  out = std::strtoul(arg + len + 1, nullptr, 10);
+  return true;
+}
+
+bool parse_bool(const char* arg, const char* name, bool& out) {
+  if (std::strcmp(arg, name) != 0) return false;
+  out = true;
+  return true;
+}
+
+bool parse_transport(const char* arg, http2::server::Transport& out) {
+  std::string s(arg);
+  if (s == "--transport=epoll") {
+    out = http2::server::TRANSPORT_EPOLL;
+  } else if (s == "--transport=io_uring") {
+    out = http2::server::TRANSPORT_IO_URING;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// resident_bytes returns the resident set size of this process.
+std::size_t resident_bytes() {
+  FILE* f = std::fopen("/proc/self/statm", "r");
+  if (f == nullptr) return 0;
+  unsigned long size = 0, resident = 0;
+  if (std::fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+  std::fclose(f);
+  return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+// raise_fd_limit lifts the soft descriptor limit to the hard one, and
+// returns the number of connections that fit: each takes two descriptors.
+unsigned int raise_fd_limit(unsigned int wanted) {
+  struct rlimit rl;
+  if (::getrlimit(RLIMIT_NOFILE, &rl) != 0) return wanted;
+  rl.rlim_cur = rl.rlim_max;
+  ::setrlimit(RLIMIT_NOFILE, &rl);
+  ::getrlimit(RLIMIT_NOFILE, &rl);
+  rlim_t fit = (rl.rlim_cur > 256) ? (rl.rlim_cur - 256) / 2 : 0;
+  return (wanted > fit) ? unsigned(fit) : wanted;
+}
+
+std::vector<uint8_t> opening(bool partial) {
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "GET"},
+                      {":scheme", "http"},
+                      {":path", "/"},
+                      {":authority", "localhost"}},
+                     block);
+  std::vector<uint8_t> out(std::begin(proto::kConnectionPreface),
+                           std::end(proto::kConnectionPreface));
+  proto::encode_frame_header(0, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0,
+                             out);
+  proto::encode_frame_header(block.size(), proto::HEADERS_FRAME,
+                             proto::END_HEADERS | proto::END_STREAM, 1, out);
+  out.insert(out.end(), block.begin(), block.end());
+  if (partial) {
+    // The first half of another request.
+    std::size_t start = out.size();
+    proto::encode_frame_header(block.size(), proto::HEADERS_FRAME,
+                               proto::END_HEADERS | proto::END_STREAM, 3, out);
+    out.insert(out.end(), block.begin(), block.end());
+    out.resize(start + (out.size() - start) / 2);
+  }
+  return out;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  for (int i = 1; i < argc; ++i) {
+    if (!parse_flag(argv[i], "--connections", flags.connections) &&
+        !parse_flag(argv[i], "--settle_ms", flags.settle_ms) &&
+        !parse_flag(argv[i], "--max_bytes_per_connection",
+                    flags.max_bytes_per_connection) &&
+        !parse_bool(argv[i], "--partial", flags.partial) &&
+        !parse_bool(argv[i], "--hugepages", flags.hugepages) &&
+        !parse_transport(argv[i], flags.transport)) {
+      std::cerr << "unknown flag: " << argv[i] << std::endl;
+      return 2;
+    }
+  }
+  unsigned int connections = raise_fd_limit(flags.connections);
+  if (connections < flags.connections) {
+    std::cerr << "descriptor limit allows only " << connections
+              << " connections" << std::endl;
+  }
+  if (connections == 0) return 1;
+
+  http2::server::ServerOptions options;
+  options.address = "127.0.0.1";
+  options.num_shards = 1;
+  options.transport = flags.transport;
+  options.epoll.hugepages = flags.hugepages;
+  options.backlog = 4096;
+  http2::server::Server server(options, [](const http2::server::Request&,
+                                           http2::server::Response& resp) {
+    resp.headers.add(":status", "200");
+    resp.body.assign({'o', 'k'});
+  });
+  server.start();
+
+  std::vector<uint8_t> hello = opening(flags.partial);
+  std::vector<int> fds;
+  fds.reserve(connections);
+  std::size_t before = resident_bytes();
+  for (unsigned int i = 0; i < connections; ++i) {
+    int fd = http2::net::connect_tcp("127.0.0.1", server.port());
+    ssize_t n = ::send(fd, hello.data(), hello.size(), MSG_NOSIGNAL);
+    if (n != ssize_t(hello.size())) {
+      std::cerr << "send failed on connection " << i << std::endl;
+      return 1;
+    }
+    fds.push_back(fd);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(flags.settle_ms));
+  std::size_t after = resident_bytes();
+
+  double per_conn = double(after - before) / connections;
+  std::cout << "connections=" << connections << " rss_before=" << before
+            << " rss_after=" << after
+            << " bytes_per_connection=" << uint64_t(per_conn)
+            << " mib_per_100k=" << per_conn * 100000 / (1 << 20) << std::endl;
+
+  server.stop();
+  for (int fd : fds) ::close(fd);
+  if (flags.max_bytes_per_connection != 0 &&
+      per_conn > flags.max_bytes_per_connection) {
+    std::cerr << "over the limit of " << flags.max_bytes_per_connection
+              << " bytes per connection" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,42 @@
+// Tools for bounding the memory held on behalf of peers.
+
+#ifndef HTTP2_SERVER_MEMORY_H
+#define HTTP2_SERVER_MEMORY_H
+
+#include <cstddef>
+
+namespace http2 {
+namespace server {
+
+// MemoryBudget totals the memory held by every connection of one shard, and
+// compares it against a limit.  It is not thread-safe: like the connections
+// that report to it, it belongs to its shard's thread.
+class MemoryBudget final {
+ public:
+  // A limit of 0 means no limit.
+  explicit MemoryBudget(std::size_t limit) : limit_(limit), used_(0) {}
+
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  std::size_t limit() const { return limit_; }
+  std::size_t used() const { return used_; }
+
+  // exceeded returns true iff the shard is holding more than its limit.
+  bool exceeded() const { return limit_ != 0 && used_ > limit_; }
+
+  // adjust records that one connection's usage changed from old_usage to
+  // new_usage.
+  void adjust(std::size_t old_usage, std::size_t new_usage) {
+    used_ = used_ - old_usage + new_usage;
+  }
+
+ private:
+  std::size_t limit_;
+  std::size_t used_;
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_MEMORY_H
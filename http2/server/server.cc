@@ -0,0 +1,204 @@
+#include "http2/server/server.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include "http2/net/socket.h"
+#include "http2/server/epoll_shard.h"
+#include "http2/server/uring_shard.h"
+
+namespace http2 {
+namespace server {
+
+Server::Server(ServerOptions options, Handler handler)
+    : options_(std::move(options)),
+      handler_(std::move(handler)),
+      port_(0),
+      handoff_fd_(-1),
+      handoff_wake_(-1),
+      handed_off_(false) {}
+
+Server::~Server() { stop(); }
+
+void Server::start() {
+  unsigned int n = options_.num_shards;
+  if (n == 0) n = std::thread::hardware_concurrency();
+  if (n == 0) n = 1;
+
+  if (options_.num_workers > 0 && options_.connection.executor == nullptr) {
+    executor_ = std::make_unique<Executor>(options_.num_workers);
+    options_.connection.executor = executor_.get();
+  }
+
+  if (options_.tls.enabled() && tls_ == nullptr) {
+    if (options_.transport != TRANSPORT_EPOLL) {
+      throw std::system_error(EOPNOTSUPP, std::generic_category(),
+                              "TLS requires TRANSPORT_EPOLL");
+    }
+    if (!http2::tls::ktls_supported()) {
+      throw std::system_error(ENOPROTOOPT, std::generic_category(), "kTLS");
+    }
+    tls_ = std::make_unique<http2::tls::TlsContext>(options_.tls);
+  }
+
+  // In a hot restart, the old process hands over its listening sockets.
+  int predecessor = -1;
+  std::vector<int> inherited;
+  if (!options_.handoff_path.empty()) {
+    predecessor = http2::net::connect_unix(options_.handoff_path);
+    if (predecessor >= 0) {
+      try {
+        inherited = http2::net::recv_fds(predecessor);
+      } catch (...) {
+        ::close(predecessor);
+        throw;
+      }
+    }
+  }
+  if (!inherited.empty()) n = inherited.size();
+
+  // The first listener may ask the kernel for a port; the others then join
+  // that port's SO_REUSEPORT group.
+  port_ = inherited.empty() ? options_.port : 0;
+  for (unsigned int i = 0; i < n; ++i) {
+    int fd;
+    if (!inherited.empty()) {
+      fd = inherited[i];
+    } else {
+      fd = http2::net::listen_tcp(options_.address, port_, true,
+                                  options_.backlog);
+    }
+    try {
+      if (port_ == 0) port_ = http2::net::local_port(fd);
+      if (options_.transport == TRANSPORT_IO_URING) {
+        shards_.emplace_back(new UringShard(fd, options_.connection, handler_,
+                                            options_.uring,
+                                            options_.shard_memory_limit));
+      } else {
+        shards_.emplace_back(new EpollShard(fd, options_.connection, handler_,
+                                            options_.epoll,
+                                            options_.shard_memory_limit,
+                                            tls_.get()));
+      }
+    } catch (...) {
+      ::close(fd);
+      for (unsigned int j = i + 1; j < inherited.size(); ++j) {
+        ::close(inherited[j]);
+      }
+      if (predecessor >= 0) ::close(predecessor);
+      shards_.clear();
+      listen_fds_.clear();
+      throw;
+    }
+    listen_fds_.push_back(fd);
+  }
+
+  unsigned int ncpu = std::thread::hardware_concurrency();
+  for (unsigned int i = 0; i < n; ++i) {
+    Shard* shard = shards_[i].get();
+    threads_.emplace_back([shard] { shard->run(); });
+    if (options_.pin_shards && ncpu > 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(i % ncpu, &set);
+      ::pthread_setaffinity_np(threads_.back().native_handle(), sizeof(set),
+                               &set);
+    }
+  }
+
+  // The sockets are being served, so the old process may drain.
+  if (predecessor >= 0) {
+    uint8_t ready = 1;
+    ssize_t sent = ::send(predecessor, &ready, 1, MSG_NOSIGNAL);
+    (void)sent;
+    ::close(predecessor);
+  }
+
+  if (!options_.handoff_path.empty()) {
+    handoff_fd_ = http2::net::listen_unix(options_.handoff_path, 1);
+    handoff_wake_ = ::eventfd(0, EFD_CLOEXEC);
+    if (handoff_wake_ < 0) {
+      throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
+    handoff_thread_ = std::thread([this] { serve_handoff(); });
+  }
+}
+
+// serve_handoff offers the listening sockets to each process that connects
+// to handoff_path, until one of them says it is serving them.  This process
+// then drains.
+void Server::serve_handoff() {
+  pollfd pfds[2] = {{handoff_fd_, POLLIN, 0}, {handoff_wake_, POLLIN, 0}};
+  while (true) {
+    if (::poll(pfds, 2, -1) < 0 && errno != EINTR) return;
+    if (pfds[1].revents != 0) return;  // stop()
+    if (pfds[0].revents == 0) continue;
+    int fd = ::accept4(handoff_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+
+    bool ready = false;
+    try {
+      http2::net::send_fds(fd, listen_fds_);
+      pollfd wait[2] = {{fd, POLLIN, 0}, {handoff_wake_, POLLIN, 0}};
+      while (::poll(wait, 2, -1) < 0 && errno == EINTR) {
+      }
+      uint8_t byte;
+      ready = (wait[0].revents != 0 && ::read(fd, &byte, 1) == 1);
+    } catch (const std::system_error&) {
+      // The successor went away; keep serving.
+    }
+    ::close(fd);
+    if (ready) {
+      handed_off_ = true;
+      drain();
+      return;
+    }
+  }
+}
+
+void Server::drain() {
+  for (auto& shard : shards_) shard->drain();
+}
+
+void Server::wait() {
+  for (auto& thread : threads_) thread.join();
+  threads_.clear();
+}
+
+void Server::stop() {
+  if (handoff_thread_.joinable()) {
+    uint64_t one = 1;
+    ssize_t n = ::write(handoff_wake_, &one, sizeof(one));
+    (void)n;
+    handoff_thread_.join();
+  }
+  if (handoff_fd_ >= 0) {
+    ::close(handoff_fd_);
+    ::close(handoff_wake_);
+    handoff_fd_ = handoff_wake_ = -1;
+    // After a handoff, the path belongs to the successor.
+    if (!handed_off_) ::unlink(options_.handoff_path.c_str());
+  }
+  for (auto& shard : shards_) shard->stop();
+  for (auto& thread : threads_) thread.join();
+  threads_.clear();
+  // The workers post their last results to the shards' mailboxes, so they
+  // must finish first.
+  if (executor_) {
+    executor_.reset();
+    options_.connection.executor = nullptr;
+  }
+  shards_.clear();
+  listen_fds_.clear();
+}
+
+}  // namespace server
+}  // namespace http2
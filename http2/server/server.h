@@ -0,0 +1,156 @@
+// An HTTP/2 server you can link into your binary.
+
+#ifndef HTTP2_SERVER_SERVER_H
+#define HTTP2_SERVER_SERVER_H
+
+#include <cstdint>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http2/server/connection.h"
+#include "http2/server/epoll_shard.h"
+#include "http2/server/executor.h"
+#include "http2/server/handler.h"
+#include "http2/server/uring_shard.h"
+#include "http2/tls/tls.h"
+
+namespace http2 {
+namespace server {
+
+class Shard;
+
+// Transport enumerates the I/O backends that shards can run on.
+enum Transport {
+  // TRANSPORT_EPOLL reads and writes sockets when epoll reports them ready.
+  TRANSPORT_EPOLL,
+
+  // TRANSPORT_IO_URING submits socket I/O through io_uring (Linux 6.0+).
+  TRANSPORT_IO_URING,
+};
+
+// ServerOptions holds the configuration for a Server.
+struct ServerOptions final {
+  // address and port name the IPv4 endpoint to listen on.  If port is 0, the
+  // kernel picks one; see Server::port().
+  std::string address = "0.0.0.0";
+  uint16_t port = 0;
+
+  // num_shards is the number of event loops, each with its own thread and
+  // SO_REUSEPORT listening socket.  If 0, one shard is started per CPU.
+  unsigned int num_shards = 0;
+
+  // pin_shards binds shard i to CPU i, to keep each connection's state in
+  // one core's caches.
+  bool pin_shards = false;
+
+  int backlog = 1024;
+
+  // transport selects the I/O backend used by every shard.
+  Transport transport = TRANSPORT_EPOLL;
+
+  // epoll configures each shard's reads (TRANSPORT_EPOLL only).
+  EpollOptions epoll;
+
+  // uring sizes each shard's io_uring resources (TRANSPORT_IO_URING only).
+  UringOptions uring;
+
+  // shard_memory_limit bounds the memory held by the connections of each
+  // shard (0 for no limit).  Once it is exceeded, the connections using the
+  // most are closed with ENHANCE_YOUR_CALM.
+  std::size_t shard_memory_limit = std::size_t(512) << 20;
+
+  // num_workers, if not 0, starts an Executor with that many threads for
+  // ServerStream::offload, unless connection.executor is already set.
+  unsigned int num_workers = 0;
+
+  // handoff_path, if set, enables hot restarts through a Unix socket at that
+  // path.  See Server::start.
+  std::string handoff_path;
+
+  // tls, if enabled, serves HTTP/2 over TLS ("h2" by ALPN) instead of h2c,
+  // with the record layer offloaded to kTLS (TRANSPORT_EPOLL only).
+  http2::tls::TlsOptions tls;
+
+  ConnectionOptions connection;
+};
+
+// Server accepts cleartext HTTP/2 connections with prior knowledge (h2c), or
+// TLS connections that negotiate "h2" (see ServerOptions::tls), and serves
+// them from a set of shared-nothing shards.  The kernel spreads new
+// connections across the shards' listening sockets; a connection then lives
+// on its shard's thread for its whole life, so no request-path state is ever
+// shared between threads.
+//
+// A Server can hand its listening sockets over to a new process, so that a
+// binary can be replaced without refusing or resetting a single connection:
+// the new process starts with the same handoff_path, receives the sockets
+// (SCM_RIGHTS) and starts serving them, and the old one then drains its
+// connections with GOAWAY and exits.  Neither process binds the port again,
+// so the accept queue is never interrupted.
+class Server final {
+ public:
+  Server(ServerOptions options, Handler handler);
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  // start binds the listening sockets and launches one thread per shard.
+  //
+  // With a handoff_path, start first asks the process listening there for
+  // its sockets.  If it gets them, it runs one shard per socket instead of
+  // binding its own, and tells the old process to drain once the shards are
+  // running.  Either way, it then listens at handoff_path for its own
+  // successor.
+  //
+  // THROWS std::system_error if the sockets cannot be set up, or if TLS is
+  // enabled but the certificate cannot be loaded or the kernel lacks kTLS.
+  void start();
+
+  // stop shuts down every shard, closing all connections, and waits for the
+  // shard threads to exit.
+  void stop();
+
+  // drain stops accepting connections and shuts the open ones down
+  // gracefully (see Shard::drain).  Safe to call from any thread.
+  void drain();
+
+  // wait blocks until every shard has exited, which only happens once they
+  // have been drained (by drain, or by handing off to a new process) and
+  // their connections have closed.
+  void wait();
+
+  // port returns the port being listened on.  Only valid after start().
+  uint16_t port() const { return port_; }
+
+  // num_shards returns the number of running shards.
+  std::size_t num_shards() const { return shards_.size(); }
+
+ private:
+  void serve_handoff();
+
+  ServerOptions options_;
+  Handler handler_;
+  uint16_t port_;
+  std::unique_ptr<Executor> executor_;
+  std::unique_ptr<http2::tls::TlsContext> tls_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::vector<std::thread> threads_;
+
+  // The shards' listening sockets, which they own, as offered to a
+  // successor.  handoff_fd_ listens at handoff_path; stop wakes its thread
+  // through handoff_wake_.
+  std::vector<int> listen_fds_;
+  int handoff_fd_;
+  int handoff_wake_;
+  bool handed_off_;
+  std::thread handoff_thread_;
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_SERVER_H
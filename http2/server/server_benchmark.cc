@@ -0,0 +1,215 @@
+// Loopback benchmark: measures requests/sec against an in-process Server as
+// the number of shards grows.
+//
+// Usage: server_benchmark [--max_shards=N] [--connections=N] [--streams=N]
+//                         [--seconds=N] [--transport=epoll|io_uring]
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http2/net/socket.h"
+#include "http2/protocol/constants.h"
+#include "http2/protocol/frame.h"
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/server/server.h"
+
+namespace proto = http2::protocol;
+
+namespace {
+
+struct Flags {
+  unsigned int max_shards = std::thread::hardware_concurrency();
+  unsigned int connections = 64;
+  unsigned int streams = 16;
+  unsigned int seconds = 3;
+  http2::server::Transport transport = http2::server::TRANSPORT_EPOLL;
+};
+
+bool parse_flag(const char* arg, const char* name, unsigned int& out) {
+  std::size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+  out = std::strtoul(arg + len + 1, nullptr, 10);
+  return true;
+}
+
+bool parse_transport(const char* arg, http2::server::Transport& out) {
+  std::string s(arg);
+  if (s == "--transport=epoll") {
+    out = http2::server::TRANSPORT_EPOLL;
+  } else if (s == "--transport=io_uring") {
+    out = http2::server::TRANSPORT_IO_URING;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool write_all(int fd, const std::vector<uint8_t>& buf) {
+  std::size_t pos = 0;
+  while (pos < buf.size()) {
+    ssize_t n = ::send(fd, buf.data() + pos, buf.size() - pos, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    pos += n;
+  }
+  return true;
+}
+
+// run_client keeps `streams` requests in flight on one connection until
+// `stop` is set, and returns the number of responses received.
+uint64_t run_client(uint16_t port, unsigned int streams,
+                    const std::atomic<bool>& stop) {
+  int fd = http2::net::connect_tcp("127.0.0.1", port);
+  proto::hpack::Encoder encoder;
+  proto::hpack::Decoder decoder;
+  std::vector<http2::headers::Header> request = {
+      {":method", "GET"},
+      {":scheme", "http"},
+      {":path", "/"},
+      {":authority", "localhost"},
+  };
+
+  uint32_t next_id = 1;
+  std::vector<uint8_t> out(std::begin(proto::kConnectionPreface),
+                           std::end(proto::kConnectionPreface));
+  proto::encode_frame_header(0, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0,
+                             out);
+  auto send_request = [&] {
+    std::vector<uint8_t> block;
+    encoder.encode_all(request, block);
+    proto::encode_frame_header(block.size(), proto::HEADERS_FRAME,
+                               proto::END_HEADERS | proto::END_STREAM,
+                               next_id, out);
+    out.insert(out.end(), block.begin(), block.end());
+    next_id += 2;
+  };
+  for (unsigned int i = 0; i < streams; ++i) send_request();
+
+  uint64_t completed = 0;
+  uint32_t unacked_data = 0;
+  std::vector<uint8_t> in;
+  std::vector<http2::headers::Header> decoded;
+  uint8_t chunk[65536];
+  while (!stop.load(std::memory_order_relaxed)) {
+    if (!out.empty()) {
+      if (!write_all(fd, out)) break;
+      out.clear();
+    }
+    ssize_t n = ::read(fd, chunk, sizeof(chunk));
+    if (n <= 0) break;
+    in.insert(in.end(), chunk, chunk + n);
+
+    const uint8_t* p = in.data();
+    const uint8_t* q = p + in.size();
+    proto::FrameHeader hdr;
+    while (proto::decode_frame_header(p, q, hdr) &&
+           std::size_t(q - p) >= proto::kFrameHeaderSize + hdr.length) {
+      const uint8_t* payload = p + proto::kFrameHeaderSize;
+      p = payload + hdr.length;
+      bool finished = false;
+      switch (hdr.type) {
+        case proto::SETTINGS_FRAME:
+          if (!hdr.has_flag(proto::ACK)) {
+            proto::encode_frame_header(0, proto::SETTINGS_FRAME, proto::ACK,
+                                       0, out);
+          }
+          break;
+        case proto::HEADERS_FRAME:
+          decoder.decode(payload, p, decoded);
+          finished = hdr.has_flag(proto::END_STREAM);
+          break;
+        case proto::DATA_FRAME:
+          unacked_data += hdr.length;
+          finished = hdr.has_flag(proto::END_STREAM);
+          break;
+      }
+      if (finished) {
+        ++completed;
+        send_request();
+      }
+    }
+    in.erase(in.begin(), in.begin() + (p - in.data()));
+
+    if (unacked_data >= 32768) {
+      uint32_t v = unacked_data;
+      proto::encode_frame_header(4, proto::WINDOW_UPDATE_FRAME,
+                                 proto::NO_FLAGS, 0, out);
+      out.insert(out.end(), {uint8_t(v >> 24), uint8_t(v >> 16),
+                             uint8_t(v >> 8), uint8_t(v)});
+      unacked_data = 0;
+    }
+  }
+  ::close(fd);
+  return completed;
+}
+
+double run_once(unsigned int shards, const Flags& flags) {
+  http2::server::ServerOptions options;
+  options.address = "127.0.0.1";
+  options.num_shards = shards;
+  options.pin_shards = true;
+  options.transport = flags.transport;
+  options.connection.settings.set_max_concurrent_streams(flags.streams);
+  http2::server::Server server(options, [](const http2::server::Request&,
+                                           http2::server::Response& resp) {
+    resp.headers.add(":status", "200");
+    resp.body.assign({'o', 'k'});
+  });
+  server.start();
+
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> total(0);
+  std::vector<std::thread> clients;
+  for (unsigned int i = 0; i < flags.connections; ++i) {
+    clients.emplace_back([&] {
+      total += run_client(server.port(), flags.streams, stop);
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(flags.seconds));
+  stop = true;
+  // Shutting the server down unblocks any client stuck in read().
+  server.stop();
+  for (auto& t : clients) t.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return total / elapsed.count();
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  for (int i = 1; i < argc; ++i) {
+    if (!parse_flag(argv[i], "--max_shards", flags.max_shards) &&
+        !parse_flag(argv[i], "--connections", flags.connections) &&
+        !parse_flag(argv[i], "--streams", flags.streams) &&
+        !parse_flag(argv[i], "--seconds", flags.seconds) &&
+        !parse_transport(argv[i], flags.transport)) {
+      std::cerr << "unknown flag: " << argv[i] << std::endl;
+      return 2;
+    }
+  }
+  if (flags.max_shards == 0) flags.max_shards = 1;
+
+  double base = 0;
+  for (unsigned int shards = 1; shards <= flags.max_shards; shards *= 2) {
+    double rps = run_once(shards, flags);
+    if (shards == 1) base = rps;
+    std::cout << "shards=" << shards << " requests_per_sec=" << uint64_t(rps)
+              << " scaling=" << (base > 0 ? rps / base : 0) << std::endl;
+    if (shards < flags.max_shards && shards * 2 > flags.max_shards) {
+      shards = flags.max_shards / 2;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,338 @@
+#include "http2/server/server.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http2/net/socket.h"
+#include "http2/protocol/constants.h"
+#include "http2/protocol/frame.h"
+#include "http2/protocol/hpack/hpack.h"
+
+using http2::server::Request;
+using http2::server::Response;
+using http2::server::Server;
+using http2::server::ServerOptions;
+using http2::server::ServerStream;
+using http2::server::StreamTask;
+
+namespace proto = http2::protocol;
+
+namespace {
+
+// TestClient speaks just enough HTTP/2 to issue GET requests.
+class TestClient {
+ public:
+  explicit TestClient(uint16_t port)
+      : fd_(http2::net::connect_tcp("127.0.0.1", port)), next_id_(1) {
+    std::vector<uint8_t> out(std::begin(proto::kConnectionPreface),
+                             std::end(proto::kConnectionPreface));
+    proto::encode_frame_header(0, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0,
+                               out);
+    send(out);
+  }
+  ~TestClient() { ::close(fd_); }
+
+  // get sends a request and returns the response body, or "<error>".
+  std::string get(const std::string& path) {
+    return response(begin(path, true));
+  }
+
+  // begin sends the headers of a request and returns its stream ID.  Unless
+  // end_stream is set, the request stays open until finish.
+  uint32_t begin(const std::string& path, bool end_stream) {
+    uint32_t id = next_id_;
+    next_id_ += 2;
+    std::vector<uint8_t> block;
+    encoder_.encode_all({{":method", "GET"},
+                         {":scheme", "http"},
+                         {":path", path},
+                         {":authority", "localhost"}},
+                        block);
+    std::vector<uint8_t> out;
+    proto::encode_frame_header(
+        block.size(), proto::HEADERS_FRAME,
+        end_stream ? proto::END_HEADERS | proto::END_STREAM : proto::END_HEADERS,
+        id, out);
+    out.insert(out.end(), block.begin(), block.end());
+    send(out);
+    return id;
+  }
+
+  // finish ends a request opened by begin, and returns the response body.
+  std::string finish(uint32_t id) {
+    std::vector<uint8_t> out;
+    proto::encode_frame_header(0, proto::DATA_FRAME, proto::END_STREAM, id,
+                               out);
+    send(out);
+    return response(id);
+  }
+
+  // response reads the response to stream id and returns its body, or
+  // "<error>".
+  std::string response(uint32_t id) {
+    std::vector<uint8_t> out;
+    std::string body;
+    proto::Frame f;
+    while (read_frame(f)) {
+      if (f.type() == proto::SETTINGS_FRAME && !f.has_flag(proto::ACK)) {
+        out.clear();
+        proto::encode_frame_header(0, proto::SETTINGS_FRAME, proto::ACK, 0,
+                                   out);
+        send(out);
+      }
+      if (f.stream_id() != id) continue;
+      if (f.type() == proto::HEADERS_FRAME) {
+        std::vector<http2::headers::Header> headers;
+        if (!decoder_.decode(f.payload(), headers)) break;
+      } else if (f.type() == proto::DATA_FRAME) {
+        body.append(f.payload().begin(), f.payload().end());
+      } else {
+        break;
+      }
+      if (f.has_flag(proto::END_STREAM)) return body;
+    }
+    return "<error>";
+  }
+
+  // goaway reads until the server sends GOAWAY, and returns its error code,
+  // or -1 if the connection closes first.  The last stream ID it carries is
+  // stored in *last_id, if given.
+  int goaway(uint32_t* last_id = nullptr) {
+    proto::Frame f;
+    while (read_frame(f)) {
+      if (f.type() != proto::GOAWAY_FRAME) continue;
+      const auto& p = f.payload();
+      if (last_id != nullptr) {
+        *last_id = (uint32_t(p[0] & 0x7f) << 24) | (uint32_t(p[1]) << 16) |
+                   (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+      }
+      return p[7];
+    }
+    return -1;
+  }
+
+  // closed returns true once the server has closed the connection, reading
+  // and discarding anything before that.
+  bool closed() {
+    proto::Frame f;
+    while (read_frame(f)) {
+    }
+    return true;
+  }
+
+ private:
+  void send(const std::vector<uint8_t>& out) {
+    ASSERT_EQ(::send(fd_, out.data(), out.size(), MSG_NOSIGNAL),
+              ssize_t(out.size()));
+  }
+
+  bool read_exactly(uint8_t* p, std::size_t n) {
+    while (n > 0) {
+      ssize_t r = ::read(fd_, p, n);
+      if (r <= 0) return false;
+      p += r;
+      n -= r;
+    }
+    return true;
+  }
+
+  bool read_frame(proto::Frame& f) {
+    std::vector<uint8_t> buf(proto::kFrameHeaderSize);
+    proto::FrameHeader hdr;
+    if (!read_exactly(buf.data(), buf.size())) return false;
+    proto::decode_frame_header(buf.data(), buf.data() + buf.size(), hdr);
+    buf.resize(proto::kFrameHeaderSize + hdr.length);
+    if (!read_exactly(buf.data() + proto::kFrameHeaderSize, hdr.length)) {
+      return false;
+    }
+    return f.decode(buf);
+  }
+
+  int fd_;
+  uint32_t next_id_;
+  proto::hpack::Encoder encoder_;
+  proto::hpack::Decoder decoder_;
+};
+
+void echo_path(const Request& req, Response& resp) {
+  auto path = req.headers.first(":path");
+  resp.headers.add(":status", "200");
+  if (path.second == "/big") {
+    // Several DATA frames, but still within the default 64 KiB window.
+    resp.body.assign(60000, 'x');
+  } else {
+    resp.body.assign(path.second.begin(), path.second.end());
+  }
+}
+
+class ServerTest : public testing::TestWithParam<http2::server::Transport> {};
+
+TEST_P(ServerTest, Loopback) {
+  ServerOptions options;
+  options.address = "127.0.0.1";
+  options.num_shards = 2;
+  options.transport = GetParam();
+  options.uring.num_buffers = 64;
+  Server server(options, echo_path);
+  try {
+    server.start();
+  } catch (const std::system_error& e) {
+    GTEST_SKIP() << "transport unavailable: " << e.what();
+  }
+
+  TestClient a(server.port());
+  TestClient b(server.port());
+  EXPECT_EQ(a.get("/one"), "/one");
+  EXPECT_EQ(b.get("/two"), "/two");
+  EXPECT_EQ(a.get("/three"), "/three");
+
+  EXPECT_EQ(b.get("/big"), std::string(60000, 'x'));
+  server.stop();
+}
+
+TEST_P(ServerTest, FileBody) {
+  std::string contents;
+  for (int i = 0; i < 10000; ++i) contents.append(std::to_string(i));
+  contents.resize(50000);
+  char path[] = "/tmp/server_test.XXXXXX";
+  int fd = ::mkstemp(path);
+  ASSERT_GE(fd, 0);
+  ::unlink(path);
+  ASSERT_EQ(::write(fd, contents.data(), contents.size()),
+            ssize_t(contents.size()));
+
+  ServerOptions options;
+  options.address = "127.0.0.1";
+  options.num_shards = 1;
+  options.transport = GetParam();
+  options.uring.num_buffers = 64;
+  Server server(options, [fd](const Request&, Response& resp) {
+    resp.file = std::make_shared<http2::server::FileBody>(::dup(fd), 0,
+                                                          50000);
+  });
+  try {
+    server.start();
+  } catch (const std::system_error& e) {
+    ::close(fd);
+    GTEST_SKIP() << "transport unavailable: " << e.what();
+  }
+
+  TestClient client(server.port());
+  EXPECT_EQ(client.get("/file"), contents);
+  server.stop();
+  ::close(fd);
+}
+
+TEST_P(ServerTest, Offload) {
+  ServerOptions options;
+  options.address = "127.0.0.1";
+  options.num_shards = 1;
+  options.num_workers = 2;
+  options.transport = GetParam();
+  options.uring.num_buffers = 64;
+  Server server(options, [](ServerStream stream) -> StreamTask {
+    http2::headers::Headers request = co_await stream.headers();
+    std::string path(request.first(":path").second);
+    auto reverse = [path] { return std::string(path.rbegin(), path.rend()); };
+    std::string reversed = co_await stream.offload(std::move(reverse));
+    co_yield reversed;
+  });
+  try {
+    server.start();
+  } catch (const std::system_error& e) {
+    GTEST_SKIP() << "transport unavailable: " << e.what();
+  }
+
+  TestClient a(server.port());
+  TestClient b(server.port());
+  EXPECT_EQ(a.get("/abc"), "cba/");
+  EXPECT_EQ(b.get("/hello"), "olleh/");
+  EXPECT_EQ(a.get("/xy"), "yx/");
+  server.stop();
+}
+
+TEST_P(ServerTest, IdleTimeout) {
+  ServerOptions options;
+  options.address = "127.0.0.1";
+  options.num_shards = 1;
+  options.transport = GetParam();
+  options.uring.num_buffers = 64;
+  options.connection.idle_timeout_ms = 50;
+  Server server(options, echo_path);
+  try {
+    server.start();
+  } catch (const std::system_error& e) {
+    GTEST_SKIP() << "transport unavailable: " << e.what();
+  }
+
+  TestClient client(server.port());
+  EXPECT_EQ(client.get("/one"), "/one");
+  EXPECT_EQ(client.goaway(), proto::NO_ERROR);
+  server.stop();
+}
+
+TEST_P(ServerTest, Handoff) {
+  std::string path =
+      "/tmp/server_test." + std::to_string(::getpid()) + ".handoff";
+  ServerOptions options;
+  options.address = "127.0.0.1";
+  options.num_shards = 2;
+  options.transport = GetParam();
+  options.uring.num_buffers = 64;
+  options.handoff_path = path;
+
+  // The old server answers once it has the whole request body.
+  Server old_server(options, [](ServerStream stream) -> StreamTask {
+    std::vector<uint8_t> chunk;
+    while (co_await stream.read(chunk)) {
+    }
+    co_yield std::string("old");
+  });
+  try {
+    old_server.start();
+  } catch (const std::system_error& e) {
+    GTEST_SKIP() << "transport unavailable: " << e.what();
+  }
+  uint16_t port = old_server.port();
+
+  auto a = std::make_unique<TestClient>(port);
+  uint32_t open = a->begin("/open", false);
+  EXPECT_EQ(a->get("/done"), "old");  // so the open stream has been seen
+
+  // The new server takes the listeners over; the old one drains.
+  Server new_server(options, [](const Request&, Response& resp) {
+    resp.headers.add(":status", "200");
+    resp.body.assign({'n', 'e', 'w'});
+  });
+  new_server.start();
+  EXPECT_EQ(new_server.port(), port);
+
+  uint32_t last_id = 0;
+  EXPECT_EQ(a->goaway(&last_id), proto::NO_ERROR);
+  EXPECT_EQ(last_id, 3u);
+  EXPECT_EQ(a->finish(open), "old");
+  EXPECT_TRUE(a->closed());
+  a.reset();
+  old_server.wait();
+
+  TestClient b(port);
+  EXPECT_EQ(b.get("/"), "new");
+  old_server.stop();
+  new_server.stop();
+  EXPECT_EQ(::access(path.c_str(), F_OK), -1);
+}
+
+INSTANTIATE_TEST_SUITE_P(Transports, ServerTest,
+                         testing::Values(http2::server::TRANSPORT_EPOLL,
+                                         http2::server::TRANSPORT_IO_URING));
+
+}  // anonymous namespace
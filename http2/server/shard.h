@@ -0,0 +1,41 @@
+// Tools for running one shard of a shared-nothing HTTP/2 server.
+
+#ifndef HTTP2_SERVER_SHARD_H
+#define HTTP2_SERVER_SHARD_H
+
+#include <cstdint>
+
+namespace http2 {
+namespace server {
+
+// kDrainLingerMs is how long a draining shard waits, past the connections'
+// drain_timeout_ms, for peers to close their side of finished connections.
+inline constexpr uint32_t kDrainLingerMs = 1000;
+
+// Shard owns one listening socket, one I/O loop, and every connection that
+// was accepted on that socket.  All of a shard's state is touched only by the
+// thread that calls run(), so nothing in it needs a lock.
+class Shard {
+ public:
+  virtual ~Shard() = default;
+
+  // run accepts and serves connections until stop() is called, or until a
+  // drain has finished.
+  virtual void run() = 0;
+
+  // stop asks run() to return.  Safe to call from any thread.
+  virtual void stop() = 0;
+
+  // drain asks the shard to wind down gracefully: it closes its listening
+  // socket, shuts every connection down with a GOAWAY (see
+  // Connection::shutdown), and half-closes each one once it is done, so that
+  // the peer reads everything before the socket goes away.  run() returns
+  // once all are closed, or kDrainLingerMs after the drain deadline.  Safe
+  // to call from any thread.
+  virtual void drain() = 0;
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_SHARD_H
@@ -0,0 +1,128 @@
+// Statistics benchmark: feeds a Connection a stream of GET requests in
+// process, with statistics on and off, and reports the cost per request of
+// each.  The difference is the overhead of the counters and the latency
+// histograms, clock reads included.  It also times the recording functions
+// on their own.
+//
+// Usage: stats_benchmark [--requests=N] [--rounds=N] [--body_size=BYTES]
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "http2/protocol/constants.h"
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/server/benchmark_util.h"
+#include "http2/server/connection.h"
+#include "http2/stats/stats.h"
+
+namespace proto = http2::protocol;
+namespace stats = http2::stats;
+using http2::server::bench::append_frame;
+using http2::server::bench::parse_flag;
+
+namespace {
+
+struct Flags {
+  unsigned int requests = 50000;
+  unsigned int rounds = 7;
+  unsigned int body_size = 100;
+};
+
+std::vector<uint8_t> make_input(unsigned int requests, uint32_t body_size) {
+  std::vector<uint8_t> out(std::begin(proto::kConnectionPreface),
+                           std::end(proto::kConnectionPreface));
+  append_frame(out, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0, {});
+  append_frame(out, proto::SETTINGS_FRAME, proto::ACK, 0, {});
+
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> block;
+  for (unsigned int i = 0; i < requests; ++i) {
+    block.clear();
+    encoder.encode_all({{":method", "GET"},
+                        {":scheme", "http"},
+                        {":path", "/"},
+                        {":authority", "localhost"}},
+                       block);
+    append_frame(out, proto::HEADERS_FRAME,
+                 proto::END_HEADERS | proto::END_STREAM, 2 * i + 1, block);
+    if (i % 16 == 15 && body_size > 0) {
+      // Return the connection window that the responses used up.
+      uint32_t n = 16 * body_size;
+      append_frame(out, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 0,
+                   {uint8_t(n >> 24), uint8_t(n >> 16), uint8_t(n >> 8),
+                    uint8_t(n)});
+    }
+  }
+  return out;
+}
+
+// time_ns returns the nanoseconds per call of f, over n calls.
+template <typename F>
+double time_ns(unsigned int n, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < n; ++i) f(i);
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / n;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  for (int i = 1; i < argc; ++i) {
+    if (!parse_flag(argv[i], "--requests", flags.requests) &&
+        !parse_flag(argv[i], "--rounds", flags.rounds) &&
+        !parse_flag(argv[i], "--body_size", flags.body_size)) {
+      std::cerr << "unknown flag: " << argv[i] << std::endl;
+      return 2;
+    }
+  }
+
+  std::vector<uint8_t> input = make_input(flags.requests, flags.body_size);
+  http2::server::ConnectionOptions on;
+  on.settings.set_max_concurrent_streams(1000000);
+  on.max_control_frames = 0;
+  http2::server::ConnectionOptions off = on;
+  off.stats = false;
+
+  std::size_t body_size = flags.body_size;
+  http2::server::Handler handler = [body_size](const http2::server::Request&,
+                                               http2::server::Response& resp) {
+    resp.headers.add(":status", "200");
+    resp.body.assign(body_size, 'x');
+  };
+  double best_off, best_on;
+  if (!http2::server::bench::compare(off, on, handler, input, flags.rounds,
+                                     &best_off, &best_on)) {
+    std::cerr << "connection failed" << std::endl;
+    return 1;
+  }
+  double per_off = best_off / flags.requests;
+  double per_on = best_on / flags.requests;
+  std::cout << "requests=" << flags.requests
+            << " ns_per_request_off=" << per_off
+            << " ns_per_request_on=" << per_on
+            << " overhead_pct=" << (per_on - per_off) / per_off * 100
+            << std::endl;
+
+  unsigned int n = 10000000;
+  std::cout << "ns_per_count_frame="
+            << time_ns(n,
+                       [](unsigned int i) {
+                         stats::count_frame(stats::SENT, i & 7, 100);
+                       })
+            << " ns_per_histogram_record="
+            << time_ns(n,
+                       [](unsigned int i) {
+                         stats::record_time_to_headers(i * 37);
+                       })
+            << " ns_per_now=" << time_ns(n, [](unsigned int) {
+                 volatile uint64_t t = stats::now_ns();
+                 (void)t;
+               })
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include "http2/server/stream.h"
+
+#include "http2/server/connection.h"
+
+using http2::headers::Headers;
+
+namespace http2 {
+namespace server {
+
+// Each method looks its stream up by ID, rather than holding on to it,
+// because streams move within the connection's StreamTable as it grows.  A
+// stream outlives its handler's coroutine, so the lookup always succeeds.
+
+ServerStream::HeadersAwaiter ServerStream::headers() const {
+  return HeadersAwaiter(*this);
+}
+
+ServerStream::ReadAwaiter ServerStream::read(
+    std::vector<uint8_t>& chunk) const {
+  return ReadAwaiter(*this, chunk);
+}
+
+Headers ServerStream::trailers() const {
+  return std::move(conn_->find_stream(id_)->request.trailers);
+}
+
+ServerStream::CreditAwaiter ServerStream::credit() const {
+  return CreditAwaiter(*this);
+}
+
+void ServerStream::send_headers(const Headers& headers) const {
+  Connection::Stream* s = conn_->find_stream(id_);
+  if (s->headers_sent) return;
+  s->headers_sent = true;
+  conn_->send_headers(id_, headers, false);
+}
+
+void ServerStream::send_headers(const std::vector<uint8_t>& block) const {
+  Connection::Stream* s = conn_->find_stream(id_);
+  if (s->headers_sent) return;
+  s->headers_sent = true;
+  conn_->write_header_block(id_, block, false);
+}
+
+void ServerStream::set_trailers(const Headers& trailers) const {
+  // Prepared, since they are encoded long before they are sent.
+  std::vector<uint8_t> block;
+  conn_->encoder_.prepare(trailers, block);
+  set_trailers(std::move(block));
+}
+
+void ServerStream::set_trailers(std::vector<uint8_t> block) const {
+  conn_->find_stream(id_)->trailer_block = std::move(block);
+}
+
+ServerStream::WriteAwaiter ServerStream::write(const uint8_t* data,
+                                               std::size_t size) const {
+  Connection::Stream* s = conn_->find_stream(id_);
+  if (!s->headers_sent) {
+    s->headers_sent = true;
+    conn_->send_headers(id_, s->response.headers, false);
+  }
+  if (size > 0) {
+    std::vector<uint8_t>& body = s->response.body;
+    body.insert(body.end(), data, data + size);
+    conn_->body_bytes_ += size;
+    if (!s->queued) conn_->schedule(id_, s);
+  }
+  return WriteAwaiter(*this);
+}
+
+ServerStream::WriteAwaiter ServerStream::write(std::string_view chunk) const {
+  return write(reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size());
+}
+
+ServerStream::WriteAwaiter ServerStream::write(
+    const std::vector<uint8_t>& chunk) const {
+  return write(chunk.data(), chunk.size());
+}
+
+bool ServerStream::can_offload() const {
+  return conn_->options_.executor != nullptr && conn_->mailbox_ != nullptr;
+}
+
+void ServerStream::start_offload(Offload* job) const {
+  job->conn_ = conn_;
+  job->stream_id_ = id_;
+  job->mailbox_ = conn_->mailbox_;
+  conn_->offloads_.push_back(job);
+  conn_->find_stream(id_)->wait = Connection::WAIT_OFFLOAD;
+  conn_->options_.executor->submit(job);
+}
+
+Headers ServerStream::HeadersAwaiter::await_resume() const {
+  Connection* conn = stream_.conn_;
+  return std::move(conn->find_stream(stream_.id_)->request.headers);
+}
+
+bool ServerStream::ReadAwaiter::await_ready() const {
+  Connection* conn = stream_.conn_;
+  const Connection::Stream* s = conn->find_stream(stream_.id_);
+  return !s->request.body.empty() || s->state != STREAM_OPEN;
+}
+
+void ServerStream::ReadAwaiter::await_suspend(std::coroutine_handle<>) const {
+  Connection* conn = stream_.conn_;
+  conn->find_stream(stream_.id_)->wait = Connection::WAIT_READ;
+}
+
+bool ServerStream::ReadAwaiter::await_resume() const {
+  Connection* conn = stream_.conn_;
+  Connection::Stream* s = conn->find_stream(stream_.id_);
+  chunk_->clear();
+  chunk_->swap(s->request.body);
+  conn->consume_body(stream_.id_, s, chunk_->size());
+  return !chunk_->empty();
+}
+
+bool ServerStream::CreditAwaiter::await_ready() const {
+  return await_resume() > 0;
+}
+
+void ServerStream::CreditAwaiter::await_suspend(
+    std::coroutine_handle<>) const {
+  Connection* conn = stream_.conn_;
+  conn->find_stream(stream_.id_)->wait = Connection::WAIT_CREDIT;
+}
+
+int64_t ServerStream::CreditAwaiter::await_resume() const {
+  Connection* conn = stream_.conn_;
+  return conn->send_credit(*conn->find_stream(stream_.id_));
+}
+
+bool ServerStream::WriteAwaiter::await_ready() const {
+  Connection* conn = stream_.conn_;
+  const Connection::Stream* s = conn->find_stream(stream_.id_);
+  return conn->buffered_body(*s) <= conn->options_.stream_buffer_size;
+}
+
+void ServerStream::WriteAwaiter::await_suspend(std::coroutine_handle<>) const {
+  Connection* conn = stream_.conn_;
+  conn->find_stream(stream_.id_)->wait = Connection::WAIT_DRAIN;
+}
+
+}  // namespace server
+}  // namespace http2
@@ -0,0 +1,357 @@
+// Coroutine handlers, which process a request and its response a chunk at a
+// time.
+
+#ifndef HTTP2_SERVER_STREAM_H
+#define HTTP2_SERVER_STREAM_H
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "http2/headers/headers.h"
+#include "http2/net/mailbox.h"
+#include "http2/server/executor.h"
+#include "http2/server/frame_pool.h"
+
+namespace http2 {
+namespace server {
+
+class Connection;
+
+// Offload is a piece of a streaming handler's work, sent by
+// ServerStream::offload to run on an Executor.  Once it has run, it is posted
+// to its connection's Mailbox, and the shard that owns the connection hands
+// it back with Connection::complete_offload.
+class Offload : public Executor::Task, public http2::net::Mailbox::Message {
+ public:
+  // connection returns the connection that is waiting for this Offload, or
+  // null if that connection has since closed.
+  Connection* connection() const { return conn_; }
+
+ protected:
+  Offload()
+      : conn_(nullptr), stream_id_(0), mailbox_(nullptr), delivered_(false) {}
+
+  // work does the actual work, on a worker thread.
+  virtual void work() = 0;
+
+ private:
+  friend class Connection;
+  friend class ServerStream;
+
+  void run() final {
+    work();
+    mailbox_->post(this);
+  }
+
+  Connection* conn_;
+  uint32_t stream_id_;
+  http2::net::Mailbox* mailbox_;
+  bool delivered_;  // handed back to the handler by complete_offload
+};
+
+// OffloadCall is an Offload that calls a function and keeps its result.
+template <typename F>
+class OffloadCall final : public Offload {
+ public:
+  using Result = std::invoke_result_t<F&>;
+
+  explicit OffloadCall(F fn) : fn_(std::move(fn)) {}
+
+  // take returns the function's result, or rethrows its exception.
+  Result take() {
+    if (error_) std::rethrow_exception(error_);
+    if constexpr (!std::is_void_v<Result>) return std::move(*result_);
+  }
+
+ private:
+  void work() override {
+    try {
+      if constexpr (std::is_void_v<Result>) {
+        fn_();
+      } else {
+        result_.emplace(fn_());
+      }
+    } catch (...) {
+      error_ = std::current_exception();
+    }
+  }
+
+  F fn_;
+  std::optional<std::conditional_t<std::is_void_v<Result>, char, Result>>
+      result_;
+  std::exception_ptr error_;
+};
+
+// ServerStream is a streaming handler's view of its request and response.
+// It is a cheap, copyable reference to a stream of a Connection; it must only
+// be used from within the handler's coroutine, which the connection resumes
+// on its own event loop thread whenever the awaited event occurs.
+//
+// For example:
+//
+//   StreamTask upload(ServerStream stream) {
+//     Headers request = co_await stream.headers();
+//     std::vector<uint8_t> chunk;
+//     std::size_t total = 0;
+//     while (co_await stream.read(chunk)) total += chunk.size();
+//     Headers response;
+//     response.add(":status", "201");
+//     stream.send_headers(response);
+//     co_yield std::to_string(total);
+//   }
+//
+// If the peer resets the stream, the coroutine is destroyed where it was
+// suspended, without being resumed.
+class ServerStream final {
+ public:
+  class HeadersAwaiter;
+  class ReadAwaiter;
+  class CreditAwaiter;
+  class WriteAwaiter;
+  template <typename F>
+  class OffloadAwaiter;
+
+  ServerStream() : conn_(nullptr), id_(0) {}
+  ServerStream(Connection* conn, uint32_t id) : conn_(conn), id_(id) {}
+
+  Connection* connection() const { return conn_; }
+  uint32_t id() const { return id_; }
+
+  // co_await headers() yields the request headers.  They are complete by the
+  // time the handler starts, so this never suspends.  The headers are moved
+  // out of the stream: await them only once.
+  HeadersAwaiter headers() const;
+
+  // co_await read(chunk) replaces the contents of chunk with the next part of
+  // the request body, suspending until some arrives.  It yields false, with
+  // chunk empty, once the whole body has been read.
+  //
+  // The peer may only send as much as the stream's flow-control window
+  // allows, and that credit is returned as the handler reads, so a handler
+  // that reads slowly slows the upload down rather than letting it pile up:
+  // no more than a window's worth of body is ever buffered.
+  ReadAwaiter read(std::vector<uint8_t>& chunk) const;
+
+  // trailers returns the request trailers, if any.  Only call it after read
+  // has yielded false.
+  http2::headers::Headers trailers() const;
+
+  // co_await credit() yields the number of bytes that could be sent right
+  // away, under both the stream's and the connection's flow-control window,
+  // beyond what the handler has already written.  It suspends until that
+  // number is positive.
+  CreditAwaiter credit() const;
+
+  // send_headers queues the response headers, unless they were already sent.
+  // If the handler writes body data (or returns) first, headers consisting
+  // of ":status: 200" are sent for it.
+  void send_headers(const http2::headers::Headers& headers) const;
+
+  // send_headers(block) is send_headers for a header block prepared with
+  // http2::protocol::hpack::Encoder::prepare, which is sent as is.  It must
+  // include ":status".
+  void send_headers(const std::vector<uint8_t>& block) const;
+
+  // set_trailers sets the trailers that end the response: once the handler
+  // has returned and the body has been sent, they follow it in a HEADERS
+  // frame with END_STREAM, in place of an END_STREAM flag on the last DATA
+  // frame.  The block form takes trailers prepared with Encoder::prepare.
+  void set_trailers(const http2::headers::Headers& trailers) const;
+  void set_trailers(std::vector<uint8_t> block) const;
+
+  // write queues a chunk of the response body.  co_await the result to
+  // suspend until the stream's buffered output is no more than
+  // ConnectionOptions::stream_buffer_size.  "co_yield chunk" in a handler
+  // does both.
+  WriteAwaiter write(const uint8_t* data, std::size_t size) const;
+  WriteAwaiter write(std::string_view chunk) const;
+  WriteAwaiter write(const std::vector<uint8_t>& chunk) const;
+
+  // co_await offload(fn) calls fn() on a worker thread of the connection's
+  // Executor (ConnectionOptions::executor), and yields its result, or
+  // rethrows its exception.  The handler stays suspended meanwhile, so other
+  // streams on the event loop keep going.  Without an Executor, fn runs in
+  // place.
+  //
+  // fn must own everything it touches: if the stream is reset while fn runs,
+  // the handler is destroyed without waiting for fn, and fn's result is
+  // discarded.  It must not use the stream, or anything else tied to the
+  // connection.
+  //
+  // GCC 12 miscompiles lambda temporaries that capture non-trivial objects
+  // (e.g. strings) inside a co_await expression: name such a lambda first,
+  // and pass it with std::move.
+  template <typename F>
+  OffloadAwaiter<F> offload(F fn) const {
+    return OffloadAwaiter<F>(*this, std::move(fn));
+  }
+
+ private:
+  bool can_offload() const;
+  void start_offload(Offload* job) const;
+
+  Connection* conn_;
+  uint32_t id_;
+};
+
+class ServerStream::HeadersAwaiter final {
+ public:
+  explicit HeadersAwaiter(ServerStream stream) : stream_(stream) {}
+  bool await_ready() const noexcept { return true; }
+  void await_suspend(std::coroutine_handle<>) const noexcept {}
+  http2::headers::Headers await_resume() const;
+
+ private:
+  ServerStream stream_;
+};
+
+class ServerStream::ReadAwaiter final {
+ public:
+  ReadAwaiter(ServerStream stream, std::vector<uint8_t>& chunk)
+      : stream_(stream), chunk_(&chunk) {}
+  bool await_ready() const;
+  void await_suspend(std::coroutine_handle<>) const;
+  bool await_resume() const;
+
+ private:
+  ServerStream stream_;
+  std::vector<uint8_t>* chunk_;
+};
+
+class ServerStream::CreditAwaiter final {
+ public:
+  explicit CreditAwaiter(ServerStream stream) : stream_(stream) {}
+  bool await_ready() const;
+  void await_suspend(std::coroutine_handle<>) const;
+  int64_t await_resume() const;
+
+ private:
+  ServerStream stream_;
+};
+
+class ServerStream::WriteAwaiter final {
+ public:
+  explicit WriteAwaiter(ServerStream stream) : stream_(stream) {}
+  bool await_ready() const;
+  void await_suspend(std::coroutine_handle<>) const;
+  void await_resume() const noexcept {}
+
+ private:
+  ServerStream stream_;
+};
+
+template <typename F>
+class ServerStream::OffloadAwaiter final {
+ public:
+  OffloadAwaiter(ServerStream stream, F fn)
+      : stream_(stream), fn_(std::move(fn)), call_(nullptr) {}
+  OffloadAwaiter(const OffloadAwaiter&) = delete;
+  OffloadAwaiter& operator=(const OffloadAwaiter&) = delete;
+
+  // The handler owns its OffloadCall once it is delivered, even if it is
+  // destroyed without being resumed; until then, the connection or the
+  // mailbox does.
+  ~OffloadAwaiter() {
+    if (call_ != nullptr && call_->delivered_) delete call_;
+  }
+
+  bool await_ready() const { return !stream_.can_offload(); }
+
+  void await_suspend(std::coroutine_handle<>) {
+    call_ = new OffloadCall<F>(std::move(fn_));
+    stream_.start_offload(call_);
+  }
+
+  std::invoke_result_t<F&> await_resume() {
+    if (call_ == nullptr) return fn_();
+    std::unique_ptr<OffloadCall<F>> call(call_);
+    call_ = nullptr;
+    return call->take();
+  }
+
+ private:
+  ServerStream stream_;
+  F fn_;
+  OffloadCall<F>* call_;
+};
+
+// StreamTask is the coroutine type of a streaming handler.  It owns the
+// coroutine, which starts suspended; the connection that called the handler
+// drives it from then on.  Coroutine frames are allocated from the
+// connection's FramePool.
+//
+// A handler that lets an exception escape has its stream reset with
+// INTERNAL_ERROR.
+class StreamTask final {
+ public:
+  class promise_type;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  StreamTask() noexcept : handle_(nullptr) {}
+  explicit StreamTask(Handle handle) noexcept : handle_(handle) {}
+  ~StreamTask() {
+    if (handle_) handle_.destroy();
+  }
+
+  StreamTask(StreamTask&& other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr)) {}
+  StreamTask& operator=(StreamTask&& other) noexcept {
+    if (this != &other) {
+      if (handle_) handle_.destroy();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+
+  explicit operator bool() const noexcept { return bool(handle_); }
+  bool done() const { return handle_.done(); }
+  void resume() const { handle_.resume(); }
+  promise_type& promise() const { return handle_.promise(); }
+
+ private:
+  Handle handle_;
+};
+
+class StreamTask::promise_type final {
+ public:
+  StreamTask get_return_object() noexcept {
+    return StreamTask(Handle::from_promise(*this));
+  }
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  std::suspend_always final_suspend() const noexcept { return {}; }
+  void return_void() const noexcept {}
+  void unhandled_exception() noexcept { failed_ = true; }
+
+  ServerStream::WriteAwaiter yield_value(std::string_view chunk) {
+    return stream_.write(chunk);
+  }
+  ServerStream::WriteAwaiter yield_value(const std::vector<uint8_t>& chunk) {
+    return stream_.write(chunk);
+  }
+
+  static void* operator new(std::size_t n) {
+    return FramePool::allocate(FramePool::current(), n);
+  }
+  static void operator delete(void* p) noexcept { FramePool::deallocate(p); }
+
+  bool failed() const { return failed_; }
+
+ private:
+  friend class Connection;
+
+  ServerStream stream_;
+  bool failed_ = false;
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_STREAM_H
@@ -0,0 +1,489 @@
+#include "http2/server/uring_shard.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+
+#include "http2/net/socket.h"
+
+// The low bits of each submission's user_data say what kind of operation it
+// was; the rest is the Session pointer (or null), which is 8-byte aligned.
+static constexpr uint64_t kOpMask = 0x7;
+static constexpr uint64_t kOpAccept = 1;
+static constexpr uint64_t kOpWakeup = 2;
+static constexpr uint64_t kOpRecv = 3;
+static constexpr uint64_t kOpSend = 4;
+static constexpr uint64_t kOpPollOut = 5;
+static constexpr uint64_t kOpMailbox = 6;
+
+// The most iovecs gathered for one sendmsg; well under IOV_MAX.
+static constexpr std::size_t kMaxIovecs = 64;
+static constexpr uint16_t kBufferGroup = 0;
+
+namespace http2 {
+namespace server {
+
+class UringShard::Session final : public ConnectionHost {
+ public:
+  Session(UringShard* shard, int fd)
+      : shard(shard), fd(fd), conn(shard->options_, shard->handler_,
+                                   &shard->budget_) {
+    conn.attach(this, &shard->mailbox_, &shard->timers_);
+  }
+  ~Session() override { ::close(fd); }
+
+  void wake() override { shard->mark_dirty(this); }
+
+  // receive feeds one kernel-selected buffer to the connection.  Complete
+  // frames are parsed in place; only a trailing partial frame is copied out,
+  // so the buffer can be recycled as soon as this returns.
+  void receive(const uint8_t* p, std::size_t n) {
+    if (carry.empty()) {
+      std::size_t used = conn.receive(p, p + n);
+      if (used < n) carry.assign(p + used, p + n);
+    } else {
+      carry.insert(carry.end(), p, p + n);
+      std::size_t used =
+          conn.receive(carry.data(), carry.data() + carry.size());
+      carry.erase(carry.begin(), carry.begin() + used);
+      if (carry.empty()) std::vector<uint8_t>().swap(carry);
+    }
+    conn.set_transport_memory(carry.capacity());
+  }
+
+  uint64_t tag(uint64_t op) { return reinterpret_cast<uint64_t>(this) | op; }
+
+  UringShard* shard;
+  int fd;
+  Connection conn;
+  std::vector<uint8_t> carry;
+
+  // The sendmsg in flight, if any.  Its iovecs point into the connection's
+  // output queue, which keeps them valid until the bytes are consumed.
+  iovec iov[kMaxIovecs];
+  msghdr msg = {};
+  unsigned int sends_inflight = 0;
+
+  bool recv_armed = false;
+  bool recv_cancelling = false;
+  bool pollout_armed = false;
+  bool dirty = false;
+  bool lingering = false;
+  bool closing = false;
+};
+
+// DrainTimer closes whatever is left once a drain has run out of time.
+class UringShard::DrainTimer final : public http2::net::TimerWheel::Timer {
+ public:
+  explicit DrainTimer(UringShard* shard) : shard_(shard) {}
+
+ private:
+  void on_expire() override { shard_->close_all(); }
+
+  UringShard* shard_;
+};
+
+UringShard::UringShard(int listen_fd, const ConnectionOptions& options,
+                       const Handler& handler, const UringOptions& uring,
+                       std::size_t memory_limit)
+    : ring_(uring.queue_depth),
+      buffers_(ring_, kBufferGroup, uring.num_buffers, uring.buffer_size),
+      listen_fd_(listen_fd),
+      wake_fd_(-1),
+      wake_value_(0),
+      mailbox_value_(0),
+      stopping_(false),
+      drain_requested_(false),
+      draining_(false),
+      accept_armed_(false),
+      wakeup_armed_(false),
+      mailbox_armed_(false),
+      options_(options),
+      handler_(handler),
+      budget_(memory_limit),
+      drain_timer_(new DrainTimer(this)) {
+  wake_fd_ = ::eventfd(0, EFD_CLOEXEC);
+  if (wake_fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(), "eventfd");
+  }
+}
+
+UringShard::~UringShard() {
+  try {
+    cancel_all();
+  } catch (const std::system_error&) {
+    // The ring is unusable; closing it is all that is left to do.
+  }
+  ring_.close();
+  sessions_.clear();
+  ::close(wake_fd_);
+  if (listen_fd_ >= 0) ::close(listen_fd_);
+}
+
+void UringShard::run() {
+  arm_accept();
+  arm_wakeup();
+  arm_mailbox();
+  while (!stopping_.load(std::memory_order_acquire)) {
+    ring_.submit(1, timers_.timeout_ms());
+    timers_.advance(http2::net::TimerWheel::clock_ms());
+    ring_.drain([this](const io_uring_cqe& cqe) { on_completion(cqe); });
+    if (drain_requested_.exchange(false, std::memory_order_acquire)) {
+      begin_drain();
+    }
+    if (budget_.exceeded()) shed_load();
+    flush_dirty();
+    // Wait for the cancelled accept, too: it may yet deliver connections.
+    if (draining_ && !accept_armed_ && sessions_.empty()) break;
+  }
+}
+
+void UringShard::drain() {
+  drain_requested_.store(true, std::memory_order_release);
+  uint64_t one = 1;
+  ssize_t n = ::write(wake_fd_, &one, sizeof(one));
+  (void)n;
+}
+
+void UringShard::stop() {
+  stopping_.store(true, std::memory_order_release);
+  uint64_t one = 1;
+  ssize_t n = ::write(wake_fd_, &one, sizeof(one));
+  (void)n;
+}
+
+void UringShard::arm_accept() {
+  io_uring_sqe* sqe = ring_.get_sqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listen_fd_;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = kOpAccept;
+  accept_armed_ = true;
+}
+
+void UringShard::arm_wakeup() {
+  io_uring_sqe* sqe = ring_.get_sqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = wake_fd_;
+  sqe->addr = reinterpret_cast<uint64_t>(&wake_value_);
+  sqe->len = sizeof(wake_value_);
+  sqe->user_data = kOpWakeup;
+  wakeup_armed_ = true;
+}
+
+void UringShard::arm_mailbox() {
+  io_uring_sqe* sqe = ring_.get_sqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = mailbox_.fd();
+  sqe->addr = reinterpret_cast<uint64_t>(&mailbox_value_);
+  sqe->len = sizeof(mailbox_value_);
+  sqe->user_data = kOpMailbox;
+  mailbox_armed_ = true;
+}
+
+void UringShard::drain_mailbox() {
+  mailbox_.drain([](http2::net::Mailbox::Message* message) {
+    Offload* job = static_cast<Offload*>(message);
+    Connection* conn = job->connection();
+    if (conn == nullptr) {
+      delete job;  // its connection has closed
+      return;
+    }
+    conn->complete_offload(job);
+  });
+}
+
+void UringShard::arm_recv(Session* s) {
+  io_uring_sqe* sqe = ring_.get_sqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = s->fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = buffers_.group_id();
+  sqe->user_data = s->tag(kOpRecv);
+  s->recv_armed = true;
+}
+
+void UringShard::cancel_recv(Session* s) {
+  // The multishot receive completes with -ECANCELED (or with data that was
+  // already on its way); either way recv_armed drops once it is gone.
+  io_uring_sqe* sqe = ring_.get_sqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = s->tag(kOpRecv);
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = 0;
+  s->recv_cancelling = true;
+}
+
+void UringShard::arm_pollout(Session* s) {
+  io_uring_sqe* sqe = ring_.get_sqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = s->fd;
+  sqe->poll32_events = POLLOUT;
+  sqe->user_data = s->tag(kOpPollOut);
+  s->pollout_armed = true;
+}
+
+bool UringShard::send_files(Session* s) {
+  // io_uring has no sendfile operation, but the socket is non-blocking, so
+  // file chunks are written inline; a full socket buffer is waited out with
+  // a POLLOUT poll.
+  Connection::FileChunk chunk;
+  while (s->conn.output_size() == 0 && s->conn.output_file(chunk)) {
+    off_t offset = chunk.offset;
+    ssize_t n = ::sendfile(s->fd, chunk.fd, &offset, chunk.length);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      arm_pollout(s);
+      return false;
+    }
+    if (n <= 0) {
+      begin_close(s);
+      return false;
+    }
+    s->conn.consume_file(n);
+  }
+  return true;
+}
+
+void UringShard::start_send(Session* s) {
+  if (s->sends_inflight > 0 || s->pollout_armed) return;
+  if (!send_files(s)) return;
+
+  // A short write is simply resubmitted, from the first byte that did not
+  // go out, once it completes.
+  std::size_t bytes;
+  s->msg.msg_iov = s->iov;
+  s->msg.msg_iovlen = s->conn.gather_output(s->iov, kMaxIovecs, &bytes);
+  if (s->msg.msg_iovlen == 0) return;
+  io_uring_sqe* sqe = ring_.get_sqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = s->fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&s->msg);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = s->tag(kOpSend);
+  ++s->sends_inflight;
+}
+
+void UringShard::on_completion(const io_uring_cqe& cqe) {
+  uint64_t op = cqe.user_data & kOpMask;
+  Session* s = reinterpret_cast<Session*>(cqe.user_data & ~kOpMask);
+  switch (op) {
+    case kOpAccept:
+      if (cqe.res >= 0 && stopping_.load(std::memory_order_relaxed)) {
+        ::close(cqe.res);
+      } else if (cqe.res >= 0) {
+        http2::net::set_nodelay(cqe.res);
+        auto session = std::make_unique<Session>(this, cqe.res);
+        s = session.get();
+        sessions_[s] = std::move(session);
+        if (draining_) s->conn.shutdown();  // accepted before the cancel
+        arm_recv(s);
+        mark_dirty(s);  // the server preface is already queued
+      }
+      if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+        accept_armed_ = false;
+        if (!stopping_.load(std::memory_order_relaxed) && !draining_) {
+          arm_accept();
+        }
+      }
+      break;
+    case kOpWakeup:
+      wakeup_armed_ = false;
+      if (!stopping_.load(std::memory_order_relaxed)) arm_wakeup();
+      break;
+    case kOpMailbox:
+      mailbox_armed_ = false;
+      drain_mailbox();
+      if (!stopping_.load(std::memory_order_relaxed)) arm_mailbox();
+      break;
+    case kOpRecv:
+      on_recv(s, cqe);
+      break;
+    case kOpSend:
+      on_send(s, cqe);
+      break;
+    case kOpPollOut:
+      s->pollout_armed = false;
+      mark_dirty(s);
+      break;
+  }
+}
+
+void UringShard::on_recv(Session* s, const io_uring_cqe& cqe) {
+  if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+    s->recv_armed = false;
+    s->recv_cancelling = false;
+  }
+  if (cqe.res > 0) {
+    uint16_t id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+    if (!s->closing && !s->lingering) {
+      s->receive(buffers_.buffer(id), cqe.res);
+    }
+    buffers_.recycle(id);
+    mark_dirty(s);
+  } else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+    // EOF or a socket error.  (ENOBUFS only means the buffer pool ran dry:
+    // the buffers recycled in this batch will let the receive resume.)
+    begin_close(s);
+  }
+  if (!s->recv_armed && !s->closing && !s->conn.paused()) arm_recv(s);
+  maybe_release(s);
+}
+
+void UringShard::on_send(Session* s, const io_uring_cqe& cqe) {
+  --s->sends_inflight;
+  if (cqe.res > 0) {
+    s->conn.consume_output(cqe.res);
+  } else if (cqe.res != -ECANCELED) {
+    begin_close(s);
+  }
+  if (s->sends_inflight == 0) mark_dirty(s);
+  maybe_release(s);
+}
+
+void UringShard::mark_dirty(Session* s) {
+  if (s->dirty) return;
+  s->dirty = true;
+  dirty_.push_back(s);
+}
+
+void UringShard::flush_dirty() {
+  // Sessions are only released from here, never while they are in dirty_.
+  for (std::size_t i = 0; i < dirty_.size(); ++i) {
+    Session* s = dirty_[i];
+    s->dirty = false;
+    if (!s->closing) {
+      // A paused connection stops reading until its output drains.
+      if (s->conn.paused()) {
+        if (s->recv_armed && !s->recv_cancelling) cancel_recv(s);
+      } else if (!s->recv_armed) {
+        arm_recv(s);
+      }
+      start_send(s);
+      if (s->conn.done() && s->sends_inflight == 0 &&
+          !s->conn.has_output()) {
+        if (draining_) {
+          linger(s);
+        } else {
+          begin_close(s);
+        }
+      }
+    }
+    maybe_release(s);
+  }
+  dirty_.clear();
+}
+
+void UringShard::shed_load() {
+  // Send away the most expensive connections until the rest fit.  They
+  // close once the GOAWAY is out.
+  std::vector<Session*> victims;
+  for (auto& item : sessions_) {
+    Session* s = item.first;
+    if (!s->closing && !s->conn.done()) victims.push_back(s);
+  }
+  std::sort(victims.begin(), victims.end(), [](Session* a, Session* b) {
+    return a->conn.memory_usage() > b->conn.memory_usage();
+  });
+  std::size_t used = budget_.used();
+  for (Session* s : victims) {
+    if (used <= budget_.limit()) break;
+    used -= std::min(used, s->conn.memory_usage());
+    s->conn.enhance_your_calm();
+    mark_dirty(s);
+  }
+}
+
+void UringShard::begin_drain() {
+  if (draining_) return;
+  draining_ = true;
+  // Connections already queued on the listener are left to whoever else has
+  // it open.
+  io_uring_sqe* sqe = ring_.get_sqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = kOpAccept;
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = 0;
+  ::close(listen_fd_);
+  listen_fd_ = -1;
+  timers_.arm(drain_timer_.get(),
+              uint64_t(options_.drain_timeout_ms) + kDrainLingerMs);
+  for (auto& item : sessions_) {
+    item.first->conn.shutdown();
+    mark_dirty(item.first);
+  }
+}
+
+void UringShard::close_all() {
+  for (auto& item : sessions_) begin_close(item.first);
+}
+
+void UringShard::linger(Session* s) {
+  // Closing with unread input would reset the connection, and the peer might
+  // lose the GOAWAY.  Half-close instead; the receive, which now discards
+  // its input, sees the peer's end of file.
+  if (s->lingering) return;
+  s->lingering = true;
+  ::shutdown(s->fd, SHUT_WR);
+}
+
+void UringShard::begin_close(Session* s) {
+  if (s->closing) return;
+  s->closing = true;
+  // Shutting the socket down completes the multishot receive and any sends
+  // still in flight; the Session is freed once they have all reported back.
+  ::shutdown(s->fd, SHUT_RDWR);
+}
+
+void UringShard::maybe_release(Session* s) {
+  if (!s->closing || s->dirty || s->recv_armed || s->sends_inflight > 0 ||
+      s->pollout_armed) {
+    return;
+  }
+  sessions_.erase(s);
+}
+
+void UringShard::cancel_all() {
+  // Operations still in flight point into the Sessions, their connections'
+  // output queues, the buffer pool and this shard, and closing the ring does
+  // not wait for the kernel to let go of them.  Cancel every one, and reap
+  // the completions, before any of that memory is freed.
+  stopping_.store(true, std::memory_order_relaxed);
+  for (auto& item : sessions_) begin_close(item.first);
+  io_uring_sqe* sqe = ring_.get_sqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_ANY;
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = 0;
+  while (in_flight()) {
+    ring_.submit(1);
+    ring_.drain([this](const io_uring_cqe& cqe) { on_completion(cqe); });
+  }
+}
+
+bool UringShard::in_flight() const {
+  if (accept_armed_ || wakeup_armed_ || mailbox_armed_) return true;
+  for (const auto& item : sessions_) {
+    const Session* s = item.first;
+    if (s->recv_armed || s->sends_inflight > 0 || s->pollout_armed) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace server
+}  // namespace http2
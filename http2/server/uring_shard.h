@@ -0,0 +1,124 @@
+// A server shard built on io_uring.
+
+#ifndef HTTP2_SERVER_URING_SHARD_H
+#define HTTP2_SERVER_URING_SHARD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "http2/net/mailbox.h"
+#include "http2/net/timer_wheel.h"
+#include "http2/net/uring.h"
+#include "http2/server/connection.h"
+#include "http2/server/handler.h"
+#include "http2/server/memory.h"
+#include "http2/server/shard.h"
+
+namespace http2 {
+namespace server {
+
+// UringOptions sizes the io_uring resources of each UringShard.
+struct UringOptions final {
+  // queue_depth is the number of submission queue entries.
+  unsigned int queue_depth = 4096;
+
+  // num_buffers is the number of provided receive buffers, at most 65536.
+  unsigned int num_buffers = 1024;
+
+  // buffer_size is the size of each provided receive buffer.
+  std::size_t buffer_size = 16384;
+};
+
+// UringShard serves its connections from one io_uring instance.  One
+// multishot accept covers the listening socket and one multishot receive
+// covers each connection, so reads are never re-armed in the steady state.
+// Receives draw from a shared pool of provided buffers; frames are parsed
+// straight out of the kernel-selected buffer, which goes back to the pool as
+// soon as the Connection has consumed it.  Output is written with one
+// sendmsg per connection, gathered straight from its output queue, so one
+// io_uring_enter can flush many connections; file bodies are written with
+// sendfile(2) in between.  The receive of a
+// connection over its memory limit is cancelled until the connection drains.
+// The results of offloaded handler work come back through the shard's
+// Mailbox, whose eventfd is read through the ring; waits on the ring are cut
+// short for the deadlines on the shard's TimerWheel.  A drained shard cancels
+// its accept and closes its listener, but leaves the socket itself open,
+// since a new process may have taken it over.
+//
+// Requires Linux 6.0 or newer.
+class UringShard final : public Shard {
+ public:
+  // Takes ownership of listen_fd.  Both options and handler must outlive the
+  // UringShard.  memory_limit bounds the memory held by all connections
+  // together (0 for no limit).
+  //
+  // THROWS std::system_error if io_uring is unavailable.
+  UringShard(int listen_fd, const ConnectionOptions& options,
+             const Handler& handler, const UringOptions& uring,
+             std::size_t memory_limit);
+  ~UringShard() override;
+
+  void run() override;
+  void stop() override;
+  void drain() override;
+
+ private:
+  class Session;
+  class DrainTimer;
+
+  void arm_accept();
+  void arm_wakeup();
+  void arm_mailbox();
+  void drain_mailbox();
+  void arm_recv(Session* s);
+  void arm_pollout(Session* s);
+  void cancel_recv(Session* s);
+  bool send_files(Session* s);
+  void start_send(Session* s);
+  void on_completion(const io_uring_cqe& cqe);
+  void on_recv(Session* s, const io_uring_cqe& cqe);
+  void on_send(Session* s, const io_uring_cqe& cqe);
+  void mark_dirty(Session* s);
+  void flush_dirty();
+  void shed_load();
+  void begin_drain();
+  void close_all();
+  void linger(Session* s);
+  void begin_close(Session* s);
+  void maybe_release(Session* s);
+  void cancel_all();
+  bool in_flight() const;
+
+  // The ring is closed by ~UringShard, before the buffers and the Sessions
+  // its operations point into are freed.
+  http2::net::Uring ring_;
+  http2::net::BufferPool buffers_;
+  int listen_fd_;
+  int wake_fd_;
+  uint64_t wake_value_;
+  http2::net::Mailbox mailbox_;
+  uint64_t mailbox_value_;
+  std::atomic<bool> stopping_;
+  std::atomic<bool> drain_requested_;
+  bool draining_;
+  bool accept_armed_;
+  bool wakeup_armed_;
+  bool mailbox_armed_;
+  const ConnectionOptions& options_;
+  const Handler& handler_;
+  MemoryBudget budget_;
+  http2::net::TimerWheel timers_;
+  std::unique_ptr<DrainTimer> drain_timer_;
+  std::unordered_map<Session*, std::unique_ptr<Session>> sessions_;
+  std::vector<Session*> dirty_;
+};
+
+}  // namespace server
+}  // namespace http2
+
+#endif  // HTTP2_SERVER_URING_SHARD_H
@@ -0,0 +1,43 @@
+#include "http2/stats/histogram.h"
+
+#include <cmath>
+
+namespace http2 {
+namespace stats {
+
+uint64_t Histogram::bucket_min(std::size_t i) {
+  if (i < kSubBuckets) return i;
+  int shift = int(i >> kSubBucketBits) - 1;
+  return uint64_t((i & (kSubBuckets - 1)) + kSubBuckets) << shift;
+}
+
+uint64_t Histogram::bucket_max(std::size_t i) {
+  if (i < kSubBuckets) return i;
+  int shift = int(i >> kSubBucketBits) - 1;
+  return bucket_min(i) + ((uint64_t(1) << shift) - 1);
+}
+
+Histogram::Histogram() : counts_(kBuckets, 0), count_(0) {}
+
+void Histogram::record(uint64_t value, uint64_t n) { add(bucket(value), n); }
+
+void Histogram::merge(const Histogram& other) {
+  for (std::size_t i = 0; i < kBuckets; ++i) counts_[i] += other.counts_[i];
+  count_ += other.count_;
+}
+
+uint64_t Histogram::percentile(double p) const {
+  if (count_ == 0) return 0;
+  uint64_t target = uint64_t(std::ceil(p / 100 * double(count_)));
+  if (target == 0) target = 1;
+  if (target > count_) target = count_;
+  uint64_t seen = 0;
+  for (std::size_t i = 0; i < kBuckets; ++i) {
+    seen += counts_[i];
+    if (seen >= target) return bucket_max(i);
+  }
+  return bucket_max(kBuckets - 1);
+}
+
+}  // namespace stats
+}  // namespace http2
@@ -0,0 +1,74 @@
+// A histogram of latencies with bounded relative error.
+
+#ifndef HTTP2_STATS_HISTOGRAM_H
+#define HTTP2_STATS_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+namespace http2 {
+namespace stats {
+
+// Histogram counts values in log-linear buckets, after HdrHistogram: each
+// power of two is split into 32 equal sub-buckets, so any value is known to
+// within about 3%, from 1 up to 2^64, in a fixed 1920 buckets.  Recording
+// is a count-leading-zeros and an increment, and histograms add up bucket
+// by bucket, which is how per-thread histograms are aggregated.
+class Histogram final {
+ public:
+  static constexpr int kSubBucketBits = 5;
+  static constexpr std::size_t kSubBuckets = std::size_t(1) << kSubBucketBits;
+  static constexpr std::size_t kBuckets = (64 - kSubBucketBits + 1)
+                                          << kSubBucketBits;
+
+  // bucket returns the index of the bucket that holds value.
+  static std::size_t bucket(uint64_t value) {
+    if (value < kSubBuckets) return value;
+    int magnitude = 63 - __builtin_clzll(value);
+    int shift = magnitude - kSubBucketBits;
+    return (std::size_t(shift + 1) << kSubBucketBits) +
+           std::size_t(value >> shift) - kSubBuckets;
+  }
+
+  // bucket_min and bucket_max return the smallest and largest values that
+  // fall into bucket i.
+  static uint64_t bucket_min(std::size_t i);
+  static uint64_t bucket_max(std::size_t i);
+
+  Histogram();
+
+  // record counts n occurrences of value.
+  void record(uint64_t value, uint64_t n = 1);
+
+  // add counts n occurrences of values in bucket i.
+  void add(std::size_t i, uint64_t n) {
+    counts_[i] += n;
+    count_ += n;
+  }
+
+  // merge adds the counts of other into this histogram.
+  void merge(const Histogram& other);
+
+  uint64_t count() const { return count_; }
+  uint64_t count(std::size_t i) const { return counts_[i]; }
+
+  // percentile returns a value that at least p percent (0 to 100) of the
+  // recorded values are no greater than, or 0 if the histogram is empty.
+  // It is the upper bound of the bucket that the percentile falls into, so
+  // it overstates the true value by at most one bucket width.
+  uint64_t percentile(double p) const;
+
+  // max returns the upper bound of the highest bucket in use, or 0.
+  uint64_t max() const { return percentile(100); }
+
+ private:
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+};
+
+}  // namespace stats
+}  // namespace http2
+
+#endif  // HTTP2_STATS_HISTOGRAM_H
@@ -0,0 +1,62 @@
+#include "http2/stats/histogram.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+using http2::stats::Histogram;
+
+TEST(Histogram, Buckets) {
+  // Small values are exact.
+  for (uint64_t v = 0; v < Histogram::kSubBuckets; ++v) {
+    EXPECT_EQ(Histogram::bucket(v), v);
+    EXPECT_EQ(Histogram::bucket_min(v), v);
+    EXPECT_EQ(Histogram::bucket_max(v), v);
+  }
+  // Larger ones land in a bucket that covers them, and is narrow.
+  for (uint64_t v : {uint64_t(32), uint64_t(33), uint64_t(1000),
+                     uint64_t(123456789), ~uint64_t(0)}) {
+    std::size_t i = Histogram::bucket(v);
+    ASSERT_LT(i, Histogram::kBuckets);
+    EXPECT_LE(Histogram::bucket_min(i), v);
+    EXPECT_GE(Histogram::bucket_max(i), v);
+    EXPECT_LE(Histogram::bucket_max(i) - Histogram::bucket_min(i),
+              v / Histogram::kSubBuckets);
+  }
+  EXPECT_EQ(Histogram::bucket(~uint64_t(0)), Histogram::kBuckets - 1);
+
+  // The buckets tile the number line.
+  for (std::size_t i = 1; i < Histogram::kBuckets; ++i) {
+    ASSERT_EQ(Histogram::bucket_min(i), Histogram::bucket_max(i - 1) + 1);
+  }
+}
+
+TEST(Histogram, Percentiles) {
+  Histogram h;
+  EXPECT_EQ(h.percentile(50), 0);
+  for (uint64_t v = 1; v <= 1000; ++v) h.record(v * 1000);
+  EXPECT_EQ(h.count(), 1000);
+
+  // Within one bucket (about 3%) of the true value, and never below it.
+  uint64_t p50 = h.percentile(50);
+  EXPECT_GE(p50, 500000);
+  EXPECT_LE(p50, 500000 * 1.04);
+  uint64_t p99 = h.percentile(99);
+  EXPECT_GE(p99, 990000);
+  EXPECT_LE(p99, 990000 * 1.04);
+  EXPECT_GE(h.max(), 1000000);
+  EXPECT_LE(h.max(), 1000000 * 1.04);
+}
+
+TEST(Histogram, Merge) {
+  Histogram a;
+  Histogram b;
+  a.record(10, 3);
+  b.record(10);
+  b.record(5000);
+  a.merge(b);
+  EXPECT_EQ(a.count(), 5);
+  EXPECT_EQ(a.count(Histogram::bucket(10)), 4);
+  EXPECT_EQ(a.percentile(80), 10);
+  EXPECT_GE(a.max(), 5000);
+}
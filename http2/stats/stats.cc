@@ -0,0 +1,175 @@
+#include "http2/stats/stats.h"
+
+#include <sstream>
+
+namespace http2 {
+namespace stats {
+namespace internal {
+
+constinit thread_local ThreadStats* current = nullptr;
+
+// Every ThreadStats ever allocated, newest first.  Blocks are only ever
+// pushed, so readers may walk the list without a lock.
+static std::atomic<ThreadStats*> all_stats{nullptr};
+
+namespace {
+
+// Releaser gives up its thread's ThreadStats when the thread exits.
+struct Releaser final {
+  ~Releaser() {
+    if (current == nullptr) return;
+    current->owned.store(false, std::memory_order_release);
+    current = nullptr;
+  }
+};
+
+}  // anonymous namespace
+
+ThreadStats* attach() {
+  static thread_local Releaser releaser;
+  (void)releaser;
+
+  ThreadStats* stats = all_stats.load(std::memory_order_acquire);
+  for (; stats != nullptr; stats = stats->next) {
+    bool owned = false;
+    if (stats->owned.compare_exchange_strong(owned, true,
+                                             std::memory_order_acquire)) {
+      break;
+    }
+  }
+  if (stats == nullptr) {
+    stats = new ThreadStats();
+    stats->owned.store(true, std::memory_order_relaxed);
+    stats->next = all_stats.load(std::memory_order_relaxed);
+    while (!all_stats.compare_exchange_weak(stats->next, stats,
+                                            std::memory_order_release)) {
+    }
+  }
+  current = stats;
+  return stats;
+}
+
+}  // namespace internal
+
+namespace {
+
+template <std::size_t N>
+void add(uint64_t (&out)[N], const std::atomic<uint64_t> (&in)[N]) {
+  for (std::size_t i = 0; i < N; ++i) {
+    out[i] += in[i].load(std::memory_order_relaxed);
+  }
+}
+
+void add(Histogram& out,
+         const std::atomic<uint64_t> (&in)[Histogram::kBuckets]) {
+  for (std::size_t i = 0; i < Histogram::kBuckets; ++i) {
+    uint64_t n = in[i].load(std::memory_order_relaxed);
+    if (n != 0) out.add(i, n);
+  }
+}
+
+const char* const kDirectionNames[2] = {"received", "sent"};
+
+const char* const kFrameNames[kFrameTypes] = {
+    "DATA",          "HEADERS",      "PRIORITY", "RST_STREAM",
+    "SETTINGS",      "PUSH_PROMISE", "PING",     "GOAWAY",
+    "WINDOW_UPDATE", "CONTINUATION", "0xa",      "0xb",
+    "0xc",           "0xd",          "0xe",      "0xf",
+    "PRIORITY_UPDATE", "other",
+};
+
+const char* const kErrorNames[kErrorCodes] = {
+    "NO_ERROR",           "PROTOCOL_ERROR",
+    "INTERNAL_ERROR",     "FLOW_CONTROL_ERROR",
+    "SETTINGS_TIMEOUT",   "STREAM_CLOSED",
+    "FRAME_SIZE_ERROR",   "REFUSED_STREAM",
+    "CANCEL",             "COMPRESSION_ERROR",
+    "CONNECT_ERROR",      "ENHANCE_YOUR_CALM",
+    "INADEQUATE_SECURITY", "HTTP_1_1_REQUIRED",
+    "other",
+};
+
+void write_by_error(std::ostringstream& out, const char* name,
+                    const uint64_t (&counts)[2][kErrorCodes]) {
+  for (int dir = 0; dir < 2; ++dir) {
+    for (std::size_t i = 0; i < kErrorCodes; ++i) {
+      if (counts[dir][i] == 0) continue;
+      out << name << "{direction=\"" << kDirectionNames[dir] << "\",error=\""
+          << kErrorNames[i] << "\"} " << counts[dir][i] << "\n";
+    }
+  }
+}
+
+void write_histogram(std::ostringstream& out, const char* name,
+                     const Histogram& h) {
+  for (double q : {50.0, 90.0, 99.0, 99.9, 100.0}) {
+    out << name << "{quantile=\"" << q / 100 << "\"} " << h.percentile(q)
+        << "\n";
+  }
+  out << name << "_count " << h.count() << "\n";
+}
+
+}  // anonymous namespace
+
+Snapshot snapshot() {
+  Snapshot snap;
+  internal::ThreadStats* stats =
+      internal::all_stats.load(std::memory_order_acquire);
+  for (; stats != nullptr; stats = stats->next) {
+    for (int dir = 0; dir < 2; ++dir) {
+      add(snap.frames[dir], stats->frames[dir]);
+      add(snap.streams_reset[dir], stats->streams_reset[dir]);
+      add(snap.goaways[dir], stats->goaways[dir]);
+      add(snap.hpack[dir].counts, stats->hpack[dir]);
+    }
+    add(snap.bytes, stats->bytes);
+    snap.streams_opened +=
+        stats->streams_opened.load(std::memory_order_relaxed);
+    snap.flow_control_stalls +=
+        stats->flow_control_stalls.load(std::memory_order_relaxed);
+    add(snap.time_to_headers, stats->time_to_headers);
+    add(snap.time_to_first_byte, stats->time_to_first_byte);
+  }
+  return snap;
+}
+
+std::string to_text(const Snapshot& snap) {
+  std::ostringstream out;
+  for (int dir = 0; dir < 2; ++dir) {
+    for (std::size_t i = 0; i < kFrameTypes; ++i) {
+      if (snap.frames[dir][i] == 0) continue;
+      out << "http2_frames_total{direction=\"" << kDirectionNames[dir]
+          << "\",type=\"" << kFrameNames[i] << "\"} " << snap.frames[dir][i]
+          << "\n";
+    }
+    if (snap.bytes[dir] != 0) {
+      out << "http2_bytes_total{direction=\"" << kDirectionNames[dir]
+          << "\"} " << snap.bytes[dir] << "\n";
+    }
+  }
+  if (snap.streams_opened != 0) {
+    out << "http2_streams_opened_total " << snap.streams_opened << "\n";
+  }
+  write_by_error(out, "http2_streams_reset_total", snap.streams_reset);
+  write_by_error(out, "http2_goaways_total", snap.goaways);
+  if (snap.flow_control_stalls != 0) {
+    out << "http2_flow_control_stalls_total " << snap.flow_control_stalls
+        << "\n";
+  }
+  for (int dir = 0; dir < 2; ++dir) {
+    for (int i = 0; i < http2::protocol::hpack::NUM_COUNTERS; ++i) {
+      if (snap.hpack[dir].counts[i] == 0) continue;
+      out << "http2_hpack_"
+          << http2::protocol::hpack::counter_name(
+                 http2::protocol::hpack::Counter(i))
+          << "_total{direction=\"" << kDirectionNames[dir] << "\"} "
+          << snap.hpack[dir].counts[i] << "\n";
+    }
+  }
+  write_histogram(out, "http2_time_to_headers_ns", snap.time_to_headers);
+  write_histogram(out, "http2_time_to_first_byte_ns", snap.time_to_first_byte);
+  return out.str();
+}
+
+}  // namespace stats
+}  // namespace http2
@@ -0,0 +1,168 @@
+// Process-wide protocol counters and latency histograms.
+
+#ifndef HTTP2_STATS_STATS_H
+#define HTTP2_STATS_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/stats/histogram.h"
+
+namespace http2 {
+namespace stats {
+
+enum Direction {
+  RECEIVED = 0,
+  SENT = 1,
+};
+
+// Frame types 0x0 through 0x10 (PRIORITY_UPDATE) are counted separately;
+// all others share the last slot.
+constexpr std::size_t kFrameTypes = 0x12;
+
+// Error codes 0x0 through 0xd (HTTP_1_1_REQUIRED) are counted separately;
+// all others share the last slot.
+constexpr std::size_t kErrorCodes = 0xf;
+
+inline std::size_t frame_slot(uint8_t type) {
+  return type < kFrameTypes - 1 ? type : kFrameTypes - 1;
+}
+
+inline std::size_t error_slot(uint32_t error) {
+  return error < kErrorCodes - 1 ? error : kErrorCodes - 1;
+}
+
+// Snapshot is the sum of the statistics of every thread, as of some moment
+// while snapshot() ran.  Counters only ever grow, so rates come from the
+// differences between snapshots.  Latencies are in nanoseconds.
+struct Snapshot final {
+  uint64_t frames[2][kFrameTypes] = {};  // [Direction][frame_slot]
+  uint64_t bytes[2] = {};                // whole frames, by Direction
+  uint64_t streams_opened = 0;
+  uint64_t streams_reset[2][kErrorCodes] = {};  // [Direction][error_slot]
+  uint64_t goaways[2][kErrorCodes] = {};        // [Direction][error_slot]
+
+  // flow_control_stalls counts the times a response had data to send but
+  // no send window to send it in.
+  uint64_t flow_control_stalls = 0;
+
+  // hpack sums the compression counters of every connection's HPACK
+  // Decoder (RECEIVED) and Encoder (SENT).
+  http2::protocol::hpack::Stats hpack[2];
+
+  // time_to_headers runs from the arrival of a request's HEADERS frame to
+  // the queueing of the response headers; time_to_first_byte, to the
+  // queueing of the first DATA frame of the response body.
+  Histogram time_to_headers;
+  Histogram time_to_first_byte;
+};
+
+// snapshot adds up the statistics of every thread.  It takes no lock, and
+// never stalls the threads that are recording: each counter is read on its
+// own, so a snapshot taken mid-request may count a frame but not its bytes.
+Snapshot snapshot();
+
+// to_text formats a snapshot in the Prometheus text exposition format.
+// Zero counters are left out.
+std::string to_text(const Snapshot& snapshot);
+
+namespace internal {
+
+// ThreadStats holds the statistics recorded by one thread.  Only its owner
+// writes to it, so increments need no atomic read-modify-write; the fields
+// are atomic only so that snapshot() may read them from another thread.
+struct ThreadStats final {
+  std::atomic<uint64_t> frames[2][kFrameTypes];
+  std::atomic<uint64_t> bytes[2];
+  std::atomic<uint64_t> streams_opened;
+  std::atomic<uint64_t> streams_reset[2][kErrorCodes];
+  std::atomic<uint64_t> goaways[2][kErrorCodes];
+  std::atomic<uint64_t> flow_control_stalls;
+  std::atomic<uint64_t> hpack[2][http2::protocol::hpack::NUM_COUNTERS];
+  std::atomic<uint64_t> time_to_headers[Histogram::kBuckets];
+  std::atomic<uint64_t> time_to_first_byte[Histogram::kBuckets];
+
+  // Set while a live thread owns this block.  Blocks are never freed: the
+  // block of a thread that exits goes to the next thread that needs one,
+  // counts and all.
+  std::atomic<bool> owned;
+  ThreadStats* next;
+};
+
+extern constinit thread_local ThreadStats* current;
+
+// attach gives the calling thread a ThreadStats.
+ThreadStats* attach();
+
+inline ThreadStats& local() {
+  ThreadStats* stats = current;
+  return stats != nullptr ? *stats : *attach();
+}
+
+inline void bump(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+}
+
+}  // namespace internal
+
+// The recording functions below cost a thread-local load and one or two
+// relaxed increments, and are safe to call from any thread.
+
+inline void count_frame(Direction dir, uint8_t type, std::size_t bytes) {
+  internal::ThreadStats& stats = internal::local();
+  internal::bump(stats.frames[dir][frame_slot(type)]);
+  internal::bump(stats.bytes[dir], bytes);
+}
+
+inline void count_stream_opened() {
+  internal::bump(internal::local().streams_opened);
+}
+
+inline void count_stream_reset(Direction dir, uint32_t error) {
+  internal::bump(internal::local().streams_reset[dir][error_slot(error)]);
+}
+
+inline void count_goaway(Direction dir, uint32_t error) {
+  internal::bump(internal::local().goaways[dir][error_slot(error)]);
+}
+
+inline void count_flow_control_stall() {
+  internal::bump(internal::local().flow_control_stalls);
+}
+
+// count_hpack adds delta, the growth of a connection's HPACK Decoder
+// (RECEIVED) or Encoder (SENT) counters since it last reported them.
+inline void count_hpack(Direction dir,
+                        const http2::protocol::hpack::Stats& delta) {
+  internal::ThreadStats& stats = internal::local();
+  for (int i = 0; i < http2::protocol::hpack::NUM_COUNTERS; ++i) {
+    uint64_t n = delta.counts[i];
+    if (n != 0) internal::bump(stats.hpack[dir][i], n);
+  }
+}
+
+inline void record_time_to_headers(uint64_t ns) {
+  internal::bump(internal::local().time_to_headers[Histogram::bucket(ns)]);
+}
+
+inline void record_time_to_first_byte(uint64_t ns) {
+  internal::bump(internal::local().time_to_first_byte[Histogram::bucket(ns)]);
+}
+
+// now_ns reads the clock that latencies are measured with.
+inline uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace stats
+}  // namespace http2
+
+#endif  // HTTP2_STATS_STATS_H
@@ -0,0 +1,85 @@
+#include "http2/stats/stats.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace stats = http2::stats;
+
+TEST(Stats, Counters) {
+  stats::Snapshot before = stats::snapshot();
+  stats::count_frame(stats::RECEIVED, 0x1, 50);
+  stats::count_frame(stats::SENT, 0x0, 1009);
+  stats::count_frame(stats::SENT, 0xfe, 9);
+  stats::count_stream_opened();
+  stats::count_stream_reset(stats::SENT, 0x8);
+  stats::count_goaway(stats::RECEIVED, 0x1234);
+  stats::count_flow_control_stall();
+  stats::record_time_to_headers(1500);
+  stats::record_time_to_first_byte(2500);
+  stats::Snapshot after = stats::snapshot();
+
+  EXPECT_EQ(after.frames[stats::RECEIVED][1] - before.frames[stats::RECEIVED][1],
+            1);
+  EXPECT_EQ(after.frames[stats::SENT][0] - before.frames[stats::SENT][0], 1);
+  EXPECT_EQ(after.frames[stats::SENT][stats::kFrameTypes - 1] -
+                before.frames[stats::SENT][stats::kFrameTypes - 1],
+            1);
+  EXPECT_EQ(after.bytes[stats::SENT] - before.bytes[stats::SENT], 1018);
+  EXPECT_EQ(after.streams_opened - before.streams_opened, 1);
+  EXPECT_EQ(after.streams_reset[stats::SENT][8] -
+                before.streams_reset[stats::SENT][8],
+            1);
+  EXPECT_EQ(after.goaways[stats::RECEIVED][stats::kErrorCodes - 1] -
+                before.goaways[stats::RECEIVED][stats::kErrorCodes - 1],
+            1);
+  EXPECT_EQ(after.flow_control_stalls - before.flow_control_stalls, 1);
+  EXPECT_EQ(after.time_to_headers.count() - before.time_to_headers.count(), 1);
+  EXPECT_EQ(after.time_to_first_byte.count() -
+                before.time_to_first_byte.count(),
+            1);
+}
+
+TEST(Stats, Threads) {
+  stats::Snapshot before = stats::snapshot();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([] {
+      for (int i = 0; i < 10000; ++i) {
+        stats::count_frame(stats::RECEIVED, 0x6, 17);
+        stats::record_time_to_headers(i);
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  stats::Snapshot after = stats::snapshot();
+  EXPECT_EQ(after.frames[stats::RECEIVED][6] - before.frames[stats::RECEIVED][6],
+            40000);
+  EXPECT_EQ(after.bytes[stats::RECEIVED] - before.bytes[stats::RECEIVED],
+            40000 * 17);
+  EXPECT_EQ(after.time_to_headers.count() - before.time_to_headers.count(),
+            40000);
+
+  // The blocks of exited threads are reused, and their counts kept.
+  threads.clear();
+  threads.emplace_back([] { stats::count_frame(stats::RECEIVED, 0x6, 17); });
+  threads.back().join();
+  EXPECT_EQ(stats::snapshot().frames[stats::RECEIVED][6] -
+                before.frames[stats::RECEIVED][6],
+            40001);
+}
+
+TEST(Stats, Text) {
+  stats::count_frame(stats::SENT, 0x7, 17);
+  stats::count_goaway(stats::SENT, 0xb);
+  std::string text = stats::to_text(stats::snapshot());
+  EXPECT_NE(text.find("http2_frames_total{direction=\"sent\",type=\"GOAWAY\"} "),
+            std::string::npos);
+  EXPECT_NE(text.find("http2_goaways_total{direction=\"sent\","
+                      "error=\"ENHANCE_YOUR_CALM\"} "),
+            std::string::npos);
+  EXPECT_NE(text.find("http2_time_to_headers_ns{quantile=\"0.99\"} "),
+            std::string::npos);
+}
@@ -0,0 +1,74 @@
+#include "http2/testing/alloc_counter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace http2 {
+namespace testing {
+namespace {
+
+constinit thread_local uint64_t count = 0;
+
+void* allocate(std::size_t n) {
+  ++count;
+  void* ptr = std::malloc(n != 0 ? n : 1);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void* allocate(std::size_t n, std::align_val_t align) {
+  ++count;
+  std::size_t a = std::max(std::size_t(align), sizeof(void*));
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, a, n != 0 ? n : 1) != 0) throw std::bad_alloc();
+  return ptr;
+}
+
+}  // anonymous namespace
+
+uint64_t allocations() { return count; }
+
+}  // namespace testing
+}  // namespace http2
+
+using http2::testing::allocate;
+
+void* operator new(std::size_t n) { return allocate(n); }
+void* operator new[](std::size_t n) { return allocate(n); }
+void* operator new(std::size_t n, std::align_val_t a) { return allocate(n, a); }
+void* operator new[](std::size_t n, std::align_val_t a) {
+  return allocate(n, a);
+}
+
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept {
+  try {
+    return allocate(n);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept {
+  try {
+    return allocate(n);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
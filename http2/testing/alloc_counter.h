@@ -0,0 +1,32 @@
+// Counts heap allocations, for tests that lock in allocation-free paths.
+
+#ifndef HTTP2_TESTING_ALLOC_COUNTER_H
+#define HTTP2_TESTING_ALLOC_COUNTER_H
+
+#include <cstdint>
+
+namespace http2 {
+namespace testing {
+
+// allocations returns the number of times the calling thread has called
+// operator new, in any of its forms.  Linking in this library replaces the
+// global operator new and operator delete with counting versions, so it
+// must only be linked into tests.
+uint64_t allocations();
+
+// AllocationCounter counts the allocations the calling thread makes between
+// its construction and each call to count().
+class AllocationCounter final {
+ public:
+  AllocationCounter() : start_(allocations()) {}
+
+  uint64_t count() const { return allocations() - start_; }
+
+ private:
+  uint64_t start_;
+};
+
+}  // namespace testing
+}  // namespace http2
+
+#endif  // HTTP2_TESTING_ALLOC_COUNTER_H
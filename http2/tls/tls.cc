@@ -0,0 +1,138 @@
+#include "http2/tls/tls.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+
+#include "http2/protocol/constants.h"
+
+namespace proto = http2::protocol;
+
+namespace http2 {
+namespace tls {
+
+namespace {
+
+[[noreturn]] void throw_openssl(const std::string& what) {
+  unsigned long code = ERR_get_error();
+  char buf[256];
+  ERR_error_string_n(code, buf, sizeof(buf));
+  ERR_clear_error();
+  throw std::system_error(EINVAL, std::generic_category(), what + ": " + buf);
+}
+
+// select_h2 is the ALPN callback: it accepts "h2" and nothing else.
+int select_h2(SSL*, const unsigned char** out, unsigned char* outlen,
+              const unsigned char* in, unsigned int inlen, void*) {
+  static const unsigned char kH2[] = {2, proto::kEncryptedToken[0],
+                                      proto::kEncryptedToken[1]};
+  unsigned char* selected;
+  int rc = SSL_select_next_proto(&selected, outlen, kH2, sizeof(kH2), in,
+                                 inlen);
+  if (rc != OPENSSL_NPN_NEGOTIATED) return SSL_TLSEXT_ERR_ALERT_FATAL;
+  *out = selected;
+  return SSL_TLSEXT_ERR_OK;
+}
+
+}  // anonymous namespace
+
+bool ktls_supported() {
+  // An unconnected socket can't take the ULP, but the error tells whether
+  // the kernel knows of it: ENOTCONN if so, ENOENT if not.
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return false;
+  int rc = ::setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls"));
+  int err = errno;
+  ::close(fd);
+  return rc == 0 || err == ENOTCONN;
+}
+
+TlsContext::TlsContext(const TlsOptions& options)
+    : ctx_(SSL_CTX_new(TLS_server_method())) {
+  if (ctx_ == nullptr) throw_openssl("SSL_CTX_new");
+  SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+  SSL_CTX_set_max_proto_version(
+      ctx_, options.allow_tls13 ? TLS1_3_VERSION : TLS1_2_VERSION);
+  // The kernel can take over AES-GCM, but has no way to renegotiate or to
+  // issue tickets once it has the keys.
+  SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION |
+                                SSL_OP_NO_TICKET |
+                                SSL_OP_CIPHER_SERVER_PREFERENCE);
+  SSL_CTX_set_num_tickets(ctx_, 0);
+  if (SSL_CTX_set_cipher_list(ctx_, "ECDHE+AESGCM") != 1 ||
+      SSL_CTX_set_ciphersuites(
+          ctx_, "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384") != 1) {
+    SSL_CTX_free(ctx_);
+    throw_openssl("cipher list");
+  }
+  if (SSL_CTX_use_certificate_chain_file(ctx_, options.cert_file.c_str()) !=
+          1 ||
+      SSL_CTX_use_PrivateKey_file(ctx_, options.key_file.c_str(),
+                                  SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(ctx_) != 1) {
+    SSL_CTX_free(ctx_);
+    throw_openssl(options.cert_file);
+  }
+  SSL_CTX_set_alpn_select_cb(ctx_, select_h2, nullptr);
+}
+
+TlsContext::~TlsContext() { SSL_CTX_free(ctx_); }
+
+TlsHandshake::TlsHandshake(const TlsContext& context, int fd)
+    : ssl_(SSL_new(context.get())), result_(WANT_READ) {
+  // The socket BIO does not close fd when it is freed.
+  if (ssl_ == nullptr || SSL_set_fd(ssl_, fd) != 1) {
+    ERR_clear_error();
+    result_ = FAILED;
+    return;
+  }
+  SSL_set_accept_state(ssl_);
+}
+
+TlsHandshake::~TlsHandshake() { SSL_free(ssl_); }
+
+TlsHandshake::Result TlsHandshake::step() {
+  if (result_ == DONE || result_ == FAILED) return result_;
+  int rc = SSL_do_handshake(ssl_);
+  if (rc == 1) return result_ = finish();
+  switch (SSL_get_error(ssl_, rc)) {
+    case SSL_ERROR_WANT_READ:
+      return result_ = WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+      return result_ = WANT_WRITE;
+    default:
+      ERR_clear_error();
+      return result_ = FAILED;
+  }
+}
+
+// finish checks the outcome of a completed handshake, and releases the
+// userspace TLS state, which is dead weight once the kernel has the keys.
+TlsHandshake::Result TlsHandshake::finish() {
+  const unsigned char* alpn = nullptr;
+  unsigned int len = 0;
+  SSL_get0_alpn_selected(ssl_, &alpn, &len);
+  alpn_.assign(reinterpret_cast<const char*>(alpn), len);
+
+  // Anything OpenSSL has already read past the handshake would be lost to
+  // the kernel.
+  bool offloaded = BIO_get_ktls_send(SSL_get_wbio(ssl_)) &&
+                   BIO_get_ktls_recv(SSL_get_rbio(ssl_)) &&
+                   !SSL_has_pending(ssl_);
+  SSL_free(ssl_);
+  ssl_ = nullptr;
+  if (alpn_.size() != 2 || alpn_[0] != proto::kEncryptedToken[0] ||
+      alpn_[1] != proto::kEncryptedToken[1]) {
+    return FAILED;
+  }
+  return offloaded ? DONE : FAILED;
+}
+
+}  // namespace tls
+}  // namespace http2
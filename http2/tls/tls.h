@@ -0,0 +1,95 @@
+// Tools for serving HTTP/2 over TLS with the record layer in the kernel.
+
+#ifndef HTTP2_TLS_TLS_H
+#define HTTP2_TLS_TLS_H
+
+#include <string>
+
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_st SSL;
+
+namespace http2 {
+namespace tls {
+
+// TlsOptions configures the TLS side of a server.
+struct TlsOptions final {
+  // cert_file and key_file name the PEM certificate chain and private key.
+  // TLS is off unless cert_file is set.
+  std::string cert_file;
+  std::string key_file;
+
+  // allow_tls13 offers TLS 1.3 as well as TLS 1.2.  It is off by default
+  // because OpenSSL 3.0 only hands the sending side of a TLS 1.3 connection
+  // to the kernel, and such connections are refused (see TlsHandshake).
+  bool allow_tls13 = false;
+
+  bool enabled() const { return !cert_file.empty(); }
+};
+
+// ktls_supported returns true iff the kernel offers the "tls" upper layer
+// protocol, without which no connection can be offloaded.
+bool ktls_supported();
+
+// TlsContext holds the certificate and the settings shared by every
+// connection: TLS 1.2 or better with ECDHE and AES-GCM only (the cipher
+// suites that both RFC 7540 and kTLS accept), no renegotiation, no session
+// tickets, and "h2" as the only ALPN protocol.  A client that does not
+// offer "h2" fails the handshake with a no_application_protocol alert.
+//
+// A TlsContext is immutable once built, so it may be shared by every shard.
+class TlsContext final {
+ public:
+  // THROWS std::system_error if the certificate or key cannot be loaded.
+  explicit TlsContext(const TlsOptions& options);
+  ~TlsContext();
+
+  TlsContext(const TlsContext&) = delete;
+  TlsContext& operator=(const TlsContext&) = delete;
+
+  SSL_CTX* get() const { return ctx_; }
+
+ private:
+  SSL_CTX* ctx_;
+};
+
+// TlsHandshake runs the server side of a handshake on a non-blocking socket,
+// then hands the connection's keys to kTLS (TLS_TX and TLS_RX).  From then
+// on the socket carries plaintext as far as userspace can tell: read(2),
+// send(2), writev(2) and sendfile(2) all work on it unchanged, with the
+// kernel framing and encrypting each record, and nothing is ever encrypted
+// or copied in userspace.
+class TlsHandshake final {
+ public:
+  enum Result {
+    DONE,        // negotiated "h2", and the socket is offloaded
+    WANT_READ,   // call step again once the socket is readable
+    WANT_WRITE,  // call step again once the socket is writable
+    FAILED,      // the handshake failed, or could not be offloaded
+  };
+
+  // Does not take ownership of fd.  context must outlive the TlsHandshake.
+  TlsHandshake(const TlsContext& context, int fd);
+  ~TlsHandshake();
+
+  TlsHandshake(const TlsHandshake&) = delete;
+  TlsHandshake& operator=(const TlsHandshake&) = delete;
+
+  // step advances the handshake as far as the socket allows.  Once it has
+  // returned DONE or FAILED, it keeps returning the same.
+  Result step();
+
+  // alpn returns the negotiated ALPN protocol, once the handshake is done.
+  const std::string& alpn() const { return alpn_; }
+
+ private:
+  Result finish();
+
+  SSL* ssl_;
+  Result result_;
+  std::string alpn_;
+};
+
+}  // namespace tls
+}  // namespace http2
+
+#endif  // HTTP2_TLS_TLS_H
@@ -0,0 +1,277 @@
+#include "http2/tls/tls.h"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http2/client/connection.h"
+#include "http2/net/socket.h"
+#include "http2/server/server.h"
+
+using http2::tls::TlsContext;
+using http2::tls::TlsHandshake;
+using http2::tls::TlsOptions;
+
+namespace proto = http2::protocol;
+
+namespace {
+
+// TlsTest writes a throwaway self-signed certificate for localhost.
+class TlsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/tls_test.XXXXXX";
+    ASSERT_NE(::mkdtemp(dir), nullptr);
+    dir_ = dir;
+    options_.cert_file = dir_ + "/cert.pem";
+    options_.key_file = dir_ + "/key.pem";
+
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    ASSERT_NE(key, nullptr);
+    X509* cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(
+        name, "CN", MBSTRING_ASC,
+        reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_set_pubkey(cert, key);
+    X509_sign(cert, key, EVP_sha256());
+
+    FILE* f = std::fopen(options_.cert_file.c_str(), "w");
+    PEM_write_X509(f, cert);
+    std::fclose(f);
+    f = std::fopen(options_.key_file.c_str(), "w");
+    PEM_write_PrivateKey(f, key, nullptr, nullptr, 0, nullptr, nullptr);
+    std::fclose(f);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+  }
+
+  void TearDown() override {
+    std::remove(options_.cert_file.c_str());
+    std::remove(options_.key_file.c_str());
+    ::rmdir(dir_.c_str());
+  }
+
+  std::string dir_;
+  TlsOptions options_;
+};
+
+// Client is a blocking OpenSSL client, as a browser would be.
+class Client {
+ public:
+  Client(uint16_t port, const std::vector<uint8_t>& alpn)
+      : ctx_(SSL_CTX_new(TLS_client_method())),
+        fd_(http2::net::connect_tcp("127.0.0.1", port)),
+        ssl_(nullptr) {
+    SSL_CTX_set_alpn_protos(ctx_, alpn.data(), alpn.size());
+    ssl_ = SSL_new(ctx_);
+    SSL_set_fd(ssl_, fd_);
+  }
+  ~Client() {
+    SSL_free(ssl_);
+    SSL_CTX_free(ctx_);
+    ::close(fd_);
+  }
+
+  bool connect() { return SSL_connect(ssl_) == 1; }
+
+  std::string alpn() const {
+    const unsigned char* p;
+    unsigned int n;
+    SSL_get0_alpn_selected(ssl_, &p, &n);
+    return std::string(reinterpret_cast<const char*>(p), n);
+  }
+
+  bool write(const uint8_t* p, std::size_t n) {
+    return SSL_write(ssl_, p, n) == int(n);
+  }
+
+  int read(uint8_t* p, std::size_t n) { return SSL_read(ssl_, p, n); }
+
+ private:
+  SSL_CTX* ctx_;
+  int fd_;
+  SSL* ssl_;
+};
+
+const std::vector<uint8_t> kOfferH2 = {2, 'h', '2', 8, 'h', 't', 't',
+                                       'p', '/', '1', '.', '1'};
+const std::vector<uint8_t> kOfferHttp11 = {8, 'h', 't', 't',
+                                           'p', '/', '1', '.', '1'};
+
+// accept_and_handshake accepts one connection on listener and runs the
+// server side of the handshake on it.
+TlsHandshake::Result accept_and_handshake(const TlsContext& context,
+                                          int listener, std::string* alpn,
+                                          int* fd_out) {
+  pollfd pfd = {listener, POLLIN, 0};
+  ::poll(&pfd, 1, 5000);
+  int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK);
+  EXPECT_GE(fd, 0);
+  TlsHandshake handshake(context, fd);
+  TlsHandshake::Result result;
+  while (true) {
+    result = handshake.step();
+    if (result == TlsHandshake::WANT_READ) {
+      pfd = {fd, POLLIN, 0};
+    } else if (result == TlsHandshake::WANT_WRITE) {
+      pfd = {fd, POLLOUT, 0};
+    } else {
+      break;
+    }
+    if (::poll(&pfd, 1, 5000) != 1) break;
+  }
+  *alpn = handshake.alpn();
+  *fd_out = fd;
+  return result;
+}
+
+}  // anonymous namespace
+
+TEST_F(TlsTest, Alpn) {
+  TlsContext context(options_);
+  int listener = http2::net::listen_tcp("127.0.0.1", 0, false, 8);
+  uint16_t port = http2::net::local_port(listener);
+
+  std::string client_alpn;
+  std::string received;
+  std::thread client_thread([&] {
+    Client client(port, kOfferH2);
+    if (!client.connect()) return;
+    client_alpn = client.alpn();
+    uint8_t buf[16];
+    int n = client.read(buf, sizeof(buf));
+    if (n > 0) received.assign(buf, buf + n);
+  });
+
+  std::string alpn;
+  int fd;
+  TlsHandshake::Result result =
+      accept_and_handshake(context, listener, &alpn, &fd);
+  EXPECT_EQ(alpn, "h2");
+  if (http2::tls::ktls_supported()) {
+    // Plaintext in, ciphertext on the wire, plaintext out.
+    ASSERT_EQ(result, TlsHandshake::DONE);
+    EXPECT_EQ(::send(fd, "hello", 5, MSG_NOSIGNAL), 5);
+  } else {
+    EXPECT_EQ(result, TlsHandshake::FAILED);
+  }
+  ::shutdown(fd, SHUT_WR);
+  client_thread.join();
+  ::close(fd);
+  ::close(listener);
+
+  EXPECT_EQ(client_alpn, "h2");
+  if (result == TlsHandshake::DONE) {
+    EXPECT_EQ(received, "hello");
+  }
+}
+
+TEST_F(TlsTest, NoH2) {
+  TlsContext context(options_);
+  int listener = http2::net::listen_tcp("127.0.0.1", 0, false, 8);
+  uint16_t port = http2::net::local_port(listener);
+
+  bool connected = true;
+  std::thread client_thread([&] {
+    Client client(port, kOfferHttp11);
+    connected = client.connect();
+  });
+  std::string alpn;
+  int fd;
+  EXPECT_EQ(accept_and_handshake(context, listener, &alpn, &fd),
+            TlsHandshake::FAILED);
+  ::close(fd);
+  client_thread.join();
+  ::close(listener);
+  EXPECT_FALSE(connected);
+  EXPECT_EQ(alpn, "");
+}
+
+TEST_F(TlsTest, BadCertificate) {
+  options_.key_file = options_.cert_file;
+  EXPECT_THROW(TlsContext context(options_), std::system_error);
+}
+
+TEST_F(TlsTest, Server) {
+  http2::server::ServerOptions options;
+  options.address = "127.0.0.1";
+  options.num_shards = 1;
+  options.tls = options_;
+  // The certificate doubles as a file body, which goes out with sendfile.
+  std::string cert_file = options_.cert_file;
+  http2::server::Server server(
+      options, [cert_file](const http2::server::Request& req,
+                           http2::server::Response& resp) {
+        resp.headers.add(":status", "200");
+        if (req.headers.first(":path").second == "/file") {
+          resp.file = http2::server::FileBody::open(cert_file);
+        } else {
+          resp.body.assign({'o', 'k'});
+        }
+      });
+  if (!http2::tls::ktls_supported()) {
+    EXPECT_THROW(server.start(), std::system_error);
+    GTEST_SKIP() << "the kernel lacks kTLS";
+  }
+  server.start();
+
+  Client tls_client(server.port(), kOfferH2);
+  ASSERT_TRUE(tls_client.connect());
+  ASSERT_EQ(tls_client.alpn(), "h2");
+
+  http2::client::ConnectionOptions client_options;
+  http2::client::Connection conn(client_options);
+  std::vector<http2::client::Response> responses;
+  for (const char* path : {"/", "/file"}) {
+    http2::headers::Headers headers;
+    headers.add(":method", "GET");
+    headers.add(":scheme", "https");
+    headers.add(":authority", "localhost");
+    headers.add(":path", path);
+    conn.request(headers, {}, [&responses](http2::client::Response& resp) {
+      responses.push_back(resp);
+    });
+  }
+  std::vector<uint8_t> in;
+  uint8_t buf[16384];
+  while (responses.size() < 2 && !conn.failed()) {
+    if (conn.has_output()) {
+      ASSERT_TRUE(tls_client.write(conn.output_data(), conn.output_size()));
+      conn.consume_output(conn.output_size());
+    }
+    int n = tls_client.read(buf, sizeof(buf));
+    ASSERT_GT(n, 0);
+    in.insert(in.end(), buf, buf + n);
+    in.erase(in.begin(),
+             in.begin() + conn.receive(in.data(), in.data() + in.size()));
+  }
+  server.stop();
+
+  ASSERT_EQ(responses.size(), 2);
+  EXPECT_EQ(std::string(responses[0].body.begin(), responses[0].body.end()),
+            "ok");
+  FILE* f = std::fopen(options_.cert_file.c_str(), "r");
+  std::string pem;
+  int c;
+  while ((c = std::fgetc(f)) != EOF) pem.push_back(char(c));
+  std::fclose(f);
+  EXPECT_EQ(std::string(responses[1].body.begin(), responses[1].body.end()),
+            pem);
+}
@@ -0,0 +1,136 @@
+// Static tracepoints (USDT probes) for eBPF tools such as bpftrace.
+
+#ifndef HTTP2_TRACE_PROBES_H
+#define HTTP2_TRACE_PROBES_H
+
+#include <type_traits>
+
+// HTTP2_PROBEn(name, args...) marks a tracepoint named http2:name with n
+// arguments.  It compiles to a single nop, plus an ELF note (in the same
+// format as SystemTap's <sys/sdt.h>) that tells a tracer where the nop is
+// and where to find each argument, so a probe costs nothing but the nop
+// until a tracer attaches to it and patches in a breakpoint.  Arguments are
+// integers or pointers that are already at hand; they must not be worth
+// computing for the probe alone, since nothing tells the code whether a
+// tracer is attached.
+//
+// Define HTTP2_NO_PROBES to compile the probes out.  Only x86-64 and
+// AArch64 are supported; elsewhere the probes compile to nothing.
+//
+// The server's Connection fires these, always with the Connection's address
+// first, to tell connections apart, and then the stream ID (0 for the
+// connection itself):
+//
+//   frame_received   conn, stream, type, flags, length  (payload length)
+//   frame_sent       conn, stream, type, flags, length
+//   stream_open      conn, stream
+//   stream_close     conn, stream, how, error code
+//                    how: 0 the response completed, 1 we sent RST_STREAM,
+//                    2 the peer did, 3 the connection failed or was torn
+//                    down; the error code is that of the RST_STREAM or
+//                    GOAWAY.  It also fires when we reset a stream that
+//                    never opened (e.g. REFUSED_STREAM) or already closed.
+//   hpack_decode_start  conn, stream, block bytes
+//   hpack_decode_end    conn, stream, headers decoded, 1 on success or 0
+//   flow_control_stall  conn, stream, bytes left to send
+//   dispatch_start   conn, stream  (the handler is about to be called)
+//   dispatch_end     conn, stream  (it returned; a streaming handler has
+//                                   only been started, and runs later)
+//
+// Sample bpftrace scripts live in http2/trace/scripts.
+
+namespace http2 {
+namespace trace {
+namespace internal {
+
+// ArgSize describes an argument to the tracer: its size in bytes, negative
+// if it is signed.  The value is negated, because the assembler template
+// prints it with "%n".
+template <typename T>
+struct ArgSize {
+  static constexpr int value =
+      std::is_signed<T>::value ? int(sizeof(T)) : -int(sizeof(T));
+};
+
+}  // namespace internal
+}  // namespace trace
+}  // namespace http2
+
+#if !defined(HTTP2_NO_PROBES) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+
+#define HTTP2_PROBE_ARG(i, x)                                          \
+  [_a##i] "nor"(x), [_s##i] "n"(::http2::trace::internal::ArgSize<     \
+                                std::decay_t<decltype(x)>>::value)
+
+#define HTTP2_PROBE_ASM(name, args, ...)                                  \
+  __asm__ __volatile__(                                                   \
+      "990: nop\n"                                                        \
+      ".pushsection .note.stapsdt,\"?\",\"note\"\n"                       \
+      ".balign 4\n"                                                       \
+      ".4byte 992f-991f, 994f-993f, 3\n"                                  \
+      "991: .asciz \"stapsdt\"\n"                                         \
+      "992: .balign 4\n"                                                  \
+      "993: .8byte 990b\n"                                                \
+      ".8byte _.stapsdt.base\n"                                           \
+      ".8byte 0\n"                                                        \
+      ".asciz \"http2\"\n"                                                \
+      ".asciz \"" #name "\"\n"                                            \
+      ".asciz \"" args "\"\n"                                             \
+      "994: .balign 4\n"                                                  \
+      ".popsection\n"                                                     \
+      ".ifndef _.stapsdt.base\n"                                          \
+      ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,"     \
+      "comdat\n"                                                          \
+      ".weak _.stapsdt.base\n"                                            \
+      ".hidden _.stapsdt.base\n"                                          \
+      "_.stapsdt.base: .space 1\n"                                        \
+      ".size _.stapsdt.base, 1\n"                                         \
+      ".popsection\n"                                                     \
+      ".endif\n"                                                          \
+      :                                                                   \
+      : __VA_ARGS__)
+
+#define HTTP2_PROBE_FMT(i) "%n[_s" #i "]@%[_a" #i "]"
+
+#define HTTP2_PROBE1(name, a1) \
+  HTTP2_PROBE_ASM(name, HTTP2_PROBE_FMT(1), HTTP2_PROBE_ARG(1, a1))
+
+#define HTTP2_PROBE2(name, a1, a2)                                     \
+  HTTP2_PROBE_ASM(name, HTTP2_PROBE_FMT(1) " " HTTP2_PROBE_FMT(2),     \
+                  HTTP2_PROBE_ARG(1, a1), HTTP2_PROBE_ARG(2, a2))
+
+#define HTTP2_PROBE3(name, a1, a2, a3)                                 \
+  HTTP2_PROBE_ASM(name,                                                \
+                  HTTP2_PROBE_FMT(1) " " HTTP2_PROBE_FMT(2) " "        \
+                      HTTP2_PROBE_FMT(3),                              \
+                  HTTP2_PROBE_ARG(1, a1), HTTP2_PROBE_ARG(2, a2),      \
+                  HTTP2_PROBE_ARG(3, a3))
+
+#define HTTP2_PROBE4(name, a1, a2, a3, a4)                             \
+  HTTP2_PROBE_ASM(name,                                                \
+                  HTTP2_PROBE_FMT(1) " " HTTP2_PROBE_FMT(2) " "        \
+                      HTTP2_PROBE_FMT(3) " " HTTP2_PROBE_FMT(4),       \
+                  HTTP2_PROBE_ARG(1, a1), HTTP2_PROBE_ARG(2, a2),      \
+                  HTTP2_PROBE_ARG(3, a3), HTTP2_PROBE_ARG(4, a4))
+
+#define HTTP2_PROBE5(name, a1, a2, a3, a4, a5)                         \
+  HTTP2_PROBE_ASM(name,                                                \
+                  HTTP2_PROBE_FMT(1) " " HTTP2_PROBE_FMT(2) " "        \
+                      HTTP2_PROBE_FMT(3) " " HTTP2_PROBE_FMT(4) " "    \
+                      HTTP2_PROBE_FMT(5),                              \
+                  HTTP2_PROBE_ARG(1, a1), HTTP2_PROBE_ARG(2, a2),      \
+                  HTTP2_PROBE_ARG(3, a3), HTTP2_PROBE_ARG(4, a4),      \
+                  HTTP2_PROBE_ARG(5, a5))
+
+#else
+
+#define HTTP2_PROBE1(name, a1) ((void)0)
+#define HTTP2_PROBE2(name, a1, a2) ((void)0)
+#define HTTP2_PROBE3(name, a1, a2, a3) ((void)0)
+#define HTTP2_PROBE4(name, a1, a2, a3, a4) ((void)0)
+#define HTTP2_PROBE5(name, a1, a2, a3, a4, a5) ((void)0)
+
+#endif
+
+#endif  // HTTP2_TRACE_PROBES_H
@@ -0,0 +1,237 @@
+#include "http2/trace/probes.h"
+
+#include <elf.h>
+#include <link.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http2/protocol/constants.h"
+#include "http2/protocol/frame.h"
+#include "http2/protocol/hpack/hpack.h"
+#include "http2/server/connection.h"
+
+namespace proto = http2::protocol;
+
+namespace {
+
+struct Probe {
+  uint64_t pc;  // the address of the nop, as linked
+  std::string provider;
+  std::string name;
+  std::string args;
+};
+
+// read_probes lists the USDT probes in the ELF notes of this executable.
+std::vector<Probe> read_probes() {
+  std::ifstream in("/proc/self/exe", std::ios::binary);
+  std::vector<char> file((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  std::vector<Probe> out;
+  if (file.size() < sizeof(Elf64_Ehdr)) return out;
+  const auto* ehdr = reinterpret_cast<const Elf64_Ehdr*>(file.data());
+  const auto* shdrs =
+      reinterpret_cast<const Elf64_Shdr*>(file.data() + ehdr->e_shoff);
+  for (unsigned int i = 0; i < ehdr->e_shnum; ++i) {
+    if (shdrs[i].sh_type != SHT_NOTE) continue;
+    const char* p = file.data() + shdrs[i].sh_offset;
+    const char* q = p + shdrs[i].sh_size;
+    while (p + sizeof(Elf64_Nhdr) <= q) {
+      const auto* nhdr = reinterpret_cast<const Elf64_Nhdr*>(p);
+      const char* name = p + sizeof(Elf64_Nhdr);
+      const char* desc = name + ((nhdr->n_namesz + 3) & ~3u);
+      p = desc + ((nhdr->n_descsz + 3) & ~3u);
+      if (nhdr->n_type != 3 || std::strcmp(name, "stapsdt") != 0) continue;
+      // Three addresses (probe, base, semaphore), then three strings.
+      const char* s = desc + 3 * sizeof(uint64_t);
+      Probe probe;
+      std::memcpy(&probe.pc, desc, sizeof(probe.pc));
+      probe.provider = s;
+      s += probe.provider.size() + 1;
+      probe.name = s;
+      s += probe.name.size() + 1;
+      probe.args = s;
+      out.push_back(probe);
+    }
+  }
+  return out;
+}
+
+const Probe* find(const std::vector<Probe>& probes, const char* name) {
+  for (const Probe& probe : probes) {
+    if (probe.name == name) return &probe;
+  }
+  return nullptr;
+}
+
+#if !defined(HTTP2_NO_PROBES) && defined(__x86_64__)
+#define HTTP2_TRAP_PROBES 1
+
+// Traps counts the times the probes with a given name fire, by patching
+// their nops with int3 breakpoints, as a tracer would.
+class Traps final {
+ public:
+  explicit Traps(const char* name) {
+    uintptr_t bias = 0;
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, std::size_t, void* bias) {
+          *static_cast<uintptr_t*>(bias) = info->dlpi_addr;
+          return 1;  // the executable comes first
+        },
+        &bias);
+    for (const Probe& probe : read_probes()) {
+      if (probe.name != name) continue;
+      auto* p = reinterpret_cast<uint8_t*>(probe.pc + bias);
+      if (*p != 0x90 || !writable(p, true)) continue;
+      *p = 0xcc;
+      writable(p, false);
+      sites_.push_back(p);
+    }
+    struct sigaction sa = {};
+    sa.sa_handler = [](int) { hits_ = hits_ + 1; };
+    sigaction(SIGTRAP, &sa, &saved_);
+    hits_ = 0;
+  }
+
+  ~Traps() {
+    for (uint8_t* p : sites_) {
+      writable(p, true);
+      *p = 0x90;
+      writable(p, false);
+    }
+    sigaction(SIGTRAP, &saved_, nullptr);
+  }
+
+  std::size_t sites() const { return sites_.size(); }
+  int hits() const { return hits_; }
+
+ private:
+  static bool writable(uint8_t* p, bool w) {
+    uintptr_t page = uintptr_t(p) & ~uintptr_t(::sysconf(_SC_PAGESIZE) - 1);
+    int prot = PROT_READ | PROT_EXEC | (w ? PROT_WRITE : 0);
+    return ::mprotect(reinterpret_cast<void*>(page), 1, prot) == 0;
+  }
+
+  static inline volatile sig_atomic_t hits_ = 0;
+  std::vector<uint8_t*> sites_;
+  struct sigaction saved_;
+};
+
+void append_frame(std::vector<uint8_t>& out, uint8_t type, uint8_t flags,
+                  uint32_t sid, std::vector<uint8_t> payload = {}) {
+  proto::encode_frame_header(payload.size(), type, flags, sid, out);
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+// open_stream returns the frames that open a stream whose request body has
+// not been sent.
+std::vector<uint8_t> open_stream(proto::hpack::Encoder& encoder,
+                                 uint32_t sid) {
+  std::vector<uint8_t> block;
+  encoder.encode_all({{":method", "POST"}, {":path", "/"}}, block);
+  std::vector<uint8_t> out;
+  append_frame(out, proto::HEADERS_FRAME, proto::END_HEADERS, sid, block);
+  return out;
+}
+#endif
+
+}  // anonymous namespace
+
+TEST(Probes, Notes) {
+  volatile uint8_t u8 = 7;
+  volatile int32_t i32 = -3;
+  volatile uint64_t u64 = 1234;
+  int object = 0;
+  int* ptr = &object;
+  HTTP2_PROBE1(test_one, uint8_t(u8));
+  HTTP2_PROBE2(test_two, ptr, int32_t(i32));
+  HTTP2_PROBE5(test_five, ptr, uint32_t(u64), uint8_t(u8), int32_t(i32),
+               uint64_t(u64));
+
+#if !defined(HTTP2_NO_PROBES) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+  std::vector<Probe> probes = read_probes();
+  const Probe* one = find(probes, "test_one");
+  ASSERT_NE(one, nullptr);
+  EXPECT_EQ(one->provider, "http2");
+  EXPECT_EQ(one->args.substr(0, 2), "1@");
+
+  const Probe* two = find(probes, "test_two");
+  ASSERT_NE(two, nullptr);
+  EXPECT_EQ(two->args.substr(0, 2), "8@");
+  EXPECT_NE(two->args.find(" -4@"), std::string::npos) << two->args;
+
+  const Probe* five = find(probes, "test_five");
+  ASSERT_NE(five, nullptr);
+  EXPECT_EQ(std::count(five->args.begin(), five->args.end(), '@'), 5)
+      << five->args;
+#endif
+}
+
+// Streams the server resets, or that are open when the connection fails or
+// goes away, must fire stream_close too, or tracers never learn they ended.
+TEST(Probes, StreamClose) {
+#if HTTP2_TRAP_PROBES
+  http2::server::ConnectionOptions options;
+  http2::server::Handler handler = [](const http2::server::Request&,
+                                      http2::server::Response& resp) {
+    resp.headers.add(":status", "204");
+  };
+  Traps traps("stream_close");
+  if (traps.sites() == 0) GTEST_SKIP() << "cannot patch the probes";
+
+  auto receive = [](http2::server::Connection& conn,
+                    const std::vector<uint8_t>& input) {
+    conn.receive(input.data(), input.data() + input.size());
+  };
+  proto::hpack::Encoder encoder;
+  std::vector<uint8_t> input(std::begin(proto::kConnectionPreface),
+                             std::end(proto::kConnectionPreface));
+  append_frame(input, proto::SETTINGS_FRAME, proto::NO_FLAGS, 0);
+  {
+    http2::server::Connection conn(options, handler);
+    receive(conn, input);
+    receive(conn, open_stream(encoder, 1));
+    ASSERT_EQ(conn.num_streams(), 1);
+    EXPECT_EQ(traps.hits(), 0);
+
+    // A zero WINDOW_UPDATE resets the stream.
+    std::vector<uint8_t> reset;
+    append_frame(reset, proto::WINDOW_UPDATE_FRAME, proto::NO_FLAGS, 1,
+                 {0, 0, 0, 0});
+    receive(conn, reset);
+    EXPECT_EQ(conn.num_streams(), 0);
+    EXPECT_EQ(traps.hits(), 1);
+
+    // A PING on a stream fails the connection, with stream 3 open.
+    receive(conn, open_stream(encoder, 3));
+    std::vector<uint8_t> bad;
+    append_frame(bad, proto::PING_FRAME, proto::NO_FLAGS, 3,
+                 {0, 0, 0, 0, 0, 0, 0, 0});
+    receive(conn, bad);
+    EXPECT_TRUE(conn.done());
+    EXPECT_EQ(traps.hits(), 2);
+  }
+  // The failed connection does not report stream 3 again.
+  EXPECT_EQ(traps.hits(), 2);
+
+  // A connection torn down with a stream open reports it.
+  proto::hpack::Encoder encoder2;
+  {
+    http2::server::Connection conn(options, handler);
+    receive(conn, input);
+    receive(conn, open_stream(encoder2, 1));
+    ASSERT_EQ(conn.num_streams(), 1);
+  }
+  EXPECT_EQ(traps.hits(), 3);
+#endif
+}